@@ -0,0 +1,944 @@
+/*
+ * clickatell_bulk_send.cpp
+ *
+ * Bulk send tool: sends one SMS message text to every recipient listed in a file.
+ *
+ * Usage: clickatell_bulk_send <recipients file> <results file> <message text> [checkpoint file]
+ *
+ * The recipients file is either CSV (the number is the first column; a first row without
+ * digits is treated as a header) or NDJSON (one object per line with a "to" or "msisdn"
+ * field). It is memory-mapped and processed one window at a time: each window is cut into
+ * chunks at line boundaries, the chunks are parsed and normalized in parallel, and the
+ * numbers are grouped into batches that are sent through a ClickSendEngine. Only a bounded
+ * number of batches is outstanding at any time, so memory use does not grow with the file.
+ *
+ * One line per input row is written to the results file:
+ *     msisdn,result,message_id,batch,curl_code,http_status,detail
+ * where result is sent, failed, expired, cancelled or rejected. Lines are written in the input
+ * order of batches: within a batch, the lines of the numbers sent come first, in input order,
+ * followed by the lines of the batch's rejected rows. The lines of the oldest outstanding batch
+ * are written as the gateway response lists its recipients, not after the whole response has
+ * been received; later batches hold theirs until every earlier batch has completed. The
+ * gateway's entries are matched to the batch's numbers by destination. A recipient the gateway
+ * did not accept is reported as failed with the gateway's error description, and so is one a
+ * successful response does not list.
+ *
+ * Progress is checkpointed: the checkpoint file records the input offset up to which every
+ * row has a result in the results file, and the length of the results file at that offset.
+ * If the tool is restarted with the same files, it truncates the results file to that length
+ * (dropping the lines of rows after the offset, and any partly written line), continues from
+ * the offset and appends to the results file. Once the whole file is done the checkpoint is
+ * kept, so that running the tool again does not repeat the campaign. Batches that completed
+ * after the last checkpoint are sent again on restart (at-least-once delivery), so keep the
+ * checkpoint interval short for large campaigns. SIGINT/SIGTERM stop submission, wait for
+ * outstanding batches and write a final checkpoint.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "clickatell_sms/clickatell_sms.hpp"
+#include "clickatell_sms/clickatell_msisdn.hpp"
+#include "clickatell_sms/clickatell_engine.hpp"
+
+/* ----------------------------------------------------------------------------- *
+ * Input configuration values                                                    *
+ * NOTE: Please modify these values and replace them with your own credentials.  *
+ * ----------------------------------------------------------------------------- */
+
+// insert your REST API credentials here
+#define CFG_REST_APIKEY             "uJqYpaWlUNPUhEDsuptRJCk5nGZD.Fwx8vHQOUjoTXTdFghXERUsZDvoK1SiF" // insert your Clickatell REST API Key here
+#define CFG_REST_APIID              "2517153" // insert your Clickatell REST API ID here
+
+// number normalization - set to your country code to accept local numbers (e.g. "27")
+#define CFG_DEFAULT_COUNTRY_CODE    ""
+
+// timeout values - these can be modified or left as is
+#define CFG_APICALL_TIMEOUT         10 // Config: Maximum time in seconds (long value) for API call to take
+#define CFG_APICALL_CONNECT_TIMEOUT 5  // Config: maximum time in seconds (long value) that API call takes to connect to Clickatell server
+
+// throughput and memory tuning - these can be modified or left as is
+#define CFG_BULK_CONNECTIONS        8                 // concurrent requests (ClickatellSms instances in the engine)
+#define CFG_BULK_BATCH_SIZE         100               // recipients per request
+#define CFG_BULK_MAX_PENDING        (4 * CFG_BULK_CONNECTIONS) // batches submitted but not completed
+#define CFG_BULK_WINDOW_BYTES       (64 * 1024 * 1024) // input bytes parsed per window
+#define CFG_BULK_MIN_CHUNK_BYTES    (256 * 1024)       // windows are not split into smaller chunks than this
+#define CFG_BULK_OUTPUT_BUFFER      (1024 * 1024)      // results buffered before each write
+#define CFG_BULK_PROGRESS_SECS      2                  // interval between progress lines
+#define CFG_BULK_CHECKPOINT_SECS    5                  // interval between checkpoints
+
+/* ----------------------------------------------------------------------------- *
+ * Fixed Macros                                                                  *
+ * ----------------------------------------------------------------------------- */
+
+#define BULK_CHECKPOINT_MAGIC       "clickatell_bulk_send/2"
+#define BULK_RESULTS_HEADER         "msisdn,result,message_id,batch,curl_code,http_status,detail\n"
+
+/* ----------------------------------------------------------------------------- *
+ * Types                                                                         *
+ * ----------------------------------------------------------------------------- */
+
+struct bulk_state;
+
+// a batch of rows, from submission until its results are written
+struct bulk_batch {
+    bulk_state *pState;
+    uint64_t iSeq;                      // batch number
+    uint64_t iEnd;                      // input offset just past the last row covered
+    uint64_t iRows;                     // input rows covered (accepted, rejected and skipped)
+    std::vector<std::string> vMsisdns;  // numbers sent
+    size_t iStreamed;                   // leading recipients whose result line is written
+    std::vector<std::string> vHeld;     // lines of recipients listed ahead of iStreamed (empty if none)
+    std::string sRejects;               // result lines of rejected rows
+    std::string sOut;                   // result lines held until the batch is the oldest outstanding
+    bool bDone;
+};
+
+// state shared between the main thread and the engine thread
+struct bulk_state {
+    std::mutex mtxState;                // guards everything below
+    std::condition_variable cvState;    // signalled when a batch completes
+    std::deque<bulk_batch> dqPending;   // outstanding batches, in input order
+    uint64_t iNextSeq;
+    uint64_t iDoneOffset;               // every row before this offset has a result
+    uint64_t iDoneRows;
+    uint64_t iSent;                     // recipients accepted by the gateway
+    uint64_t iFailed;                   // recipients whose request failed, expired or was cancelled
+    uint64_t iRejected;                 // rows rejected by normalization
+    uint64_t iWritten;                  // results file length, including what has been written from sOutBuf
+    uint64_t iDoneBytes;                // results file length at iDoneOffset (written and buffered)
+    std::string sOutBuf;
+    FILE *pOut;
+    bool bOutError;
+};
+
+// one parallel parse unit of a window
+struct bulk_chunk {
+    const char *pStart;
+    const char *pEnd;
+    uint64_t iBase;                         // input offset of pStart
+    std::vector<std::string_view> vFields;  // number field of each row
+    std::vector<uint32_t> vRowEnds;         // offset (from pStart) just past each row
+    ClickMsisdnList oList;
+};
+
+/* ----------------------------------------------------------------------------- *
+ * Forward declarations                                                          *
+ * ----------------------------------------------------------------------------- */
+
+void bulk_parse_chunk(bulk_chunk &oChunk, bool bNdjson, ClickMsisdnNormalizer &oNormalizer);
+void bulk_recipient_result(void *pUserData, const ClickRecipientResult &oResult);
+void bulk_send_done(void *pUserData, const ClickSendResult &oResult);
+
+/* ----------------------------------------------------------------------------- *
+ * Local variables                                                               *
+ * ----------------------------------------------------------------------------- */
+
+static volatile sig_atomic_t g_bulk_stop = 0;
+
+/* ----------------------------------------------------------------------------- *
+ * Local function definitions                                                    *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  bulk_signal
+ * Info:      SIGINT/SIGTERM handler: stops submission of new batches.
+ */
+static void bulk_signal(int)
+{
+    g_bulk_stop = 1;
+}
+
+/*
+ * Function:  bulk_csv_field
+ * Info:      Returns the first column of a CSV row (surrounding spaces and quotes removed).
+ */
+static std::string_view bulk_csv_field(std::string_view sLine)
+{
+    size_t i = 0;
+
+    while (i < sLine.length() && (sLine[i] == ' ' || sLine[i] == '\t'))
+        i++;
+
+    if (i < sLine.length() && sLine[i] == '"') {
+        size_t iClose = sLine.find('"', i + 1);
+        return sLine.substr(i + 1, (iClose == std::string_view::npos ? sLine.length() : iClose) - i - 1);
+    }
+
+    size_t iEnd = sLine.find(',', i);
+
+    if (iEnd == std::string_view::npos)
+        iEnd = sLine.length();
+
+    while (iEnd > i && (sLine[iEnd - 1] == ' ' || sLine[iEnd - 1] == '\t'))
+        iEnd--;
+
+    return sLine.substr(i, iEnd - i);
+}
+
+/*
+ * Function:  bulk_json_field
+ * Info:      Returns the value of the "to" (or "msisdn") member of an NDJSON row. Numbers
+ *            may be given as JSON strings or JSON numbers.
+ */
+static std::string_view bulk_json_field(std::string_view sLine)
+{
+    static const std::string_view sKeys[] = { "\"to\"", "\"msisdn\"" };
+
+    for (std::string_view sKey : sKeys) {
+        size_t i = sLine.find(sKey);
+
+        if (i == std::string_view::npos)
+            continue;
+
+        i += sKey.length();
+        while (i < sLine.length() && (sLine[i] == ' ' || sLine[i] == '\t' || sLine[i] == ':'))
+            i++;
+
+        if (i < sLine.length() && sLine[i] == '"') {
+            size_t iClose = sLine.find('"', i + 1);
+            return sLine.substr(i + 1, (iClose == std::string_view::npos ? sLine.length() : iClose) - i - 1);
+        }
+
+        size_t iEnd = i;
+        while (iEnd < sLine.length() && sLine[iEnd] != ',' && sLine[iEnd] != '}' && sLine[iEnd] != ' ')
+            iEnd++;
+
+        return sLine.substr(i, iEnd - i);
+    }
+
+    return std::string_view();
+}
+
+/*
+ * Function:  bulk_parse_chunk
+ * Info:      Parse worker: splits a chunk into rows, extracts the number field of each
+ *            non-empty row and normalizes the numbers. Blank rows are skipped; at the start
+ *            of a CSV file, a first row without digits is skipped as a header.
+ * Inputs:    oChunk      - chunk to parse (results are stored in it)
+ *            bNdjson     - rows are JSON objects rather than CSV
+ *            oNormalizer - this worker's normalizer
+ * Return:    void
+ */
+void bulk_parse_chunk(bulk_chunk &oChunk, bool bNdjson, ClickMsisdnNormalizer &oNormalizer)
+{
+    const char *p = oChunk.pStart;
+
+    oChunk.vFields.clear();
+    oChunk.vRowEnds.clear();
+
+    while (p < oChunk.pEnd) {
+        const char *pEol = (const char *)memchr(p, '\n', oChunk.pEnd - p);
+        const char *pNext = (pEol == NULL ? oChunk.pEnd : pEol + 1);
+        std::string_view sLine(p, (pEol == NULL ? oChunk.pEnd : pEol) - p);
+
+        if (!sLine.empty() && sLine.back() == '\r')
+            sLine.remove_suffix(1);
+
+        bool bHeader = (!bNdjson && oChunk.iBase == 0 && p == oChunk.pStart &&
+                        sLine.find_first_of("0123456789") == std::string_view::npos);
+
+        if (!sLine.empty() && !bHeader) {
+            oChunk.vFields.push_back(bNdjson ? bulk_json_field(sLine) : bulk_csv_field(sLine));
+            oChunk.vRowEnds.push_back((uint32_t)(pNext - oChunk.pStart));
+        }
+
+        p = pNext;
+    }
+
+    oNormalizer.Normalize(std::span<const std::string_view>(oChunk.vFields), oChunk.oList);
+}
+
+/*
+ * Function:  bulk_flush_output
+ * Info:      Writes the buffered results (state lock held).
+ * Inputs:    oState - tool state
+ *            bSync  - also flush the stream and sync the file to disk
+ * Return:    void
+ */
+static void bulk_flush_output(bulk_state &oState, bool bSync)
+{
+    if (!oState.sOutBuf.empty()) {
+        if (fwrite(oState.sOutBuf.data(), 1, oState.sOutBuf.length(), oState.pOut) != oState.sOutBuf.length())
+            oState.bOutError = true;
+        oState.iWritten += oState.sOutBuf.length();
+        oState.sOutBuf.clear();
+    }
+
+    if (bSync && (fflush(oState.pOut) != 0 || fsync(fileno(oState.pOut)) != 0))
+        oState.bOutError = true;
+}
+
+/*
+ * Function:  bulk_batch_out
+ * Info:      Returns where a batch's result lines go (state lock held): the output buffer
+ *            for the oldest outstanding batch, the batch's own buffer for later ones, so
+ *            that the results file stays in input order.
+ * Inputs:    oState - tool state
+ *            oBatch - outstanding batch
+ * Return:    buffer to append to
+ */
+static std::string &bulk_batch_out(bulk_state &oState, bulk_batch &oBatch)
+{
+    return (&oState.dqPending.front() == &oBatch ? oState.sOutBuf : oBatch.sOut);
+}
+
+/*
+ * Function:  bulk_result_line
+ * Info:      Appends one result line to a result buffer (state lock held).
+ * Inputs:    sOut     - buffer
+ *            sMsisdn  - recipient
+ *            chResult - result word
+ *            sId      - message ID (may be empty)
+ *            iSeq     - batch number
+ *            curlCode, iHttpStatus - transfer result
+ *            sDetail  - error detail (may be empty)
+ * Return:    void
+ */
+static void bulk_result_line(std::string &sOut, std::string_view sMsisdn, const char *chResult, std::string_view sId,
+                             uint64_t iSeq, CURLcode curlCode, long iHttpStatus, std::string_view sDetail)
+{
+    char chLine[512];
+
+    // the detail is free text from the gateway; keep it inside its column
+    std::string_view sSafe = sDetail.substr(0, std::min(sDetail.find_first_of(",\r\n"), (size_t)128));
+
+    int iLen = snprintf(chLine, sizeof(chLine), "%.*s,%s,%.*s,%llu,%d,%ld,%.*s\n",
+                        (int)sMsisdn.length(), sMsisdn.data(), chResult, (int)std::min<size_t>(sId.length(), 64), sId.data(),
+                        (unsigned long long)iSeq, (int)curlCode, iHttpStatus, (int)sSafe.length(), sSafe.data());
+
+    sOut.append(chLine, std::min<size_t>(iLen, sizeof(chLine) - 1));
+}
+
+/*
+ * Function:  bulk_recipient_result
+ * Info:      Engine per-recipient function of a batch (engine thread): writes the result of
+ *            one recipient as soon as the gateway response lists it, so results are written
+ *            while a large response is still arriving (held in the batch if an earlier batch
+ *            is still outstanding). An entry is matched to the first
+ *            recipient of the batch with its destination that has no result yet (to the
+ *            next one if the entry does not name its destination); an entry that matches
+ *            none is ignored. Lines stay in input order: a recipient listed ahead of its
+ *            turn is held until the recipients before it have their lines.
+ * Inputs:    pUserData - the batch
+ *            oResult   - recipient result
+ * Return:    void
+ */
+void bulk_recipient_result(void *pUserData, const ClickRecipientResult &oResult)
+{
+    bulk_batch &oBatch = *(bulk_batch *)pUserData;
+    bulk_state &oState = *oBatch.pState;
+
+    std::lock_guard<std::mutex> oLock(oState.mtxState);
+
+    // numbers are normalized to digits only; the gateway may echo them with a '+'
+    std::string_view sTo = oResult.sTo;
+    if (!sTo.empty() && sTo.front() == '+')
+        sTo.remove_prefix(1);
+
+    size_t iIndex = oBatch.iStreamed;
+    for (; iIndex < oBatch.vMsisdns.size(); iIndex++) {
+        if (!oBatch.vHeld.empty() && !oBatch.vHeld[iIndex].empty())
+            continue;
+        if (sTo.empty() || oBatch.vMsisdns[iIndex] == sTo)
+            break;
+    }
+
+    if (iIndex >= oBatch.vMsisdns.size())
+        return;
+
+    if (oResult.bAccepted)
+        oState.iSent++;
+    else
+        oState.iFailed++;
+
+    if (iIndex > oBatch.iStreamed) {
+        if (oBatch.vHeld.empty())
+            oBatch.vHeld.resize(oBatch.vMsisdns.size());
+        bulk_result_line(oBatch.vHeld[iIndex], oBatch.vMsisdns[iIndex], (oResult.bAccepted ? "sent" : "failed"),
+                         oResult.sMessageId, oBatch.iSeq, CURLE_OK, oResult.iHttpStatus, oResult.sError);
+        return;
+    }
+
+    std::string &sOut = bulk_batch_out(oState, oBatch);
+
+    bulk_result_line(sOut, oBatch.vMsisdns[iIndex], (oResult.bAccepted ? "sent" : "failed"), oResult.sMessageId,
+                     oBatch.iSeq, CURLE_OK, oResult.iHttpStatus, oResult.sError);
+    oBatch.iStreamed++;
+
+    // write the held lines that are now in turn
+    while (!oBatch.vHeld.empty() && oBatch.iStreamed < oBatch.vMsisdns.size() && !oBatch.vHeld[oBatch.iStreamed].empty()) {
+        sOut.append(oBatch.vHeld[oBatch.iStreamed]);
+        std::string().swap(oBatch.vHeld[oBatch.iStreamed]);
+        oBatch.iStreamed++;
+    }
+}
+
+/*
+ * Function:  bulk_send_done
+ * Info:      Engine completion function of a batch (engine thread): appends one result line
+ *            per recipient the response did not list (all of them if the request failed;
+ *            failed if a successful response left them out) in input order, together with
+ *            the held lines of those it listed, then the lines of the batch's rejected rows, and advances the completed offset
+ *            (and the results length at it) past every leading completed batch.
+ * Inputs:    pUserData - the batch
+ *            oResult   - send result
+ * Return:    void
+ */
+void bulk_send_done(void *pUserData, const ClickSendResult &oResult)
+{
+    bulk_batch &oBatch = *(bulk_batch *)pUserData;
+    bulk_state &oState = *oBatch.pState;
+    bool bSent = (oResult.eStatus == CLICK_SEND_DONE && oResult.curlCode == CURLE_OK &&
+                  oResult.iHttpStatus >= 200 && oResult.iHttpStatus < 300);
+    const char *chResult = "sent";
+    const char *chDetail = "";
+
+    if (oResult.eStatus == CLICK_SEND_EXPIRED)
+        chResult = "expired";
+    else if (oResult.eStatus == CLICK_SEND_CANCELLED)
+        chResult = "cancelled";
+    else if (!bSent) {
+        chResult = "failed";
+        if (oResult.curlCode != CURLE_OK)
+            chDetail = curl_easy_strerror(oResult.curlCode);
+    }
+
+    std::lock_guard<std::mutex> oLock(oState.mtxState);
+    std::string &sOut = bulk_batch_out(oState, oBatch);
+
+    // a successful response that lists some recipients but not others did not accept those
+    if (bSent && (oBatch.iStreamed > 0 || !oBatch.vHeld.empty())) {
+        chResult = "failed";
+        chDetail = "not in gateway response";
+        bSent = false;
+    }
+
+    for (size_t i = oBatch.iStreamed; i < oBatch.vMsisdns.size(); i++) {
+        if (!oBatch.vHeld.empty() && !oBatch.vHeld[i].empty()) {
+            sOut.append(oBatch.vHeld[i]);
+            continue;
+        }
+
+        bulk_result_line(sOut, oBatch.vMsisdns[i], chResult, std::string_view(), oBatch.iSeq, oResult.curlCode,
+                         oResult.iHttpStatus, chDetail);
+
+        if (bSent)
+            oState.iSent++;
+        else
+            oState.iFailed++;
+    }
+
+    oBatch.vHeld.clear();
+    sOut.append(oBatch.sRejects);
+
+    oBatch.bDone = true;
+
+    while (!oState.dqPending.empty() && oState.dqPending.front().bDone) {
+        oState.sOutBuf.append(oState.dqPending.front().sOut);
+        oState.iDoneOffset = oState.dqPending.front().iEnd;
+        oState.iDoneRows += oState.dqPending.front().iRows;
+        oState.dqPending.pop_front();
+    }
+
+    oState.iDoneBytes = oState.iWritten + oState.sOutBuf.length();
+
+    // the new oldest batch streams straight into the output buffer from now on
+    if (!oState.dqPending.empty()) {
+        oState.sOutBuf.append(oState.dqPending.front().sOut);
+        oState.dqPending.front().sOut.clear();
+    }
+
+    if (oState.sOutBuf.length() >= CFG_BULK_OUTPUT_BUFFER)
+        bulk_flush_output(oState, false);
+
+    oState.cvState.notify_all();
+}
+
+/*
+ * Function:  bulk_read_checkpoint
+ * Info:      Reads a checkpoint file.
+ * Inputs:    sPath - checkpoint file
+ *            iSize - size of the recipients file
+ * Outputs:   iOffset  - input offset to continue from
+ *            iRows    - rows completed before iOffset
+ *            iResults - results file length at iOffset
+ * Return:    0 if there is no checkpoint, 1 if one was read, -1 if it does not match the input
+ */
+static int bulk_read_checkpoint(const std::string &sPath, uint64_t iSize, uint64_t &iOffset, uint64_t &iRows,
+                                uint64_t &iResults)
+{
+    FILE *pFile = fopen(sPath.c_str(), "r");
+    char chMagic[64] = "";
+    unsigned long long iCkSize = 0, iCkOffset = 0, iCkRows = 0, iCkResults = 0;
+
+    if (pFile == NULL)
+        return 0;
+
+    int iFields = fscanf(pFile, "%63s %llu %llu %llu %llu", chMagic, &iCkSize, &iCkOffset, &iCkRows, &iCkResults);
+    fclose(pFile);
+
+    if (iFields != 5 || strcmp(chMagic, BULK_CHECKPOINT_MAGIC) != 0 || iCkSize != iSize || iCkOffset > iSize)
+        return -1;
+
+    iOffset = iCkOffset;
+    iRows = iCkRows;
+    iResults = iCkResults;
+
+    return 1;
+}
+
+/*
+ * Function:  bulk_write_checkpoint
+ * Info:      Flushes the results file and atomically replaces the checkpoint file with the
+ *            current completed offset and the results length at it, so that the checkpoint
+ *            never runs ahead of the results.
+ * Inputs:    oState - tool state
+ *            sPath  - checkpoint file
+ *            iSize  - size of the recipients file
+ * Return:    true on success
+ */
+static bool bulk_write_checkpoint(bulk_state &oState, const std::string &sPath, uint64_t iSize)
+{
+    std::string sTmp = sPath + ".tmp";
+    uint64_t iOffset, iRows, iResults;
+
+    {
+        std::lock_guard<std::mutex> oLock(oState.mtxState);
+
+        bulk_flush_output(oState, true);
+        if (oState.bOutError)
+            return false;
+
+        iOffset = oState.iDoneOffset;
+        iRows = oState.iDoneRows;
+        iResults = oState.iDoneBytes;
+    }
+
+    FILE *pFile = fopen(sTmp.c_str(), "w");
+
+    if (pFile == NULL)
+        return false;
+
+    bool bOk = (fprintf(pFile, "%s %llu %llu %llu %llu\n", BULK_CHECKPOINT_MAGIC, (unsigned long long)iSize,
+                        (unsigned long long)iOffset, (unsigned long long)iRows, (unsigned long long)iResults) > 0);
+
+    bOk = (fflush(pFile) == 0 && fsync(fileno(pFile)) == 0 && bOk);
+    bOk = (fclose(pFile) == 0 && bOk);
+
+    return (bOk && rename(sTmp.c_str(), sPath.c_str()) == 0);
+}
+
+/*
+ * Function:  bulk_report
+ * Info:      Prints a progress line to stderr.
+ * Inputs:    oState     - tool state
+ *            iSize      - size of the recipients file
+ *            iStartRows - rows completed before this run
+ *            tStart     - start of this run
+ * Return:    void
+ */
+static void bulk_report(bulk_state &oState, uint64_t iSize, uint64_t iStartRows, std::chrono::steady_clock::time_point tStart)
+{
+    double dSecs = std::chrono::duration<double>(std::chrono::steady_clock::now() - tStart).count();
+    uint64_t iOffset, iRows, iSent, iFailed, iRejected;
+    size_t iPending;
+
+    {
+        std::lock_guard<std::mutex> oLock(oState.mtxState);
+
+        iOffset = oState.iDoneOffset;
+        iRows = oState.iDoneRows;
+        iSent = oState.iSent;
+        iFailed = oState.iFailed;
+        iRejected = oState.iRejected;
+        iPending = oState.dqPending.size();
+    }
+
+    fprintf(stderr, "[%8.1fs] %5.1f%%  rows %llu  sent %llu  failed %llu  rejected %llu  pending batches %zu  %.0f rows/s\n",
+            dSecs, (iSize > 0 ? 100.0 * iOffset / iSize : 100.0), (unsigned long long)iRows,
+            (unsigned long long)iSent, (unsigned long long)iFailed, (unsigned long long)iRejected, iPending,
+            (dSecs > 0 ? (iRows - iStartRows) / dSecs : 0.0));
+}
+
+/*
+ * Function:  bulk_submit
+ * Info:      Queues a batch and hands it to the engine; a batch without numbers (only
+ *            rejected rows) completes at once. Waits while CFG_BULK_MAX_PENDING batches
+ *            are outstanding.
+ * Inputs:    oState  - tool state
+ *            oEngine - send engine
+ *            sText   - message text
+ *            vViews  - numbers of the batch
+ *            sRejects- result lines of the batch's rejected rows
+ *            iEnd    - input offset just past the last row covered
+ *            iRows   - input rows covered
+ *            fnTick  - called about once a second while waiting
+ * Return:    void
+ */
+template<typename Tick>
+static void bulk_submit(bulk_state &oState, ClickSendEngine &oEngine, std::string_view sText,
+                        std::vector<std::string_view> &vViews, std::string &sRejects,
+                        uint64_t iEnd, uint64_t iRows, Tick fnTick)
+{
+    bulk_batch *pBatch;
+
+    {
+        std::unique_lock<std::mutex> oLock(oState.mtxState);
+
+        while (oState.dqPending.size() >= CFG_BULK_MAX_PENDING) {
+            oState.cvState.wait_for(oLock, std::chrono::seconds(1));
+            oLock.unlock();
+            fnTick();
+            oLock.lock();
+        }
+
+        oState.dqPending.emplace_back();
+        pBatch = &oState.dqPending.back();
+        pBatch->pState = &oState;
+        pBatch->iSeq = oState.iNextSeq++;
+        pBatch->iEnd = iEnd;
+        pBatch->iRows = iRows;
+        pBatch->vMsisdns.assign(vViews.begin(), vViews.end());
+        pBatch->sRejects.swap(sRejects);
+        pBatch->sOut.clear();
+        pBatch->iStreamed = 0;
+        pBatch->vHeld.clear();
+        pBatch->bDone = false;
+    }
+
+    ClickSendResult oResult{0, CLICK_PRIORITY_LOW, CLICK_SEND_DONE, CURLE_OK, 200, std::string_view(),
+                            std::chrono::microseconds(0)};
+
+    if (!vViews.empty()) {
+        ClickSendOptions oOpts(CLICK_PRIORITY_LOW, ClickTimePoint::max(), bulk_send_done, pBatch, bulk_recipient_result);
+
+        if (oEngine.Submit(sText, vViews, oOpts) != 0)
+            pBatch = NULL;
+        else
+            oResult.eStatus = CLICK_SEND_CANCELLED;
+    }
+
+    // empty or refused batches complete here
+    if (pBatch != NULL)
+        bulk_send_done(pBatch, oResult);
+
+    vViews.clear();
+    sRejects.clear();
+}
+
+/*
+ * Function:  bulk_run
+ * Info:      Sends the message to every row of the mapped recipients file from iOffset on.
+ * Inputs:    oState      - tool state
+ *            oEngine     - send engine
+ *            pData       - mapped recipients file
+ *            iSize       - its size
+ *            iOffset     - input offset to start from (start of a row)
+ *            sText       - message text
+ *            fnTick      - progress/checkpoint callback
+ * Return:    void
+ */
+template<typename Tick>
+static void bulk_run(bulk_state &oState, ClickSendEngine &oEngine, const char *pData, uint64_t iSize,
+                     uint64_t iOffset, std::string_view sText, Tick fnTick)
+{
+    unsigned int iWorkers = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<bulk_chunk> vChunks(iWorkers);
+    std::vector<ClickMsisdnNormalizer> vNormalizers;
+    std::vector<std::string_view> vViews;
+    std::string sRejects;
+    long iPageSize = sysconf(_SC_PAGESIZE);
+    char chLine[256];
+    ClickMsisdnOptions oOptions;
+
+    // numbers are not de-duplicated: a file-wide set would not fit the bounded-memory budget
+    oOptions.sDefaultCountryCode = CFG_DEFAULT_COUNTRY_CODE;
+    oOptions.bDeduplicate = false;
+    vNormalizers.assign(iWorkers, ClickMsisdnNormalizer(oOptions));
+
+    size_t iFirst = 0;
+    while (iFirst < iSize && (pData[iFirst] == ' ' || pData[iFirst] == '\t' || pData[iFirst] == '\r' || pData[iFirst] == '\n'))
+        iFirst++;
+    bool bNdjson = (iFirst < iSize && pData[iFirst] == '{');
+
+    while (iOffset < iSize && !g_bulk_stop) {
+        // 1. cut the next window into chunks at line boundaries
+        uint64_t iWindowEnd = std::min<uint64_t>(iSize, iOffset + CFG_BULK_WINDOW_BYTES);
+        size_t iCount = 0;
+
+        if (iWindowEnd < iSize) {
+            const char *pEol = (const char *)memchr(pData + iWindowEnd, '\n', iSize - iWindowEnd);
+            iWindowEnd = (pEol == NULL ? iSize : (uint64_t)(pEol - pData) + 1);
+        }
+
+        uint64_t iChunkLen = std::max<uint64_t>(CFG_BULK_MIN_CHUNK_BYTES, (iWindowEnd - iOffset) / iWorkers + 1);
+
+        for (uint64_t iStart = iOffset; iStart < iWindowEnd && iCount < iWorkers; iCount++) {
+            uint64_t iEnd = (iCount + 1 == iWorkers ? iWindowEnd : std::min(iWindowEnd, iStart + iChunkLen));
+
+            if (iEnd < iWindowEnd) {
+                const char *pEol = (const char *)memchr(pData + iEnd, '\n', iWindowEnd - iEnd);
+                iEnd = (pEol == NULL ? iWindowEnd : (uint64_t)(pEol - pData) + 1);
+            }
+
+            vChunks[iCount].pStart = pData + iStart;
+            vChunks[iCount].pEnd = pData + iEnd;
+            vChunks[iCount].iBase = iStart;
+            iStart = iEnd;
+        }
+
+        // 2. parse and normalize the chunks in parallel
+        {
+            std::vector<std::thread> vThreads;
+
+            for (size_t i = 1; i < iCount; i++)
+                vThreads.emplace_back(bulk_parse_chunk, std::ref(vChunks[i]), bNdjson, std::ref(vNormalizers[i]));
+
+            bulk_parse_chunk(vChunks[0], bNdjson, vNormalizers[0]);
+
+            for (std::thread &thr : vThreads)
+                thr.join();
+        }
+
+        // 3. batch the chunks in input order; a batch never spans chunks, and the last batch
+        //    of a chunk covers the rest of it so that the completed offset reaches its end
+        for (size_t c = 0; c < iCount && !g_bulk_stop; c++) {
+            bulk_chunk &oChunk = vChunks[c];
+            const std::vector<ClickMsisdnReject> &vRejects = oChunk.oList.Rejects();
+            size_t iReject = 0, iAccepted = 0, iRows = 0;
+            uint64_t iRejected = 0;
+
+            for (size_t i = 0; i < oChunk.vFields.size(); i++) {
+                // stopping: the completed offset ends at the last batch submitted
+                if (g_bulk_stop) {
+                    vViews.clear();
+                    sRejects.clear();
+                    break;
+                }
+
+                iRows++;
+
+                if (iReject < vRejects.size() && vRejects[iReject].iIndex == i) {
+                    std::string_view sField = oChunk.vFields[i].substr(0, 64);
+                    int iLen = snprintf(chLine, sizeof(chLine), "%.*s,rejected,,0,0,0,%s\n", (int)sField.length(),
+                                        sField.data(), ClickMsisdnNormalizer::RejectName(vRejects[iReject].eReason));
+
+                    sRejects.append(chLine, std::min<size_t>(iLen, sizeof(chLine) - 1));
+                    iReject++;
+                    iRejected++;
+                    continue;
+                }
+
+                vViews.push_back(oChunk.oList.At(iAccepted++));
+
+                if (vViews.size() == CFG_BULK_BATCH_SIZE && i + 1 < oChunk.vFields.size()) {
+                    bulk_submit(oState, oEngine, sText, vViews, sRejects, oChunk.iBase + oChunk.vRowEnds[i], iRows, fnTick);
+                    iRows = 0;
+                }
+            }
+
+            if (!g_bulk_stop)
+                bulk_submit(oState, oEngine, sText, vViews, sRejects, oChunk.iBase + (oChunk.pEnd - oChunk.pStart), iRows, fnTick);
+
+            std::lock_guard<std::mutex> oLock(oState.mtxState);
+            oState.iRejected += iRejected;
+        }
+
+        // 4. the window has been handed over: release its pages
+        uint64_t iRelease = (iOffset / iPageSize) * iPageSize;
+        uint64_t iReleaseEnd = (iWindowEnd / iPageSize) * iPageSize;
+
+        if (iReleaseEnd > iRelease)
+            madvise((void *)(pData + iRelease), iReleaseEnd - iRelease, MADV_DONTNEED);
+
+        iOffset = iWindowEnd;
+        fnTick();
+    }
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Main                                                                          *
+ * ----------------------------------------------------------------------------- */
+
+int main(int argc, char *argv[])
+{
+    if (argc < 4 || argc > 5) {
+        fprintf(stderr, "Usage: %s <recipients file> <results file> <message text> [checkpoint file]\n", argv[0]);
+        return 2;
+    }
+
+    std::string sInput(argv[1]);
+    std::string sOutput(argv[2]);
+    std::string sText(argv[3]);
+    std::string sCheckpoint(argc > 4 ? argv[4] : sOutput + ".checkpoint");
+    uint64_t iOffset = 0, iStartRows = 0, iResults = 0;
+
+    // map the recipients file
+    int iFd = open(sInput.c_str(), O_RDONLY);
+    struct stat oStat;
+
+    if (iFd < 0 || fstat(iFd, &oStat) != 0) {
+        fprintf(stderr, "Cannot open %s: %s\n", sInput.c_str(), strerror(errno));
+        return 1;
+    }
+
+    uint64_t iSize = (uint64_t)oStat.st_size;
+    const char *pData = NULL;
+
+    if (iSize > 0) {
+        void *pMap = mmap(NULL, iSize, PROT_READ, MAP_SHARED, iFd, 0);
+
+        if (pMap == MAP_FAILED) {
+            fprintf(stderr, "Cannot map %s: %s\n", sInput.c_str(), strerror(errno));
+            close(iFd);
+            return 1;
+        }
+
+        madvise(pMap, iSize, MADV_SEQUENTIAL);
+        pData = (const char *)pMap;
+    }
+
+    close(iFd);
+
+    // resume from the checkpoint, if any
+    int iCheckpoint = bulk_read_checkpoint(sCheckpoint, iSize, iOffset, iStartRows, iResults);
+
+    if (iCheckpoint < 0) {
+        fprintf(stderr, "Checkpoint %s does not match %s; remove it to start over\n", sCheckpoint.c_str(), sInput.c_str());
+        return 1;
+    }
+
+    bulk_state oState;
+
+    oState.iNextSeq = 1;
+    oState.iDoneOffset = iOffset;
+    oState.iDoneRows = iStartRows;
+    oState.iSent = oState.iFailed = oState.iRejected = 0;
+    oState.iWritten = oState.iDoneBytes = iResults;
+    oState.bOutError = false;
+    oState.sOutBuf.reserve(CFG_BULK_OUTPUT_BUFFER + 64 * 1024);
+    oState.pOut = fopen(sOutput.c_str(), (iCheckpoint > 0 ? "a" : "w"));
+
+    if (oState.pOut == NULL) {
+        fprintf(stderr, "Cannot open %s: %s\n", sOutput.c_str(), strerror(errno));
+        return 1;
+    }
+
+    if (iCheckpoint == 0) {
+        oState.sOutBuf.append(BULK_RESULTS_HEADER);
+        oState.iDoneBytes = oState.sOutBuf.length();
+    }
+    else {
+        // drop the lines written after the checkpoint: their rows are sent again
+        struct stat oOutStat;
+
+        if (fstat(fileno(oState.pOut), &oOutStat) != 0 || (uint64_t)oOutStat.st_size < iResults) {
+            fprintf(stderr, "Results file %s is shorter than checkpoint %s records; remove the checkpoint to start over\n",
+                    sOutput.c_str(), sCheckpoint.c_str());
+            return 1;
+        }
+
+        if (ftruncate(fileno(oState.pOut), (off_t)iResults) != 0) {
+            fprintf(stderr, "Cannot truncate %s: %s\n", sOutput.c_str(), strerror(errno));
+            return 1;
+        }
+
+        fprintf(stderr, "Resuming %s at offset %llu (%llu rows done)\n", sInput.c_str(),
+                (unsigned long long)iOffset, (unsigned long long)iStartRows);
+    }
+
+    signal(SIGINT, bulk_signal);
+    signal(SIGTERM, bulk_signal);
+
+    if (curl_global_init(CURL_GLOBAL_ALL) != 0) {
+        fprintf(stderr, "curl_global_init failed!\n");
+        return 1;
+    }
+
+    int iRet = 0;
+
+    try {
+        std::vector<std::unique_ptr<ClickatellSms>> vClients;
+        ClickEngineOptions oEngineOpts;
+
+        for (int i = 0; i < CFG_BULK_CONNECTIONS; i++)
+            vClients.push_back(std::make_unique<ClickatellSms>(CLICK_DEBUG_OFF, CLICK_API_REST, CFG_REST_APIKEY, CFG_REST_APIID,
+                                                               CFG_APICALL_TIMEOUT, CFG_APICALL_CONNECT_TIMEOUT));
+
+        // the tool is the only user of the engine: nothing to reserve, nothing to age
+        oEngineOpts.iReservedHigh = 0;
+        oEngineOpts.iAgingMs = 0;
+
+        ClickSendEngine oEngine(std::move(vClients), oEngineOpts);
+        std::chrono::steady_clock::time_point tStart = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point tProgress = tStart, tCheckpoint = tStart;
+
+        auto fnTick = [&]() {
+            std::chrono::steady_clock::time_point tNow = std::chrono::steady_clock::now();
+
+            if (tNow - tProgress >= std::chrono::seconds(CFG_BULK_PROGRESS_SECS)) {
+                bulk_report(oState, iSize, iStartRows, tStart);
+                tProgress = tNow;
+            }
+
+            if (tNow - tCheckpoint >= std::chrono::seconds(CFG_BULK_CHECKPOINT_SECS)) {
+                if (!bulk_write_checkpoint(oState, sCheckpoint, iSize))
+                    fprintf(stderr, "Cannot write checkpoint %s\n", sCheckpoint.c_str());
+                tCheckpoint = tNow;
+            }
+        };
+
+        bulk_run(oState, oEngine, pData, iSize, iOffset, sText, fnTick);
+
+        // wait for the outstanding batches
+        {
+            std::unique_lock<std::mutex> oLock(oState.mtxState);
+
+            while (!oState.dqPending.empty()) {
+                oState.cvState.wait_for(oLock, std::chrono::seconds(1));
+                oLock.unlock();
+                fnTick();
+                oLock.lock();
+            }
+        }
+
+        bulk_report(oState, iSize, iStartRows, tStart);
+    }
+    catch (std::string sErr) {
+        fprintf(stderr, "Exception occurred when constructing the send engine. Exception: %s\n", sErr.c_str());
+        iRet = 1;
+    }
+
+    if (!bulk_write_checkpoint(oState, sCheckpoint, iSize)) {
+        fprintf(stderr, "Cannot write results/checkpoint: %s\n", strerror(errno));
+        iRet = 1;
+    }
+
+    if (fclose(oState.pOut) != 0)
+        iRet = 1;
+
+    curl_global_cleanup();
+
+    if (pData != NULL)
+        munmap((void *)pData, iSize);
+
+    return (g_bulk_stop ? 130 : iRet);
+}
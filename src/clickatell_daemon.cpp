@@ -0,0 +1,714 @@
+/*
+ * clickatell_daemon.cpp
+ *
+ * Sender daemon: sends SMS messages on behalf of local processes.
+ *
+ * Usage: clickatell_daemon [socket path]
+ *
+ * The daemon owns the gateway connections (a ClickSendEngine with adaptive concurrency over
+ * a pool of REST clients sharing DNS, TLS sessions and connections), so local processes do
+ * not each pay for connection setup and do not compete for the gateway's rate limit; the
+ * engine starts at most CFG_DAEMON_RATE_PER_SEC sends (retries included) per second. It
+ * listens on a Unix domain socket (default CLICK_IPC_DEFAULT_SOCKET) and speaks the frame
+ * protocol described in clickatell_ipc.hpp; ClickDaemonClient is the matching client.
+ *
+ * A send is acknowledged as soon as it is queued. Attempts that provably never reached the
+ * gateway (not sent before the deadline, name resolution or connection failures) and those
+ * refused with HTTP 429 are retried with exponential backoff (CFG_DAEMON_ATTEMPTS attempts
+ * in all, never past the message's deadline). Any other failure (a timeout, a receive error,
+ * a 5xx status) may follow a POST the gateway already accepted, so like ClickShardedClient
+ * the daemon reports it rather than risking a duplicate SMS. The client gets one result,
+ * that of the last attempt. Status queries are answered by a separate client on their own
+ * thread, so they do not wait behind queued sends.
+ *
+ * With CFG_DAEMON_TRACE_FILE set, a sampled fraction of the sends is traced (see
+ * clickatell_trace.hpp); the retries of a traced send join its trace.
+ *
+ * SIGINT/SIGTERM stop the daemon: queued sends and unanswered status queries are cancelled
+ * and reported as such to the clients still connected, and the socket is removed.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "clickatell_sms/clickatell_sms.hpp"
+#include "clickatell_sms/clickatell_share.hpp"
+#include "clickatell_sms/clickatell_engine.hpp"
+#include "clickatell_sms/clickatell_ipc.hpp"
+#include "clickatell_sms/clickatell_metrics.hpp"
+#include "clickatell_sms/clickatell_trace.hpp"
+
+/* ----------------------------------------------------------------------------- *
+ * Input configuration values                                                    *
+ * NOTE: Please modify these values and replace them with your own credentials.  *
+ * ----------------------------------------------------------------------------- */
+
+// insert your REST API credentials here
+#define CFG_REST_APIKEY             "uJqYpaWlUNPUhEDsuptRJCk5nGZD.Fwx8vHQOUjoTXTdFghXERUsZDvoK1SiF" // insert your Clickatell REST API Key here
+#define CFG_REST_APIID              "2517153" // insert your Clickatell REST API ID here
+
+// timeout values - these can be modified or left as is
+#define CFG_APICALL_TIMEOUT         10 // Config: Maximum time in seconds (long value) for API call to take
+#define CFG_APICALL_CONNECT_TIMEOUT 5  // Config: maximum time in seconds (long value) that API call takes to connect to Clickatell server
+
+// daemon tuning - these can be modified or left as is
+#define CFG_DAEMON_CONNECTIONS      8           // concurrent requests at most (ClickatellSms instances in the engine)
+#define CFG_DAEMON_MAX_CLIENTS      256         // local connections accepted at once
+#define CFG_DAEMON_ATTEMPTS         3           // attempts per send, including the first
+#define CFG_DAEMON_RETRY_BASE_MS    500         // delay before the first retry (doubled for each further one)
+#define CFG_DAEMON_RATE_PER_SEC     100         // sends started per second at most; set to the account's rate limit (0: no cap)
+#define CFG_DAEMON_SOCKET_MODE      0660        // permissions of the socket: who may submit
+#define CFG_DAEMON_OUTPUT_LIMIT     (1024 * 1024) // a client's requests are not read while this many reply bytes are unsent
+#define CFG_DAEMON_TRACE_FILE       ""          // OTLP/JSON trace output of sampled sends ("": no tracing)
+#define CFG_DAEMON_TRACE_SAMPLE     0.01        // fraction of sends traced
+
+/* ----------------------------------------------------------------------------- *
+ * Types                                                                         *
+ * ----------------------------------------------------------------------------- */
+
+struct daemon_state;
+
+// a send, from its SEND frame until its RESULT is written
+struct daemon_send {
+    daemon_state *pState;
+    uint64_t iConn;                     // connection that submitted it
+    uint32_t iTag;                      // tag of the SEND frame
+    int iAttempt;                       // attempts made so far
+    eClickPriority ePriority;
+    ClickTimePoint tDeadline;
+    std::string sText;                  // kept for retries
+    std::vector<std::string> vMsisdns;
+    ClickTraceId oTrace;                // trace of the first attempt, joined by the retries
+};
+
+// a finished send attempt or status query, handed to the main thread
+struct daemon_event {
+    daemon_send *pSend;                 // NULL for a status query
+    uint64_t iConn;                     // status query: connection and tag
+    uint32_t iTag;
+    eClickSendStatus eStatus;
+    CURLcode curlCode;
+    long iHttpStatus;
+    std::string sResponse;
+};
+
+// a status query waiting for the status thread
+struct daemon_query {
+    uint64_t iConn;
+    uint32_t iTag;
+    std::string sMsgId;
+};
+
+// a local client connection
+struct daemon_conn {
+    int iFd;
+    std::string sIn;                    // bytes received, not yet decoded
+    std::string sOut;                   // replies not yet written
+};
+
+// state shared between the main thread, the engine thread and the status thread
+struct daemon_state {
+    std::mutex mtxState;                // guards everything below
+    std::condition_variable cvQueries;  // signalled when a query is queued or on stop
+    std::deque<daemon_event> dqEvents;
+    std::deque<daemon_query> dqQueries;
+    bool bStop;
+    int iWakeFd;                        // write end of the main loop's wake pipe
+};
+
+/* ----------------------------------------------------------------------------- *
+ * Local variables                                                               *
+ * ----------------------------------------------------------------------------- */
+
+static volatile sig_atomic_t g_daemon_stop = 0;
+
+/* ----------------------------------------------------------------------------- *
+ * Local function definitions                                                    *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  daemon_signal
+ * Info:      SIGINT/SIGTERM handler: stops the main loop.
+ */
+static void daemon_signal(int)
+{
+    g_daemon_stop = 1;
+}
+
+/*
+ * Function:  daemon_post
+ * Info:      Hands an event to the main thread and wakes it (any thread).
+ * Inputs:    oState - daemon state
+ *            oEvent - the event
+ * Return:    void
+ */
+static void daemon_post(daemon_state &oState, daemon_event &&oEvent)
+{
+    std::lock_guard<std::mutex> oLock(oState.mtxState);
+
+    oState.dqEvents.push_back(std::move(oEvent));
+
+    // a full pipe already guarantees a wakeup
+    if (write(oState.iWakeFd, "", 1) < 0 && errno != EAGAIN)
+        perror("wake");
+}
+
+/*
+ * Function:  daemon_send_done
+ * Info:      Completion function of an engine send (engine thread).
+ */
+static void daemon_send_done(void *pUserData, const ClickSendResult &oResult)
+{
+    daemon_send *pSend = (daemon_send *)pUserData;
+
+    pSend->oTrace = oResult.oTrace;
+    daemon_post(*pSend->pState, daemon_event{pSend, pSend->iConn, pSend->iTag, oResult.eStatus, oResult.curlCode,
+                                             oResult.iHttpStatus, std::string(oResult.sResponse)});
+}
+
+/*
+ * Function:  daemon_submit
+ * Info:      Hands a send to the engine, at once or (for a retry) after a delay.
+ * Inputs:    oEngine  - send engine
+ *            pSend    - the send
+ *            iDelayMs - delay (0: queue at once)
+ * Return:    engine message ID, or 0 if the engine refused it
+ */
+static uint64_t daemon_submit(ClickSendEngine &oEngine, daemon_send *pSend, long iDelayMs)
+{
+    std::vector<std::string_view> vViews(pSend->vMsisdns.begin(), pSend->vMsisdns.end());
+    ClickSendOptions oOpts(pSend->ePriority, pSend->tDeadline, daemon_send_done, pSend);
+
+    oOpts.oTrace = pSend->oTrace;
+    pSend->iAttempt++;
+
+    if (iDelayMs == 0)
+        return oEngine.Submit(pSend->sText, vViews, oOpts);
+
+    return oEngine.SubmitAt(std::chrono::system_clock::now() + std::chrono::milliseconds(iDelayMs), pSend->sText, vViews, oOpts);
+}
+
+/*
+ * Function:  daemon_retry_delay
+ * Info:      Decides whether a finished attempt is retried: only if the request never
+ *            reached the gateway (expired before sending, name resolution or connection
+ *            failure) or was refused with HTTP 429, attempts remain and the retry can be
+ *            sent before the deadline. Every other failure is final, since the gateway may
+ *            already have accepted the message.
+ * Inputs:    pSend  - the send
+ *            oEvent - result of its last attempt
+ * Return:    delay before the retry in ms, or -1 if the result is final
+ */
+static long daemon_retry_delay(const daemon_send *pSend, const daemon_event &oEvent)
+{
+    bool bRetryable = false;
+
+    if (oEvent.eStatus == CLICK_SEND_EXPIRED)
+        bRetryable = true;
+    else if (oEvent.eStatus == CLICK_SEND_DONE)
+        bRetryable = (oEvent.curlCode == CURLE_COULDNT_RESOLVE_HOST || oEvent.curlCode == CURLE_COULDNT_RESOLVE_PROXY ||
+                      oEvent.curlCode == CURLE_COULDNT_CONNECT ||
+                      (oEvent.curlCode == CURLE_OK && oEvent.iHttpStatus == 429));
+
+    if (!bRetryable || pSend->iAttempt >= CFG_DAEMON_ATTEMPTS)
+        return -1;
+
+    long iDelayMs = (long)CFG_DAEMON_RETRY_BASE_MS << (pSend->iAttempt - 1);
+
+    if (std::chrono::steady_clock::now() + std::chrono::milliseconds(iDelayMs) >= pSend->tDeadline)
+        return -1;
+
+    return iDelayMs;
+}
+
+/*
+ * Function:  daemon_write_result
+ * Info:      Queues a RESULT frame on a connection.
+ * Return:    void
+ */
+static void daemon_write_result(daemon_conn &oConn, uint32_t iTag, eClickSendStatus eStatus, CURLcode curlCode,
+                                long iHttpStatus, std::string_view sResponse)
+{
+    size_t iStart = ClickIpc::Begin(oConn.sOut, CLICK_IPC_RESULT, iTag);
+
+    ClickIpc::Put8(oConn.sOut, (uint8_t)eStatus);
+    ClickIpc::Put32(oConn.sOut, (uint32_t)(int32_t)curlCode);
+    ClickIpc::Put32(oConn.sOut, (uint32_t)(int32_t)iHttpStatus);
+    ClickIpc::PutString(oConn.sOut, sResponse);
+    ClickIpc::End(oConn.sOut, iStart);
+}
+
+/*
+ * Function:  daemon_write_ack
+ * Info:      Queues an ACK frame on a connection.
+ * Return:    void
+ */
+static void daemon_write_ack(daemon_conn &oConn, uint32_t iTag, uint64_t iId)
+{
+    size_t iStart = ClickIpc::Begin(oConn.sOut, CLICK_IPC_ACK, iTag);
+
+    ClickIpc::Put8(oConn.sOut, iId != 0);
+    ClickIpc::Put64(oConn.sOut, iId);
+    ClickIpc::End(oConn.sOut, iStart);
+}
+
+/*
+ * Function:  daemon_status_thread
+ * Info:      Answers status queries with a client of its own, one at a time.
+ * Inputs:    oState - daemon state
+ *            oSms   - client used for the queries
+ * Return:    void
+ */
+static void daemon_status_thread(daemon_state &oState, ClickatellSms &oSms)
+{
+    std::unique_lock<std::mutex> oLock(oState.mtxState);
+
+    for (;;) {
+        oState.cvQueries.wait(oLock, [&]() { return oState.bStop || !oState.dqQueries.empty(); });
+
+        if (oState.bStop)
+            return;
+
+        daemon_query oQuery = std::move(oState.dqQueries.front());
+        oState.dqQueries.pop_front();
+        oLock.unlock();
+
+        std::string sResponse = oSms.SmsStatusGet(oQuery.sMsgId);
+
+        daemon_post(oState, daemon_event{NULL, oQuery.iConn, oQuery.iTag, CLICK_SEND_DONE, oSms.GetCurlCode(),
+                                         oSms.GetHttpStatus(), std::move(sResponse)});
+        oLock.lock();
+    }
+}
+
+/*
+ * Function:  daemon_frame
+ * Info:      Handles one request frame of a connection.
+ * Inputs:    oState  - daemon state
+ *            oEngine - send engine
+ *            iConn   - connection ID
+ *            oConn   - the connection
+ *            sFrame  - frame after its length field
+ * Return:    false if the frame is malformed (the connection is dropped)
+ */
+static bool daemon_frame(daemon_state &oState, ClickSendEngine &oEngine, uint64_t iConn, daemon_conn &oConn,
+                         std::string_view sFrame)
+{
+    ClickIpcReader oReader(sFrame);
+    uint8_t iType = oReader.Get8();
+    uint32_t iTag = oReader.Get32();
+
+    if (iType == CLICK_IPC_STATUS) {
+        std::string_view sMsgId = oReader.GetString();
+
+        if (!oReader.Ok() || !oReader.AtEnd())
+            return false;
+
+        std::lock_guard<std::mutex> oLock(oState.mtxState);
+        oState.dqQueries.push_back(daemon_query{iConn, iTag, std::string(sMsgId)});
+        oState.cvQueries.notify_one();
+        return true;
+    }
+
+    if (iType != CLICK_IPC_SEND)
+        return false;
+
+    std::unique_ptr<daemon_send> pSend = std::make_unique<daemon_send>();
+    uint8_t iPriority = oReader.Get8();
+    uint32_t iDeadlineMs = oReader.Get32();
+
+    pSend->pState = &oState;
+    pSend->iConn = iConn;
+    pSend->iTag = iTag;
+    pSend->iAttempt = 0;
+    pSend->ePriority = (eClickPriority)std::min<uint8_t>(iPriority, CLICK_PRIORITY_LOW);
+    pSend->tDeadline = (iDeadlineMs == 0 ? ClickTimePoint::max() :
+                        std::chrono::steady_clock::now() + std::chrono::milliseconds(iDeadlineMs));
+    pSend->sText.assign(oReader.GetString());
+
+    // every number takes at least its two length bytes
+    uint32_t iCount = oReader.Get32();
+
+    if (iCount > sFrame.length() / 2)
+        return false;
+
+    pSend->vMsisdns.reserve(iCount);
+
+    for (uint32_t i = 0; i < iCount && oReader.Ok(); i++)
+        pSend->vMsisdns.emplace_back(oReader.GetBytes(oReader.Get16()));
+
+    if (!oReader.Ok() || !oReader.AtEnd())
+        return false;
+
+    uint64_t iId = daemon_submit(oEngine, pSend.get(), 0);
+
+    // the result cannot overtake the ACK: both are written by this thread
+    daemon_write_ack(oConn, iTag, iId);
+
+    if (iId != 0)
+        pSend.release();
+
+    return true;
+}
+
+/*
+ * Function:  daemon_read
+ * Info:      Reads from a connection and handles every complete frame.
+ * Return:    false if the connection closed or sent a malformed frame
+ */
+static bool daemon_read(daemon_state &oState, ClickSendEngine &oEngine, uint64_t iConn, daemon_conn &oConn)
+{
+    char chBuf[65536];
+    ssize_t iRead = recv(oConn.iFd, chBuf, sizeof(chBuf), 0);
+
+    if (iRead < 0)
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+
+    if (iRead == 0)
+        return false;
+
+    oConn.sIn.append(chBuf, iRead);
+
+    size_t iPos = 0;
+    long iLen;
+
+    while ((iLen = ClickIpc::FrameLength(std::string_view(oConn.sIn).substr(iPos))) > 0) {
+        if (!daemon_frame(oState, oEngine, iConn, oConn, std::string_view(oConn.sIn).substr(iPos + 4, iLen - 4)))
+            return false;
+
+        iPos += iLen;
+    }
+
+    oConn.sIn.erase(0, iPos);
+
+    return (iLen == 0);
+}
+
+/*
+ * Function:  daemon_write
+ * Info:      Writes as much of a connection's pending replies as the socket takes.
+ * Return:    false if the connection failed
+ */
+static bool daemon_write(daemon_conn &oConn)
+{
+    ssize_t iSent = send(oConn.iFd, oConn.sOut.data(), oConn.sOut.length(), MSG_NOSIGNAL);
+
+    if (iSent < 0)
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+
+    oConn.sOut.erase(0, iSent);
+
+    return true;
+}
+
+/*
+ * Function:  daemon_events
+ * Info:      Handles finished attempts and status queries: retries a send or writes its
+ *            result (and frees it), and writes query results. Results for connections that
+ *            have closed are dropped.
+ * Inputs:    oState  - daemon state
+ *            pEngine - send engine (NULL while shutting down: nothing is retried)
+ *            mConns  - open connections
+ * Return:    void
+ */
+static void daemon_events(daemon_state &oState, ClickSendEngine *pEngine, std::map<uint64_t, daemon_conn> &mConns)
+{
+    std::deque<daemon_event> dqEvents;
+
+    {
+        std::lock_guard<std::mutex> oLock(oState.mtxState);
+        dqEvents.swap(oState.dqEvents);
+    }
+
+    for (daemon_event &oEvent : dqEvents) {
+        if (oEvent.pSend != NULL) {
+            long iDelayMs = (pEngine == NULL ? -1 : daemon_retry_delay(oEvent.pSend, oEvent));
+
+            if (iDelayMs > 0 && daemon_submit(*pEngine, oEvent.pSend, iDelayMs) != 0) {
+                ClickMetrics::Add(CLICK_METRIC_RETRIES);
+                continue;
+            }
+        }
+
+        std::map<uint64_t, daemon_conn>::iterator it = mConns.find(oEvent.iConn);
+
+        if (it != mConns.end())
+            daemon_write_result(it->second, oEvent.iTag, oEvent.eStatus, oEvent.curlCode, oEvent.iHttpStatus, oEvent.sResponse);
+
+        delete oEvent.pSend;
+    }
+}
+
+/*
+ * Function:  daemon_listen
+ * Info:      Creates the listening socket. A socket file left behind by a daemon that is no
+ *            longer running is replaced; one that still accepts connections is not, and
+ *            neither is anything at the path that is not a socket. The socket is created
+ *            with CFG_DAEMON_SOCKET_MODE through the umask, so it is never reachable with
+ *            wider permissions (called before any thread is started).
+ * Inputs:    sPath - socket path
+ * Return:    listening descriptor, or -1 (reported on stderr)
+ */
+static int daemon_listen(const std::string &sPath)
+{
+    struct sockaddr_un oAddr;
+    struct stat oStat;
+    int iFd;
+
+    if (sPath.length() >= sizeof(oAddr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", sPath.c_str());
+        return -1;
+    }
+
+    memset(&oAddr, 0, sizeof(oAddr));
+    oAddr.sun_family = AF_UNIX;
+    memcpy(oAddr.sun_path, sPath.data(), sPath.length());
+
+    if ((iFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    if (connect(iFd, (struct sockaddr *)&oAddr, sizeof(oAddr)) == 0) {
+        fprintf(stderr, "Another daemon is listening on %s\n", sPath.c_str());
+        close(iFd);
+        return -1;
+    }
+
+    close(iFd);
+
+    if (lstat(sPath.c_str(), &oStat) == 0) {
+        if (!S_ISSOCK(oStat.st_mode)) {
+            fprintf(stderr, "%s exists and is not a socket\n", sPath.c_str());
+            return -1;
+        }
+
+        unlink(sPath.c_str());
+    }
+
+    mode_t iOldMask = umask(~(mode_t)CFG_DAEMON_SOCKET_MODE & 0777);
+
+    if ((iFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)) < 0 ||
+        bind(iFd, (struct sockaddr *)&oAddr, sizeof(oAddr)) != 0 ||
+        listen(iFd, SOMAXCONN) != 0) {
+        fprintf(stderr, "Cannot listen on %s: %s\n", sPath.c_str(), strerror(errno));
+        umask(iOldMask);
+        if (iFd >= 0)
+            close(iFd);
+        return -1;
+    }
+
+    umask(iOldMask);
+
+    return iFd;
+}
+
+/*
+ * Function:  daemon_run
+ * Info:      Main loop: accepts connections, reads requests, writes replies and handles
+ *            events until SIGINT/SIGTERM.
+ * Inputs:    oState    - daemon state
+ *            oEngine   - send engine
+ *            iListenFd - listening socket
+ *            iWakeRead - read end of the wake pipe
+ *            mConns    - open connections
+ * Return:    void
+ */
+static void daemon_run(daemon_state &oState, ClickSendEngine &oEngine, int iListenFd, int iWakeRead,
+                       std::map<uint64_t, daemon_conn> &mConns)
+{
+    std::vector<struct pollfd> vPoll;
+    std::vector<uint64_t> vIds;
+    uint64_t iNextConn = 1;
+    char chBuf[256];
+
+    while (!g_daemon_stop) {
+        vPoll.assign({{iListenFd, (short)(mConns.size() < CFG_DAEMON_MAX_CLIENTS ? POLLIN : 0), 0}, {iWakeRead, POLLIN, 0}});
+        vIds.clear();
+
+        for (std::pair<const uint64_t, daemon_conn> &oEntry : mConns) {
+            daemon_conn &oConn = oEntry.second;
+            short iEvents = (short)((oConn.sOut.length() < CFG_DAEMON_OUTPUT_LIMIT ? POLLIN : 0) |
+                                    (oConn.sOut.empty() ? 0 : POLLOUT));
+
+            vPoll.push_back({oConn.iFd, iEvents, 0});
+            vIds.push_back(oEntry.first);
+        }
+
+        if (poll(vPoll.data(), vPoll.size(), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            return;
+        }
+
+        if (vPoll[0].revents & POLLIN) {
+            int iFd = accept4(iListenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+            if (iFd >= 0)
+                mConns[iNextConn++].iFd = iFd;
+        }
+
+        if (vPoll[1].revents & POLLIN) {
+            while (read(iWakeRead, chBuf, sizeof(chBuf)) > 0)
+                ;
+        }
+
+        for (size_t i = 0; i < vIds.size(); i++) {
+            daemon_conn &oConn = mConns[vIds[i]];
+            bool bOk = !(vPoll[i + 2].revents & (POLLERR | POLLNVAL));
+
+            if (bOk && (vPoll[i + 2].revents & (POLLIN | POLLHUP)))
+                bOk = daemon_read(oState, oEngine, vIds[i], oConn);
+
+            if (bOk && (vPoll[i + 2].revents & POLLOUT))
+                bOk = daemon_write(oConn);
+
+            // pending sends of a dropped connection still complete; their results are discarded
+            if (!bOk) {
+                close(oConn.iFd);
+                mConns.erase(vIds[i]);
+            }
+        }
+
+        daemon_events(oState, &oEngine, mConns);
+    }
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Main                                                                          *
+ * ----------------------------------------------------------------------------- */
+
+int main(int argc, char *argv[])
+{
+    if (argc > 2) {
+        fprintf(stderr, "Usage: %s [socket path]\n", argv[0]);
+        return 2;
+    }
+
+    std::string sPath(argc > 1 ? argv[1] : CLICK_IPC_DEFAULT_SOCKET);
+    int iWake[2];
+
+    if (pipe2(iWake, O_NONBLOCK | O_CLOEXEC) != 0) {
+        perror("pipe2");
+        return 1;
+    }
+
+    signal(SIGINT, daemon_signal);
+    signal(SIGTERM, daemon_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    int iListenFd = daemon_listen(sPath);
+
+    if (iListenFd < 0)
+        return 1;
+
+    if (curl_global_init(CURL_GLOBAL_ALL) != 0) {
+        fprintf(stderr, "curl_global_init failed!\n");
+        return 1;
+    }
+
+    daemon_state oState;
+    std::map<uint64_t, daemon_conn> mConns;
+    int iRet = 0;
+
+    oState.bStop = false;
+    oState.iWakeFd = iWake[1];
+
+    try {
+        // the tracer outlives the engine that records into it
+        std::unique_ptr<ClickTracer> pTracer;
+        // all engine clients run on the engine thread, so they may share one connection pool
+        ClickShare oShare;
+        std::vector<std::unique_ptr<ClickatellSms>> vClients;
+        ClickEngineOptions oEngineOpts;
+        ClickatellSms oStatusSms(CLICK_DEBUG_OFF, CLICK_API_REST, CFG_REST_APIKEY, CFG_REST_APIID,
+                                 CFG_APICALL_TIMEOUT, CFG_APICALL_CONNECT_TIMEOUT);
+
+        for (int i = 0; i < CFG_DAEMON_CONNECTIONS; i++) {
+            vClients.push_back(std::make_unique<ClickatellSms>(CLICK_DEBUG_OFF, CLICK_API_REST, CFG_REST_APIKEY, CFG_REST_APIID,
+                                                               CFG_APICALL_TIMEOUT, CFG_APICALL_CONNECT_TIMEOUT));
+            vClients.back()->SetShare(&oShare);
+        }
+
+        oEngineOpts.bAdaptiveConcurrency = true;
+        oEngineOpts.dRatePerSec = CFG_DAEMON_RATE_PER_SEC;
+
+        if (strlen(CFG_DAEMON_TRACE_FILE) > 0) {
+            ClickTraceOptions oTraceOpts;
+
+            oTraceOpts.sFile = CFG_DAEMON_TRACE_FILE;
+            oTraceOpts.dSampleRate = CFG_DAEMON_TRACE_SAMPLE;
+            oTraceOpts.sServiceName = "clickatell_daemon";
+            pTracer = std::make_unique<ClickTracer>(oTraceOpts);
+            oEngineOpts.pTracer = pTracer.get();
+        }
+
+        {
+            std::unique_ptr<ClickSendEngine> pEngine = std::make_unique<ClickSendEngine>(std::move(vClients), oEngineOpts);
+            std::thread thrStatus(daemon_status_thread, std::ref(oState), std::ref(oStatusSms));
+
+            fprintf(stderr, "Listening on %s\n", sPath.c_str());
+
+            daemon_run(oState, *pEngine, iListenFd, iWake[0], mConns);
+
+            {
+                std::lock_guard<std::mutex> oLock(oState.mtxState);
+                oState.bStop = true;
+                oState.cvQueries.notify_all();
+            }
+
+            thrStatus.join();
+
+            // queries the status thread did not get to are answered as cancelled
+            for (daemon_query &oQuery : oState.dqQueries)
+                daemon_post(oState, daemon_event{NULL, oQuery.iConn, oQuery.iTag, CLICK_SEND_CANCELLED,
+                                                 CURLE_ABORTED_BY_CALLBACK, 0, std::string()});
+            oState.dqQueries.clear();
+
+            // cancels what is still queued or scheduled; the completions are handled below
+            pEngine.reset();
+        }
+
+        daemon_events(oState, NULL, mConns);
+    }
+    catch (std::string sErr) {
+        fprintf(stderr, "Exception occurred when constructing the send engine. Exception: %s\n", sErr.c_str());
+        iRet = 1;
+    }
+
+    // best effort: tell the clients still connected about the cancelled sends
+    for (std::pair<const uint64_t, daemon_conn> &oEntry : mConns) {
+        daemon_write(oEntry.second);
+        close(oEntry.second.iFd);
+    }
+
+    close(iListenFd);
+    unlink(sPath.c_str());
+    close(iWake[0]);
+    close(iWake[1]);
+
+    curl_global_cleanup();
+
+    return (g_daemon_stop ? 0 : iRet);
+}
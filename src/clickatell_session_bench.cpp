@@ -0,0 +1,212 @@
+/*
+ * clickatell_session_bench.cpp
+ *
+ * Benchmark of first-request latency with and without persisted TLS sessions.
+ *
+ * Usage: clickatell_session_bench [rounds] [session file]
+ *
+ * Each round simulates two process starts. The cold start builds a new ClickShare and
+ * ClickatellSms and times its first request (a balance query), which needs a full TLS
+ * handshake; its sessions are then saved with ClickShare::SaveSessions(). The warm start
+ * builds another new ClickShare, loads the file with ClickShare::LoadSessions() and times
+ * the same first request, which can resume the saved session (abbreviated handshake).
+ * Nothing else is carried over between the two: each start has its own share, cURL
+ * handle and connection.
+ *
+ * For each start the wall time of the request, the time to the end of the TLS handshake
+ * (from the transfer's metrics) and the process CPU time spent in the request are
+ * printed, then the medians over all rounds. If libcurl cannot export sessions (before
+ * 8.12, or built without it), only the cold starts are measured.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "clickatell_sms/clickatell_sms.hpp"
+#include "clickatell_sms/clickatell_share.hpp"
+
+/* ----------------------------------------------------------------------------- *
+ * Input configuration values                                                    *
+ * NOTE: Please modify these values and replace them with your own credentials.  *
+ * ----------------------------------------------------------------------------- */
+
+// insert your REST API credentials here (a refused request still completes the handshake)
+#define CFG_REST_APIKEY             "uJqYpaWlUNPUhEDsuptRJCk5nGZD.Fwx8vHQOUjoTXTdFghXERUsZDvoK1SiF" // insert your Clickatell REST API Key here
+#define CFG_REST_APIID              "2517153" // insert your Clickatell REST API ID here
+
+// timeout values - these can be modified or left as is
+#define CFG_APICALL_TIMEOUT         10 // Config: Maximum time in seconds (long value) for API call to take
+#define CFG_APICALL_CONNECT_TIMEOUT 5  // Config: maximum time in seconds (long value) that API call takes to connect to Clickatell server
+
+// benchmark settings - these can be modified or left as is
+#define CFG_BENCH_ROUNDS            10                                // rounds when not given on the command line
+#define CFG_BENCH_SESSION_FILE      "/tmp/clickatell_sessions.bench"  // session file when not given on the command line
+#define CFG_BENCH_RESOLVE           ""                                // pin the gateway ("host:port:address"), e.g. to a test server ("": DNS)
+
+/* ----------------------------------------------------------------------------- *
+ * Types                                                                         *
+ * ----------------------------------------------------------------------------- */
+
+// one timed first request
+struct bench_sample {
+    bool bOk;                 // the request completed at the transport level
+    double dWallMs;           // wall time of the request
+    double dTlsMs;            // start of the transfer to the end of the TLS handshake
+    double dCpuMs;            // process CPU time during the request
+    int iSessions;            // sessions saved (cold) or loaded (warm)
+};
+
+/* ----------------------------------------------------------------------------- *
+ * Local function definitions                                                    *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  bench_cpu_ms
+ * Info:      Returns the CPU time used by the process so far.
+ * Return:    milliseconds
+ */
+static double bench_cpu_ms()
+{
+    struct timespec tNow;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &tNow);
+
+    return tNow.tv_sec * 1000.0 + tNow.tv_nsec / 1e6;
+}
+
+/*
+ * Function:  bench_first_request
+ * Info:      Simulates a process start: a new share (loading the session file if bWarm,
+ *            saving the sessions to it afterwards if not) and a new instance, and times
+ *            the instance's first request.
+ * Inputs:    sSessionFile - session file
+ *            bWarm        - load the session file before the request
+ * Return:    the sample
+ */
+static bench_sample bench_first_request(const std::string &sSessionFile, bool bWarm)
+{
+    ClickShareOptions oShareOpts;
+    bench_sample oSample = {false, 0, 0, 0, 0};
+
+    if (std::string(CFG_BENCH_RESOLVE).length() > 0)
+        oShareOpts.vResolve.push_back(CFG_BENCH_RESOLVE);
+
+    ClickShare oShare(oShareOpts);
+
+    if (bWarm)
+        oSample.iSessions = oShare.LoadSessions(sSessionFile);
+
+    {
+        ClickatellSms oClickSms(CLICK_DEBUG_OFF, CLICK_API_REST, CFG_REST_APIKEY, CFG_REST_APIID,
+                                CFG_APICALL_TIMEOUT, CFG_APICALL_CONNECT_TIMEOUT);
+
+        oClickSms.SetShare(&oShare);
+
+        double dCpuStart = bench_cpu_ms();
+        std::chrono::steady_clock::time_point tStart = std::chrono::steady_clock::now();
+
+        oClickSms.SmsBalanceGet();
+
+        oSample.dWallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - tStart).count();
+        oSample.dCpuMs = bench_cpu_ms() - dCpuStart;
+        oSample.dTlsMs = oClickSms.GetMetrics().iTlsUs / 1000.0;
+        oSample.bOk = (oClickSms.GetCurlCode() == CURLE_OK);
+
+        if (!oSample.bOk)
+            printf("  request failed: %s\n", curl_easy_strerror(oClickSms.GetCurlCode()));
+    }
+
+    if (!bWarm)
+        oSample.iSessions = oShare.SaveSessions(sSessionFile);
+
+    return oSample;
+}
+
+/*
+ * Function:  bench_median
+ * Info:      Returns the median of a field over the successful samples.
+ * Inputs:    vSamples - samples
+ *            pField   - field
+ * Return:    median (0 if there is no successful sample)
+ */
+static double bench_median(const std::vector<bench_sample> &vSamples, double bench_sample::*pField)
+{
+    std::vector<double> vValues;
+
+    for (const bench_sample &oSample : vSamples) {
+        if (oSample.bOk)
+            vValues.push_back(oSample.*pField);
+    }
+
+    if (vValues.empty())
+        return 0;
+
+    std::sort(vValues.begin(), vValues.end());
+
+    return (vValues.size() % 2 ? vValues[vValues.size() / 2]
+                               : (vValues[vValues.size() / 2 - 1] + vValues[vValues.size() / 2]) / 2);
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Main                                                                          *
+ * ----------------------------------------------------------------------------- */
+
+int main(int argc, char *argv[])
+{
+    int iRounds = (argc > 1 ? atoi(argv[1]) : CFG_BENCH_ROUNDS);
+    std::string sSessionFile = (argc > 2 ? argv[2] : CFG_BENCH_SESSION_FILE);
+    std::vector<bench_sample> vCold;
+    std::vector<bench_sample> vWarm;
+
+    if (iRounds <= 0) {
+        printf("Usage: %s [rounds] [session file]\n", argv[0]);
+        return 1;
+    }
+
+    printf("%-6s %-5s %10s %10s %10s %9s\n", "round", "start", "wall ms", "tls ms", "cpu ms", "sessions");
+
+    try {
+        for (int i = 0; i < iRounds; i++) {
+            unlink(sSessionFile.c_str());
+
+            vCold.push_back(bench_first_request(sSessionFile, false));
+            printf("%-6d %-5s %10.2f %10.2f %10.2f %9d\n", i + 1, "cold", vCold.back().dWallMs, vCold.back().dTlsMs,
+                   vCold.back().dCpuMs, vCold.back().iSessions);
+
+            // nothing to resume from
+            if (vCold.back().iSessions <= 0)
+                continue;
+
+            vWarm.push_back(bench_first_request(sSessionFile, true));
+            printf("%-6d %-5s %10.2f %10.2f %10.2f %9d\n", i + 1, "warm", vWarm.back().dWallMs, vWarm.back().dTlsMs,
+                   vWarm.back().dCpuMs, vWarm.back().iSessions);
+        }
+    }
+    catch (const std::string &sError) {
+        printf("Error: %s\n", sError.c_str());
+        return 1;
+    }
+
+    unlink(sSessionFile.c_str());
+
+    printf("\nmedian %-5s %10.2f %10.2f %10.2f\n", "cold", bench_median(vCold, &bench_sample::dWallMs),
+           bench_median(vCold, &bench_sample::dTlsMs), bench_median(vCold, &bench_sample::dCpuMs));
+
+    if (vWarm.empty()) {
+        printf("No sessions were saved: libcurl cannot export TLS sessions (8.12 or later is needed),\n"
+               "or the cold requests did not reach the gateway.\n");
+        return 1;
+    }
+
+    printf("median %-5s %10.2f %10.2f %10.2f\n", "warm", bench_median(vWarm, &bench_sample::dWallMs),
+           bench_median(vWarm, &bench_sample::dTlsMs), bench_median(vWarm, &bench_sample::dCpuMs));
+
+    return 0;
+}
@@ -0,0 +1,300 @@
+/*
+ * clickatell_api.cpp
+ *
+ *  Clickatell API policies: credential validation and default headers. The per-operation
+ *  request builders are templates and live in clickatell_api.hpp.
+ *
+ *  A streamed REST send body is a sequence of pieces: the JSON framing, the text and, for
+ *  each destination, its opening quote (with the separating comma), number and closing
+ *  quote. Any piece can be found from its index alone, so reading and seeking keep no
+ *  more state than the current piece and the offset within it.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+
+#include "clickatell_string.hpp"
+#include "clickatell_api.hpp"
+
+/* ----------------------------------------------------------------------------- *
+ * Public function definitions                                                   *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickApiBase::ValidateApiString
+ * Info:      Validates a login credential passed to a client constructor.
+ *            Throws a std::string naming the credential if it is empty.
+ * Inputs:    eCred  - which credential sParam is
+ *            sParam - credential value
+ * Return:    sParam
+ */
+std::string_view ClickApiBase::ValidateApiString(eClickLoginCred eCred, std::string_view sParam)
+{
+    if (sParam.empty()) {
+        std::string sInfo("Invalid ");
+
+        switch (eCred) {
+            case CLICK_CRED_USER:
+                sInfo.append("user");
+                break;
+            case CLICK_CRED_PASS:
+                sInfo.append("password");
+                break;
+            case CLICK_CRED_APIKEY:
+                sInfo.append("API Key");
+                break;
+            case CLICK_CRED_APIID:
+                sInfo.append("API ID");
+                break;
+            default:
+                sInfo.append("constructor parameter");
+                break;
+        }
+
+        throw sInfo;
+    }
+
+    return sParam;
+}
+
+/*
+ * Function:  ClickApiBase::FormatUnixTime
+ * Info:      Formats a scheduled delivery time as Unix seconds, the format both APIs accept.
+ * Inputs:    tTime - delivery time
+ *            chBuf - output buffer of at least 24 characters
+ * Return:    number of characters written
+ */
+size_t ClickApiBase::FormatUnixTime(ClickWallTime tTime, char *chBuf)
+{
+    long long iSecs = std::chrono::duration_cast<std::chrono::seconds>(tTime.time_since_epoch()).count();
+    int iLen = snprintf(chBuf, 24, "%lld", iSecs);
+
+    return (iLen > 0 ? (size_t)iLen : 0);
+}
+
+/*
+ * Function:  HttpApi::Credentials
+ * Info:      Constructor. Validates the HTTP API credentials and URL-encodes them into the
+ *            query string prefix shared by every request.
+ * Inputs:    sUsername, sPassword - HTTP API login
+ *            sApiId_              - API ID
+ */
+HttpApi::Credentials::Credentials(std::string_view sUsername, std::string_view sPassword, std::string_view sApiId_)
+                                  : sApiId(ValidateApiString(CLICK_CRED_APIID, sApiId_)),
+                                    oUserCred(ValidateApiString(CLICK_CRED_USER, sUsername),
+                                              ValidateApiString(CLICK_CRED_PASS, sPassword))
+{
+    std::string sValue;
+
+    const ClickKeyVal vKeyVals[] = {{"?user=",     oUserCred.sUsername},
+                                    {"&password=", oUserCred.sPassword},
+                                    {"&api_id=",   sApiId}};
+
+    for (const ClickKeyVal &oKeyVal : vKeyVals) {
+        sValue.assign(oKeyVal.sVal);
+        clickstr::click_string_url_encode(sValue);
+
+        sAuthQuery.append(oKeyVal.sKey);
+        sAuthQuery.append(sValue);
+    }
+}
+
+/*
+ * Function:  HttpApi::Headers
+ * Info:      Creates the default headers of an HTTP API client. The caller owns the list.
+ * Return:    header list
+ */
+struct curl_slist *HttpApi::Headers(const Credentials &)
+{
+    // configure default headers - always ensure first slist append call has NULL headers arg
+    struct curl_slist *curlHeaders = curl_slist_append(NULL, "Connection:keep-alive");
+    curlHeaders = curl_slist_append(curlHeaders, "Cache-Control:max-age=0");
+    curlHeaders = curl_slist_append(curlHeaders, "Origin:null");
+
+    return curlHeaders;
+}
+
+/*
+ * Function:  RestApi::Credentials
+ * Info:      Constructor. Validates the REST API credentials.
+ * Inputs:    sApiKey_ - REST API key (auth token)
+ *            sApiId_  - API ID
+ */
+RestApi::Credentials::Credentials(std::string_view sApiKey_, std::string_view sApiId_)
+                                  : sApiId(ValidateApiString(CLICK_CRED_APIID, sApiId_)),
+                                    sApiKey(ValidateApiString(CLICK_CRED_APIKEY, sApiKey_))
+{
+}
+
+/*
+ * Function:  RestApi::Headers
+ * Info:      Creates the default headers of a REST API client, including the API key as the
+ *            authorization token. The caller owns the list.
+ * Return:    header list
+ */
+struct curl_slist *RestApi::Headers(const Credentials &oCred)
+{
+    // configure default headers - always ensure first slist append call has NULL headers arg
+    struct curl_slist *curlHeaders = curl_slist_append(NULL, "X-Version: 1");
+    curlHeaders = curl_slist_append(curlHeaders, "Content-Type: application/json");
+    curlHeaders = curl_slist_append(curlHeaders, "Accept: application/json");
+
+    // the REST API key will be used as the authorization token
+    std::string sToken("Authorization: Bearer ");
+    sToken.append(oCred.sApiKey);
+    curlHeaders = curl_slist_append(curlHeaders, sToken.c_str());
+
+    return curlHeaders;
+}
+
+/*
+ * Function:  ClickBodyStream::LocalPiece
+ * Info:      Returns one piece of the body. Pieces 0-2 open the object up to the destination
+ *            array, each destination takes three pieces, and the last five pieces close the
+ *            array, add the scheduled delivery time (empty if not scheduled) and close the
+ *            object.
+ * Inputs:    iIndex - piece index (below LocalPieces())
+ * Return:    piece
+ */
+std::string_view ClickBodyStream::LocalPiece(size_t iIndex) const
+{
+    size_t iDests = 3 * vMsisdns.size();
+
+    if (iIndex < 3) {
+        const std::string_view sHead[3] = {"{\"text\":\"", sText, "\",\"to\":["};
+        return sHead[iIndex];
+    }
+
+    if (iIndex - 3 < iDests) {
+        size_t iDest = (iIndex - 3) / 3;
+
+        switch ((iIndex - 3) % 3) {
+            case 0:
+                return (iDest == 0 ? "\"" : ",\"");
+            case 1:
+                return vMsisdns[iDest];
+            default:
+                return "\"";
+        }
+    }
+
+    switch (iIndex - 3 - iDests) {
+        case 0:
+            return "]";
+        case 1:
+            return (iTimeLen > 0 ? ",\"scheduledDeliveryTime\":\"" : "");
+        case 2:
+            return std::string_view(chTime, iTimeLen);
+        case 3:
+            return (iTimeLen > 0 ? "\"" : "");
+        default:
+            return "}";
+    }
+}
+
+/*
+ * Function:  ClickBodyStream
+ * Info:      Constructor. The stream is empty until Reset().
+ */
+ClickBodyStream::ClickBodyStream()
+                                 : iTimeLen(0),
+                                   iLength(0),
+                                   iPiece(0),
+                                   iOffset(0)
+{
+}
+
+/*
+ * Function:  ClickBodyStream::Reset
+ * Info:      Starts a new body and rewinds the read position. The body is the same JSON
+ *            that RestApi::Build() formats for a send. The body offset of every
+ *            iSeekStride-th destination is recorded for Seek().
+ * Inputs:    sText_     - message text
+ *            vMsisdns_  - destinations
+ *            tScheduled - gateway-side delivery time (epoch: at once)
+ * Return:    body length
+ */
+size_t ClickBodyStream::Reset(std::string_view sText_, std::span<const std::string_view> vMsisdns_, ClickWallTime tScheduled)
+{
+    sText = sText_;
+    vMsisdns = vMsisdns_;
+    iTimeLen = (tScheduled != ClickWallTime() ? ClickApiBase::FormatUnixTime(tScheduled, chTime) : 0);
+    iLength = 0;
+    vSeekMarks.clear();
+
+    for (size_t i = 0; i < LocalPieces(); i++) {
+        if (i >= 3 && i - 3 < 3 * vMsisdns.size() && (i - 3) % (3 * iSeekStride) == 0)
+            vSeekMarks.push_back(iLength);
+
+        iLength += LocalPiece(i).length();
+    }
+
+    iPiece = 0;
+    iOffset = 0;
+
+    return iLength;
+}
+
+/*
+ * Function:  ClickBodyStream::Read
+ * Info:      Copies the next part of the body into the caller's buffer.
+ * Inputs:    chBuf - output buffer
+ *            iMax  - size of chBuf
+ * Return:    bytes copied, 0 once the whole body has been read
+ */
+size_t ClickBodyStream::Read(char *chBuf, size_t iMax)
+{
+    size_t iCopied = 0;
+
+    while (iCopied < iMax && iPiece < LocalPieces()) {
+        std::string_view sPiece = LocalPiece(iPiece);
+        size_t iLen = std::min(sPiece.length() - iOffset, iMax - iCopied);
+
+        memcpy(chBuf + iCopied, sPiece.data() + iOffset, iLen);
+        iCopied += iLen;
+        iOffset += iLen;
+
+        if (iOffset == sPiece.length()) {
+            iPiece++;
+            iOffset = 0;
+        }
+    }
+
+    return iCopied;
+}
+
+/*
+ * Function:  ClickBodyStream::Seek
+ * Info:      Moves the read position, e.g. when cURL has to send the body again. The last
+ *            seek mark at or before iPos is found by binary search; the pieces from there on
+ *            (at most iSeekStride destinations) are then skipped one by one.
+ * Inputs:    iPos - offset from the start of the body
+ * Return:    true if the position was moved, false if iPos is past the end
+ */
+bool ClickBodyStream::Seek(size_t iPos)
+{
+    if (iPos > iLength)
+        return false;
+
+    iPiece = 0;
+    iOffset = 0;
+
+    std::vector<size_t>::const_iterator itMark = std::upper_bound(vSeekMarks.begin(), vSeekMarks.end(), iPos);
+
+    if (itMark != vSeekMarks.begin()) {
+        --itMark;
+        iPiece = 3 + 3 * iSeekStride * (size_t)(itMark - vSeekMarks.begin());
+        iPos -= *itMark;
+    }
+
+    while (iPiece < LocalPieces() && iPos >= LocalPiece(iPiece).length()) {
+        iPos -= LocalPiece(iPiece).length();
+        iPiece++;
+    }
+
+    iOffset = iPos;
+
+    return true;
+}
@@ -0,0 +1,311 @@
+#ifndef CLICKATELL_API_H
+#define CLICKATELL_API_H
+
+/*
+ * clickatell_api.hpp
+ *
+ *  Clickatell API types and compile-time API policies.
+ *
+ *  HttpApi and RestApi describe everything that differs between the two Clickatell APIs:
+ *  login credentials, resource paths, request methods, default headers and how a request is
+ *  laid out (URL-encoded query string versus JSON body). ClickatellClient<Api> takes one of
+ *  them as a template parameter, so the request-building path of a client is fixed at
+ *  compile time and carries no API-type branches.
+ */
+#include <chrono>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <curl/curl.h>
+
+#include "clickatell_arena.hpp"
+
+// enumeration designating Clickatell APIs supported in this class library
+enum eClickApi {
+    CLICK_API_HTTP,   // HTTP API using username+password to authenticate
+    CLICK_API_REST,   // REST API using api_key (an auth token) to authenticate
+    CLICK_API_COUNT
+}; // count of supported APIs
+
+// enum designating cURL request types
+enum eClickCurlRequestType{CLICK_CURL_GET,     // REST or HTTP
+                           CLICK_CURL_POST,    // REST or HTTP
+                           CLICK_CURL_DELETE}; // REST API only
+
+// enumeration designating possible login credentials
+enum eClickLoginCred {
+    CLICK_CRED_USER,   // API using username for Clickatell APIs such as HTTP
+    CLICK_CRED_PASS,   // API using password for Clickatell APIs such as HTTP
+    CLICK_CRED_APIKEY, // API token for the Clickatell REST API
+    CLICK_CRED_APIID   // API ID for a Clickatell API
+}; // count of supported APIs
+
+// enumeration designating Clickatell API operations
+enum eClickOperation {
+    CLICK_OP_SEND,     // send MT message(s)
+    CLICK_OP_STATUS,   // get message status
+    CLICK_OP_BALANCE,  // get user's credit balance
+    CLICK_OP_CHARGE,   // get message charge
+    CLICK_OP_COVERAGE, // get coverage
+    CLICK_OP_STOP,     // stop message
+    CLICK_OP_COUNT
+}; // count of supported operations
+
+// monotonic time point used for request deadlines
+typedef std::chrono::steady_clock::time_point ClickTimePoint;
+
+// wall-clock time point used for scheduled delivery
+typedef std::chrono::system_clock::time_point ClickWallTime;
+
+// deadline iMs milliseconds from now, e.g. the budget of an OTP send
+inline ClickTimePoint ClickDeadlineIn(long long iMs)
+{
+    return std::chrono::steady_clock::now() + std::chrono::milliseconds(iMs);
+}
+
+// per-call options for the API functions
+struct ClickCallOptions {
+    std::stop_token oStopToken; // aborts the transfer when stop is requested (blocking calls: checked before sending)
+    ClickTimePoint tDeadline;   // the call, connection set-up included, is abandoned at this time
+    ClickWallTime tScheduled;   // send only: the gateway delivers the message at this time (epoch: at once)
+
+    ClickCallOptions()
+                     : tDeadline(ClickTimePoint::max()) {}
+    explicit ClickCallOptions(ClickTimePoint tDeadline_)
+                              : tDeadline(tDeadline_) {}
+    ClickCallOptions(std::stop_token oStopToken_, ClickTimePoint tDeadline_ = ClickTimePoint::max(),
+                     ClickWallTime tScheduled_ = ClickWallTime())
+                     : oStopToken(oStopToken_),
+                       tDeadline(tDeadline_),
+                       tScheduled(tScheduled_) {}
+};
+
+// key/value pair container (views into caller data or the request arena)
+struct ClickKeyVal {
+    std::string_view sKey; // parameter key string
+    std::string_view sVal; // parameter value string
+};
+
+// username/password container
+struct ClickUserPass {
+    std::string sUsername; // user's Clickatell API username
+    std::string sPassword; // user's Clickatell API password
+
+    ClickUserPass(){ }
+    ClickUserPass(std::string_view sUsername_, std::string_view sPassword_)
+                  : sUsername(sUsername_),
+                    sPassword(sPassword_) { }
+};
+
+// parts shared by the API policies
+struct ClickApiBase {
+    static constexpr std::string_view sBaseUrl = "https://api.clickatell.com/";
+
+    // operations taking an argument (everything but balance) and operations taking destinations (send)
+    static constexpr bool HasArg(eClickOperation eOp) { return eOp != CLICK_OP_BALANCE; }
+    static constexpr bool HasMsisdns(eClickOperation eOp) { return eOp == CLICK_OP_SEND; }
+
+    // throws a std::string naming the credential if it is empty
+    static std::string_view ValidateApiString(eClickLoginCred eCred, std::string_view sParam);
+
+    // formats a scheduled delivery time as Unix seconds; returns the length (chBuf holds at least 24 chars)
+    static size_t FormatUnixTime(ClickWallTime tTime, char *chBuf);
+};
+
+/* HTTP API policy
+ * Every request is a GET carrying the credentials and the operation's parameter in a
+ * URL-encoded query string. The credentials are encoded once, when the client is created.
+ */
+struct HttpApi : ClickApiBase {
+    static constexpr eClickApi eType = CLICK_API_HTTP;
+    static constexpr bool bStreamSend = false; // sends are GET requests without a body
+
+    // username+password login credentials
+    struct Credentials {
+        std::string sApiId;      // user's Clickatell API ID
+        ClickUserPass oUserCred; // username+password
+        std::string sAuthQuery;  // "?user=..&password=..&api_id=.." (URL-encoded)
+
+        Credentials(std::string_view sUsername, std::string_view sPassword, std::string_view sApiId_);
+    };
+
+    static constexpr std::string_view sPaths[CLICK_OP_COUNT] = {"http/sendmsg.php", "http/querymsg.php",
+                                                                "http/getbalance.php", "http/getmsgcharge.php",
+                                                                "utils/routecoverage.php", "http/delmsg.php"};
+    static constexpr std::string_view sArgKeys[CLICK_OP_COUNT] = {"&text=", "&apimsgid=", "", "&apimsgid=",
+                                                                  "&msisdn=", "&apimsgid="};
+    static constexpr eClickCurlRequestType eMethods[CLICK_OP_COUNT] = {CLICK_CURL_GET, CLICK_CURL_GET, CLICK_CURL_GET,
+                                                                       CLICK_CURL_GET, CLICK_CURL_GET, CLICK_CURL_GET};
+
+    static struct curl_slist *Headers(const Credentials &oCred);
+
+    /* Builds the request for operation eOp in the arena (which the caller has reset).
+     * example URL:  https://api.clickatell.com/http/sendmsg.php?user=..&password=..&api_id=..&text=Hi&to=2799900001,2799900002
+     * A scheduled send adds &scheduled_time=<Unix seconds>.
+     */
+    template <eClickOperation eOp>
+    static void Build(ClickArena &oArena, const Credentials &oCred, std::string_view sArg,
+                      std::span<const std::string_view> vMsisdns, ClickWallTime tScheduled,
+                      std::string_view &sUrl, std::string_view &sPost)
+    {
+        oArena.StrBegin();
+        oArena.StrAppend(sBaseUrl);
+        oArena.StrAppend(sPaths[eOp]);
+        oArena.StrAppend(oCred.sAuthQuery);
+
+        if constexpr (HasArg(eOp)) {
+            oArena.StrAppend(sArgKeys[eOp]);
+            oArena.StrAppendUrlEncoded(sArg);
+        }
+
+        if constexpr (HasMsisdns(eOp)) {
+            oArena.StrAppend("&to=");
+
+            for (size_t i = 0; i < vMsisdns.size(); i++) {
+                if (i > 0)
+                    oArena.StrAppendChar(',');
+                oArena.StrAppend(vMsisdns[i]);
+            }
+
+            if (tScheduled != ClickWallTime()) {
+                char chTime[24];
+
+                oArena.StrAppend("&scheduled_time=");
+                oArena.StrAppend(std::string_view(chTime, FormatUnixTime(tScheduled, chTime)));
+            }
+        }
+
+        sUrl = oArena.StrEnd();
+        sPost = std::string_view();
+    }
+};
+
+/* Send body generated on demand (REST API)
+ * Produces the JSON body of a REST send piece by piece, straight from the caller's text and
+ * destinations, for cURL's read callback. The body never exists in memory as a whole, so a
+ * request costs about the same memory whatever the number of destinations (a seek table
+ * holds one offset per iSeekStride destinations); its length is computed up front so that
+ * it can be sent with a Content-Length header. The text and the
+ * destinations are viewed, not copied, and must stay valid until the transfer completes.
+ */
+class ClickBodyStream
+{
+private:
+    std::string_view sText;                     // message text
+    std::span<const std::string_view> vMsisdns; // destinations
+    char chTime[24];                            // scheduled delivery time (Unix seconds)
+    size_t iTimeLen;                            // length of chTime (0: not scheduled)
+    size_t iLength;                             // total body length
+    size_t iPiece;                              // piece being read
+    size_t iOffset;                             // bytes of that piece already read
+    std::vector<size_t> vSeekMarks;             // body offset of every iSeekStride-th destination
+
+    static constexpr size_t iSeekStride = 64;   // destinations between seek marks
+
+    size_t LocalPieces() const { return 3 * vMsisdns.size() + 8; }
+    std::string_view LocalPiece(size_t iIndex) const;
+
+public:
+    ClickBodyStream();
+
+    // starts a new body; returns its length
+    size_t Reset(std::string_view sText_, std::span<const std::string_view> vMsisdns_, ClickWallTime tScheduled);
+    // copies up to iMax bytes of the body from the read position; returns the count (0 at the end)
+    size_t Read(char *chBuf, size_t iMax);
+    // moves the read position; false if iPos is past the end
+    bool Seek(size_t iPos);
+
+    size_t Length() const { return iLength; }
+};
+
+/* REST API policy
+ * The operation's parameter is part of the resource path, except for a send, which posts
+ * "text" and "to" as JSON. The API key is sent as a bearer token in the default headers.
+ */
+struct RestApi : ClickApiBase {
+    static constexpr eClickApi eType = CLICK_API_REST;
+    static constexpr bool bStreamSend = true;  // a send body can be streamed (BuildStream())
+
+    // API key login credentials
+    struct Credentials {
+        std::string sApiId;      // user's Clickatell API ID
+        std::string sApiKey;     // REST API Key
+
+        Credentials(std::string_view sApiKey_, std::string_view sApiId_);
+    };
+
+    static constexpr std::string_view sPaths[CLICK_OP_COUNT] = {"rest/message", "rest/message/",
+                                                                "rest/account/balance", "rest/message/",
+                                                                "rest/coverage/", "rest/message/"};
+    static constexpr eClickCurlRequestType eMethods[CLICK_OP_COUNT] = {CLICK_CURL_POST, CLICK_CURL_GET, CLICK_CURL_GET,
+                                                                       CLICK_CURL_GET, CLICK_CURL_GET, CLICK_CURL_DELETE};
+
+    static struct curl_slist *Headers(const Credentials &oCred);
+
+    /* Builds the request for operation eOp in the arena (which the caller has reset).
+     * example URL:  https://api.clickatell.com/rest/message/47584bae0165fbec57b18bf47895fece
+     * example post data (send):  {"text":"Test Message","to":["2799900001","2799900002"]}
+     * A scheduled send adds "scheduledDeliveryTime":"<Unix seconds>".
+     */
+    template <eClickOperation eOp>
+    static void Build(ClickArena &oArena, const Credentials &, std::string_view sArg,
+                      std::span<const std::string_view> vMsisdns, ClickWallTime tScheduled,
+                      std::string_view &sUrl, std::string_view &sPost)
+    {
+        if constexpr (HasMsisdns(eOp)) {
+            sUrl = oArena.Concat({sBaseUrl, sPaths[eOp]});
+
+            oArena.StrBegin();
+            oArena.StrAppend("{\"text\":\"");
+            oArena.StrAppend(sArg);
+            oArena.StrAppend("\",\"to\":[");
+
+            for (size_t i = 0; i < vMsisdns.size(); i++) {
+                oArena.StrAppend(i == 0 ? "\"" : ",\"");
+                oArena.StrAppend(vMsisdns[i]);
+                oArena.StrAppendChar('"');
+            }
+
+            oArena.StrAppendChar(']');
+
+            if (tScheduled != ClickWallTime()) {
+                char chTime[24];
+
+                oArena.StrAppend(",\"scheduledDeliveryTime\":\"");
+                oArena.StrAppend(std::string_view(chTime, FormatUnixTime(tScheduled, chTime)));
+                oArena.StrAppendChar('"');
+            }
+
+            oArena.StrAppendChar('}');
+            sPost = oArena.StrEnd();
+        }
+        else if constexpr (HasArg(eOp)) {
+            sUrl = oArena.Concat({sBaseUrl, sPaths[eOp], sArg});
+            sPost = std::string_view();
+        }
+        else {
+            sUrl = oArena.Concat({sBaseUrl, sPaths[eOp]});
+            sPost = std::string_view();
+        }
+    }
+
+    /* Builds a send whose body is read from oBody (see ClickBodyStream) instead of being
+     * formatted in the arena; only the URL goes into the arena. Returns the body length.
+     */
+    template <eClickOperation eOp>
+    static size_t BuildStream(ClickArena &oArena, const Credentials &, std::string_view sArg,
+                              std::span<const std::string_view> vMsisdns, ClickWallTime tScheduled,
+                              std::string_view &sUrl, ClickBodyStream &oBody)
+    {
+        static_assert(HasMsisdns(eOp), "only sends carry a body");
+
+        sUrl = oArena.Concat({sBaseUrl, sPaths[eOp]});
+
+        return oBody.Reset(sArg, vMsisdns, tScheduled);
+    }
+};
+
+#endif // CLICKATELL_API_H
@@ -0,0 +1,253 @@
+/*
+ * clickatell_arena.cpp
+ *
+ *  Per-request bump arena used by the Clickatell SMS library.
+ *
+ *  Memory is handed out from a chain of blocks. When a block runs out a larger one is
+ *  chained in front of it; earlier blocks stay alive so that views handed out earlier in
+ *  the same request remain valid. Reset() coalesces the chain into a single block big
+ *  enough for everything the last request needed, so the steady state is one block and
+ *  zero allocations.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "clickatell_string.hpp"
+#include "clickatell_arena.hpp"
+
+/* ----------------------------------------------------------------------------- *
+ * Private function definitions                                                  *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickArena::BlockCreate
+ * Info:      Allocates a new arena block with iSize bytes of data area.
+ * Inputs:    iSize - size of data area
+ *            pPrev - block to chain behind the new block (may be NULL)
+ * Return:    New block. Throws a std::string if the allocation failed.
+ */
+ClickArena::ClickArenaBlock *ClickArena::BlockCreate(size_t iSize, ClickArenaBlock *pPrev)
+{
+    ClickArenaBlock *pBlock = (ClickArenaBlock *)malloc(sizeof(ClickArenaBlock) + iSize);
+
+    if (pBlock == NULL)
+        throw (std::string("ClickArena block allocation failed!"));
+
+    pBlock->pPrev = pPrev;
+    pBlock->iSize = iSize;
+    pBlock->iUsed = 0;
+
+    return pBlock;
+}
+
+/*
+ * Function:  ClickArena::LocalReserve
+ * Info:      Ensures iLen bytes are free at the top of the current block. If a string is
+ *            under construction, it is moved along to the new block so it stays contiguous.
+ * Inputs:    iLen - number of bytes required
+ * Return:    void
+ */
+void ClickArena::LocalReserve(size_t iLen)
+{
+    if (pHead->iUsed + iLen <= pHead->iSize)
+        return;
+
+    size_t iPending = (bStrOpen ? pHead->iUsed - iStrStart : 0);
+    size_t iSize = pHead->iSize * 2;
+
+    while (iSize < iPending + iLen)
+        iSize *= 2;
+
+    ClickArenaBlock *pBlock = BlockCreate(iSize, pHead);
+
+    if (iPending > 0) {
+        memcpy(BlockData(pBlock), BlockData(pHead) + iStrStart, iPending);
+        pHead->iUsed = iStrStart; // the partial string is now owned by the new block
+    }
+
+    pBlock->iUsed = iPending;
+    iStrStart = 0;
+    pHead = pBlock;
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Public function definitions                                                   *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickArena
+ * Info:      Constructor. Allocates the first arena block.
+ * Inputs:    iInitialSize - size of first block in bytes
+ */
+ClickArena::ClickArena(size_t iInitialSize)
+                       : pHead(BlockCreate((iInitialSize > 0 ? iInitialSize : CLICK_ARENA_DEFAULT_SIZE), NULL)),
+                         iStrStart(0),
+                         bStrOpen(false)
+{}
+
+/*
+ * Function:  ~ClickArena
+ * Info:      Destructor. Frees all arena blocks.
+ */
+ClickArena::~ClickArena()
+{
+    while (pHead != NULL) {
+        ClickArenaBlock *pPrev = pHead->pPrev;
+        free(pHead);
+        pHead = pPrev;
+    }
+}
+
+/*
+ * Function:  ClickArena::Reset
+ * Info:      Releases everything handed out since the last reset. Views obtained from the
+ *            arena are invalid after this call. If the previous request overflowed into
+ *            more than one block, the chain is replaced by one block large enough to hold
+ *            all of it, so the next request of the same size does not allocate.
+ * Return:    void
+ */
+void ClickArena::Reset()
+{
+    bStrOpen = false;
+    iStrStart = 0;
+
+    if (pHead->pPrev != NULL) {
+        size_t iTotal = 0;
+
+        while (pHead != NULL) {
+            ClickArenaBlock *pPrev = pHead->pPrev;
+            iTotal += pHead->iSize;
+            free(pHead);
+            pHead = pPrev;
+        }
+
+        pHead = BlockCreate(iTotal, NULL);
+    }
+
+    pHead->iUsed = 0;
+}
+
+/*
+ * Function:  ClickArena::Alloc
+ * Info:      Allocates iLen bytes from the arena. Must not be called while a string is
+ *            under construction.
+ * Inputs:    iLen   - number of bytes
+ *            iAlign - required alignment (power of two)
+ * Return:    Pointer to uninitialized memory, valid until Reset()
+ */
+void *ClickArena::Alloc(size_t iLen, size_t iAlign)
+{
+    size_t iPad = (iAlign - ((size_t)(BlockData(pHead) + pHead->iUsed) & (iAlign - 1))) & (iAlign - 1);
+
+    if (pHead->iUsed + iPad + iLen > pHead->iSize) {
+        LocalReserve(iLen + iAlign);
+        iPad = (iAlign - ((size_t)(BlockData(pHead) + pHead->iUsed) & (iAlign - 1))) & (iAlign - 1);
+    }
+
+    void *pData = BlockData(pHead) + pHead->iUsed + iPad;
+    pHead->iUsed += iPad + iLen;
+
+    return pData;
+}
+
+/*
+ * Function:  ClickArena::Capacity
+ * Info:      Total number of bytes the arena can hold without allocating.
+ * Return:    Capacity in bytes
+ */
+size_t ClickArena::Capacity() const
+{
+    size_t iTotal = 0;
+
+    for (ClickArenaBlock *pBlock = pHead; pBlock != NULL; pBlock = pBlock->pPrev)
+        iTotal += pBlock->iSize;
+
+    return iTotal;
+}
+
+/*
+ * Function:  ClickArena::StrBegin
+ * Info:      Starts building a string at the top of the arena.
+ * Return:    void
+ */
+void ClickArena::StrBegin()
+{
+    bStrOpen = true;
+    iStrStart = pHead->iUsed;
+}
+
+/*
+ * Function:  ClickArena::StrAppend
+ * Info:      Appends data to the string under construction.
+ * Inputs:    sData - data to append
+ * Return:    void
+ */
+void ClickArena::StrAppend(std::string_view sData)
+{
+    LocalReserve(sData.length());
+    memcpy(BlockData(pHead) + pHead->iUsed, sData.data(), sData.length());
+    pHead->iUsed += sData.length();
+}
+
+/*
+ * Function:  ClickArena::StrAppendChar
+ * Info:      Appends a single character to the string under construction.
+ * Inputs:    ch - character to append
+ * Return:    void
+ */
+void ClickArena::StrAppendChar(char ch)
+{
+    LocalReserve(1);
+    BlockData(pHead)[pHead->iUsed++] = ch;
+}
+
+/*
+ * Function:  ClickArena::StrAppendUrlEncoded
+ * Info:      URL-encodes data and appends it to the string under construction. The
+ *            encoding matches clickstr::click_string_url_encode().
+ * Inputs:    sData - data to URL-encode
+ * Return:    void
+ */
+void ClickArena::StrAppendUrlEncoded(std::string_view sData)
+{
+    // worst case every character expands to 3 characters
+    LocalReserve(sData.length() * 3);
+
+    char *chDest = BlockData(pHead) + pHead->iUsed;
+
+    for (size_t i = 0; i < sData.length(); i++)
+        chDest += clickstr::click_string_url_encode_char(sData[i], chDest);
+
+    pHead->iUsed = chDest - BlockData(pHead);
+}
+
+/*
+ * Function:  ClickArena::StrEnd
+ * Info:      Finishes the string under construction and NUL-terminates it.
+ * Return:    View of the finished string (terminating NUL excluded)
+ */
+std::string_view ClickArena::StrEnd()
+{
+    StrAppendChar('\0');
+    bStrOpen = false;
+
+    return std::string_view(BlockData(pHead) + iStrStart, pHead->iUsed - iStrStart - 1);
+}
+
+/*
+ * Function:  ClickArena::Concat
+ * Info:      Concatenates a list of strings into a new arena string.
+ * Inputs:    lParts - strings to concatenate
+ * Return:    NUL-terminated view, valid until Reset()
+ */
+std::string_view ClickArena::Concat(std::initializer_list<std::string_view> lParts)
+{
+    StrBegin();
+
+    for (std::string_view sPart : lParts)
+        StrAppend(sPart);
+
+    return StrEnd();
+}
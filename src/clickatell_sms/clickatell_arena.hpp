@@ -0,0 +1,64 @@
+#ifndef CLICKATELL_ARENA_H
+#define CLICKATELL_ARENA_H
+
+/*
+ * clickatell_arena.hpp
+ *
+ *  Per-request bump arena used by the Clickatell SMS library.
+ *
+ *  All temporary data needed to build a request (URL, post data, key/value views,
+ *  URL-encoded values) is carved out of the arena. The arena is reset at the start of
+ *  each request instead of being freed, so once it has grown to the size of the largest
+ *  request seen, building further requests performs no heap allocations.
+ */
+#include <cstddef>
+#include <initializer_list>
+#include <string_view>
+
+// default size of the first arena block
+#define CLICK_ARENA_DEFAULT_SIZE  4096
+
+class ClickArena
+{
+private:
+    // arena memory block header, block data directly follows this header
+    struct ClickArenaBlock {
+        ClickArenaBlock *pPrev; // previously filled block (kept alive until Reset)
+        size_t iSize;           // size of data area in bytes
+        size_t iUsed;           // bytes handed out from data area
+    };
+
+    ClickArenaBlock *pHead; // block currently being allocated from
+    size_t iStrStart;       // offset in pHead of string under construction
+    bool bStrOpen;          // true between StrBegin() and StrEnd()
+
+    static ClickArenaBlock *BlockCreate(size_t iSize, ClickArenaBlock *pPrev);
+    static char *BlockData(ClickArenaBlock *pBlock) { return (char *)(pBlock + 1); }
+    void LocalReserve(size_t iLen);
+
+public:
+    ClickArena(size_t iInitialSize = CLICK_ARENA_DEFAULT_SIZE);
+    ~ClickArena();
+
+    ClickArena(const ClickArena &) = delete;
+    ClickArena &operator=(const ClickArena &) = delete;
+
+    void Reset();
+    void *Alloc(size_t iLen, size_t iAlign = alignof(std::max_align_t));
+    size_t Capacity() const;
+
+    // typed array allocation (the arena never runs destructors, so T must be trivially destructible)
+    template <typename T>
+    T *AllocArray(size_t iCount) { return static_cast<T *>(Alloc(iCount * sizeof(T), alignof(T))); }
+
+    // incremental string building; the returned view is NUL-terminated and valid until Reset()
+    void StrBegin();
+    void StrAppend(std::string_view sData);
+    void StrAppendChar(char ch);
+    void StrAppendUrlEncoded(std::string_view sData);
+    std::string_view StrEnd();
+
+    std::string_view Concat(std::initializer_list<std::string_view> lParts);
+};
+
+#endif // CLICKATELL_ARENA_H
@@ -0,0 +1,311 @@
+/*
+ * clickatell_breaker.cpp
+ *
+ *  Circuit breaker and endpoint health tracking for the Clickatell SMS library.
+ *
+ *  The rolling window is a ring of fixed-length buckets. A bucket is reused once its slice
+ *  of time has left the window, so recording an outcome is O(1) and the window never
+ *  allocates after construction.
+ */
+
+#include <algorithm>
+#include <string>
+
+#include "clickatell_breaker.hpp"
+
+/* ----------------------------------------------------------------------------- *
+ * Private function definitions                                                  *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickCircuitBreaker::LocalEpoch
+ * Info:      Returns the bucket slice number of a point in time.
+ */
+int64_t ClickCircuitBreaker::LocalEpoch(ClickTimePoint tNow) const
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(tNow.time_since_epoch()).count() / tBucketLen.count();
+}
+
+/*
+ * Function:  ClickCircuitBreaker::LocalAdvance
+ * Info:      Moves an open breaker to half-open once its open period has passed
+ *            (called with mtxState held).
+ * Return:    void
+ */
+void ClickCircuitBreaker::LocalAdvance(ClickTimePoint tNow)
+{
+    if (eState == CLICK_BREAKER_OPEN && tNow >= tOpenUntil) {
+        eState = CLICK_BREAKER_HALF_OPEN;
+        iProbesIssued = 0;
+        iProbesPassed = 0;
+    }
+}
+
+/*
+ * Function:  ClickCircuitBreaker::LocalOpen
+ * Info:      Opens the breaker (called with mtxState held).
+ * Return:    void
+ */
+void ClickCircuitBreaker::LocalOpen(ClickTimePoint tNow)
+{
+    eState = CLICK_BREAKER_OPEN;
+    tOpenUntil = tNow + std::chrono::milliseconds(oOptions.iOpenMs);
+    iOpened++;
+}
+
+/*
+ * Function:  ClickCircuitBreaker::LocalClose
+ * Info:      Closes the breaker and forgets the window that opened it (called with
+ *            mtxState held).
+ * Return:    void
+ */
+void ClickCircuitBreaker::LocalClose()
+{
+    eState = CLICK_BREAKER_CLOSED;
+
+    for (ClickBreakerBucket &oBucket : vBuckets)
+        oBucket.iEpoch = -1;
+}
+
+/*
+ * Function:  ClickCircuitBreaker::LocalTotals
+ * Info:      Sums the buckets still inside the window (called with mtxState held).
+ * Outputs:   oHealth - request, failure, slow and latency fields
+ * Return:    void
+ */
+void ClickCircuitBreaker::LocalTotals(ClickTimePoint tNow, ClickBreakerHealth &oHealth) const
+{
+    int64_t iOldest = LocalEpoch(tNow) - (int64_t)vBuckets.size() + 1;
+    uint64_t iLatencyUs = 0;
+
+    oHealth.iRequests = oHealth.iFailures = oHealth.iSlow = oHealth.iMaxLatencyUs = 0;
+
+    for (const ClickBreakerBucket &oBucket : vBuckets) {
+        if (oBucket.iEpoch < iOldest)
+            continue;
+
+        oHealth.iRequests += oBucket.iRequests;
+        oHealth.iFailures += oBucket.iFailures;
+        oHealth.iSlow += oBucket.iSlow;
+        iLatencyUs += oBucket.iLatencyUs;
+        oHealth.iMaxLatencyUs = std::max(oHealth.iMaxLatencyUs, oBucket.iMaxLatencyUs);
+    }
+
+    oHealth.dFailureRate = (oHealth.iRequests ? (double)oHealth.iFailures / oHealth.iRequests : 0);
+    oHealth.dSlowRate = (oHealth.iRequests ? (double)oHealth.iSlow / oHealth.iRequests : 0);
+    oHealth.iMeanLatencyUs = (oHealth.iRequests ? iLatencyUs / oHealth.iRequests : 0);
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Public function definitions                                                   *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickCircuitBreaker
+ * Info:      Constructor. Starts closed with an empty window.
+ * Inputs:    oOptions_ - thresholds
+ */
+ClickCircuitBreaker::ClickCircuitBreaker(const ClickBreakerOptions &oOptions_)
+                                         : oOptions(oOptions_),
+                                           eState(CLICK_BREAKER_CLOSED),
+                                           iProbesIssued(0),
+                                           iProbesPassed(0),
+                                           iRejected(0),
+                                           iOpened(0),
+                                           fnFallback(NULL),
+                                           pFallbackData(NULL)
+{
+    if (oOptions.iBuckets == 0)
+        oOptions.iBuckets = 1;
+    if (oOptions.iWindowMs < oOptions.iBuckets)
+        oOptions.iWindowMs = oOptions.iBuckets;
+    if (oOptions.iProbes == 0)
+        oOptions.iProbes = 1;
+
+    tBucketLen = std::chrono::milliseconds(oOptions.iWindowMs / oOptions.iBuckets);
+    vBuckets.assign(oOptions.iBuckets, ClickBreakerBucket{-1, 0, 0, 0, 0, 0});
+}
+
+/*
+ * Function:  ClickCircuitBreaker::Allow
+ * Info:      Decides whether a request may be sent. Every admitted request must be reported
+ *            with Record(), including requests that end up not being sent.
+ * Return:    admission decision
+ */
+eClickBreakerPermit ClickCircuitBreaker::Allow()
+{
+    std::lock_guard<std::mutex> oLock(mtxState);
+
+    LocalAdvance(std::chrono::steady_clock::now());
+
+    switch (eState) {
+        case CLICK_BREAKER_CLOSED:
+            return CLICK_PERMIT_NORMAL;
+
+        case CLICK_BREAKER_HALF_OPEN:
+            if (iProbesIssued < oOptions.iProbes) {
+                iProbesIssued++;
+                return CLICK_PERMIT_PROBE;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    iRejected++;
+
+    return CLICK_PERMIT_DENIED;
+}
+
+/*
+ * Function:  ClickCircuitBreaker::Record
+ * Info:      Reports the outcome of a request admitted by Allow(). A failed trial request
+ *            reopens the breaker; once every trial request has succeeded it closes.
+ * Inputs:    ePermit  - value returned by Allow() for this request
+ *            eOutcome - outcome of the request
+ *            tLatency - time from sending the request to its completion
+ * Return:    void
+ */
+void ClickCircuitBreaker::Record(eClickBreakerPermit ePermit, eClickBreakerOutcome eOutcome, std::chrono::microseconds tLatency)
+{
+    if (ePermit == CLICK_PERMIT_DENIED)
+        return;
+
+    std::lock_guard<std::mutex> oLock(mtxState);
+    ClickTimePoint tNow = std::chrono::steady_clock::now();
+
+    LocalAdvance(tNow);
+
+    if (ePermit == CLICK_PERMIT_PROBE) {
+        // trial requests decide the half-open state on their own
+        if (eState != CLICK_BREAKER_HALF_OPEN)
+            return;
+
+        if (eOutcome == CLICK_OUTCOME_IGNORED)
+            iProbesIssued--;
+        else if (eOutcome == CLICK_OUTCOME_FAILURE || tLatency >= std::chrono::milliseconds(oOptions.iSlowCallMs))
+            LocalOpen(tNow);
+        else if (++iProbesPassed >= oOptions.iProbes)
+            LocalClose();
+
+        return;
+    }
+
+    if (eOutcome == CLICK_OUTCOME_IGNORED)
+        return;
+
+    int64_t iEpoch = LocalEpoch(tNow);
+    ClickBreakerBucket &oBucket = vBuckets[(size_t)(iEpoch % (int64_t)vBuckets.size())];
+    uint64_t iLatencyUs = (uint64_t)std::max<int64_t>(tLatency.count(), 0);
+
+    if (oBucket.iEpoch != iEpoch)
+        oBucket = ClickBreakerBucket{iEpoch, 0, 0, 0, 0, 0};
+
+    oBucket.iRequests++;
+    oBucket.iFailures += (eOutcome == CLICK_OUTCOME_FAILURE);
+    oBucket.iSlow += (tLatency >= std::chrono::milliseconds(oOptions.iSlowCallMs));
+    oBucket.iLatencyUs += iLatencyUs;
+    oBucket.iMaxLatencyUs = std::max(oBucket.iMaxLatencyUs, iLatencyUs);
+
+    // only closed-state traffic can open the breaker; stragglers admitted before it opened are just counted
+    if (eState != CLICK_BREAKER_CLOSED)
+        return;
+
+    ClickBreakerHealth oHealth;
+    LocalTotals(tNow, oHealth);
+
+    if (oHealth.iRequests >= oOptions.iMinRequests &&
+        (oHealth.dFailureRate >= oOptions.dFailureRate ||
+         (oOptions.dSlowRate > 0 && oHealth.dSlowRate >= oOptions.dSlowRate)))
+        LocalOpen(tNow);
+}
+
+/*
+ * Function:  ClickCircuitBreaker::Fallback
+ * Info:      Hands a request that was failed fast to the fallback, if one is set.
+ * Return:    void
+ */
+void ClickCircuitBreaker::Fallback(eClickOperation eOp, std::string_view sArg, std::span<const std::string_view> vMsisdns)
+{
+    ClickBreakerFallbackFn fnCall = NULL;
+    void *pData = NULL;
+
+    {
+        std::lock_guard<std::mutex> oLock(mtxState);
+        fnCall = fnFallback;
+        pData = pFallbackData;
+    }
+
+    if (fnCall != NULL)
+        fnCall(pData, eOp, sArg, vMsisdns);
+}
+
+/*
+ * Function:  ClickCircuitBreaker::SetFallback
+ * Info:      Sets the function called for requests failed fast (NULL to clear).
+ * Return:    void
+ */
+void ClickCircuitBreaker::SetFallback(ClickBreakerFallbackFn fnFallback_, void *pUserData)
+{
+    std::lock_guard<std::mutex> oLock(mtxState);
+
+    fnFallback = fnFallback_;
+    pFallbackData = pUserData;
+}
+
+/*
+ * Function:  ClickCircuitBreaker::Reset
+ * Info:      Forces the breaker closed and clears the window.
+ * Return:    void
+ */
+void ClickCircuitBreaker::Reset()
+{
+    std::lock_guard<std::mutex> oLock(mtxState);
+
+    LocalClose();
+}
+
+/*
+ * Function:  ClickCircuitBreaker::State
+ * Info:      Returns the current state.
+ */
+eClickBreakerState ClickCircuitBreaker::State()
+{
+    std::lock_guard<std::mutex> oLock(mtxState);
+
+    LocalAdvance(std::chrono::steady_clock::now());
+
+    return eState;
+}
+
+/*
+ * Function:  ClickCircuitBreaker::Health
+ * Info:      Returns a health snapshot of the endpoint over the rolling window.
+ */
+ClickBreakerHealth ClickCircuitBreaker::Health()
+{
+    std::lock_guard<std::mutex> oLock(mtxState);
+    ClickTimePoint tNow = std::chrono::steady_clock::now();
+    ClickBreakerHealth oHealth;
+
+    LocalAdvance(tNow);
+    LocalTotals(tNow, oHealth);
+
+    oHealth.eState = eState;
+    oHealth.iRejected = iRejected;
+    oHealth.iOpened = iOpened;
+
+    return oHealth;
+}
+
+/*
+ * Function:  StateName
+ * Info:      Returns a printable name for a breaker state.
+ */
+const char *ClickCircuitBreaker::StateName(eClickBreakerState eState)
+{
+    static const char *chNames[CLICK_BREAKER_COUNT] = {"closed", "open", "half-open"};
+
+    return (eState >= CLICK_BREAKER_CLOSED && eState < CLICK_BREAKER_COUNT ? chNames[eState] : "unknown");
+}
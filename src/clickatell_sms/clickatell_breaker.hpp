@@ -0,0 +1,143 @@
+#ifndef CLICKATELL_BREAKER_H
+#define CLICKATELL_BREAKER_H
+
+/*
+ * clickatell_breaker.hpp
+ *
+ *  Circuit breaker and endpoint health tracking for the Clickatell SMS library.
+ *
+ *  One ClickCircuitBreaker tracks one gateway endpoint and is shared by every ClickatellSms
+ *  instance that talks to it (ClickatellSms::SetCircuitBreaker()). It keeps a rolling window
+ *  of request outcomes and latencies; once the error rate or slow-call rate crosses its
+ *  threshold the breaker opens and requests fail fast instead of waiting out the transfer
+ *  timeout. After a cool-down it lets a few trial requests through (half-open) and closes
+ *  again if they succeed.
+ */
+#include <stdint.h>
+#include <chrono>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "clickatell_debug.hpp"
+#include "clickatell_api.hpp"
+
+// breaker state
+enum eClickBreakerState {
+    CLICK_BREAKER_CLOSED,     // requests flow normally
+    CLICK_BREAKER_OPEN,       // requests fail fast
+    CLICK_BREAKER_HALF_OPEN,  // a limited number of trial requests are let through
+    CLICK_BREAKER_COUNT
+};
+
+// admission decision returned by Allow()
+enum eClickBreakerPermit : int {
+    CLICK_PERMIT_DENIED,  // fail fast
+    CLICK_PERMIT_NORMAL,  // closed-state request
+    CLICK_PERMIT_PROBE    // half-open trial request
+};
+
+// outcome of an admitted request
+enum eClickBreakerOutcome {
+    CLICK_OUTCOME_SUCCESS,  // the endpoint answered
+    CLICK_OUTCOME_FAILURE,  // transport error or server error (5xx)
+    CLICK_OUTCOME_IGNORED   // not attributable to the endpoint (cancelled, never sent)
+};
+
+// called for requests rejected while the breaker is open, e.g. to divert sends to a durable queue
+typedef void (*ClickBreakerFallbackFn)(void *pUserData, eClickOperation eOp, std::string_view sArg,
+                                       std::span<const std::string_view> vMsisdns);
+
+// breaker thresholds
+struct ClickBreakerOptions {
+    unsigned int iWindowMs;       // length of the rolling window
+    unsigned int iBuckets;        // number of buckets the window is divided into
+    unsigned int iMinRequests;    // requests in the window before the rates are evaluated
+    double dFailureRate;          // failure rate that opens the breaker (0..1)
+    unsigned int iSlowCallMs;     // requests slower than this count as slow
+    double dSlowRate;             // slow-call rate that opens the breaker (0: disabled)
+    unsigned int iOpenMs;         // time spent open before trial requests are allowed
+    unsigned int iProbes;         // trial requests in half-open state; all must succeed to close
+
+    ClickBreakerOptions()
+                        : iWindowMs(10000),
+                          iBuckets(10),
+                          iMinRequests(20),
+                          dFailureRate(0.5),
+                          iSlowCallMs(3000),
+                          dSlowRate(0.8),
+                          iOpenMs(5000),
+                          iProbes(3) {}
+};
+
+// health snapshot over the rolling window
+struct ClickBreakerHealth {
+    eClickBreakerState eState;  // current state
+    uint64_t iRequests;         // completed requests in the window
+    uint64_t iFailures;         // failed requests in the window
+    uint64_t iSlow;             // slow requests in the window
+    double dFailureRate;        // iFailures / iRequests
+    double dSlowRate;           // iSlow / iRequests
+    uint64_t iMeanLatencyUs;    // mean latency in the window
+    uint64_t iMaxLatencyUs;     // max latency in the window
+    uint64_t iRejected;         // requests failed fast since construction
+    uint64_t iOpened;           // number of times the breaker has opened
+};
+
+class ClickCircuitBreaker
+{
+private:
+    // one slice of the rolling window
+    struct ClickBreakerBucket {
+        int64_t iEpoch;           // slice number (time / bucket length), -1 if unused
+        uint32_t iRequests;
+        uint32_t iFailures;
+        uint32_t iSlow;
+        uint64_t iLatencyUs;      // sum
+        uint64_t iMaxLatencyUs;
+    };
+
+    ClickBreakerOptions oOptions;
+    std::chrono::milliseconds tBucketLen;
+
+    std::mutex mtxState;                      // guards everything below
+    std::vector<ClickBreakerBucket> vBuckets;
+    eClickBreakerState eState;
+    ClickTimePoint tOpenUntil;                // end of the open period
+    unsigned int iProbesIssued;               // half-open trial requests admitted
+    unsigned int iProbesPassed;               // half-open trial requests succeeded
+    uint64_t iRejected;
+    uint64_t iOpened;
+
+    ClickBreakerFallbackFn fnFallback;
+    void *pFallbackData;
+
+    int64_t LocalEpoch(ClickTimePoint tNow) const;
+    void LocalAdvance(ClickTimePoint tNow);
+    void LocalOpen(ClickTimePoint tNow);
+    void LocalClose();
+    void LocalTotals(ClickTimePoint tNow, ClickBreakerHealth &oHealth) const;
+
+public:
+    ClickCircuitBreaker(const ClickBreakerOptions &oOptions_ = ClickBreakerOptions());
+
+    ClickCircuitBreaker(const ClickCircuitBreaker &) = delete;
+    ClickCircuitBreaker &operator=(const ClickCircuitBreaker &) = delete;
+
+    // request admission and outcome reporting (used by ClickatellSms)
+    eClickBreakerPermit Allow();
+    void Record(eClickBreakerPermit ePermit, eClickBreakerOutcome eOutcome, std::chrono::microseconds tLatency);
+    void Fallback(eClickOperation eOp, std::string_view sArg, std::span<const std::string_view> vMsisdns);
+
+    void SetFallback(ClickBreakerFallbackFn fnFallback_, void *pUserData);
+    void Reset();
+
+    // health signal
+    eClickBreakerState State();
+    ClickBreakerHealth Health();
+
+    static const char *StateName(eClickBreakerState eState);
+};
+
+#endif // CLICKATELL_BREAKER_H
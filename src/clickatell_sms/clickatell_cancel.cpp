@@ -0,0 +1,191 @@
+/*
+ * clickatell_cancel.cpp
+ *
+ *  Bulk stop of messages already accepted by the gateway, for the Clickatell SMS library.
+ *
+ *  Run() drives its own ClickLoop on the calling thread, like the send engine's thread:
+ *  each round frees the instances whose stop finished, starts the next pending IDs on free
+ *  instances as the rate allows, and waits in ClickLoop::RunOnce() until a transfer
+ *  finishes or the next start is due. Starts are spaced 1/dRatePerSec apart; a retry goes
+ *  to the back of the pending list and waits for its turn like any other ID.
+ */
+
+#include <algorithm>
+#include <string>
+
+#include "clickatell_cancel.hpp"
+
+/* ----------------------------------------------------------------------------- *
+ * Types/Macros                                                                  *
+ * ----------------------------------------------------------------------------- */
+
+#define CLICK_STOP_MAX_WAIT_MS  1000  // longest Run() waits without re-checking the deadline
+
+/* ----------------------------------------------------------------------------- *
+ * Private function definitions                                                  *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickBulkStop::LocalReport
+ * Info:      Reports the outcome of one message and counts it.
+ * Return:    void
+ */
+void ClickBulkStop::LocalReport(size_t iIndex, eClickResult eResult, CURLcode curlCode, long iHttpStatus,
+                                std::string_view sResponse)
+{
+    if (eResult == CLICK_RESULT_OK)
+        oStats.iStopped++;
+    else if (eResult == CLICK_RESULT_UNAVAILABLE)
+        oStats.iNotSent++;
+    else
+        oStats.iFailed++;
+
+    if (fnDone != NULL)
+        fnDone(pUserData, ClickStopOutcome{iIndex, vMsgIds[iIndex], eResult, curlCode, iHttpStatus, sResponse, vAttempts[iIndex]});
+}
+
+/*
+ * Function:  ClickBulkStop::LocalStop
+ * Info:      Coroutine sending the stop request of the ID held by a slot. Transport
+ *            failures and throttling go back to the pending list while attempts remain. A
+ *            request aborted because stop was requested, or that found the deadline passed
+ *            before it was sent, counts as not sent, not as failed.
+ * Inputs:    oSlot - pool slot
+ * Return:    task (started by Run())
+ */
+ClickTask<void> ClickBulkStop::LocalStop(ClickStopSlot &oSlot)
+{
+    size_t iIndex = oSlot.iIndex;
+
+    vAttempts[iIndex]++;
+    oStats.iRequests++;
+
+    const std::string &sResponse = co_await oSlot.pSms->SmsMessageStopAsync(oLoop, vMsgIds[iIndex],
+                                                                            ClickCallOptions(oStopToken, oOptions.tDeadline));
+    CURLcode curlCode = oSlot.pSms->GetCurlCode();
+    long iHttpStatus = oSlot.pSms->GetHttpStatus();
+    eClickResult eResult = ClickShardedClient::Classify(oSlot.pSms->GetApiType(), curlCode, iHttpStatus, sResponse);
+
+    if (oSlot.pSms->GetNotSent() || (curlCode == CURLE_ABORTED_BY_CALLBACK && oStopToken.stop_requested()))
+        eResult = CLICK_RESULT_UNAVAILABLE;
+
+    if ((eResult == CLICK_RESULT_TRANSPORT || eResult == CLICK_RESULT_THROTTLED) && vAttempts[iIndex] < oOptions.iMaxAttempts &&
+        !oStopToken.stop_requested() && std::chrono::steady_clock::now() < oOptions.tDeadline) {
+        dqPending.push_back(iIndex);
+        co_return;
+    }
+
+    LocalReport(iIndex, eResult, curlCode, iHttpStatus, sResponse);
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Public function definitions                                                   *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickBulkStop
+ * Info:      Constructor. Takes ownership of the pool instances; the pool size is the
+ *            number of concurrent stop requests. Throws a std::string if it is empty.
+ * Inputs:    vClients  - pool
+ *            oOptions_ - rate, attempts and deadline
+ */
+ClickBulkStop::ClickBulkStop(std::vector<std::unique_ptr<ClickatellSms>> vClients, const ClickBulkStopOptions &oOptions_)
+                             : oOptions(oOptions_),
+                               vSlots(vClients.size()),
+                               fnDone(NULL),
+                               pUserData(NULL),
+                               oStats()
+{
+    if (vClients.empty())
+        throw (std::string("ClickBulkStop needs at least one ClickatellSms instance!"));
+
+    oOptions.iMaxAttempts = std::max(1u, oOptions.iMaxAttempts);
+
+    for (size_t i = 0; i < vClients.size(); i++)
+        vSlots[i].pSms = std::move(vClients[i]);
+}
+
+/*
+ * Function:  ClickBulkStop::Run
+ * Info:      Stops a list of messages at the gateway. Blocks until every ID has an
+ *            outcome; fnDone_ is called on this thread.
+ * Inputs:    vMsgIds_   - gateway message IDs (must stay valid during the call)
+ *            fnDone_    - outcome function (may be NULL)
+ *            pUserData_ - passed to fnDone_
+ *            oStop_     - ends the run early
+ * Return:    totals
+ */
+ClickBulkStopStats ClickBulkStop::Run(std::span<const std::string_view> vMsgIds_, ClickStopDoneFn fnDone_, void *pUserData_,
+                                      std::stop_token oStop_)
+{
+    ClickTimePoint tNextStart = std::chrono::steady_clock::now();
+    std::chrono::nanoseconds tInterval(0);
+
+    vMsgIds = vMsgIds_;
+    vAttempts.assign(vMsgIds.size(), 0);
+    dqPending.clear();
+    fnDone = fnDone_;
+    pUserData = pUserData_;
+    oStopToken = oStop_;
+    oStats = ClickBulkStopStats();
+
+    for (size_t i = 0; i < vMsgIds.size(); i++)
+        dqPending.push_back(i);
+
+    if (oOptions.dRatePerSec > 0)
+        tInterval = std::chrono::nanoseconds((long long)(1e9 / oOptions.dRatePerSec));
+
+    // a stop request wakes the loop, so that the remaining IDs are reported at once
+    std::stop_callback oWake(oStopToken, [this]() { oLoop.Wakeup(); });
+
+    for (;;) {
+        ClickTimePoint tNow = std::chrono::steady_clock::now();
+        size_t iBusy = 0;
+
+        for (ClickStopSlot &oSlot : vSlots) {
+            if (oSlot.oTask && oSlot.oTask->Done())
+                oSlot.oTask.reset();
+
+            iBusy += (oSlot.oTask ? 1 : 0);
+        }
+
+        if (oStopToken.stop_requested() || tNow >= oOptions.tDeadline) {
+            for (size_t iIndex : dqPending)
+                LocalReport(iIndex, CLICK_RESULT_UNAVAILABLE, CURLE_OK, 0, std::string_view());
+            dqPending.clear();
+        }
+
+        for (size_t i = 0; i < vSlots.size() && !dqPending.empty() && tNow >= tNextStart; i++) {
+            ClickStopSlot &oSlot = vSlots[i];
+
+            if (oSlot.oTask)
+                continue;
+
+            oSlot.iIndex = dqPending.front();
+            dqPending.pop_front();
+            oSlot.oTask.emplace(LocalStop(oSlot));
+            oSlot.oTask->Start();
+            iBusy++;
+
+            // a late start does not earn a burst
+            tNextStart = std::max(tNextStart, tNow - tInterval) + tInterval;
+        }
+
+        if (iBusy == 0 && dqPending.empty())
+            break;
+
+        long long iWaitMs = CLICK_STOP_MAX_WAIT_MS;
+
+        if (!dqPending.empty() && iBusy < vSlots.size())
+            iWaitMs = std::chrono::duration_cast<std::chrono::milliseconds>(tNextStart - tNow).count() + 1;
+        if (oOptions.tDeadline != ClickTimePoint::max())
+            iWaitMs = std::min<long long>(iWaitMs, std::chrono::duration_cast<std::chrono::milliseconds>(oOptions.tDeadline - tNow).count() + 1);
+
+        oLoop.RunOnce((int)std::clamp<long long>(iWaitMs, 0, CLICK_STOP_MAX_WAIT_MS));
+    }
+
+    fnDone = NULL;
+    pUserData = NULL;
+
+    return oStats;
+}
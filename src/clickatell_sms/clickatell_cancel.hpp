@@ -0,0 +1,111 @@
+#ifndef CLICKATELL_CANCEL_H
+#define CLICKATELL_CANCEL_H
+
+/*
+ * clickatell_cancel.hpp
+ *
+ *  Bulk stop of messages already accepted by the gateway, for the Clickatell SMS library.
+ *
+ *  Pulling a campaign takes two steps: ClickSendEngine::Cancel() removes the messages that
+ *  are still local (queued or scheduled), then ClickBulkStop sends a stop request for every
+ *  gateway message ID the campaign has already been given. The stops run concurrently, one
+ *  per pool instance, at no more than dRatePerSec requests per second; transport failures
+ *  and throttled requests are retried up to iMaxAttempts times. Every ID gets exactly one
+ *  outcome.
+ *
+ *      ClickBulkStop oStop(std::move(vClients), oStopOpts);
+ *      ClickBulkStopStats oStats = oStop.Run(vApiMessageIds, fnOutcome, pUserData);
+ */
+#include <stdint.h>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <string_view>
+#include <vector>
+
+#include "clickatell_sms.hpp"
+#include "clickatell_task.hpp"
+#include "clickatell_shard.hpp"
+
+// bulk stop options
+struct ClickBulkStopOptions {
+    double dRatePerSec;          // stop requests started per second (0: unlimited)
+    unsigned int iMaxAttempts;   // attempts per message for transport failures and throttling
+    ClickTimePoint tDeadline;    // no request is started or left running after this time
+
+    ClickBulkStopOptions()
+                         : dRatePerSec(0),
+                           iMaxAttempts(3),
+                           tDeadline(ClickTimePoint::max()) {}
+};
+
+// outcome of one message
+struct ClickStopOutcome {
+    size_t iIndex;               // index of the ID in the list passed to Run()
+    std::string_view sMsgId;     // gateway message ID
+    eClickResult eResult;        // CLICK_RESULT_OK if the gateway accepted the stop;
+                                 // CLICK_RESULT_UNAVAILABLE if still pending at the deadline or stop,
+                                 // or if stop aborted its request
+    CURLcode curlCode;           // of the last attempt
+    long iHttpStatus;            // of the last attempt
+    std::string_view sResponse;  // gateway response (valid during the callback only)
+    unsigned int iAttempts;      // requests sent
+};
+
+// called once per message, on the thread running Run()
+typedef void (*ClickStopDoneFn)(void *pUserData, const ClickStopOutcome &oOutcome);
+
+// totals of one Run()
+struct ClickBulkStopStats {
+    size_t iStopped;             // stops accepted by the gateway
+    size_t iFailed;              // stops refused or failed after the last attempt
+    size_t iNotSent;             // messages pending when the deadline passed or stop was requested, aborted by stop,
+                                 // or whose request found the deadline passed before it was sent
+    size_t iRequests;            // stop requests sent, retries included
+};
+
+class ClickBulkStop
+{
+private:
+    // a pool instance and the stop it is running
+    struct ClickStopSlot {
+        std::unique_ptr<ClickatellSms> pSms;
+        std::optional<ClickTask<void>> oTask;
+        size_t iIndex;
+    };
+
+    ClickBulkStopOptions oOptions;
+    ClickLoop oLoop;
+    std::vector<ClickStopSlot> vSlots;
+
+    // state of the current Run()
+    std::span<const std::string_view> vMsgIds;
+    std::vector<unsigned int> vAttempts;
+    std::deque<size_t> dqPending;
+    ClickStopDoneFn fnDone;
+    void *pUserData;
+    std::stop_token oStopToken;
+    ClickBulkStopStats oStats;
+
+    ClickTask<void> LocalStop(ClickStopSlot &oSlot);
+    void LocalReport(size_t iIndex, eClickResult eResult, CURLcode curlCode, long iHttpStatus, std::string_view sResponse);
+
+public:
+    // takes ownership of the pool (throws a std::string if it is empty)
+    ClickBulkStop(std::vector<std::unique_ptr<ClickatellSms>> vClients,
+                  const ClickBulkStopOptions &oOptions_ = ClickBulkStopOptions());
+
+    ClickBulkStop(const ClickBulkStop &) = delete;
+    ClickBulkStop &operator=(const ClickBulkStop &) = delete;
+
+    /* Stops the messages with the given gateway IDs and reports each outcome to fnDone_;
+     * blocks until all are reported. oStop_ ends the run early: requests in progress are
+     * aborted and the remaining messages are reported as not sent.
+     */
+    ClickBulkStopStats Run(std::span<const std::string_view> vMsgIds_, ClickStopDoneFn fnDone_, void *pUserData_,
+                           std::stop_token oStop_ = std::stop_token());
+};
+
+#endif // CLICKATELL_CANCEL_H
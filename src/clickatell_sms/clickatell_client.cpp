@@ -0,0 +1,1442 @@
+/*
+ * clickatell_client.cpp
+ *
+ *  Clickatell SMS client specialized at compile time for one API.
+ *
+ *  ClickClientBase runs the transfers: it owns the cURL handle and the request arena and
+ *  reports results to the circuit breaker. ClickatellClient<Api> builds each request with
+ *  its API policy; the operation is a template argument of the request builder, so every
+ *  API function compiles down to straight-line code for its own operation and API.
+ *  Both specializations are instantiated at the end of this file.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "curl/curl.h"
+
+#include "clickatell_client.hpp"
+#include "clickatell_breaker.hpp"
+#include "clickatell_share.hpp"
+#include "clickatell_metrics.hpp"
+#include "clickatell_coalesce.hpp"
+
+
+/* ----------------------------------------------------------------------------- *
+ * Types/Macros                                                                  *
+ * ----------------------------------------------------------------------------- */
+
+// default cURL request timeout values
+#define CLICK_SMS_DEFAULT_APICALL_TIMEOUT          5  // max time allowed for api call to Clickatell
+#define CLICK_SMS_DEFAULT_APICALL_CONNECT_TIMEOUT  5  // max connection time allowed for api call to Clickatell
+
+// a timeout this close to the call's deadline is taken to be the deadline's
+#define CLICK_DEADLINE_SLACK_MS                    2
+
+/* ----------------------------------------------------------------------------- *
+ * Free (non-class) functions                                                    *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  LocalCurlResponseCallback
+ * Info:      This is a cURL callback function prototype. It acts as a cURL response callback
+ *            function which is set in function ClickClientBase::LocalCurlConfig() when configuring
+ *            the cURL CURLOPT_WRITEFUNCTION.
+ *            The 'response' parameter passed back here was set in function
+ *            ClickClientBase::LocalCurlPrepare() when configuring the cURL CURLOPT_WRITEDATA.
+ *            This callback function reads a curl request's response data. In here we
+ *            allocate the response data to the corresponding client instance's response
+ *            field.
+ * Return:    Total size of response data buffer
+ */
+size_t LocalCurlResponseCallback(void *buffer, size_t iSize, size_t iMemLen, void *response)
+{
+    size_t iTotalSize = iMemLen * iSize;
+
+    if (iTotalSize > 0) {
+        // use static_cast C-type cast for safe (stricter) casting in order to catch bad casts at compile time
+        ClickClientBase *instance_ptr = static_cast<ClickClientBase *>(response);
+
+        /* cURL may deliver the response in several chunks, so append each chunk straight into
+         * the instance's response buffer. The buffer was cleared (capacity retained) before the
+         * request was executed, so no temporary copy is required.
+         */
+        instance_ptr->AppendResponse(static_cast<const char *>(buffer), iTotalSize);
+    }
+
+    return (iTotalSize);
+}
+
+/*
+ * Function:  LocalCurlBodyCallback
+ * Info:      cURL read callback (CURLOPT_READFUNCTION) of a streamed send body. The
+ *            'pStream' parameter is the client's ClickBodyStream, set as CURLOPT_READDATA in
+ *            ClickClientBase::LocalCurlConfig().
+ * Return:    bytes copied into buffer, 0 at the end of the body
+ */
+size_t LocalCurlBodyCallback(char *buffer, size_t iSize, size_t iItems, void *pStream)
+{
+    return static_cast<ClickBodyStream *>(pStream)->Read(buffer, iSize * iItems);
+}
+
+/*
+ * Function:  LocalCurlSeekCallback
+ * Info:      cURL seek callback (CURLOPT_SEEKFUNCTION) of a streamed send body, used when
+ *            cURL has to send the body again (e.g. on a reused connection that was closed).
+ * Return:    CURL_SEEKFUNC_OK, or CURL_SEEKFUNC_CANTSEEK for a position outside the body
+ */
+int LocalCurlSeekCallback(void *pStream, curl_off_t iOffset, int iOrigin)
+{
+    if (iOrigin != SEEK_SET || iOffset < 0)
+        return CURL_SEEKFUNC_CANTSEEK;
+
+    return (static_cast<ClickBodyStream *>(pStream)->Seek((size_t)iOffset) ? CURL_SEEKFUNC_OK : CURL_SEEKFUNC_CANTSEEK);
+}
+
+/*
+ * Function:  << operator overload friend function
+ * Info:      Function which overloads the << ostream operator and accesses some private
+ *            client class members (for READ purposes only). An external calling function
+ *            would use this to output details regarding the last cURL API request that
+ *            was made to Clickatell.
+ * Inputs:    os      - ostream object
+ *            oClient - client object which we can pass into the output stream.
+ * Return:    std::ostream - output stream
+ */
+std::ostream& operator<<(std::ostream& os, const ClickClientBase &oClient)
+{
+    std::string sReq((oClient.eRequest == CLICK_CURL_POST ? "POST" :
+                      (oClient.eRequest == CLICK_CURL_GET ? "GET" : "DELETE")));
+
+    os << "Curl " << sReq.c_str() << "-Request URL:\n" << oClient.sFullUrl << std::endl
+       << "Curl HTTP response code:\n" << oClient.curlHttpStatus << std::endl
+       << "Curl response:\n" << oClient.sClickatellResponse.c_str() << std::endl;
+
+    return os;
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Private function definitions                                                  *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickClientBase::LocalCurlConfig
+ * Info:      Initializes private cURL handle using standard libcurl library functions.
+ *            This function applies standard cURL configs. For request-specific
+ *            cURL configuration logic, please see function ClickClientBase::LocalCurlPrepare().
+ * Inputs:    iTimeout        - Maximum duration for cURL request to Clickatell server
+ *            iConnectTimeout - Maximum timeout for cURL connection to Clickatell server
+ * Return:    void
+ */
+void ClickClientBase::LocalCurlConfig(long iTimeout, long iConnectTimeout)
+{
+    // set this to 1 for detailed curl debug
+    curl_easy_setopt(curlHandle, CURLOPT_VERBOSE, 0);
+
+    // curl version set
+    curl_easy_setopt(curlHandle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+
+    // remember the timeout values; they are applied per request so that a deadline can shorten them
+    iTimeoutMs = (iTimeout <= 0 ? CLICK_SMS_DEFAULT_APICALL_TIMEOUT : iTimeout) * 1000;
+    iConnectTimeoutMs = (iConnectTimeout <= 0 ? CLICK_SMS_DEFAULT_APICALL_CONNECT_TIMEOUT : iConnectTimeout) * 1000;
+
+    // Clickatell will write the response data to this write function callback (instead of to stdout)
+    curl_easy_setopt(curlHandle, CURLOPT_WRITEFUNCTION, LocalCurlResponseCallback);
+
+    // streamed send bodies are read from here (only used while CURLOPT_POSTFIELDS is NULL)
+    curl_easy_setopt(curlHandle, CURLOPT_READFUNCTION, LocalCurlBodyCallback);
+    curl_easy_setopt(curlHandle, CURLOPT_READDATA, &oBodyStream);
+    curl_easy_setopt(curlHandle, CURLOPT_SEEKFUNCTION, LocalCurlSeekCallback);
+    curl_easy_setopt(curlHandle, CURLOPT_SEEKDATA, &oBodyStream);
+
+    // accept any response encoding libcurl can decode ("" advertises all of them)
+    curl_easy_setopt(curlHandle, CURLOPT_ACCEPT_ENCODING, (oCompress.bAcceptEncoding ? "" : NULL));
+}
+
+/*
+ * Function:  ClickClientBase::LocalCurlComplete
+ * Info:      Records the result of a finished cURL transfer.
+ *            The result of the cURL operation (cURL return code) will be set in the
+ *            instance's 'curlCode' class member.
+ * Input:     curlResult - result of curl_easy_perform() or of the event loop transfer
+ * Output:    None
+ * Return:    void
+ */
+void ClickClientBase::LocalCurlComplete(CURLcode curlResult)
+{
+    curlCode = curlResult;
+
+    // a shortened timeout that fired before the deadline was the connect timeout, not the deadline
+    if (bDeadlineCut)
+        bDeadlineCut = (curlResult == CURLE_OPERATION_TIMEDOUT &&
+                        std::chrono::steady_clock::now() + std::chrono::milliseconds(CLICK_DEADLINE_SLACK_MS) >= tDeadline);
+
+    // obtain response code
+    if (curlCode == CURLE_OK)
+        curlCode = curl_easy_getinfo(curlHandle, CURLINFO_RESPONSE_CODE, &curlHttpStatus);
+
+    // the download counter counts the response as received, before it is decoded
+    curl_off_t iWireBytes = 0;
+    curl_easy_getinfo(curlHandle, CURLINFO_SIZE_DOWNLOAD_T, &iWireBytes);
+
+    // a response without a final line break completes its last result now
+    if (bParseResponse && curlResult == CURLE_OK)
+        pParser->Finish();
+
+    oMetrics.iResponseBytes = sClickatellResponse.length();
+    oMetrics.iResponseWireBytes = (size_t)iWireBytes;
+
+    curl_off_t iTimes[5] = {0, 0, 0, 0, 0};
+
+    curl_easy_getinfo(curlHandle, CURLINFO_NAMELOOKUP_TIME_T, &iTimes[0]);
+    curl_easy_getinfo(curlHandle, CURLINFO_CONNECT_TIME_T, &iTimes[1]);
+    curl_easy_getinfo(curlHandle, CURLINFO_APPCONNECT_TIME_T, &iTimes[2]);
+    curl_easy_getinfo(curlHandle, CURLINFO_STARTTRANSFER_TIME_T, &iTimes[3]);
+    curl_easy_getinfo(curlHandle, CURLINFO_TOTAL_TIME_T, &iTimes[4]);
+    oMetrics.iDnsUs = (uint64_t)iTimes[0];
+    oMetrics.iConnectUs = (uint64_t)iTimes[1];
+    oMetrics.iTlsUs = (uint64_t)iTimes[2];
+    oMetrics.iFirstByteUs = (uint64_t)iTimes[3];
+    oMetrics.iTotalUs = (uint64_t)iTimes[4];
+
+    LocalBreakerRecord(curlResult);
+    LocalMetricsRecord(iWireBytes);
+
+    tDeadline = ClickTimePoint::max();
+    bInFlight = false;
+}
+
+/*
+ * Function:  ClickClientBase::LocalCurlNotSent
+ * Info:      Records the result of a request that was not sent because its deadline had
+ *            passed or stop was requested. Nothing is read from the cURL handle, which still
+ *            holds the previous transfer: the response, HTTP status and request metrics are
+ *            reset, and the request is counted as CLICK_REQUEST_NOT_SENT.
+ * Input:     curlResult - CURLE_OPERATION_TIMEDOUT or CURLE_ABORTED_BY_CALLBACK
+ * Output:    None
+ * Return:    void
+ */
+void ClickClientBase::LocalCurlNotSent(CURLcode curlResult)
+{
+    curlCode = curlResult;
+    sClickatellResponse.clear();
+    curlHttpStatus = 0;
+    oMetrics = ClickRequestMetrics();
+    bDeadlineCut = (curlResult == CURLE_OPERATION_TIMEDOUT);
+    bNotSent = true;
+
+    LocalBreakerRecord(curlResult);
+
+    if (bMetricPending)
+        ClickMetrics::Request(eMetricOp, eApiType, CLICK_REQUEST_NOT_SENT);
+    bMetricPending = false;
+
+    tDeadline = ClickTimePoint::max();
+    bInFlight = false;
+}
+
+/*
+ * Function:  LocalBreakerAdmit
+ * Info:      Asks the circuit breaker, if one is attached, whether the request may be sent.
+ *            A request failed fast completes at once with CURLE_COULDNT_CONNECT and an empty
+ *            response, and is handed to the breaker's fallback.
+ * Inputs:    eOp, sArg, vMsisdns - the request (see ClickatellClient::LocalRequestBuild())
+ * Return:    true if the request may be sent
+ */
+bool ClickClientBase::LocalBreakerAdmit(eClickOperation eOp, std::string_view sArg, std::span<const std::string_view> vMsisdns)
+{
+    if (pBreaker == NULL)
+        return true;
+
+    if ((ePermit = pBreaker->Allow()) != CLICK_PERMIT_DENIED)
+        return true;
+
+    sClickatellResponse.clear();
+    curlHttpStatus = 0;
+    curlCode = CURLE_COULDNT_CONNECT;
+    bShortCircuited = true;
+
+    oLocalDebug.Print("%s: circuit breaker open, request not sent\n", __func__);
+
+    pBreaker->Fallback(eOp, sArg, vMsisdns);
+
+    return false;
+}
+
+/*
+ * Function:  LocalBreakerRecord
+ * Info:      Reports the outcome of the current request to the circuit breaker, if it was
+ *            admitted by one. Transport errors and 5xx responses count against the endpoint;
+ *            cancellations and timeouts imposed by the caller's deadline do not. A timeout
+ *            on the instance's own timeouts counts, whether or not the call had a deadline.
+ * Inputs:    curlResult - result of the transfer
+ * Return:    void
+ */
+void ClickClientBase::LocalBreakerRecord(CURLcode curlResult)
+{
+    if (pBreaker == NULL || ePermit == CLICK_PERMIT_DENIED)
+        return;
+
+    eClickBreakerOutcome eOutcome = CLICK_OUTCOME_SUCCESS;
+
+    if (curlResult == CURLE_ABORTED_BY_CALLBACK || curlResult == CURLE_FAILED_INIT ||
+        (curlResult == CURLE_OPERATION_TIMEDOUT && bDeadlineCut))
+        eOutcome = CLICK_OUTCOME_IGNORED;
+    else if (curlResult != CURLE_OK || curlHttpStatus >= 500)
+        eOutcome = CLICK_OUTCOME_FAILURE;
+
+    pBreaker->Record(ePermit, eOutcome,
+                     std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - tSent));
+    ePermit = CLICK_PERMIT_DENIED;
+}
+
+/*
+ * Function:  LocalMetricsRecord
+ * Info:      Counts the current request in the process-wide metrics, if it was admitted:
+ *            its outcome, the messages and segments of a successful send, and the bytes
+ *            transferred. A request cancelled before it started counts as a transport
+ *            failure.
+ * Inputs:    iWireBytes - response bytes received
+ * Return:    void
+ */
+void ClickClientBase::LocalMetricsRecord(curl_off_t iWireBytes)
+{
+    if (!bMetricPending)
+        return;
+
+    eClickRequestOutcome eOutcome = CLICK_REQUEST_OK;
+
+    if (curlCode != CURLE_OK)
+        eOutcome = CLICK_REQUEST_TRANSPORT;
+    else if (curlHttpStatus == 429)
+        eOutcome = CLICK_REQUEST_THROTTLED;
+    else if (curlHttpStatus >= 400)
+        eOutcome = CLICK_REQUEST_HTTP_ERROR;
+
+    ClickMetrics::Request(eMetricOp, eApiType, eOutcome);
+
+    if (eOutcome == CLICK_REQUEST_THROTTLED)
+        ClickMetrics::Add(CLICK_METRIC_THROTTLES);
+
+    if (eOutcome == CLICK_REQUEST_OK && curlHttpStatus >= 200 && curlHttpStatus < 300 && iMetricMessages > 0) {
+        ClickMetrics::Add(CLICK_METRIC_MESSAGES, (int64_t)iMetricMessages);
+        ClickMetrics::Add(CLICK_METRIC_SEGMENTS, (int64_t)iMetricSegments);
+    }
+
+    if (bMetricInFlight) {
+        curl_off_t iSentBytes = 0;
+
+        curl_easy_getinfo(curlHandle, CURLINFO_SIZE_UPLOAD_T, &iSentBytes);
+        ClickMetrics::Add(CLICK_METRIC_IN_FLIGHT, -1);
+        ClickMetrics::Add(CLICK_METRIC_BYTES_SENT, (int64_t)iSentBytes);
+        ClickMetrics::Add(CLICK_METRIC_BYTES_RECEIVED, (int64_t)iWireBytes);
+    }
+
+    bMetricPending = false;
+    bMetricInFlight = false;
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Protected function definitions                                                *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickClientBase
+ * Info:      Constructor. The cURL handle is created by Initialize(), once the derived
+ *            client has its credentials and can supply its default headers.
+ * Inputs:    eDebugOpt - debug option
+ */
+ClickClientBase::ClickClientBase(eClickDebugOption eDebugOpt)
+                                 : curlHeaders(NULL),
+                                   curlHttpStatus(0),
+                                   curlHandle(NULL),
+                                   curlCode(CURLE_OK),
+                                   tDeadline(ClickTimePoint::max()),
+                                   iTimeoutMs(0),
+                                   iConnectTimeoutMs(0),
+                                   bDeadlineCut(false),
+                                   bNotSent(false),
+                                   bInFlight(false),
+                                   pBreaker(NULL),
+                                   ePermit(CLICK_PERMIT_DENIED),
+                                   bShortCircuited(false),
+                                   pShare(NULL),
+                                   iResolveGen(0),
+                                   pCoalescer(NULL),
+                                   curlGzipHeaders(NULL),
+                                   oMetrics(),
+                                   iKeepBytes(CLICK_PARSER_KEEP_BYTES),
+                                   bParseResponse(false),
+                                   eApiType(CLICK_API_HTTP),
+                                   eMetricOp(CLICK_OP_SEND),
+                                   iMetricMessages(0),
+                                   iMetricSegments(0),
+                                   bMetricPending(false),
+                                   bMetricInFlight(false),
+                                   bStreamBody(false),
+                                   iStreamMinBytes(0),
+                                   oLocalDebug(eDebugOpt),
+                                   eRequest(CLICK_CURL_GET)
+{
+    // compression is opt-in (SetCompression())
+    oCompress.bAcceptEncoding = false;
+}
+
+/*
+ * Function:  ~ClickClientBase
+ * Info:      Destructor. Frees the cURL resources of this instance.
+ * Inputs:    none
+ * Return:    none
+ */
+ClickClientBase::~ClickClientBase()
+{
+    // free curl resources for this object instance
+    if (curlHeaders != NULL) {
+        curl_slist_free_all(curlHeaders);
+        curlHeaders = NULL;
+    }
+
+    if (curlGzipHeaders != NULL) {
+        curl_slist_free_all(curlGzipHeaders);
+        curlGzipHeaders = NULL;
+    }
+
+    if (curlHandle != NULL) {
+        curl_easy_cleanup(curlHandle);
+        curlHandle = NULL;
+    }
+}
+
+/*
+ * Function:  Initialize
+ * Info:      Creates and configures the cURL handle.
+ * Inputs:    eApiType_       - API of the derived client (metrics label)
+ *            iTimeout        - Maximum timeout for API call to take
+ *            iConnectTimeout - Maximum timeout for API call connection to take
+ *            curlHeaders_    - default headers of the API (ownership is taken)
+ * Return:    void
+ */
+void ClickClientBase::Initialize(eClickApi eApiType_, long iTimeout, long iConnectTimeout, struct curl_slist *curlHeaders_)
+{
+    eApiType = eApiType_;
+    curlHeaders = curlHeaders_;
+
+    if ((curlHandle = curl_easy_init()) == NULL)
+        throw (std::string("curl_easy_init failed!"));
+
+    LocalCurlConfig(iTimeout, iConnectTimeout);
+
+    // set default headers - can replace them if necessary
+    curl_easy_setopt(curlHandle, CURLOPT_HTTPHEADER, curlHeaders);
+}
+
+/*
+ * Function:  ClickClientBase::LocalCurlPrepare
+ * Info:      Applies the request built in the arena to the cURL handle.
+ *            The URL and 'POST request' data are taken from the 'sFullUrl' and 'sPostData'
+ *            class members, which point into the request arena.
+ * Input:     None
+ * Output:    None
+ * Return:    void
+ */
+void ClickClientBase::LocalCurlPrepare()
+{
+    // an admitted request is in flight from here until LocalCurlComplete() (Warmup() is not counted)
+    if (bMetricPending && !bMetricInFlight) {
+        ClickMetrics::Add(CLICK_METRIC_IN_FLIGHT);
+        bMetricInFlight = true;
+    }
+
+    // add headers if applicable
+    if (curlHeaders != NULL)
+        curl_easy_setopt(curlHandle, CURLOPT_HTTPHEADER, curlHeaders);
+    else // remove headers
+        curl_easy_setopt(curlHandle, CURLOPT_HTTPHEADER, NULL);
+
+    // pick up host pinning published by the share since the last request
+    if (pShare != NULL && pShare->ResolveGeneration() != iResolveGen) {
+        iResolveGen = pShare->ResolveGeneration();
+        pResolveList = pShare->ResolveList();
+        curl_easy_setopt(curlHandle, CURLOPT_RESOLVE, pResolveList.get());
+    }
+
+    // set full URL for curl request and class instance to pass back to response callback
+    // the arena strings are NUL-terminated, so they can be handed to cURL directly
+    curl_easy_setopt(curlHandle, CURLOPT_URL, sFullUrl.data());
+    curl_easy_setopt(curlHandle, CURLOPT_WRITEDATA, this);
+
+    // a DELETE from a previous request must not leak into this one
+    curl_easy_setopt(curlHandle, CURLOPT_CUSTOMREQUEST, NULL);
+
+    oMetrics = ClickRequestMetrics();
+
+    switch (eRequest) {
+        case CLICK_CURL_POST:
+            // a streamed body is read through LocalCurlBodyCallback(); its length is known
+            if (bStreamBody) {
+                oBodyStream.Seek(0);
+                oMetrics.iBodyBytes = oMetrics.iBodyWireBytes = oBodyStream.Length();
+
+                curl_easy_setopt(curlHandle, CURLOPT_POST, 1);
+                curl_easy_setopt(curlHandle, CURLOPT_POSTFIELDS, NULL);
+                curl_easy_setopt(curlHandle, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)oBodyStream.Length());
+
+                oLocalDebug.Print("Curl post data: streamed, %zu bytes\n", oBodyStream.Length());
+            }
+            // set cURL 'POST request' data if requested and if the post data exists
+            else if (!sPostData.empty()) {
+                std::string_view sBody = sPostData;
+                std::string_view sGzip;
+
+                oMetrics.iBodyBytes = sPostData.length();
+
+                // large bodies are sent gzipped if that makes them smaller
+                if (pCompressor != NULL && sPostData.length() >= oCompress.iMinBytes &&
+                    pCompressor->Compress(oArena, sPostData, sGzip, oMetrics.iCompressCpuUs) &&
+                    sGzip.length() < sPostData.length()) {
+                    sBody = sGzip;
+                    curl_easy_setopt(curlHandle, CURLOPT_HTTPHEADER, curlGzipHeaders);
+                }
+
+                oMetrics.iBodyWireBytes = sBody.length();
+
+                curl_easy_setopt(curlHandle, CURLOPT_POST, 1);
+                curl_easy_setopt(curlHandle, CURLOPT_POSTFIELDS, sBody.data());
+                curl_easy_setopt(curlHandle, CURLOPT_POSTFIELDSIZE, (long)sBody.length());
+
+                oLocalDebug.Print("Curl post data:\n%s\n", sPostData.data());
+            }
+            break;
+
+        case CLICK_CURL_DELETE:
+            curl_easy_setopt(curlHandle, CURLOPT_CUSTOMREQUEST, "DELETE");
+            break;
+
+        case CLICK_CURL_GET:
+        default:
+            curl_easy_setopt(curlHandle, CURLOPT_HTTPGET, 1);
+            break;
+    }
+
+    // the transfer, and connection set-up within it, may not outlive the request deadline
+    long iRequestTimeoutMs = iTimeoutMs;
+    long iRequestConnectMs = iConnectTimeoutMs;
+
+    bDeadlineCut = false;
+    bNotSent = false;
+
+    if (tDeadline != ClickTimePoint::max()) {
+        long long iRemainingMs = std::chrono::ceil<std::chrono::milliseconds>(tDeadline - std::chrono::steady_clock::now()).count();
+
+        iRemainingMs = std::max(iRemainingMs, 1LL);
+        bDeadlineCut = (iRemainingMs < iRequestTimeoutMs);
+        iRequestTimeoutMs = (long)std::min<long long>(iRequestTimeoutMs, iRemainingMs);
+        iRequestConnectMs = (long)std::min<long long>(iRequestConnectMs, iRemainingMs);
+    }
+
+    curl_easy_setopt(curlHandle, CURLOPT_TIMEOUT_MS, iRequestTimeoutMs);
+    curl_easy_setopt(curlHandle, CURLOPT_CONNECTTIMEOUT_MS, iRequestConnectMs);
+
+    // response chunks are appended by the write callback, so start from an empty buffer
+    sClickatellResponse.clear();
+
+    if (bParseResponse)
+        pParser->Reset();
+    curlHttpStatus = 0;
+    tSent = std::chrono::steady_clock::now();
+}
+
+/*
+ * Function:  ClickClientBase::LocalCurlExecute
+ * Info:      Executes the prepared cURL request using libcurl, blocking until it completes
+ *            or the call's deadline passes. The cURL operation's response data will be set
+ *            in the 'sClickatellResponse' class member of the instance. A call whose
+ *            deadline has already passed, or whose stop was requested, completes at once
+ *            with CURLE_OPERATION_TIMEDOUT or CURLE_ABORTED_BY_CALLBACK, without sending.
+ * Input:     oOpts - per-call options (deadline, stop token)
+ * Output:    None
+ * Return:    void
+ */
+void ClickClientBase::LocalCurlExecute(const ClickCallOptions &oOpts)
+{
+    CURLcode curlResult = CURLE_OK;
+
+    tDeadline = oOpts.tDeadline;
+
+    if (tDeadline <= std::chrono::steady_clock::now())
+        curlResult = CURLE_OPERATION_TIMEDOUT;
+    else if (oOpts.oStopToken.stop_requested())
+        curlResult = CURLE_ABORTED_BY_CALLBACK;
+
+    if (curlResult != CURLE_OK) {
+        LocalCurlNotSent(curlResult);
+        return;
+    }
+
+    LocalCurlPrepare();
+
+    // execute curl request
+    LocalCurlComplete(curl_easy_perform(curlHandle));
+}
+
+/*
+ * Function:  ClickClientBase::LocalRequestBegin
+ * Info:      Starts a new request: resets the request arena. Throws a std::string if an
+ *            asynchronous request is still in flight on this object, because its URL and
+ *            post data live in the arena.
+ * Return:    void
+ */
+void ClickClientBase::LocalRequestBegin()
+{
+    if (bInFlight)
+        throw (std::string("ClickatellSms request already in progress!"));
+
+    oArena.Reset();
+    bStreamBody = false;
+    bParseResponse = false;
+    bMetricPending = false;
+}
+
+/*
+ * Function:  ClickClientBase::LocalRequestAdmit
+ * Info:      Decides whether a request that is about to be built may be sent: its parameters
+ *            must be valid and the circuit breaker, if attached, must let it through.
+ * Inputs:    bValid              - result of the caller's parameter check
+ *            eOp, sArg, vMsisdns - the request (handed to the breaker's fallback if it is
+ *                                  failed fast)
+ * Return:    true if the request may be built and sent
+ */
+bool ClickClientBase::LocalRequestAdmit(bool bValid, eClickOperation eOp, std::string_view sArg,
+                                        std::span<const std::string_view> vMsisdns)
+{
+    bShortCircuited = false;
+    bDeadlineCut = false;
+    bNotSent = false;
+    bParseResponse = (pParser != NULL && pParser->HasHandler() && ClickApiBase::HasMsisdns(eOp));
+
+    if (!bValid) {
+        oLocalDebug.Print("%s ERROR: invalid parameter!\n", __func__);
+        return false;
+    }
+
+    eMetricOp = eOp;
+
+    if (!LocalBreakerAdmit(eOp, sArg, vMsisdns)) {
+        ClickMetrics::Request(eOp, eApiType, CLICK_REQUEST_SHORT_CIRCUIT);
+        return false;
+    }
+
+    iMetricMessages = (ClickApiBase::HasMsisdns(eOp) ? vMsisdns.size() : 0);
+    iMetricSegments = (iMetricMessages > 0 ? iMetricMessages * ClickMetrics::Segments(sArg) : 0);
+    bMetricPending = true;
+
+    return true;
+}
+
+/*
+ * Function:  ClickClientBase::LocalViews
+ * Info:      Views the caller's strings through an arena array rather than copying them.
+ *            The arena must have been reset (LocalRequestBegin()).
+ * Inputs:    vStrings - strings to view
+ * Return:    span of views, valid until the next request
+ */
+std::span<const std::string_view> ClickClientBase::LocalViews(const std::vector<std::string> &vStrings)
+{
+    std::string_view *vViews = oArena.AllocArray<std::string_view>(vStrings.size());
+
+    for (size_t i = 0; i < vStrings.size(); i++)
+        vViews[i] = vStrings[i];
+
+    return std::span<const std::string_view>(vViews, vStrings.size());
+}
+
+/*
+ * Function:  ClickClientBase::LocalJoin
+ * Info:      Hands a read-only query to the coalescer, if one is attached. If an identical
+ *            query was in flight or cached, its result becomes this object's result; waiting
+ *            for a query in flight ends at the call's deadline. Queries with a missing
+ *            argument are not coalesced (they are never sent).
+ * Inputs:    eOp       - operation
+ *            sScope    - account scope (API ID)
+ *            sArg      - query argument
+ *            tDeadline - deadline of the call
+ * Outputs:   oTicket - flight to complete with LocalPublish() if this object sends the query
+ * Return:    true if the result was taken over, false if the query must be sent
+ */
+bool ClickClientBase::LocalJoin(eClickOperation eOp, std::string_view sScope, std::string_view sArg, ClickTimePoint tDeadline,
+                                ClickFlightTicket &oTicket)
+{
+    ClickCoalescedResult oResult;
+
+    if (pCoalescer == NULL || (ClickApiBase::HasArg(eOp) && sArg.empty()))
+        return false;
+
+    if (!pCoalescer->Begin(eOp, eApiType, sScope, sArg, oTicket, oResult, tDeadline))
+        return false;
+
+    sClickatellResponse.assign(oResult.sResponse);
+    curlCode = oResult.curlCode;
+    curlHttpStatus = oResult.iHttpStatus;
+    bShortCircuited = oResult.bShortCircuited;
+
+    return true;
+}
+
+/*
+ * Function:  ClickClientBase::LocalPublish
+ * Info:      Passes the result of a query this object sent after LocalJoin() to the
+ *            coalescer (no-op if the query was not coalesced). A query cut short by this
+ *            call's deadline or stop token is abandoned instead, so that the callers that
+ *            joined it send it again rather than sharing an outcome that is not theirs.
+ * Inputs:    oTicket - flight from LocalJoin()
+ * Return:    void
+ */
+void ClickClientBase::LocalPublish(ClickFlightTicket &oTicket)
+{
+    if (oTicket.pFlight == NULL)
+        return;
+
+    if ((curlCode == CURLE_OPERATION_TIMEDOUT && bDeadlineCut) || curlCode == CURLE_ABORTED_BY_CALLBACK) {
+        pCoalescer->Abandon(oTicket);
+        return;
+    }
+
+    pCoalescer->Complete(oTicket, ClickCoalescedResult{sClickatellResponse, curlCode, curlHttpStatus, bShortCircuited});
+}
+
+/*
+ * Function:  LocalRequestAsync
+ * Info:      Wraps an already built request in an awaiter for the given event loop.
+ * Inputs:    oLoop  - event loop that will drive the transfer
+ *            bBuilt - result of LocalRequestBuild()
+ *            oOpts  - per-call options (cancellation, deadline)
+ * Return:    awaiter
+ */
+ClickSmsAwaiter ClickClientBase::LocalRequestAsync(ClickLoop &oLoop, bool bBuilt, const ClickCallOptions &oOpts)
+{
+    if (bBuilt) {
+        bInFlight = true;
+        tDeadline = oOpts.tDeadline;
+    }
+
+    return ClickSmsAwaiter(*this, oLoop, bBuilt, oOpts);
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Public function definitions                                                   *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickClientBase::GetCurlCode, GetHttpStatus
+ * Info:      Result of the most recent request: the cURL return code and the HTTP status
+ *            code (0 if no HTTP response was received).
+ */
+CURLcode ClickClientBase::GetCurlCode() const
+{
+    return curlCode;
+}
+
+long ClickClientBase::GetHttpStatus() const
+{
+    return curlHttpStatus;
+}
+
+/*
+ * Function:  ClickClientBase::GetShortCircuited
+ * Info:      True if the most recent request was failed fast by the circuit breaker.
+ */
+bool ClickClientBase::GetShortCircuited() const
+{
+    return bShortCircuited;
+}
+
+/*
+ * Function:  ClickClientBase::GetNotSent, GetDeadlineCut
+ * Info:      True if the most recent request finished before it was sent, and true if it
+ *            timed out on the call's deadline rather than on the instance's timeouts.
+ */
+bool ClickClientBase::GetNotSent() const
+{
+    return bNotSent;
+}
+
+bool ClickClientBase::GetDeadlineCut() const
+{
+    return (curlCode == CURLE_OPERATION_TIMEDOUT && bDeadlineCut);
+}
+
+/*
+ * Function:  ClickClientBase::SetTimeouts
+ * Info:      Sets the default request and connect timeouts with millisecond precision.
+ *            Throws a std::string if a request is in flight.
+ * Inputs:    iTimeoutMs_        - maximum duration of a request (0: library default)
+ *            iConnectTimeoutMs_ - maximum duration of connection set-up (0: library default)
+ * Return:    void
+ */
+void ClickClientBase::SetTimeouts(long iTimeoutMs_, long iConnectTimeoutMs_)
+{
+    if (bInFlight)
+        throw (std::string("ClickatellSms request already in progress!"));
+
+    iTimeoutMs = (iTimeoutMs_ <= 0 ? CLICK_SMS_DEFAULT_APICALL_TIMEOUT * 1000 : iTimeoutMs_);
+    iConnectTimeoutMs = (iConnectTimeoutMs_ <= 0 ? CLICK_SMS_DEFAULT_APICALL_CONNECT_TIMEOUT * 1000 : iConnectTimeoutMs_);
+}
+
+/*
+ * Function:  ClickClientBase::SetCircuitBreaker
+ * Info:      Attaches a circuit breaker shared by all instances using the same endpoint,
+ *            or detaches it (NULL). Must not be called while a request is in flight.
+ * Inputs:    pBreaker_ - breaker, or NULL
+ * Return:    void
+ */
+void ClickClientBase::SetCircuitBreaker(ClickCircuitBreaker *pBreaker_)
+{
+    if (bInFlight)
+        throw (std::string("ClickatellSms request already in progress!"));
+
+    pBreaker = pBreaker_;
+    ePermit = CLICK_PERMIT_DENIED;
+}
+
+/*
+ * Function:  ClickClientBase::SetShare
+ * Info:      Attaches the cURL handle to shared DNS/TLS/connection state, or detaches it
+ *            (NULL). Must not be called while a request is in flight.
+ * Inputs:    pShare_ - share, or NULL
+ * Return:    void
+ */
+void ClickClientBase::SetShare(ClickShare *pShare_)
+{
+    if (bInFlight)
+        throw (std::string("ClickatellSms request already in progress!"));
+
+    pShare = pShare_;
+    iResolveGen = 0;
+    pResolveList.reset();
+
+    curl_easy_setopt(curlHandle, CURLOPT_RESOLVE, NULL);
+    curl_easy_setopt(curlHandle, CURLOPT_SHARE, (pShare != NULL ? pShare->Handle() : NULL));
+    curl_easy_setopt(curlHandle, CURLOPT_MAXCONNECTS, (pShare != NULL ? (long)pShare->MaxConnections() : 5L));
+}
+
+/*
+ * Function:  ClickClientBase::SetCoalescer
+ * Info:      Attaches a query coalescer shared with other instances, or detaches it (NULL).
+ * Inputs:    pCoalescer_ - coalescer, or NULL
+ * Return:    void
+ */
+void ClickClientBase::SetCoalescer(ClickCoalescer *pCoalescer_)
+{
+    pCoalescer = pCoalescer_;
+}
+
+/*
+ * Function:  ClickClientBase::SetCompression
+ * Info:      Configures response and request body compression. The compressor context and
+ *            the gzip variant of the default headers are created here, once, rather than
+ *            per request. Must not be called while a request is in flight.
+ * Inputs:    oOptions - compression options
+ * Return:    void
+ */
+void ClickClientBase::SetCompression(const ClickCompressOptions &oOptions)
+{
+    if (bInFlight)
+        throw (std::string("ClickatellSms request already in progress!"));
+
+    if (!oOptions.bCompressRequests)
+        pCompressor.reset();
+    else if (pCompressor == NULL || oOptions.iLevel != oCompress.iLevel)
+        pCompressor = std::make_unique<ClickCompressor>(oOptions.iLevel);
+
+    if (curlGzipHeaders != NULL) {
+        curl_slist_free_all(curlGzipHeaders);
+        curlGzipHeaders = NULL;
+    }
+
+    if (oOptions.bCompressRequests) {
+        for (struct curl_slist *curlItem = curlHeaders; curlItem != NULL; curlItem = curlItem->next)
+            curlGzipHeaders = curl_slist_append(curlGzipHeaders, curlItem->data);
+        curlGzipHeaders = curl_slist_append(curlGzipHeaders, "Content-Encoding: gzip");
+    }
+
+    oCompress = oOptions;
+    curl_easy_setopt(curlHandle, CURLOPT_ACCEPT_ENCODING, (oCompress.bAcceptEncoding ? "" : NULL));
+}
+
+/*
+ * Function:  ClickClientBase::SetBodyStreaming
+ * Info:      Sets the body length from which REST send bodies are streamed instead of being
+ *            formatted in the request arena. Must not be called while a request is in flight.
+ * Inputs:    iMinBytes - smallest body to stream (0: never stream)
+ * Return:    void
+ */
+void ClickClientBase::SetBodyStreaming(size_t iMinBytes)
+{
+    if (bInFlight)
+        throw (std::string("ClickatellSms request already in progress!"));
+
+    iStreamMinBytes = iMinBytes;
+}
+
+/*
+ * Function:  ClickClientBase::SetResultStream
+ * Info:      Turns streaming of per-recipient send results on or off. The parser is created
+ *            once and kept, so switching the handler per request costs nothing. Must not be
+ *            called while a request is in flight.
+ * Inputs:    fnResult    - called once per recipient of a send (NULL: streaming off)
+ *            pUserData   - passed to fnResult
+ *            iKeepBytes_ - response bytes kept while results are streamed
+ * Return:    void
+ */
+void ClickClientBase::SetResultStream(ClickRecipientFn fnResult, void *pUserData, size_t iKeepBytes_)
+{
+    if (bInFlight)
+        throw (std::string("ClickatellSms request already in progress!"));
+
+    if (pParser == NULL && fnResult != NULL)
+        pParser = std::make_unique<ClickResponseParser>(fnResult, pUserData);
+    else if (pParser != NULL)
+        pParser->SetHandler(fnResult, pUserData);
+
+    iKeepBytes = iKeepBytes_;
+}
+
+/*
+ * Function:  ClickClientBase::GetMetrics
+ * Info:      Sizes of the most recent request and response, before and after compression,
+ *            and the CPU time spent compressing the request body.
+ */
+const ClickRequestMetrics &ClickClientBase::GetMetrics() const
+{
+    return oMetrics;
+}
+
+/*
+ * Function:  ClickClientBase::Warmup
+ * Info:      Resolves the gateway and opens a connection (with TLS handshake) by sending a
+ *            HEAD request, so that the next API call does not pay for them.
+ * Return:    true if the connection was established
+ */
+bool ClickClientBase::Warmup()
+{
+    LocalRequestBegin();
+
+    sFullUrl = ClickApiBase::sBaseUrl;
+    eRequest = CLICK_CURL_GET;
+    LocalCurlPrepare();
+
+    curl_easy_setopt(curlHandle, CURLOPT_NOBODY, 1L);
+    curlCode = curl_easy_perform(curlHandle);
+    curl_easy_setopt(curlHandle, CURLOPT_NOBODY, 0L);
+    curl_easy_setopt(curlHandle, CURLOPT_HTTPGET, 1L);
+
+    return (curlCode == CURLE_OK);
+}
+
+/*
+ * Function:  ClickClientBase::SetResponse
+ * Info:      Function to set the 'sClickatellResponse' class member. Can be called for
+ *            example from an external callback function.
+ * Inputs:    cstr - character string designating new response to set to private class
+ *            member.
+ * Return:    void
+ */
+void ClickClientBase::SetResponse(char *chStr)
+{
+    sClickatellResponse.assign(chStr);
+}
+
+/*
+ * Function:  ClickClientBase::AppendResponse
+ * Info:      Appends a chunk of response data to the 'sClickatellResponse' class member.
+ *            Called from the cURL write callback. The buffer keeps its capacity between
+ *            requests, so this only allocates while the buffer is still growing.
+ *            The response of a send with streamed results (SetResultStream()) is parsed
+ *            here instead, and only its start is kept.
+ * Inputs:    chData - response data (not NUL-terminated)
+ *            iLen   - length of response data
+ * Return:    void
+ */
+void ClickClientBase::AppendResponse(const char *chData, size_t iLen)
+{
+    if (!bParseResponse) {
+        sClickatellResponse.append(chData, iLen);
+        return;
+    }
+
+    // the status is known once the body arrives; results carry it
+    if (pParser->HttpStatus() == 0) {
+        long iStatus = 0;
+
+        curl_easy_getinfo(curlHandle, CURLINFO_RESPONSE_CODE, &iStatus);
+        pParser->SetHttpStatus(iStatus);
+    }
+
+    pParser->Feed(chData, iLen);
+
+    // only the start of a streamed response is kept, e.g. for a request-level error
+    if (sClickatellResponse.length() < iKeepBytes)
+        sClickatellResponse.append(chData, std::min(iLen, iKeepBytes - sClickatellResponse.length()));
+}
+
+/* ----------------------------------------------------------------------------- *
+ * ClickatellClient function definitions                                         *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  LocalRequestBuild
+ * Info:      Formats the request for one Clickatell API operation in the request arena,
+ *            using the Api policy. The arena must have been reset by the caller
+ *            (LocalRequestBegin()), since the destination views may already live in it.
+ *            The operation is a template argument, so the parameter checks, the request
+ *            method and the request layout are all resolved at compile time.
+ * Inputs:    sArg     - message text (send), message ID (status, charge, stop) or
+ *                       msisdn (coverage). Unused for balance.
+ *            vMsisdns - destination mobile numbers (send only)
+ *            tScheduled - gateway-side delivery time (send only; epoch: at once)
+ * Return:    true if the request was built, false if a parameter was invalid or the
+ *            circuit breaker failed the request fast
+ */
+template <typename Api>
+template <eClickOperation eOp>
+bool ClickatellClient<Api>::LocalRequestBuild(std::string_view sArg, std::span<const std::string_view> vMsisdns,
+                                              ClickWallTime tScheduled)
+{
+    eRequest = Api::eMethods[eOp];
+
+    if (!LocalRequestAdmit((!Api::HasArg(eOp) || !sArg.empty()) && (!Api::HasMsisdns(eOp) || !vMsisdns.empty()),
+                           eOp, sArg, vMsisdns))
+        return false;
+
+    // large send bodies are streamed rather than formatted (only the URL goes into the arena)
+    if constexpr (Api::bStreamSend && Api::HasMsisdns(eOp)) {
+        if (iStreamMinBytes > 0) {
+            Api::template BuildStream<eOp>(oArena, oCred, sArg, vMsisdns, tScheduled, sFullUrl, oBodyStream);
+
+            if (oBodyStream.Length() >= iStreamMinBytes) {
+                sPostData = std::string_view();
+                bStreamBody = true;
+                return true;
+            }
+        }
+    }
+
+    Api::template Build<eOp>(oArena, oCred, sArg, vMsisdns, tScheduled, sFullUrl, sPostData);
+
+    return true;
+}
+
+/*
+ * Function:  ClickatellClient
+ * Info:      Constructor. Creates a client for the Api policy's Clickatell API.
+ * Inputs:    eDebugOpt       - debug option
+ *            oCred_          - login credentials (validated by their constructor)
+ *            iTimeout        - Maximum timeout for API call to take
+ *            iConnectTimeout - Maximum timeout for API call connection to take
+ */
+template <typename Api>
+ClickatellClient<Api>::ClickatellClient(eClickDebugOption eDebugOpt, const typename Api::Credentials &oCred_,
+                                        long iTimeout, long iConnectTimeout)
+                                        : ClickClientBase(eDebugOpt),
+                                          oCred(oCred_)
+{
+    Initialize(Api::eType, iTimeout, iConnectTimeout, Api::Headers(oCred));
+}
+
+/*
+ * Function:  SmsMessageSend
+ * Info:      Sends SMSes.
+ *            This function will set the URL / sPostData params as follows:
+ *            For REST, we need at least 2 key/value pairs:
+ *               "text" "to"
+ *            For other APIs (ie HTTP), we need at least 5 key/value pairs:
+ *               "user" "password" "api_id" "text" "to"
+ * Inputs:    sText     - Message Text (Latin1 input format supported in this library)
+ *            vMsisdns - Vector of destination mobile number strings
+ *            oOpts     - per-call options (deadline; the stop token is checked before sending)
+ * Return:    API Message ID or error code if operation unsuccessful or NULL if invalid parameter
+ */
+template <typename Api>
+const std::string &ClickatellClient<Api>::SmsMessageSend(const std::string &sText, const std::vector<std::string> &vMsisdns,
+                                                         const ClickCallOptions &oOpts)
+{
+    LocalRequestBegin();
+
+    // performs formatting of API call and then executes the request
+    if (LocalRequestBuild<CLICK_OP_SEND>(sText, LocalViews(vMsisdns)))
+        LocalCurlExecute(oOpts);
+
+    return Response();
+}
+
+/*
+ * Function:  SmsMessageSend
+ * Info:      Sends SMSes. Same as above, but takes views of the caller's data so that no
+ *            strings need to be constructed by the caller or by this library.
+ * Inputs:    sText    - Message Text (Latin1 input format supported in this library)
+ *            vMsisdns - span of destination mobile number views
+ *            oOpts    - per-call options (see above)
+ * Return:    API Message ID or error code if operation unsuccessful or NULL if invalid parameter
+ */
+template <typename Api>
+const std::string &ClickatellClient<Api>::SmsMessageSend(std::string_view sText, std::span<const std::string_view> vMsisdns,
+                                                         const ClickCallOptions &oOpts)
+{
+    LocalRequestBegin();
+
+    // performs formatting of API call and then executes the request
+    if (LocalRequestBuild<CLICK_OP_SEND>(sText, vMsisdns))
+        LocalCurlExecute(oOpts);
+
+    return Response();
+}
+
+/*
+ * Function:  SmsStatusGet
+ * Info:      Obtain current status of an SMS message.
+ *            Authentication: This function uses username/password to authenticate for the
+ *                            HTTP API, however it is also possible in a session to use a session ID to
+ *                            authenticate with the HTTP API. See the Clickatell API docs at
+ *                            www.clickatell.com for more details.
+ *            URL Encoding: For the HTTP API, The URL parameter values are URL-encoded by
+ *                          HttpApi::Build().
+ * Inputs:    API Message ID - SMS ID assigned by Clickatell
+ *            oOpts          - per-call options (see SmsMessageSend())
+ * Return:    Status of API message
+ */
+template <typename Api>
+const std::string &ClickatellClient<Api>::SmsStatusGet(std::string_view sMsgId, const ClickCallOptions &oOpts)
+{
+    ClickFlightTicket oTicket;
+
+    LocalRequestBegin();
+
+    // identical concurrent queries share one transfer (SetCoalescer())
+    if (LocalJoin(CLICK_OP_STATUS, oCred.sApiId, sMsgId, oOpts.tDeadline, oTicket))
+        return Response();
+
+    // performs formatting of API call and then executes the request
+    if (LocalRequestBuild<CLICK_OP_STATUS>(sMsgId, {}))
+        LocalCurlExecute(oOpts);
+
+    LocalPublish(oTicket);
+
+    return Response();
+}
+
+/*
+ * Function:  SmsBalanceGet
+ * Info:      Obtain user's credit balance.
+ *            Authentication: This function uses username/password to authenticate for the
+ *                            HTTP API, however it is also possible in a session to use a session ID to
+ *                            authenticate with the HTTP API. See the Clickatell API docs at
+ *                            www.clickatell.com for more details.
+ *            URL Encoding: For the HTTP API, The URL parameter values are URL-encoded by
+ *                          HttpApi::Build().
+ * Inputs:    oOpts - per-call options (see SmsMessageSend())
+ * Return:    User's current balance.
+ */
+template <typename Api>
+const std::string &ClickatellClient<Api>::SmsBalanceGet(const ClickCallOptions &oOpts)
+{
+    ClickFlightTicket oTicket;
+
+    LocalRequestBegin();
+
+    // identical concurrent queries share one transfer (SetCoalescer())
+    if (LocalJoin(CLICK_OP_BALANCE, oCred.sApiId, std::string_view(), oOpts.tDeadline, oTicket))
+        return Response();
+
+    // performs formatting of API call and then executes the request
+    if (LocalRequestBuild<CLICK_OP_BALANCE>(std::string_view(), {}))
+        LocalCurlExecute(oOpts);
+
+    LocalPublish(oTicket);
+
+    return Response();
+}
+
+/*
+ * Function:  SmsChargeGet
+ * Info:      Obtain charge of an SMS message.
+ *            Authentication: This function uses username/password to authenticate for the
+ *                            HTTP API, however it is also possible in a session to use a session ID to
+ *                            authenticate with the HTTP API. See the Clickatell API docs at
+ *                            www.clickatell.com for more details.
+ *            URL Encoding: For the HTTP API, The URL parameter values are URL-encoded by
+ *                          HttpApi::Build().
+ * Inputs:    API Message ID - SMS ID assigned by Clickatell
+ *            oOpts          - per-call options (see SmsMessageSend())
+ * Return:    Charge of SMS message.
+ */
+template <typename Api>
+const std::string &ClickatellClient<Api>::SmsChargeGet(std::string_view sMsgId, const ClickCallOptions &oOpts)
+{
+    ClickFlightTicket oTicket;
+
+    LocalRequestBegin();
+
+    // identical concurrent queries share one transfer (SetCoalescer())
+    if (LocalJoin(CLICK_OP_CHARGE, oCred.sApiId, sMsgId, oOpts.tDeadline, oTicket))
+        return Response();
+
+    // performs formatting of API call and then executes the request
+    if (LocalRequestBuild<CLICK_OP_CHARGE>(sMsgId, {}))
+        LocalCurlExecute(oOpts);
+
+    LocalPublish(oTicket);
+
+    return Response();
+}
+
+/*
+ * Function:  SmsCoverageGet
+ * Info:      Enables users to check Clickatell coverage of a network/number, without sending
+ *            a message to that number
+ *            Authentication: This function uses username/password to authenticate for the
+ *                            HTTP API, however it is also possible in a session to use a session ID to
+ *                            authenticate with the HTTP API. See the Clickatell API docs at
+ *                            www.clickatell.com for more details.
+ *            URL Encoding: For the HTTP API, The URL parameter values are URL-encoded by
+ *                          HttpApi::Build().
+ * Inputs:    sMsisdn - single msisdn for which Clickatell will verify has supported coverage
+ *            oOpts   - per-call options (see SmsMessageSend())
+ * Return:    Prefix is currently supported or prefix is not supported by Clickatell.
+ */
+template <typename Api>
+const std::string &ClickatellClient<Api>::SmsCoverageGet(std::string_view sMsisdn, const ClickCallOptions &oOpts)
+{
+    ClickFlightTicket oTicket;
+
+    LocalRequestBegin();
+
+    // identical concurrent queries share one transfer (SetCoalescer())
+    if (LocalJoin(CLICK_OP_COVERAGE, oCred.sApiId, sMsisdn, oOpts.tDeadline, oTicket))
+        return Response();
+
+    // performs formatting of API call and then executes the request
+    if (LocalRequestBuild<CLICK_OP_COVERAGE>(sMsisdn, {}))
+        LocalCurlExecute(oOpts);
+
+    LocalPublish(oTicket);
+
+    return Response();
+}
+
+/*
+ * Function:  SmsMessageStop
+ * Info:      Attempt to stop the delivery of an SMS message. This command can only stop messages
+ *            which may be queued within the Clickatell system and not messages which have already
+ *            been delivered to an SMSC.
+ *            Authentication: This function uses username/password to authenticate for the
+ *                            HTTP API, however it is also possible in a session to use a session ID to
+ *                            authenticate with the HTTP API. See the Clickatell API docs at
+ *                            www.clickatell.com for more details.
+ *            URL Encoding: For the HTTP API, The URL parameter values are URL-encoded by
+ *                          HttpApi::Build().
+ * Inputs:    API Message ID - SMS ID assigned by Clickatell
+ *            oOpts          - per-call options (see SmsMessageSend())
+ * Return:    ID with status or an error number with error description.
+ */
+template <typename Api>
+const std::string &ClickatellClient<Api>::SmsMessageStop(std::string_view sMsgId, const ClickCallOptions &oOpts)
+{
+    LocalRequestBegin();
+
+    // performs formatting of API call and then executes the request
+    if (LocalRequestBuild<CLICK_OP_STOP>(sMsgId, {}))
+        LocalCurlExecute(oOpts);
+
+    return Response();
+}
+
+/*
+ * Function:  SmsMessageSendAsync, SmsStatusGetAsync, SmsBalanceGetAsync, SmsChargeGetAsync,
+ *            SmsCoverageGetAsync, SmsMessageStopAsync
+ * Info:      Awaitable versions of the API functions above. The request is built when the
+ *            function is called; co_await-ing the result registers the transfer with oLoop
+ *            and suspends the awaiting coroutine until the transfer completes. The coroutine
+ *            is resumed on the thread driving oLoop.
+ *            Only one request may be in flight per client object; use one object per
+ *            concurrent request.
+ *            oOpts.oStopToken aborts the transfer when stop is requested, and oOpts.tDeadline
+ *            bounds the whole transfer (an already expired deadline completes immediately
+ *            with CURLE_OPERATION_TIMEDOUT without sending anything). For a send,
+ *            oOpts.tScheduled asks the gateway to hold the message until that time.
+ * Inputs:    oLoop - event loop that drives the transfer
+ *            see the corresponding blocking function for the remaining inputs
+ * Return:    awaiter yielding the same response as the blocking function
+ */
+template <typename Api>
+ClickSmsAwaiter ClickatellClient<Api>::SmsMessageSendAsync(ClickLoop &oLoop, std::string_view sText,
+                                                           std::span<const std::string_view> vMsisdns,
+                                                           const ClickCallOptions &oOpts)
+{
+    LocalRequestBegin();
+    return LocalRequestAsync(oLoop, LocalRequestBuild<CLICK_OP_SEND>(sText, vMsisdns, oOpts.tScheduled), oOpts);
+}
+
+template <typename Api>
+ClickSmsAwaiter ClickatellClient<Api>::SmsStatusGetAsync(ClickLoop &oLoop, std::string_view sMsgId, const ClickCallOptions &oOpts)
+{
+    LocalRequestBegin();
+    return LocalRequestAsync(oLoop, LocalRequestBuild<CLICK_OP_STATUS>(sMsgId, {}), oOpts);
+}
+
+template <typename Api>
+ClickSmsAwaiter ClickatellClient<Api>::SmsBalanceGetAsync(ClickLoop &oLoop, const ClickCallOptions &oOpts)
+{
+    LocalRequestBegin();
+    return LocalRequestAsync(oLoop, LocalRequestBuild<CLICK_OP_BALANCE>(std::string_view(), {}), oOpts);
+}
+
+template <typename Api>
+ClickSmsAwaiter ClickatellClient<Api>::SmsChargeGetAsync(ClickLoop &oLoop, std::string_view sMsgId, const ClickCallOptions &oOpts)
+{
+    LocalRequestBegin();
+    return LocalRequestAsync(oLoop, LocalRequestBuild<CLICK_OP_CHARGE>(sMsgId, {}), oOpts);
+}
+
+template <typename Api>
+ClickSmsAwaiter ClickatellClient<Api>::SmsCoverageGetAsync(ClickLoop &oLoop, std::string_view sMsisdn, const ClickCallOptions &oOpts)
+{
+    LocalRequestBegin();
+    return LocalRequestAsync(oLoop, LocalRequestBuild<CLICK_OP_COVERAGE>(sMsisdn, {}), oOpts);
+}
+
+template <typename Api>
+ClickSmsAwaiter ClickatellClient<Api>::SmsMessageStopAsync(ClickLoop &oLoop, std::string_view sMsgId, const ClickCallOptions &oOpts)
+{
+    LocalRequestBegin();
+    return LocalRequestAsync(oLoop, LocalRequestBuild<CLICK_OP_STOP>(sMsgId, {}), oOpts);
+}
+
+// the two supported specializations
+template class ClickatellClient<HttpApi>;
+template class ClickatellClient<RestApi>;
+
+/* ----------------------------------------------------------------------------- *
+ * ClickSmsAwaiter function definitions                                          *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickSmsAwaiter
+ * Info:      Constructor. Called by the *Async() API functions once the request has been
+ *            built. Parameter errors and expired deadlines complete immediately.
+ * Inputs:    oSms_  - object whose request is to be transferred
+ *            oLoop_ - event loop that drives the transfer
+ *            bBuilt - false if the request could not be built (invalid parameter)
+ *            oOpts  - per-call options
+ */
+ClickSmsAwaiter::ClickSmsAwaiter(ClickClientBase &oSms_, ClickLoop &oLoop_, bool bBuilt, const ClickCallOptions &oOpts)
+                                 : oSms(oSms_),
+                                   oLoop(oLoop_),
+                                   curlResult(CURLE_OK),
+                                   eState(bBuilt ? CLICK_AWAIT_PENDING : CLICK_AWAIT_INVALID),
+                                   bResumed(false),
+                                   bNotSent(false),
+                                   oStopToken(oOpts.oStopToken)
+{
+    if (eState == CLICK_AWAIT_PENDING && oOpts.tDeadline <= std::chrono::steady_clock::now()) {
+        eState = CLICK_AWAIT_FINISHED;
+        curlResult = CURLE_OPERATION_TIMEDOUT;
+    }
+    else if (eState == CLICK_AWAIT_PENDING && oStopToken.stop_requested()) {
+        eState = CLICK_AWAIT_FINISHED;
+        curlResult = CURLE_ABORTED_BY_CALLBACK;
+    }
+
+    // nothing will be sent (see await_resume())
+    bNotSent = (eState == CLICK_AWAIT_FINISHED);
+
+    oTransfer.curlHandle = oSms.curlHandle;
+    oTransfer.fnDone = ClickSmsAwaiter::OnDone;
+    oTransfer.pUserData = this;
+}
+
+/*
+ * Function:  ~ClickSmsAwaiter
+ * Info:      Destructor. Releases the client object if the awaiter was discarded
+ *            without being awaited. Destroying a coroutine while it is suspended on a
+ *            registered transfer is not supported; cancel the transfer first.
+ */
+ClickSmsAwaiter::~ClickSmsAwaiter()
+{
+    if (eState != CLICK_AWAIT_INVALID && !bResumed) {
+        oSms.LocalBreakerRecord(CURLE_ABORTED_BY_CALLBACK);
+        oSms.tDeadline = ClickTimePoint::max();
+        oSms.bInFlight = false;
+    }
+}
+
+/*
+ * Function:  ClickSmsAwaiter::OnDone
+ * Info:      Loop completion callback. Resumes the awaiting coroutine.
+ * Inputs:    pUserData - the awaiter
+ *            curlCode  - transfer result
+ * Return:    void
+ */
+void ClickSmsAwaiter::OnDone(void *pUserData, CURLcode curlCode)
+{
+    ClickSmsAwaiter *pAwaiter = static_cast<ClickSmsAwaiter *>(pUserData);
+
+    pAwaiter->curlResult = curlCode;
+    pAwaiter->eState = CLICK_AWAIT_FINISHED;
+    pAwaiter->hWaiter.resume();
+}
+
+/*
+ * Function:  ClickSmsAwaiter::await_suspend
+ * Info:      Registers the transfer with the loop. If stop is requested from then on, the
+ *            transfer is cancelled through the loop.
+ * Inputs:    hWaiter_ - awaiting coroutine
+ * Return:    false if the transfer could not be started (the coroutine continues at once)
+ */
+bool ClickSmsAwaiter::await_suspend(std::coroutine_handle<> hWaiter_)
+{
+    hWaiter = hWaiter_;
+
+    oSms.LocalCurlPrepare();
+
+    if (!oLoop.Add(&oTransfer)) {
+        curlResult = CURLE_FAILED_INIT;
+        eState = CLICK_AWAIT_FINISHED;
+        return false;
+    }
+
+    if (oStopToken.stop_possible())
+        oStopCallback.emplace(oStopToken, ClickSmsStopFn{this});
+
+    return true;
+}
+
+/*
+ * Function:  ClickSmsAwaiter::await_resume
+ * Info:      Records the transfer result in the client object, or a not-sent result if
+ *            the call finished before sending.
+ * Return:    the response (valid until the next request on the same object)
+ */
+const std::string &ClickSmsAwaiter::await_resume()
+{
+    oStopCallback.reset();
+    bResumed = true;
+
+    if (bNotSent)
+        oSms.LocalCurlNotSent(curlResult);
+    else if (eState != CLICK_AWAIT_INVALID)
+        oSms.LocalCurlComplete(curlResult);
+
+    return oSms.sClickatellResponse;
+}
+
+/*
+ * Function:  ClickSmsStopFn::operator()
+ * Info:      Stop-token callback: cancels the awaiter's transfer (may run on any thread).
+ * Return:    void
+ */
+void ClickSmsStopFn::operator()() const noexcept
+{
+    pAwaiter->oLoop.Cancel(&pAwaiter->oTransfer);
+}
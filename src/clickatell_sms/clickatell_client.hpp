@@ -0,0 +1,318 @@
+#ifndef CLICKATELL_CLIENT_H
+#define CLICKATELL_CLIENT_H
+
+/*
+ * clickatell_client.hpp
+ *
+ *  Clickatell SMS client specialized at compile time for one API.
+ *
+ *  ClickClientBase holds everything that does not depend on the API: the cURL handle, the
+ *  request arena, the response, timeouts and deadlines, and the optional circuit breaker,
+ *  shared connection state and query coalescer. ClickatellClient<Api> adds the login credentials and the API
+ *  functions, building each request with the Api policy (HttpApi or RestApi, see
+ *  clickatell_api.hpp):
+ *
+ *      ClickatellClient<RestApi> oClient(CLICK_DEBUG_OFF, {"apikey", "apiid"}, 5, 5);
+ *      oClient.SmsBalanceGet();
+ *
+ *  ClickatellSms wraps both specializations for callers that pick the API at run time.
+ */
+#include <stdint.h>
+#include <coroutine>
+#include <iosfwd>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <curl/curl.h>
+
+#include "clickatell_debug.hpp"
+#include "clickatell_arena.hpp"
+#include "clickatell_loop.hpp"
+#include "clickatell_api.hpp"
+#include "clickatell_compress.hpp"
+#include "clickatell_parser.hpp"
+
+class ClickClientBase;
+class ClickSmsAwaiter;
+class ClickCircuitBreaker;
+class ClickShare;
+class ClickCoalescer;
+struct ClickFlightTicket;
+enum eClickBreakerPermit : int;
+
+// stop-token callback used by ClickSmsAwaiter
+struct ClickSmsStopFn {
+    ClickSmsAwaiter *pAwaiter;
+    void operator()() const noexcept;
+};
+
+// state of a ClickSmsAwaiter
+enum eClickAwaitState {
+    CLICK_AWAIT_INVALID,  // request could not be built, nothing to transfer
+    CLICK_AWAIT_PENDING,  // request built, transfer not finished
+    CLICK_AWAIT_FINISHED  // transfer finished (or abandoned before it started)
+};
+
+/* Awaitable returned by the *Async() API functions.
+ * co_await yields the Clickatell response string, exactly as the blocking functions do.
+ */
+class ClickSmsAwaiter
+{
+private:
+    friend struct ClickSmsStopFn;
+
+    ClickClientBase &oSms;          // object owning the request and cURL handle
+    ClickLoop &oLoop;               // loop driving the transfer
+    ClickTransfer oTransfer;        // loop registration
+    std::coroutine_handle<> hWaiter; // coroutine to resume on completion
+    CURLcode curlResult;            // transfer result
+    eClickAwaitState eState;        // awaiter state
+    bool bResumed;                  // await_resume() has run
+    bool bNotSent;                  // finished before sending (deadline passed or stop requested)
+    std::stop_token oStopToken;     // caller's cancellation token
+    std::optional<std::stop_callback<ClickSmsStopFn>> oStopCallback; // registered while suspended
+
+    static void OnDone(void *pUserData, CURLcode curlCode);
+
+public:
+    ClickSmsAwaiter(ClickClientBase &oSms_, ClickLoop &oLoop_, bool bBuilt, const ClickCallOptions &oOpts);
+    ~ClickSmsAwaiter();
+
+    ClickSmsAwaiter(const ClickSmsAwaiter &) = delete;
+    ClickSmsAwaiter &operator=(const ClickSmsAwaiter &) = delete;
+
+    bool await_ready() const noexcept { return eState != CLICK_AWAIT_PENDING; }
+    bool await_suspend(std::coroutine_handle<> hWaiter_);
+    const std::string &await_resume();
+};
+
+// API-independent part of a Clickatell SMS client
+class ClickClientBase
+{
+private:
+    friend class ClickSmsAwaiter;
+
+    void LocalCurlConfig(long iTimeout, long iConnectTimeout);
+    void LocalCurlComplete(CURLcode curlResult);
+    void LocalCurlNotSent(CURLcode curlResult);
+    bool LocalBreakerAdmit(eClickOperation eOp, std::string_view sArg, std::span<const std::string_view> vMsisdns);
+    void LocalBreakerRecord(CURLcode curlResult);
+    void LocalMetricsRecord(curl_off_t iWireBytes);
+
+    // output data
+    std::string sClickatellResponse; // Clickatell API response string
+
+    // cURL-request class members
+    struct curl_slist *curlHeaders; // cURL header data
+    long     curlHttpStatus;        // HTTP status code
+    CURL    *curlHandle;            // libcurl handle
+    CURLcode curlCode;              // return code from recent curl request
+
+    ClickTimePoint tDeadline;       // deadline of the current request (max() if none)
+    long iTimeoutMs;                // default maximum duration of a request
+    long iConnectTimeoutMs;         // default maximum duration of connection set-up
+    bool bDeadlineCut;              // the deadline shortened the current request's timeout
+    bool bNotSent;                  // the last request finished before it was sent
+    bool bInFlight;                 // an asynchronous request is using the arena and cURL handle
+
+    // circuit breaker (optional, shared with other instances using the same endpoint)
+    ClickCircuitBreaker *pBreaker;  // NULL if not used
+    eClickBreakerPermit ePermit;    // admission of the current request
+    ClickTimePoint tSent;           // time the current request was handed to cURL
+    bool bShortCircuited;           // the last request was failed fast by the breaker
+
+    // shared DNS/TLS/connection state (optional)
+    ClickShare *pShare;                         // NULL if not used
+    std::shared_ptr<curl_slist> pResolveList;   // CURLOPT_RESOLVE list in use
+    uint64_t iResolveGen;                       // generation of pResolveList
+
+    // single-flight coalescing of read-only queries (optional, shared with other instances)
+    ClickCoalescer *pCoalescer;                 // NULL if not used
+
+    // body compression (optional)
+    ClickCompressOptions oCompress;             // current options
+    std::unique_ptr<ClickCompressor> pCompressor; // NULL unless request bodies are compressed
+    struct curl_slist *curlGzipHeaders;         // default headers plus Content-Encoding: gzip
+    ClickRequestMetrics oMetrics;               // figures of the most recent request
+
+    // per-recipient send results (optional)
+    std::unique_ptr<ClickResponseParser> pParser; // NULL until send results are first streamed
+    size_t iKeepBytes;                          // response bytes kept while results are streamed
+    bool bParseResponse;                        // the current request is a send parsed by pParser
+
+    // process-wide metrics (see clickatell_metrics.hpp)
+    eClickApi eApiType;                         // API of this client
+    eClickOperation eMetricOp;                  // operation of the current request
+    size_t iMetricMessages;                     // send: recipients of the current request
+    size_t iMetricSegments;                     // send: SMS segments over all recipients
+    bool bMetricPending;                        // the current request was admitted and is not yet counted
+    bool bMetricInFlight;                       // the current request is counted as in flight
+
+protected:
+    // per-request data - all of it lives in oArena, which is reset at the start of every request
+    ClickArena oArena;           // request-building arena
+    std::string_view sFullUrl;   // URL request to Clickatell
+    std::string_view sPostData;  // cURL 'POST request' data
+    ClickBodyStream oBodyStream; // send body read by cURL, if bStreamBody
+    bool bStreamBody;            // the body is streamed from oBodyStream instead of sPostData
+    size_t iStreamMinBytes;      // send bodies at least this long are streamed (0: never)
+
+    ClickDebug oLocalDebug;  // local debug instance
+
+    eClickCurlRequestType eRequest; // Type of request (i.e. POST, GET, DELETE)
+
+    ClickClientBase(eClickDebugOption eDebugOpt);
+    ~ClickClientBase();
+
+    void Initialize(eClickApi eApiType_, long iTimeout, long iConnectTimeout, struct curl_slist *curlHeaders_);
+    void LocalCurlPrepare();
+    void LocalCurlExecute(const ClickCallOptions &oOpts);
+    void LocalRequestBegin();
+    bool LocalRequestAdmit(bool bValid, eClickOperation eOp, std::string_view sArg,
+                           std::span<const std::string_view> vMsisdns);
+    std::span<const std::string_view> LocalViews(const std::vector<std::string> &vStrings);
+    bool LocalJoin(eClickOperation eOp, std::string_view sScope, std::string_view sArg, ClickTimePoint tDeadline,
+                   ClickFlightTicket &oTicket);
+    void LocalPublish(ClickFlightTicket &oTicket);
+    ClickSmsAwaiter LocalRequestAsync(ClickLoop &oLoop, bool bBuilt, const ClickCallOptions &oOpts);
+    const std::string &Response() const { return sClickatellResponse; }
+
+public:
+    ClickClientBase(const ClickClientBase &) = delete;
+    ClickClientBase &operator=(const ClickClientBase &) = delete;
+
+    // result of the most recent request
+    CURLcode GetCurlCode() const;
+    long GetHttpStatus() const;
+    bool GetShortCircuited() const;
+
+    /* True if the most recent request finished without being sent, because its deadline
+     * had passed (CURLE_OPERATION_TIMEDOUT) or its stop was requested
+     * (CURLE_ABORTED_BY_CALLBACK) before the transfer started.
+     */
+    bool GetNotSent() const;
+
+    /* True if the most recent request timed out because the call's deadline shortened its
+     * timeout, rather than on the instance's own timeouts. Such a request may or may not
+     * have reached the gateway (see GetNotSent()).
+     */
+    bool GetDeadlineCut() const;
+
+    /* Sets the default request and connect timeouts in milliseconds (0: library defaults),
+     * replacing the whole seconds given to the constructor. A call's deadline shortens
+     * both. Must not be called while a request is in flight.
+     */
+    void SetTimeouts(long iTimeoutMs_, long iConnectTimeoutMs_);
+
+    /* Attaches a circuit breaker (NULL to detach). While it is open, requests are not sent:
+     * they complete at once with CURLE_COULDNT_CONNECT, an empty response and
+     * GetShortCircuited() returning true. The breaker must outlive this object.
+     */
+    void SetCircuitBreaker(ClickCircuitBreaker *pBreaker_);
+
+    /* Attaches shared DNS/TLS/connection state (NULL to detach), including any host pinning
+     * it publishes. The share must outlive this object (or be detached first).
+     */
+    void SetShare(ClickShare *pShare_);
+
+    /* Attaches a query coalescer (NULL to detach): SmsStatusGet(), SmsBalanceGet(),
+     * SmsChargeGet() and SmsCoverageGet() then share one transfer with the identical calls
+     * of other instances, or are answered from its cache. GetMetrics() keeps describing the
+     * last request this object sent itself. The coalescer must outlive this object.
+     */
+    void SetCoalescer(ClickCoalescer *pCoalescer_);
+
+    /* Enables compressed responses and, optionally, gzip-compressed request bodies of at
+     * least oOptions.iMinBytes (a body is sent uncompressed if gzip does not shrink it).
+     * Both are off until this is called.
+     */
+    void SetCompression(const ClickCompressOptions &oOptions);
+
+    /* Streams REST send bodies of at least iMinBytes (0: never) to the gateway as cURL
+     * reads them, instead of formatting them in the request arena, so that a send costs
+     * the same memory whatever the number of destinations. A streamed body is sent with
+     * its precomputed length and is never compressed. The text and destinations of a
+     * streamed send must stay valid until the transfer completes, also for *Async().
+     */
+    void SetBodyStreaming(size_t iMinBytes);
+
+    /* Reports the per-recipient results of every send to fnResult while the response is
+     * still arriving (see ClickResponseParser), on the thread running the transfer. The
+     * response of a send then keeps only its first iKeepBytes bytes, so memory stays
+     * bounded however many recipients the response lists. fnResult must not start a
+     * request on this object. NULL turns result streaming off.
+     */
+    void SetResultStream(ClickRecipientFn fnResult, void *pUserData, size_t iKeepBytes = CLICK_PARSER_KEEP_BYTES);
+
+    // sizes, compression ratios, compression CPU time and transfer timings of the most recent request
+    const ClickRequestMetrics &GetMetrics() const;
+
+    // opens (or refreshes) this object's connection to the gateway with a HEAD request
+    bool Warmup();
+
+    // gateway base URL
+    static std::string_view BaseUrl() { return ClickApiBase::sBaseUrl; }
+
+    // setter functions (can be called from a callback, so they need to be public)
+    void SetResponse(char *chStr);
+    void AppendResponse(const char *chData, size_t iLen);
+
+    friend std::ostream& operator<<(std::ostream& os, const ClickClientBase &oClient);
+};
+
+// Clickatell SMS client for one API (HttpApi or RestApi)
+template <typename Api>
+class ClickatellClient : public ClickClientBase
+{
+private:
+    typename Api::Credentials oCred; // login credentials
+
+    template <eClickOperation eOp>
+    bool LocalRequestBuild(std::string_view sArg, std::span<const std::string_view> vMsisdns,
+                           ClickWallTime tScheduled = ClickWallTime());
+
+public:
+    typedef Api ApiType;
+
+    ClickatellClient(eClickDebugOption eDebugOpt, const typename Api::Credentials &oCred_,
+                     long iTimeout, long iConnectTimeout);
+
+    /* Clickatell API functions
+     * The returned response reference stays valid until the next API call on this object.
+     * The string_view/span overload of SmsMessageSend() performs no heap allocations once
+     * the request arena and response buffer have grown to their steady-state size.
+     * oOpts.tDeadline bounds the call; oOpts.tScheduled is not used.
+     */
+    const std::string &SmsMessageSend(const std::string &sText, const std::vector<std::string> &vMsisdns,
+                                      const ClickCallOptions &oOpts = ClickCallOptions());
+    const std::string &SmsMessageSend(std::string_view sText, std::span<const std::string_view> vMsisdns,
+                                      const ClickCallOptions &oOpts = ClickCallOptions());
+    const std::string &SmsStatusGet(std::string_view sMsgId, const ClickCallOptions &oOpts = ClickCallOptions());
+    const std::string &SmsBalanceGet(const ClickCallOptions &oOpts = ClickCallOptions());
+    const std::string &SmsChargeGet(std::string_view sMsgId, const ClickCallOptions &oOpts = ClickCallOptions());
+    const std::string &SmsCoverageGet(std::string_view sMsisdn, const ClickCallOptions &oOpts = ClickCallOptions());
+    const std::string &SmsMessageStop(std::string_view sMsgId, const ClickCallOptions &oOpts = ClickCallOptions());
+
+    /* Awaitable Clickatell API functions (C++20 coroutines)
+     * The request is built immediately; co_await suspends until the transfer driven by oLoop
+     * completes. One request may be in flight per object at a time.
+     */
+    ClickSmsAwaiter SmsMessageSendAsync(ClickLoop &oLoop, std::string_view sText, std::span<const std::string_view> vMsisdns,
+                                        const ClickCallOptions &oOpts = ClickCallOptions());
+    ClickSmsAwaiter SmsStatusGetAsync(ClickLoop &oLoop, std::string_view sMsgId, const ClickCallOptions &oOpts = ClickCallOptions());
+    ClickSmsAwaiter SmsBalanceGetAsync(ClickLoop &oLoop, const ClickCallOptions &oOpts = ClickCallOptions());
+    ClickSmsAwaiter SmsChargeGetAsync(ClickLoop &oLoop, std::string_view sMsgId, const ClickCallOptions &oOpts = ClickCallOptions());
+    ClickSmsAwaiter SmsCoverageGetAsync(ClickLoop &oLoop, std::string_view sMsisdn, const ClickCallOptions &oOpts = ClickCallOptions());
+    ClickSmsAwaiter SmsMessageStopAsync(ClickLoop &oLoop, std::string_view sMsgId, const ClickCallOptions &oOpts = ClickCallOptions());
+};
+
+// both specializations are compiled once, in clickatell_client.cpp
+extern template class ClickatellClient<HttpApi>;
+extern template class ClickatellClient<RestApi>;
+
+#endif // CLICKATELL_CLIENT_H
@@ -0,0 +1,201 @@
+/*
+ * clickatell_coalesce.cpp
+ *
+ *  Single-flight coalescing of read-only queries for the Clickatell SMS library.
+ *
+ *  The first caller of a query registers a flight under the query's key and sends it; the
+ *  callers that find the flight wait on its condition variable. The sender removes the
+ *  flight when it completes, so a query arriving afterwards starts a new transfer unless
+ *  the result was cached. Expired cache entries are dropped when they are looked up, and
+ *  all of them when the cache is full. A flight abandoned at its sender's deadline wakes its
+ *  callers without a result; the first of them to look the query up again becomes its
+ *  new sender.
+ */
+
+#include "clickatell_coalesce.hpp"
+
+/* ----------------------------------------------------------------------------- *
+ * Private function definitions                                                  *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickCoalescer::LocalCache
+ * Info:      Caches a result if its operation has a TTL and the query succeeded (mtxState
+ *            held).
+ * Inputs:    sKey    - query key
+ *            eOp     - operation
+ *            oResult - result
+ *            tNow    - current time
+ * Return:    void
+ */
+void ClickCoalescer::LocalCache(const std::string &sKey, eClickOperation eOp, const ClickCoalescedResult &oResult, ClickTimePoint tNow)
+{
+    if (oOptions.iTtlMs[eOp] == 0 || oResult.curlCode != CURLE_OK || oResult.iHttpStatus < 200 || oResult.iHttpStatus >= 300)
+        return;
+
+    if (mCache.size() >= oOptions.iMaxCached) {
+        for (std::unordered_map<std::string, ClickCachedResult>::iterator it = mCache.begin(); it != mCache.end(); ) {
+            if (it->second.tExpires <= tNow)
+                it = mCache.erase(it);
+            else
+                ++it;
+        }
+
+        if (mCache.size() >= oOptions.iMaxCached)
+            return;
+    }
+
+    mCache[sKey] = ClickCachedResult{oResult, tNow + std::chrono::milliseconds(oOptions.iTtlMs[eOp])};
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Public function definitions                                                   *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickCoalescer
+ * Info:      Constructor. Send and stop requests change state, so they are never cached.
+ * Inputs:    oOptions_ - cache TTLs and size
+ */
+ClickCoalescer::ClickCoalescer(const ClickCoalesceOptions &oOptions_)
+                               : oOptions(oOptions_),
+                                 oStats()
+{
+    oOptions.iTtlMs[CLICK_OP_SEND] = 0;
+    oOptions.iTtlMs[CLICK_OP_STOP] = 0;
+}
+
+/*
+ * Function:  ClickCoalescer::Begin
+ * Info:      Answers a query from the cache, joins the identical query in flight, or makes
+ *            the caller its sender.
+ * Inputs:    eOp       - operation (read-only)
+ *            eApi      - API
+ *            sScope    - account scope, e.g. the API ID (queries of different accounts differ)
+ *            sArg      - message ID or MSISDN (empty for balance)
+ *            tDeadline - the caller's deadline; waiting for a transfer in flight ends there
+ * Outputs:   oTicket - the caller's flight, if it sends the query
+ *            oResult - the result, if true is returned
+ * Return:    true if oResult holds the result, false if the caller must send the query
+ */
+bool ClickCoalescer::Begin(eClickOperation eOp, eClickApi eApi, std::string_view sScope, std::string_view sArg,
+                           ClickFlightTicket &oTicket, ClickCoalescedResult &oResult, ClickTimePoint tDeadline)
+{
+    ClickTimePoint tNow = std::chrono::steady_clock::now();
+    std::shared_ptr<ClickFlight> pFlight;
+
+    oTicket.sKey.clear();
+    oTicket.sKey.push_back((char)('0' + eOp));
+    oTicket.sKey.push_back((char)('0' + eApi));
+    oTicket.sKey.append(sScope);
+    oTicket.sKey.push_back('\0');
+    oTicket.sKey.append(sArg);
+    oTicket.eOp = eOp;
+
+    std::unique_lock<std::mutex> oLock(mtxState);
+
+    std::unordered_map<std::string, ClickCachedResult>::iterator itCache = mCache.find(oTicket.sKey);
+
+    if (itCache != mCache.end()) {
+        if (itCache->second.tExpires > tNow) {
+            oResult = itCache->second.oResult;
+            oStats.iCacheHits[eOp]++;
+            return true;
+        }
+
+        mCache.erase(itCache);
+    }
+
+    for (;;) {
+        std::unordered_map<std::string, std::shared_ptr<ClickFlight>>::iterator itFlight = mFlights.find(oTicket.sKey);
+
+        if (itFlight == mFlights.end()) {
+            oTicket.pFlight = std::make_shared<ClickFlight>();
+            mFlights.emplace(oTicket.sKey, oTicket.pFlight);
+            oStats.iSent[eOp]++;
+            return false;
+        }
+
+        pFlight = itFlight->second;
+        oStats.iCollapsed[eOp]++;
+
+        if (tDeadline == ClickTimePoint::max())
+            pFlight->cvDone.wait(oLock, [&]() { return pFlight->bDone; });
+        else if (!pFlight->cvDone.wait_until(oLock, tDeadline, [&]() { return pFlight->bDone; })) {
+            oResult = ClickCoalescedResult{std::string(), CURLE_OPERATION_TIMEDOUT, 0, false};
+            oStats.iTimedOut[eOp]++;
+            return true;
+        }
+
+        if (!pFlight->bAbandoned) {
+            oResult = pFlight->oResult;
+            return true;
+        }
+    }
+}
+
+/*
+ * Function:  ClickCoalescer::Complete
+ * Info:      Publishes the result of a query to the callers that joined it, caches it, and
+ *            ends the flight.
+ * Inputs:    oTicket - ticket from Begin() (cleared)
+ *            oResult - the result
+ * Return:    void
+ */
+void ClickCoalescer::Complete(ClickFlightTicket &oTicket, const ClickCoalescedResult &oResult)
+{
+    if (oTicket.pFlight == NULL)
+        return;
+
+    {
+        std::lock_guard<std::mutex> oLock(mtxState);
+
+        oTicket.pFlight->oResult = oResult;
+        oTicket.pFlight->bDone = true;
+        mFlights.erase(oTicket.sKey);
+        LocalCache(oTicket.sKey, oTicket.eOp, oResult, std::chrono::steady_clock::now());
+    }
+
+    oTicket.pFlight->cvDone.notify_all();
+    oTicket.pFlight.reset();
+}
+
+/*
+ * Function:  ClickCoalescer::Abandon
+ * Info:      Ends a query whose sender gave up at its own deadline. Nothing is cached; the
+ *            callers that joined it look the query up again, and one of them sends it if
+ *            its deadline allows.
+ * Inputs:    oTicket - ticket from Begin() (cleared)
+ * Return:    void
+ */
+void ClickCoalescer::Abandon(ClickFlightTicket &oTicket)
+{
+    if (oTicket.pFlight == NULL)
+        return;
+
+    {
+        std::lock_guard<std::mutex> oLock(mtxState);
+
+        oTicket.pFlight->bAbandoned = true;
+        oTicket.pFlight->bDone = true;
+        mFlights.erase(oTicket.sKey);
+    }
+
+    oTicket.pFlight->cvDone.notify_all();
+    oTicket.pFlight.reset();
+}
+
+void ClickCoalescer::Clear()
+{
+    std::lock_guard<std::mutex> oLock(mtxState);
+    mCache.clear();
+}
+
+ClickCoalesceStats ClickCoalescer::Stats()
+{
+    std::lock_guard<std::mutex> oLock(mtxState);
+
+    oStats.iCached = mCache.size();
+
+    return oStats;
+}
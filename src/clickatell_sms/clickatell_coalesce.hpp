@@ -0,0 +1,121 @@
+#ifndef CLICKATELL_COALESCE_H
+#define CLICKATELL_COALESCE_H
+
+/*
+ * clickatell_coalesce.hpp
+ *
+ *  Single-flight coalescing of read-only queries for the Clickatell SMS library.
+ *
+ *  A ClickCoalescer is shared by the ClickatellSms instances of an application
+ *  (ClickatellSms::SetCoalescer()). When several of them make the same read-only query at
+ *  the same time - SmsBalanceGet(), SmsCoverageGet() for one number, SmsStatusGet() or
+ *  SmsChargeGet() for one message - only the first sends it; the others wait for its
+ *  transfer and get the same response, cURL code and HTTP status. Queries are the same if
+ *  they have the same operation, API, API ID and argument.
+ *
+ *  With a TTL set for an operation, successful responses are also cached for that long, so
+ *  identical queries arriving just after the transfer are answered without one. TTLs are
+ *  zero (no cache) by default; balances and statuses change, so keep them short.
+ *
+ *  A caller waiting for another's transfer gives up at its own deadline. If the sender gives
+ *  up at its deadline instead, the callers still within theirs send the query again.
+ *
+ *  Only the blocking functions coalesce; the *Async() functions always send.
+ */
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <curl/curl.h>
+
+#include "clickatell_api.hpp"
+
+#define CLICK_COALESCE_MAX_CACHED  4096  // default bound on cached responses
+
+// coalescer options
+struct ClickCoalesceOptions {
+    unsigned int iTtlMs[CLICK_OP_COUNT];  // result cache TTL per operation (0: no cache; send and stop are never cached)
+    size_t iMaxCached;                    // cached responses at most; further results are not cached
+
+    ClickCoalesceOptions() : iTtlMs(), iMaxCached(CLICK_COALESCE_MAX_CACHED) {}
+};
+
+// outcome of a query, as shared with the callers that joined it
+struct ClickCoalescedResult {
+    std::string sResponse;
+    CURLcode curlCode;
+    long iHttpStatus;
+    bool bShortCircuited;
+};
+
+// counters per operation
+struct ClickCoalesceStats {
+    uint64_t iSent[CLICK_OP_COUNT];       // queries sent upstream through the coalescer
+    uint64_t iCollapsed[CLICK_OP_COUNT];  // queries that joined a transfer already in flight
+    uint64_t iCacheHits[CLICK_OP_COUNT];  // queries answered from the cache
+    uint64_t iTimedOut[CLICK_OP_COUNT];   // joined queries whose caller's deadline passed first
+    size_t iCached;                       // responses in the cache
+};
+
+// a query in flight, shared by its sender and the callers waiting for it
+struct ClickFlight {
+    std::condition_variable cvDone;
+    bool bDone = false;
+    bool bAbandoned = false;  // the sender's deadline passed before the response; there is no result
+    ClickCoalescedResult oResult;
+};
+
+// handed to the caller that sends a query; passed back to Complete()
+struct ClickFlightTicket {
+    std::shared_ptr<ClickFlight> pFlight;  // NULL if the query is not coalesced
+    std::string sKey;
+    eClickOperation eOp;
+};
+
+class ClickCoalescer
+{
+private:
+    // cached response
+    struct ClickCachedResult {
+        ClickCoalescedResult oResult;
+        ClickTimePoint tExpires;
+    };
+
+    ClickCoalesceOptions oOptions;
+
+    std::mutex mtxState;  // guards everything below
+    std::unordered_map<std::string, std::shared_ptr<ClickFlight>> mFlights;
+    std::unordered_map<std::string, ClickCachedResult> mCache;
+    ClickCoalesceStats oStats;
+
+    void LocalCache(const std::string &sKey, eClickOperation eOp, const ClickCoalescedResult &oResult, ClickTimePoint tNow);
+
+public:
+    ClickCoalescer(const ClickCoalesceOptions &oOptions_ = ClickCoalesceOptions());
+
+    ClickCoalescer(const ClickCoalescer &) = delete;
+    ClickCoalescer &operator=(const ClickCoalescer &) = delete;
+
+    /* Starts a query (any thread). Returns true if the result is already in oResult, from
+     * the cache or from a transfer in flight that this call waited for (until tDeadline at
+     * most: the result is then CURLE_OPERATION_TIMEDOUT). Otherwise the caller sends the
+     * query and must pass the ticket to Complete() or Abandon(), whatever the outcome.
+     */
+    bool Begin(eClickOperation eOp, eClickApi eApi, std::string_view sScope, std::string_view sArg,
+               ClickFlightTicket &oTicket, ClickCoalescedResult &oResult, ClickTimePoint tDeadline = ClickTimePoint::max());
+    // publishes the result of a query sent after Begin() to the callers waiting for it
+    void Complete(ClickFlightTicket &oTicket, const ClickCoalescedResult &oResult);
+    // ends a query given up at the sender's deadline; the callers waiting for it try again
+    void Abandon(ClickFlightTicket &oTicket);
+
+    // drops all cached responses
+    void Clear();
+    ClickCoalesceStats Stats();
+};
+
+#endif // CLICKATELL_COALESCE_H
@@ -0,0 +1,110 @@
+/*
+ * clickatell_compress.cpp
+ *
+ *  Request body compression for the Clickatell SMS library.
+ *
+ *  The deflate context is created with a gzip wrapper (windowBits 15 + 16). Its output is
+ *  bounded with deflateBound(), so a body is compressed in a single deflate() call straight
+ *  into arena memory.
+ */
+
+#include <string>
+
+#include <time.h>
+#include <zlib.h>
+
+#include "clickatell_compress.hpp"
+
+/* ----------------------------------------------------------------------------- *
+ * Types/Macros                                                                  *
+ * ----------------------------------------------------------------------------- */
+
+#define CLICK_COMPRESS_GZIP_WINDOW  (15 + 16)  // 32K window with gzip header and trailer
+#define CLICK_COMPRESS_MEM_LEVEL    8          // zlib default
+
+/* ----------------------------------------------------------------------------- *
+ * Private function definitions                                                  *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  LocalThreadCpuUs
+ * Info:      Returns the CPU time consumed by the calling thread.
+ */
+static uint64_t LocalThreadCpuUs()
+{
+    struct timespec tNow;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tNow) != 0)
+        return 0;
+
+    return (uint64_t)tNow.tv_sec * 1000000 + (uint64_t)tNow.tv_nsec / 1000;
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Public function definitions                                                   *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickCompressor
+ * Info:      Constructor. Creates the deflate context. Throws a std::string if zlib cannot
+ *            initialize it.
+ * Inputs:    iLevel - zlib compression level (clamped to 1..9)
+ */
+ClickCompressor::ClickCompressor(int iLevel)
+                                 : pStream(new z_stream())
+{
+    if (iLevel < Z_BEST_SPEED || iLevel > Z_BEST_COMPRESSION)
+        iLevel = (iLevel < Z_BEST_SPEED ? Z_BEST_SPEED : Z_BEST_COMPRESSION);
+
+    if (deflateInit2(pStream, iLevel, Z_DEFLATED, CLICK_COMPRESS_GZIP_WINDOW, CLICK_COMPRESS_MEM_LEVEL,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        delete pStream;
+        throw (std::string("deflateInit2 failed!"));
+    }
+}
+
+/*
+ * Function:  ~ClickCompressor
+ * Info:      Destructor. Frees the deflate context.
+ */
+ClickCompressor::~ClickCompressor()
+{
+    deflateEnd(pStream);
+    delete pStream;
+}
+
+/*
+ * Function:  ClickCompressor::Compress
+ * Info:      Gzips data into arena memory, valid until the arena is reset.
+ * Inputs:    oArena - request arena
+ *            sData  - data to compress
+ * Outputs:   sOut   - compressed data
+ *            iCpuUs - CPU time spent compressing
+ * Return:    true if the data was compressed
+ */
+bool ClickCompressor::Compress(ClickArena &oArena, std::string_view sData, std::string_view &sOut, uint64_t &iCpuUs)
+{
+    uint64_t iStartUs = LocalThreadCpuUs();
+
+    if (deflateReset(pStream) != Z_OK)
+        return false;
+
+    uLong iBound = deflateBound(pStream, (uLong)sData.length());
+    char *chOut = oArena.AllocArray<char>(iBound);
+
+    pStream->next_in = (Bytef *)sData.data();
+    pStream->avail_in = (uInt)sData.length();
+    pStream->next_out = (Bytef *)chOut;
+    pStream->avail_out = (uInt)iBound;
+
+    int iResult = deflate(pStream, Z_FINISH);
+
+    iCpuUs = LocalThreadCpuUs() - iStartUs;
+
+    if (iResult != Z_STREAM_END)
+        return false;
+
+    sOut = std::string_view(chOut, pStream->total_out);
+
+    return true;
+}
@@ -0,0 +1,71 @@
+#ifndef CLICKATELL_COMPRESS_H
+#define CLICKATELL_COMPRESS_H
+
+/*
+ * clickatell_compress.hpp
+ *
+ *  Request body compression for the Clickatell SMS library.
+ *
+ *  A ClickCompressor gzips request bodies into the request arena with one zlib deflate
+ *  context that is reset, not recreated, between requests, so compressing a body performs
+ *  no heap allocations once the arena has grown to its steady-state size.
+ */
+#include <stdint.h>
+#include <cstddef>
+#include <string_view>
+
+#include "clickatell_arena.hpp"
+
+struct z_stream_s;
+
+// compression options (see ClickClientBase::SetCompression())
+struct ClickCompressOptions {
+    bool bAcceptEncoding;       // ask for compressed responses (any encoding libcurl can decode)
+    bool bCompressRequests;     // gzip request bodies (the endpoint must accept Content-Encoding: gzip)
+    size_t iMinBytes;           // smallest body worth compressing
+    int iLevel;                 // zlib compression level (1..9)
+
+    ClickCompressOptions()
+                         : bAcceptEncoding(true),
+                           bCompressRequests(false),
+                           iMinBytes(1024),
+                           iLevel(6) {}
+};
+
+// size and compression figures of the most recent request
+struct ClickRequestMetrics {
+    size_t iBodyBytes;          // request body before compression
+    size_t iBodyWireBytes;      // request body as sent
+    uint64_t iCompressCpuUs;    // CPU time spent compressing the request body
+    size_t iResponseBytes;      // response body after decoding
+    size_t iResponseWireBytes;  // response body as received
+
+    // transfer timings, from the start of the transfer to the end of each step (0: step not taken)
+    uint64_t iDnsUs;            // name resolved
+    uint64_t iConnectUs;        // TCP connected
+    uint64_t iTlsUs;            // TLS handshake done
+    uint64_t iFirstByteUs;      // first response byte received
+    uint64_t iTotalUs;          // transfer complete
+
+    // wire size / original size (1 if nothing was compressed)
+    double RequestRatio() const { return (iBodyBytes ? (double)iBodyWireBytes / iBodyBytes : 1); }
+    double ResponseRatio() const { return (iResponseBytes ? (double)iResponseWireBytes / iResponseBytes : 1); }
+};
+
+class ClickCompressor
+{
+private:
+    struct z_stream_s *pStream;  // deflate context, reset per body
+
+public:
+    ClickCompressor(int iLevel);
+    ~ClickCompressor();
+
+    ClickCompressor(const ClickCompressor &) = delete;
+    ClickCompressor &operator=(const ClickCompressor &) = delete;
+
+    // gzips sData into the arena; returns false (sOut untouched) if zlib fails
+    bool Compress(ClickArena &oArena, std::string_view sData, std::string_view &sOut, uint64_t &iCpuUs);
+};
+
+#endif // CLICKATELL_COMPRESS_H
@@ -0,0 +1,1196 @@
+/*
+ * clickatell_engine.cpp
+ *
+ *  Concurrent send engine for the Clickatell SMS library.
+ *
+ *  The engine thread alternates between dispatching and driving the loop: it drops expired
+ *  messages, hands queued messages to free pool instances (each send is a coroutine
+ *  awaiting SmsMessageSendAsync()), then waits in ClickLoop::RunOnce() until a transfer
+ *  finishes, a message is submitted (Submit() wakes the loop) or the next queued deadline
+ *  is due. Scheduled messages that have become due are moved from the timer wheel into
+ *  the queue at the start of each round.
+ *
+ *  Each round starts by moving the messages waiting in the intake into the scheduler, as
+ *  many as iMaxQueued leaves room for. Submit() only wakes the loop if the engine thread
+ *  has announced (bSleeping) that it is about to wait; a fence on each side makes sure that
+ *  either the engine thread sees the new message before it waits or the producer sees the
+ *  flag. SubmitWait() blocks on a condition variable that the engine thread signals after
+ *  draining, and only if a producer has registered as waiting, so the fast path never
+ *  touches the mutex.
+ *
+ *  Traced messages get a "message" root span from Submit() to the completion function and
+ *  a child span per step; a resubmission that joins the trace of an earlier attempt gets a
+ *  "retry" span under that root instead, so a trace has one root however often the message
+ *  is retried. Their rate_limit_wait span is the part of their queue wait during
+ *  which dispatch was held back with free instances (by the in-flight limit or the
+ *  high-priority reservation): the engine accumulates that time per dispatch round, and a
+ *  message's share is the growth of the total while it was queued.
+ *
+ *  Schedule checkpoint format: a "clickatell_schedule/2 <count>" line, then per message a
+ *  "<id> <priority> <due ms> <deadline ms or -1> <text length> <destinations> <tag>" line,
+ *  the text, and one destination per line. Times are Unix milliseconds. Version 1 files,
+ *  whose message lines have no tag, are still read.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+
+#include "clickatell_engine.hpp"
+#include "clickatell_metrics.hpp"
+
+/* ----------------------------------------------------------------------------- *
+ * Types/Macros                                                                  *
+ * ----------------------------------------------------------------------------- */
+
+#define CLICK_ENGINE_MAX_WAIT_MS  1000  // longest the engine thread waits without re-checking
+#define CLICK_ENGINE_SCHEDULE_MAGIC "clickatell_schedule/2"
+#define CLICK_ENGINE_SCHEDULE_MAGIC_V1 "clickatell_schedule/1" // without campaign tags; still read
+#define CLICK_ENGINE_DELAY_WEIGHT 0.2   // weight of a new sample in the smoothed queue delay
+
+static const char *sClickSendStatusNames[] = {"done", "expired", "cancelled", "dropped"};
+
+/* ----------------------------------------------------------------------------- *
+ * Private function definitions                                                  *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickSendEngine::LocalLimitWait
+ * Info:      Returns the total time dispatch has been held back with free instances,
+ *            including the current round if it is held back (state lock held).
+ * Inputs:    tNow - current time
+ */
+std::chrono::nanoseconds ClickSendEngine::LocalLimitWait(ClickTimePoint tNow) const
+{
+    if (!bLimitBlocked || tNow <= tLimitSince)
+        return tLimitWait;
+
+    return tLimitWait + (tNow - tLimitSince);
+}
+
+/*
+ * Function:  ClickSendEngine::LocalTraceSubmit
+ * Info:      Records the submit span of a traced message, and its root span if the message
+ *            was refused.
+ * Inputs:    oTrace     - trace ID (zero: not traced)
+ *            iRootSpan  - root span ID
+ *            tSubmitted - time of the submission
+ *            iId        - message ID, or 0 if refused
+ * Return:    void
+ */
+void ClickSendEngine::LocalTraceSubmit(const ClickTraceId &oTrace, uint64_t iRootSpan, ClickTimePoint tSubmitted, uint64_t iId)
+{
+    if (oOptions.pTracer == NULL || !oTrace.Valid())
+        return;
+
+    ClickTimePoint tNow = std::chrono::steady_clock::now();
+
+    oOptions.pTracer->Span(oTrace, ClickTracer::NewSpanId(), iRootSpan, "submit", tSubmitted, tNow, iId == 0,
+                           {{"click.message_id", (int64_t)iId}});
+
+    if (iId == 0)
+        LocalTraceEnd(oTrace, iRootSpan, tSubmitted, tNow, true, {{"click.status", "refused"}});
+}
+
+/*
+ * Function:  ClickSendEngine::LocalTraceEnd
+ * Info:      Records the span covering one attempt of a traced message: the trace's
+ *            "message" root span for the first attempt, or a "retry" span under that root
+ *            for a message that joined the trace of an earlier attempt.
+ * Inputs:    oTrace       - trace ID
+ *            iSpan        - span ID of the attempt (ClickSendJob::iRootSpan)
+ *            tStart, tEnd - submission and end of the attempt
+ *            bError       - the attempt failed
+ *            vAttrs       - attributes
+ * Return:    void
+ */
+void ClickSendEngine::LocalTraceEnd(const ClickTraceId &oTrace, uint64_t iSpan, ClickTimePoint tStart, ClickTimePoint tEnd,
+                                    bool bError, std::initializer_list<ClickTraceAttr> vAttrs)
+{
+    bool bRetry = (iSpan != oTrace.iRootSpan);
+
+    oOptions.pTracer->Span(oTrace, iSpan, (bRetry ? oTrace.iRootSpan : 0), (bRetry ? "retry" : "message"), tStart, tEnd, bError,
+                           vAttrs);
+}
+
+/*
+ * Function:  ClickSendEngine::LocalReport
+ * Info:      Passes the final state of a message to its completion function, if any, and
+ *            ends its trace. An untraced message is reported with a correlation ID made of
+ *            the engine's prefix and its message ID, unless it joined an earlier one.
+ * Inputs:    oJob        - the message
+ *            eStatus     - final state
+ *            curlCode    - cURL result
+ *            iHttpStatus - HTTP status
+ *            sResponse   - gateway response
+ *            tLeftQueue  - time the message left the queue
+ * Return:    void
+ */
+void ClickSendEngine::LocalReport(const ClickSendJob &oJob, eClickSendStatus eStatus, CURLcode curlCode, long iHttpStatus,
+                                  std::string_view sResponse, ClickTimePoint tLeftQueue)
+{
+    ClickTimePoint tCallback = std::chrono::steady_clock::now();
+
+    if (oJob.oOpts.fnDone != NULL) {
+        ClickSendResult oResult{oJob.iId, oJob.oOpts.ePriority, eStatus, curlCode, iHttpStatus, sResponse,
+                                std::chrono::duration_cast<std::chrono::microseconds>(tLeftQueue - oJob.tEnqueued),
+                                oJob.oOpts.oTrace};
+
+        if (!oResult.oTrace.Valid()) {
+            oResult.oTrace.iHigh = iCorrelationPrefix;
+            oResult.oTrace.iLow = oJob.iId;
+        }
+
+        oJob.oOpts.fnDone(oJob.oOpts.pUserData, oResult);
+    }
+
+    if (!LocalTraced(oJob))
+        return;
+
+    ClickTimePoint tEnd = std::chrono::steady_clock::now();
+    bool bError = (eStatus != CLICK_SEND_DONE || curlCode != CURLE_OK || iHttpStatus >= 400);
+
+    if (oJob.oOpts.fnDone != NULL)
+        oOptions.pTracer->Span(oJob.oOpts.oTrace, ClickTracer::NewSpanId(), oJob.iRootSpan, "callback", tCallback, tEnd, false);
+
+    LocalTraceEnd(oJob.oOpts.oTrace, oJob.iRootSpan, oJob.tSubmitted, tEnd, bError,
+                  {{"click.message_id", (int64_t)oJob.iId},
+                   {"click.priority", (int64_t)oJob.oOpts.ePriority},
+                   {"click.recipients", (int64_t)oJob.vMsisdns.size()},
+                   {"click.status", sClickSendStatusNames[eStatus]},
+                   {"click.curl_code", (int64_t)curlCode},
+                   {"http.response.status_code", (int64_t)iHttpStatus}});
+}
+
+/*
+ * Function:  ClickSendEngine::LocalSend
+ * Info:      Coroutine sending the message held by a slot. The send is bounded by the
+ *            message deadline and cancelled through the slot's stop source.
+ * Inputs:    oSlot - pool slot holding the message
+ * Return:    task (started by LocalDispatch())
+ */
+ClickTask<void> ClickSendEngine::LocalSend(ClickEngineSlot &oSlot)
+{
+    std::vector<std::string_view> vViews(oSlot.oJob.vMsisdns.begin(), oSlot.oJob.vMsisdns.end());
+
+    // per-recipient results go straight from the response to the submitter
+    oSlot.pSms->SetResultStream(oSlot.oJob.oOpts.fnRecipient, oSlot.oJob.oOpts.pUserData);
+
+    // the request is built when the send is started, before the first suspension
+    ClickTimePoint tBuild = std::chrono::steady_clock::now();
+    ClickSmsAwaiter oSend = oSlot.pSms->SmsMessageSendAsync(oLoop, oSlot.oJob.sText, vViews,
+                                ClickCallOptions(oSlot.oStop.get_token(), oSlot.oJob.oOpts.tDeadline,
+                                                 oSlot.oJob.tScheduled));
+    ClickTimePoint tBuilt = std::chrono::steady_clock::now();
+    const std::string &sResponse = co_await oSend;
+
+    // a send that found its deadline passed before anything went out expired, it was not sent
+    eClickSendStatus eStatus = (oSlot.oStop.stop_requested() ? CLICK_SEND_CANCELLED :
+                                oSlot.pSms->GetNotSent() ? CLICK_SEND_EXPIRED : CLICK_SEND_DONE);
+    ClickTimePoint tDone = std::chrono::steady_clock::now();
+
+    if (LocalTraced(oSlot.oJob)) {
+        const ClickRequestMetrics &oMetrics = oSlot.pSms->GetMetrics();
+        CURLcode curlCode = oSlot.pSms->GetCurlCode();
+        long iHttpStatus = oSlot.pSms->GetHttpStatus();
+
+        oOptions.pTracer->Span(oSlot.oJob.oOpts.oTrace, ClickTracer::NewSpanId(), oSlot.oJob.iRootSpan, "build", tBuild, tBuilt, false,
+                               {{"click.text_length", (int64_t)oSlot.oJob.sText.length()}});
+        oOptions.pTracer->Span(oSlot.oJob.oOpts.oTrace, ClickTracer::NewSpanId(), oSlot.oJob.iRootSpan, "attempt", tBuilt, tDone,
+                               (eStatus != CLICK_SEND_DONE || curlCode != CURLE_OK || iHttpStatus >= 400),
+                               {{"click.curl_code", (int64_t)curlCode},
+                                {"http.response.status_code", (int64_t)iHttpStatus},
+                                {"click.dns_us", (int64_t)oMetrics.iDnsUs},
+                                {"click.connect_us", (int64_t)oMetrics.iConnectUs},
+                                {"click.tls_us", (int64_t)oMetrics.iTlsUs},
+                                {"click.first_byte_us", (int64_t)oMetrics.iFirstByteUs},
+                                {"click.total_us", (int64_t)oMetrics.iTotalUs},
+                                {"click.bytes_sent", (int64_t)oMetrics.iBodyWireBytes},
+                                {"click.bytes_received", (int64_t)oMetrics.iResponseWireBytes}});
+    }
+
+    LocalReport(oSlot.oJob, eStatus, oSlot.pSms->GetCurlCode(), oSlot.pSms->GetHttpStatus(), sResponse, oSlot.tStarted);
+
+    std::lock_guard<std::mutex> oLock(mtxState);
+
+    // a timeout imposed by the message's own deadline says nothing about the gateway's load
+    if (oOptions.bAdaptiveConcurrency) {
+        eClickLimiterSample eSample = (eStatus == CLICK_SEND_DONE && !oSlot.pSms->GetDeadlineCut()
+                                       ? ClickConcurrencyLimiter::Classify(oSlot.pSms->GetCurlCode(), oSlot.pSms->GetHttpStatus())
+                                       : CLICK_LIMITER_IGNORED);
+
+        oLimiter.OnSample(eSample, std::chrono::duration_cast<std::chrono::microseconds>(tDone - oSlot.tStarted),
+                          oStats.iInFlight, tDone);
+    }
+
+    if (eStatus == CLICK_SEND_DONE)
+        oStats.iSent++;
+    else if (eStatus == CLICK_SEND_EXPIRED)
+        oStats.iExpired++;
+    else
+        oStats.iCancelled++;
+}
+
+/*
+ * Function:  ClickSendEngine::LocalJob
+ * Info:      Validates a message and copies it into a job. Invalid messages are counted
+ *            as refused.
+ * Inputs:    sText, vMsisdns, oOpts - the message (see Submit())
+ * Outputs:   oJob - the job
+ * Return:    false if the message is invalid
+ */
+bool ClickSendEngine::LocalJob(std::string_view sText, std::span<const std::string_view> vMsisdns,
+                               const ClickSendOptions &oOpts, ClickSendJob &oJob)
+{
+    if (sText.empty() || vMsisdns.empty() || oOpts.ePriority < CLICK_PRIORITY_HIGH || oOpts.ePriority >= CLICK_PRIORITY_COUNT) {
+        iRefused.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    oJob.oOpts = oOpts;
+    oJob.tEnqueued = oJob.tSubmitted = std::chrono::steady_clock::now();
+
+    if (oOptions.pTracer != NULL && !oJob.oOpts.oTrace.Valid())
+        oJob.oOpts.oTrace = oOptions.pTracer->Sample();
+    oJob.iRootSpan = (LocalTraced(oJob) ? ClickTracer::NewSpanId() : 0);
+
+    // the first attempt's span is the trace's root; later attempts hang below it
+    if (LocalTraced(oJob) && oJob.oOpts.oTrace.iRootSpan == 0)
+        oJob.oOpts.oTrace.iRootSpan = oJob.iRootSpan;
+    oJob.sText.assign(sText);
+    oJob.vMsisdns.assign(vMsisdns.begin(), vMsisdns.end());
+
+    return true;
+}
+
+/*
+ * Function:  ClickSendEngine::LocalWake
+ * Info:      Wakes the engine thread after a message was pushed onto the intake, if it is
+ *            waiting with nothing to do.
+ * Return:    void
+ */
+void ClickSendEngine::LocalWake()
+{
+    // pairs with the fence in LocalThread(): the push is visible to the engine or the flag to us
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (bSleeping.load(std::memory_order_relaxed) && bSleeping.exchange(false, std::memory_order_relaxed))
+        oLoop.Wakeup();
+}
+
+/*
+ * Function:  ClickSendEngine::LocalNotifyIntake
+ * Info:      Wakes the threads waiting in SubmitWait() after the intake was drained.
+ * Return:    void
+ */
+void ClickSendEngine::LocalNotifyIntake()
+{
+    // pairs with the fence in LocalQueue(): the room is visible to the waiter or the waiter to us
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (iIntakeWaiters.load(std::memory_order_relaxed) == 0)
+        return;
+
+    std::lock_guard<std::mutex> oLock(mtxIntake);
+    cvIntake.notify_all();
+}
+
+/*
+ * Function:  ClickSendEngine::LocalQueue
+ * Info:      Pushes a job onto the intake and wakes the engine thread. Takes no lock unless
+ *            bWait is set and the intake is full.
+ * Inputs:    oJob  - the job (its ID is assigned here)
+ *            bWait - wait for room until the job's deadline
+ * Return:    message ID, or 0 if the intake is full or the engine is stopping
+ */
+uint64_t ClickSendEngine::LocalQueue(ClickSendJob &&oJob, bool bWait)
+{
+    ClickTimePoint tDeadline = oJob.oOpts.tDeadline;
+    uint64_t iId = oJob.iId = iNextId.fetch_add(1, std::memory_order_relaxed);
+    bool bQueued = false;
+
+    if (bStop.load(std::memory_order_acquire)) {
+        iRefused.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+    }
+
+    bQueued = oIntake.TryPush(std::move(oJob));
+
+    if (!bQueued && bWait) {
+        std::unique_lock<std::mutex> oLock(mtxIntake);
+
+        iIntakeWaiters.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        while (!bStop.load(std::memory_order_acquire)) {
+            // time spent waiting for room is not queue time
+            oJob.tEnqueued = std::chrono::steady_clock::now();
+
+            if (oIntake.TryPush(std::move(oJob))) {
+                bQueued = true;
+                break;
+            }
+
+            if (tDeadline == ClickTimePoint::max())
+                cvIntake.wait(oLock);
+            else if (cvIntake.wait_until(oLock, tDeadline) == std::cv_status::timeout)
+                break;
+        }
+
+        iIntakeWaiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    if (!bQueued) {
+        iRefused.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+    }
+
+    LocalWake();
+
+    return iId;
+}
+
+/*
+ * Function:  ClickSendEngine::LocalDrain
+ * Info:      Moves the messages waiting in the intake into the scheduler (state lock held;
+ *            the lock makes its holder the intake's single consumer). Unless bAll is set,
+ *            no more are taken than iMaxQueued leaves room for. With bDropLowest, a full
+ *            scheduler drops a message for each one taken (see ClickScheduler::Evict()), or
+ *            the new message itself if everything queued is of a higher class.
+ * Inputs:    bAll - take every message, e.g. so that Cancel() sees them
+ * Return:    number of messages taken from the intake
+ */
+size_t ClickSendEngine::LocalDrain(bool bAll)
+{
+    size_t iRoom = SIZE_MAX;
+
+    if (!bAll && oOptions.iMaxQueued > 0 && !oOptions.bDropLowest) {
+        size_t iQueued = oScheduler.Size();
+
+        iRoom = (iQueued >= oOptions.iMaxQueued ? 0 : oOptions.iMaxQueued - iQueued);
+    }
+
+    return oIntake.PopBatch(iRoom, [this](ClickSendJob &&oJob) {
+        if (oOptions.bDropLowest && oOptions.iMaxQueued > 0 && oScheduler.Size() >= oOptions.iMaxQueued) {
+            ClickSendJob oVictim;
+
+            oStats.iDropped++;
+
+            if (!oScheduler.Evict(oJob.oOpts.ePriority, oVictim)) {
+                vEvicted.push_back(std::move(oJob));
+                return;
+            }
+
+            vEvicted.push_back(std::move(oVictim));
+        }
+
+        oJob.tLimitMark = LocalLimitWait(oJob.tEnqueued);
+        oScheduler.Push(std::move(oJob));
+    });
+}
+
+/*
+ * Function:  ClickSendEngine::LocalCancel
+ * Info:      Moves the queued and scheduled messages matching fnMatch to vCancelled and
+ *            wakes the engine thread to report them.
+ * Inputs:    fnMatch - bool(const ClickSendJob &)
+ * Return:    number of messages removed
+ */
+template <typename Pred>
+size_t ClickSendEngine::LocalCancel(Pred fnMatch)
+{
+    size_t iRemoved = 0;
+    size_t iTaken = 0;
+
+    {
+        std::lock_guard<std::mutex> oLock(mtxState);
+
+        if (bStop)
+            return 0;
+
+        // messages still in the intake belong to the campaign as well
+        iTaken = LocalDrain(true);
+        iRemoved = oScheduler.RemoveIf(fnMatch, vCancelled);
+
+        for (std::unordered_map<uint64_t, ClickDeferredSend>::iterator it = mDeferred.begin(); it != mDeferred.end(); ) {
+            if (!fnMatch(it->second.oJob)) {
+                ++it;
+                continue;
+            }
+
+            oWheel.Cancel(it->second.iHandle);
+            vCancelled.push_back(std::move(it->second.oJob));
+            it = mDeferred.erase(it);
+            bCheckpointDirty = true;
+            iRemoved++;
+        }
+
+        oStats.iCancelled += iRemoved;
+    }
+
+    if (iTaken > 0)
+        LocalNotifyIntake();
+
+    if (iRemoved > 0 || iTaken > 0)
+        oLoop.Wakeup();
+
+    return iRemoved;
+}
+
+/*
+ * Function:  ClickSendEngine::LocalTick
+ * Info:      Converts a wall-clock time to a timer wheel tick.
+ * Inputs:    tTime    - time
+ *            bRoundUp - round up (due times, so that messages are never released early)
+ *                       rather than down (the current time)
+ */
+uint64_t ClickSendEngine::LocalTick(ClickWallTime tTime, bool bRoundUp) const
+{
+    long long iMs = std::chrono::duration_cast<std::chrono::milliseconds>(tTime.time_since_epoch()).count();
+    uint64_t iTickMs = std::max(1u, oOptions.iTimerTickMs);
+
+    if (iMs < 0)
+        iMs = 0;
+
+    return (bRoundUp ? ((uint64_t)iMs + iTickMs - 1) / iTickMs : (uint64_t)iMs / iTickMs);
+}
+
+/*
+ * Function:  ClickSendEngine::LocalFire
+ * Info:      Moves the scheduled messages that have become due into the queue (engine
+ *            thread, state lock held). Their queue wait starts now.
+ * Inputs:    tNow - current time
+ * Return:    void
+ */
+void ClickSendEngine::LocalFire(ClickTimePoint tNow)
+{
+    vFired.clear();
+    oWheel.Advance(LocalTick(std::chrono::system_clock::now(), false), vFired);
+
+    for (uint64_t iId : vFired) {
+        std::unordered_map<uint64_t, ClickDeferredSend>::iterator it = mDeferred.find(iId);
+
+        if (it == mDeferred.end())
+            continue;
+
+        it->second.oJob.tEnqueued = tNow;
+        it->second.oJob.tLimitMark = LocalLimitWait(tNow);
+        oScheduler.Push(std::move(it->second.oJob));
+        mDeferred.erase(it);
+    }
+
+    if (!vFired.empty())
+        bCheckpointDirty = true;
+}
+
+/*
+ * Function:  ClickSendEngine::LocalCheckpointLoad
+ * Info:      Restores the scheduled messages saved in the checkpoint file, if there is one
+ *            (constructor only). Restored messages keep their IDs and campaign tags and are
+ *            reported to fnRestoredDone. Files written before tags were saved load with tag
+ *            0. Throws a std::string if the file cannot be parsed.
+ * Return:    void
+ */
+void ClickSendEngine::LocalCheckpointLoad()
+{
+    FILE *pFile = fopen(oOptions.sScheduleCheckpoint.c_str(), "r");
+    char chMagic[32] = "";
+    size_t iCount = 0;
+    bool bOk = true;
+
+    if (pFile == NULL)
+        return;
+
+    long long iWallNow = std::chrono::duration_cast<std::chrono::milliseconds>(
+                             std::chrono::system_clock::now().time_since_epoch()).count();
+    ClickTimePoint tNow = std::chrono::steady_clock::now();
+
+    if (fscanf(pFile, "%31s %zu", chMagic, &iCount) != 2 ||
+        (strcmp(chMagic, CLICK_ENGINE_SCHEDULE_MAGIC) != 0 && strcmp(chMagic, CLICK_ENGINE_SCHEDULE_MAGIC_V1) != 0))
+        bOk = false;
+
+    bool bTagged = (strcmp(chMagic, CLICK_ENGINE_SCHEDULE_MAGIC) == 0);
+
+    for (size_t i = 0; i < iCount && bOk; i++) {
+        unsigned long long iId = 0, iTag = 0;
+        int iPriority = 0;
+        long long iWhenMs = 0, iDeadlineMs = 0;
+        size_t iTextLen = 0, iMsisdns = 0;
+        ClickSendJob oJob;
+
+        if (fscanf(pFile, " %llu %d %lld %lld %zu %zu", &iId, &iPriority, &iWhenMs, &iDeadlineMs, &iTextLen, &iMsisdns) != 6 ||
+            (bTagged && fscanf(pFile, " %llu", &iTag) != 1) ||
+            fgetc(pFile) != '\n' || iId == 0 || iPriority < CLICK_PRIORITY_HIGH || iPriority >= CLICK_PRIORITY_COUNT) {
+            bOk = false;
+            break;
+        }
+
+        oJob.sText.resize(iTextLen);
+        if (fread(oJob.sText.data(), 1, iTextLen, pFile) != iTextLen) {
+            bOk = false;
+            break;
+        }
+
+        for (size_t j = 0; j < iMsisdns && bOk; j++) {
+            std::string sMsisdn;
+            int ch;
+
+            while ((ch = fgetc(pFile)) != EOF && ch != '\n')
+                sMsisdn.push_back((char)ch);
+
+            bOk = (ch == '\n' && !sMsisdn.empty());
+            oJob.vMsisdns.push_back(std::move(sMsisdn));
+        }
+
+        if (!bOk)
+            break;
+
+        ClickTimePoint tDeadline = (iDeadlineMs < 0 ? ClickTimePoint::max() : tNow + std::chrono::milliseconds(iDeadlineMs - iWallNow));
+        ClickWallTime tWhen{std::chrono::milliseconds(iWhenMs)};
+
+        oJob.iId = iId;
+        oJob.oOpts = ClickSendOptions((eClickPriority)iPriority, tDeadline, oOptions.fnRestoredDone, oOptions.pRestoredUserData);
+        oJob.oOpts.iTag = iTag;
+        oJob.tEnqueued = tNow;
+
+        uint64_t iHandle = oWheel.Insert(LocalTick(tWhen, true), iId);
+        mDeferred.emplace(iId, ClickDeferredSend{iHandle, tWhen, std::move(oJob)});
+        iNextId = std::max<uint64_t>(iNextId, iId + 1);
+    }
+
+    fclose(pFile);
+
+    if (!bOk)
+        throw (std::string("Invalid schedule checkpoint file: ") + oOptions.sScheduleCheckpoint);
+}
+
+/*
+ * Function:  ClickSendEngine::LocalCheckpointWrite
+ * Info:      Saves the pending scheduled messages to the checkpoint file (engine thread),
+ *            if they changed and iCheckpointMs has passed since the last write. The state
+ *            is serialized under the lock and written outside it; the file is replaced
+ *            atomically (temporary file, fsync, rename).
+ * Inputs:    bForce - write now if anything changed (shutdown)
+ * Return:    void
+ */
+void ClickSendEngine::LocalCheckpointWrite(bool bForce)
+{
+    ClickTimePoint tNow = std::chrono::steady_clock::now();
+    std::string sData;
+    char chLine[192];
+
+    if (oOptions.sScheduleCheckpoint.empty() ||
+        (!bForce && tNow - tCheckpoint < std::chrono::milliseconds(oOptions.iCheckpointMs)))
+        return;
+
+    {
+        std::lock_guard<std::mutex> oLock(mtxState);
+
+        if (!bCheckpointDirty)
+            return;
+
+        long long iWallNow = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                 std::chrono::system_clock::now().time_since_epoch()).count();
+
+        snprintf(chLine, sizeof(chLine), "%s %zu\n", CLICK_ENGINE_SCHEDULE_MAGIC, mDeferred.size());
+        sData.append(chLine);
+
+        for (const std::pair<const uint64_t, ClickDeferredSend> &oEntry : mDeferred) {
+            const ClickSendJob &oJob = oEntry.second.oJob;
+            long long iDeadlineMs = -1;
+
+            if (oJob.oOpts.tDeadline != ClickTimePoint::max())
+                iDeadlineMs = iWallNow + std::chrono::duration_cast<std::chrono::milliseconds>(oJob.oOpts.tDeadline - tNow).count();
+
+            snprintf(chLine, sizeof(chLine), "%llu %d %lld %lld %zu %zu %llu\n", (unsigned long long)oJob.iId,
+                     (int)oJob.oOpts.ePriority,
+                     (long long)std::chrono::duration_cast<std::chrono::milliseconds>(oEntry.second.tWhen.time_since_epoch()).count(),
+                     iDeadlineMs, oJob.sText.length(), oJob.vMsisdns.size(), (unsigned long long)oJob.oOpts.iTag);
+            sData.append(chLine);
+            sData.append(oJob.sText);
+
+            for (const std::string &sMsisdn : oJob.vMsisdns) {
+                sData.append(sMsisdn);
+                sData.push_back('\n');
+            }
+        }
+
+        bCheckpointDirty = false;
+    }
+
+    tCheckpoint = tNow;
+
+    std::string sTmp = oOptions.sScheduleCheckpoint + ".tmp";
+    FILE *pFile = fopen(sTmp.c_str(), "w");
+    bool bOk = (pFile != NULL);
+
+    if (bOk) {
+        bOk = (fwrite(sData.data(), 1, sData.length(), pFile) == sData.length());
+        bOk = (fflush(pFile) == 0 && fsync(fileno(pFile)) == 0 && bOk);
+        bOk = (fclose(pFile) == 0 && bOk);
+        bOk = (bOk && rename(sTmp.c_str(), oOptions.sScheduleCheckpoint.c_str()) == 0);
+    }
+
+    if (!bOk) {
+        std::lock_guard<std::mutex> oLock(mtxState);
+
+        oStats.iCheckpointFailed++;
+        bCheckpointDirty = true;
+    }
+}
+
+/*
+ * Function:  ClickSendEngine::LocalDispatch
+ * Info:      One dispatch round (engine thread): frees the slots of finished sends, drains
+ *            the intake, queues scheduled messages that are due, drops expired messages
+ *            and starts a send for each free slot that the scheduler has a message for, up
+ *            to the in-flight limit and the tokens of the rate limit. While only the reserved slots are free, only
+ *            high-priority messages are started. Once the engine is stopping, queued
+ *            messages (and those left in the intake) are cancelled (and so are scheduled
+ *            messages, unless they are checkpointed) and sends in progress are asked to
+ *            stop.
+ * Return:    false once the engine is stopping and no send is in progress
+ */
+bool ClickSendEngine::LocalDispatch()
+{
+    std::vector<ClickSendJob> vDropped;
+    std::vector<ClickSendJob> vCancel;
+    std::vector<ClickSendJob> vEvict;
+    std::vector<size_t> vStart;
+    ClickTimePoint tNow = std::chrono::steady_clock::now();
+    size_t iFree = 0;
+    size_t iTaken = 0;
+    bool bStopping = false;
+
+    for (ClickEngineSlot &oSlot : vSlots) {
+        if (oSlot.oTask && oSlot.oTask->Done())
+            oSlot.oTask.reset();
+
+        iFree += !oSlot.oTask;
+    }
+
+    {
+        std::lock_guard<std::mutex> oLock(mtxState);
+
+        bStopping = bStop;
+        iTaken = LocalDrain(bStopping);
+        vCancel.swap(vCancelled);
+        vEvict.swap(vEvicted);
+
+        if (bStopping) {
+            oScheduler.Clear(vDropped);
+
+            // without a checkpoint, scheduled messages cannot outlive the engine
+            if (oOptions.sScheduleCheckpoint.empty()) {
+                for (std::pair<const uint64_t, ClickDeferredSend> &oEntry : mDeferred)
+                    vDropped.push_back(std::move(oEntry.second.oJob));
+                mDeferred.clear();
+                oWheel = ClickTimerWheel(oWheel.Now());
+            }
+
+            oStats.iCancelled += vDropped.size();
+        }
+        else {
+            if (!mDeferred.empty())
+                LocalFire(tNow);
+
+            oStats.iExpired += oScheduler.DropExpired(tNow, vDropped);
+
+            // sends that may start: free instances, within the in-flight limit
+            size_t iLimit = (oOptions.bAdaptiveConcurrency ? oLimiter.Limit() : vSlots.size());
+            size_t iBusy = vSlots.size() - iFree;
+            size_t iAvail = (iBusy >= iLimit ? 0 : std::min(iFree, iLimit - iBusy));
+            size_t iReserved = std::min<size_t>(oOptions.iReservedHigh, iLimit - 1);
+            size_t iTokens = SIZE_MAX;
+
+            if (oOptions.dRatePerSec > 0) {
+                double dElapsed = std::chrono::duration<double>(tNow - tRefill).count();
+
+                dTokens = std::min((double)oOptions.iBurst, dTokens + dElapsed * oOptions.dRatePerSec);
+                tRefill = tNow;
+                iTokens = (size_t)dTokens;
+            }
+
+            for (size_t i = 0; i < vSlots.size() && iAvail > 0 && iTokens > 0; i++) {
+                if (vSlots[i].oTask)
+                    continue;
+
+                if (!oScheduler.Pop(tNow, iAvail <= iReserved, vSlots[i].oJob))
+                    break;
+
+                long long iDelayUs = std::chrono::duration_cast<std::chrono::microseconds>(tNow - vSlots[i].oJob.tEnqueued).count();
+
+                oStats.tQueueDelay += std::chrono::microseconds((long long)(CLICK_ENGINE_DELAY_WEIGHT * (iDelayUs - oStats.tQueueDelay.count())));
+
+                if (LocalTraced(vSlots[i].oJob)) {
+                    const ClickSendJob &oJob = vSlots[i].oJob;
+                    std::chrono::nanoseconds tLimited = LocalLimitWait(tNow) - oJob.tLimitMark;
+
+                    oOptions.pTracer->Span(oJob.oOpts.oTrace, ClickTracer::NewSpanId(), oJob.iRootSpan, "queue", oJob.tEnqueued, tNow, false,
+                                           {{"click.priority", (int64_t)oJob.oOpts.ePriority}});
+                    if (tLimited.count() > 0)
+                        oOptions.pTracer->Span(oJob.oOpts.oTrace, ClickTracer::NewSpanId(), oJob.iRootSpan, "rate_limit_wait",
+                                               tNow - std::min(tLimited, tNow - oJob.tEnqueued), tNow, false);
+                }
+
+                vStart.push_back(i);
+                iAvail--;
+                iFree--;
+
+                if (oOptions.dRatePerSec > 0) {
+                    dTokens -= 1.0;
+                    iTokens--;
+                }
+            }
+
+            // messages left queued with free instances wait for the limit until the next round
+            tLimitWait = LocalLimitWait(tNow);
+            tLimitSince = tNow;
+            bLimitBlocked = (oScheduler.Size() > 0 && iFree > 0);
+        }
+
+        // until a send finishes or a message leaves, the intake cannot be drained further
+        bIntakeHeld = (!oOptions.bDropLowest && oOptions.iMaxQueued > 0 && oScheduler.Size() >= oOptions.iMaxQueued);
+
+        for (int i = 0; i < CLICK_PRIORITY_COUNT; i++)
+            oStats.iQueued[i] = oScheduler.Size((eClickPriority)i);
+        oStats.iInFlight = vSlots.size() - iFree;
+
+        // the engines' queue depth gauge follows every pop, drop and due scheduled message
+        ClickMetrics::Add(CLICK_METRIC_QUEUE_DEPTH, (int64_t)oScheduler.Size() - (int64_t)iGaugeQueued);
+        iGaugeQueued = oScheduler.Size();
+    }
+
+    if (iTaken > 0)
+        LocalNotifyIntake();
+
+    for (ClickSendJob &oJob : vEvict) {
+        if (LocalTraced(oJob))
+            oOptions.pTracer->Span(oJob.oOpts.oTrace, ClickTracer::NewSpanId(), oJob.iRootSpan, "queue", oJob.tEnqueued, tNow, true,
+                                   {{"click.priority", (int64_t)oJob.oOpts.ePriority}});
+        LocalReport(oJob, CLICK_SEND_DROPPED, CURLE_OK, 0, std::string_view(), tNow);
+    }
+
+    for (ClickSendJob &oJob : vCancel) {
+        if (LocalTraced(oJob))
+            oOptions.pTracer->Span(oJob.oOpts.oTrace, ClickTracer::NewSpanId(), oJob.iRootSpan, "queue", oJob.tEnqueued, tNow, true,
+                                   {{"click.priority", (int64_t)oJob.oOpts.ePriority}});
+        LocalReport(oJob, CLICK_SEND_CANCELLED, CURLE_OK, 0, std::string_view(), tNow);
+    }
+
+    for (ClickSendJob &oJob : vDropped) {
+        if (LocalTraced(oJob))
+            oOptions.pTracer->Span(oJob.oOpts.oTrace, ClickTracer::NewSpanId(), oJob.iRootSpan, "queue", oJob.tEnqueued, tNow, true,
+                                   {{"click.priority", (int64_t)oJob.oOpts.ePriority}});
+        LocalReport(oJob, (bStopping ? CLICK_SEND_CANCELLED : CLICK_SEND_EXPIRED), CURLE_OK, 0, std::string_view(), tNow);
+    }
+
+    if (bStopping) {
+        for (ClickEngineSlot &oSlot : vSlots) {
+            if (oSlot.oTask)
+                oSlot.oStop.request_stop();
+        }
+
+        return (iFree < vSlots.size());
+    }
+
+    for (size_t i : vStart) {
+        ClickEngineSlot &oSlot = vSlots[i];
+
+        oSlot.oStop = std::stop_source();
+        oSlot.tStarted = tNow;
+        oSlot.oTask.emplace(LocalSend(oSlot));
+        oSlot.oTask->Start();
+    }
+
+    return true;
+}
+
+/*
+ * Function:  ClickSendEngine::LocalWaitMs
+ * Info:      Returns how long the engine thread may wait for loop activity: until the
+ *            earliest queued deadline, so that the message is dropped on time, until the
+ *            timer wheel has work, until a pending checkpoint write is due, or, while
+ *            queued messages wait for the rate limit, until the next token.
+ */
+int ClickSendEngine::LocalWaitMs()
+{
+    ClickTimePoint tNext;
+    uint64_t iTick;
+    bool bDirty;
+    long long iWaitMs = CLICK_ENGINE_MAX_WAIT_MS;
+
+    {
+        std::lock_guard<std::mutex> oLock(mtxState);
+
+        tNext = oScheduler.NextDeadline();
+        iTick = oWheel.NextTick();
+        bDirty = bCheckpointDirty;
+
+        if (oOptions.dRatePerSec > 0 && dTokens < 1.0 && oScheduler.Size() > 0)
+            iWaitMs = std::min<long long>(iWaitMs, (long long)((1.0 - dTokens) * 1000.0 / oOptions.dRatePerSec) + 1);
+    }
+
+    ClickTimePoint tNow = std::chrono::steady_clock::now();
+
+    if (tNext != ClickTimePoint::max())
+        iWaitMs = std::min<long long>(iWaitMs, std::chrono::duration_cast<std::chrono::milliseconds>(tNext - tNow).count() + 1);
+
+    if (iTick != UINT64_MAX) {
+        ClickWallTime tWallNow = std::chrono::system_clock::now();
+        uint64_t iNowTick = LocalTick(tWallNow, false);
+
+        if (iTick <= iNowTick)
+            iWaitMs = 0;
+        else if (iTick - iNowTick <= CLICK_ENGINE_MAX_WAIT_MS) {
+            long long iDueMs = (long long)(iTick * std::max(1u, oOptions.iTimerTickMs));
+            long long iNowMs = std::chrono::duration_cast<std::chrono::milliseconds>(tWallNow.time_since_epoch()).count();
+
+            iWaitMs = std::min(iWaitMs, iDueMs - iNowMs);
+        }
+    }
+
+    if (bDirty && !oOptions.sScheduleCheckpoint.empty())
+        iWaitMs = std::min<long long>(iWaitMs, std::chrono::duration_cast<std::chrono::milliseconds>(
+                                          tCheckpoint + std::chrono::milliseconds(oOptions.iCheckpointMs) - tNow).count() + 1);
+
+    return (int)std::clamp<long long>(iWaitMs, 0, CLICK_ENGINE_MAX_WAIT_MS);
+}
+
+/*
+ * Function:  ClickSendEngine::LocalThread
+ * Info:      Engine thread body.
+ * Return:    void
+ */
+void ClickSendEngine::LocalThread()
+{
+    while (LocalDispatch()) {
+        LocalCheckpointWrite(false);
+
+        int iWaitMs = LocalWaitMs();
+
+        bSleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        // a message pushed before the flag was set was not announced
+        if (!bIntakeHeld && !oIntake.Empty())
+            iWaitMs = 0;
+
+        oLoop.RunOnce(iWaitMs);
+        bSleeping.store(false, std::memory_order_relaxed);
+    }
+
+    LocalCheckpointWrite(true);
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Public function definitions                                                   *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickSendEngine
+ * Info:      Constructor. Takes ownership of the pool instances (configure them, e.g. with a
+ *            circuit breaker or share, before handing them over), restores the scheduled
+ *            messages of the checkpoint file (if configured) and starts the engine thread.
+ *            Throws a std::string if the pool is empty or the checkpoint file is invalid.
+ * Inputs:    vClients  - pool; its size is the number of concurrent sends
+ *            oOptions_ - engine options
+ */
+ClickSendEngine::ClickSendEngine(std::vector<std::unique_ptr<ClickatellSms>> vClients,
+                                 const ClickEngineOptions &oOptions_)
+                                 : oOptions(oOptions_),
+                                   iCorrelationPrefix(ClickTracer::NewSpanId()),
+                                   vSlots(vClients.size()),
+                                   tCheckpoint(std::chrono::steady_clock::now()),
+                                   bIntakeHeld(false),
+                                   oIntake(oOptions_.iIntakeCapacity),
+                                   iNextId(1),
+                                   iRefused(0),
+                                   bSleeping(false),
+                                   bStop(false),
+                                   iIntakeWaiters(0),
+                                   oScheduler(oOptions_.iAgingMs),
+                                   oWheel(LocalTick(std::chrono::system_clock::now(), false)),
+                                   oLimiter(oOptions_.oLimiter),
+                                   oStats(),
+                                   iGaugeQueued(0),
+                                   tLimitWait(0),
+                                   tLimitSince(std::chrono::steady_clock::now()),
+                                   bLimitBlocked(false),
+                                   dTokens(0),
+                                   tRefill(std::chrono::steady_clock::now()),
+                                   bCheckpointDirty(false)
+{
+    if (vClients.empty())
+        throw (std::string("ClickSendEngine needs at least one ClickatellSms instance!"));
+
+    // at least one instance stays available to every class
+    if (oOptions.iReservedHigh >= vClients.size())
+        oOptions.iReservedHigh = (unsigned int)vClients.size() - 1;
+
+    // a rate limit without a bucket depth allows one second's worth of sends at once
+    if (oOptions.dRatePerSec > 0 && oOptions.iBurst == 0)
+        oOptions.iBurst = (oOptions.dRatePerSec < 1 ? 1 : (unsigned int)oOptions.dRatePerSec);
+
+    dTokens = oOptions.iBurst;
+
+    // the limit cannot exceed the pool
+    if (oOptions.bAdaptiveConcurrency) {
+        ClickLimiterOptions oLimiterOpts = oOptions.oLimiter;
+
+        oLimiterOpts.iMaxLimit = std::min<unsigned int>(std::max(1u, oLimiterOpts.iMaxLimit), (unsigned int)vClients.size());
+        oLimiterOpts.iMinLimit = std::min(oLimiterOpts.iMinLimit, oLimiterOpts.iMaxLimit);
+        oLimiter = ClickConcurrencyLimiter(oLimiterOpts);
+    }
+
+    for (size_t i = 0; i < vClients.size(); i++)
+        vSlots[i].pSms = std::move(vClients[i]);
+
+    if (!oOptions.sScheduleCheckpoint.empty())
+        LocalCheckpointLoad();
+
+    thrEngine = std::thread(&ClickSendEngine::LocalThread, this);
+}
+
+/*
+ * Function:  ~ClickSendEngine
+ * Info:      Destructor. Cancels queued messages and sends in progress (their completion
+ *            functions are called with CLICK_SEND_CANCELLED) and stops the engine thread.
+ *            Scheduled messages are saved to the checkpoint file if one is configured,
+ *            otherwise they are cancelled as well. Threads waiting in SubmitWait() are
+ *            refused. A message that a racing Submit() pushed onto the intake after the
+ *            engine thread's last drain is cancelled here, on the destroying thread.
+ */
+ClickSendEngine::~ClickSendEngine()
+{
+    bStop.store(true, std::memory_order_release);
+
+    {
+        std::lock_guard<std::mutex> oLock(mtxIntake);
+        cvIntake.notify_all();
+    }
+
+    oLoop.Wakeup();
+    thrEngine.join();
+
+    // a Submit() that passed the stop check may have pushed after the engine thread ended
+    std::vector<ClickSendJob> vLate;
+    ClickTimePoint tNow = std::chrono::steady_clock::now();
+
+    {
+        std::lock_guard<std::mutex> oLock(mtxState);
+
+        oIntake.PopBatch(SIZE_MAX, [&vLate](ClickSendJob &&oJob) { vLate.push_back(std::move(oJob)); });
+        oStats.iCancelled += vLate.size();
+    }
+
+    for (ClickSendJob &oJob : vLate)
+        LocalReport(oJob, CLICK_SEND_CANCELLED, CURLE_OK, 0, std::string_view(), tNow);
+}
+
+/*
+ * Function:  ClickSendEngine::Submit
+ * Info:      Queues a message. Can be called from any thread, including from a completion
+ *            function; takes no lock and never blocks. The completion function is called
+ *            exactly once for an accepted message, on the engine thread.
+ * Inputs:    sText    - message text
+ *            vMsisdns - destinations
+ *            oOpts    - priority, deadline and completion function
+ * Return:    message ID, or 0 if the message was refused (invalid, intake full or stopping)
+ */
+uint64_t ClickSendEngine::Submit(std::string_view sText, std::span<const std::string_view> vMsisdns,
+                                 const ClickSendOptions &oOpts)
+{
+    ClickSendJob oJob;
+
+    if (!LocalJob(sText, vMsisdns, oOpts, oJob))
+        return 0;
+
+    ClickTraceId oTrace = oJob.oOpts.oTrace;
+    uint64_t iRootSpan = oJob.iRootSpan;
+    ClickTimePoint tSubmitted = oJob.tSubmitted;
+    uint64_t iId = LocalQueue(std::move(oJob), false);
+
+    LocalTraceSubmit(oTrace, iRootSpan, tSubmitted, iId);
+
+    return iId;
+}
+
+/*
+ * Function:  ClickSendEngine::SubmitWait
+ * Info:      Queues a message like Submit(), but if the intake is full, waits until the
+ *            engine thread makes room, the message's deadline passes or the engine stops.
+ *            Must not be called from a completion function (the engine thread would wait
+ *            for itself).
+ * Inputs:    sText    - message text
+ *            vMsisdns - destinations
+ *            oOpts    - priority, deadline (also the longest wait) and completion function
+ * Return:    message ID, or 0 if the message was refused (invalid, no room by the deadline or stopping)
+ */
+uint64_t ClickSendEngine::SubmitWait(std::string_view sText, std::span<const std::string_view> vMsisdns,
+                                     const ClickSendOptions &oOpts)
+{
+    ClickSendJob oJob;
+
+    if (!LocalJob(sText, vMsisdns, oOpts, oJob))
+        return 0;
+
+    ClickTraceId oTrace = oJob.oOpts.oTrace;
+    uint64_t iRootSpan = oJob.iRootSpan;
+    ClickTimePoint tSubmitted = oJob.tSubmitted;
+    uint64_t iId = LocalQueue(std::move(oJob), true);
+
+    LocalTraceSubmit(oTrace, iRootSpan, tSubmitted, iId);
+
+    return iId;
+}
+
+/*
+ * Function:  ClickSendEngine::SubmitAt
+ * Info:      Schedules a message. It waits in the timer wheel and is queued (as by Submit())
+ *            once tWhen has passed; a time in the past queues it at once. If
+ *            iGatewayScheduleS is set and tWhen is at least that far ahead, the message is
+ *            instead sent now with the gateway's scheduled-delivery parameter, and the
+ *            gateway holds it. The deadline applies to sending the request, not to delivery.
+ *            Can be called from any thread.
+ * Inputs:    tWhen    - delivery time
+ *            sText    - message text
+ *            vMsisdns - destinations
+ *            oOpts    - priority, deadline and completion function
+ * Return:    message ID, or 0 if the message was refused (invalid or stopping)
+ */
+uint64_t ClickSendEngine::SubmitAt(ClickWallTime tWhen, std::string_view sText, std::span<const std::string_view> vMsisdns,
+                                   const ClickSendOptions &oOpts)
+{
+    ClickWallTime tNow = std::chrono::system_clock::now();
+    ClickSendJob oJob;
+    uint64_t iId = 0;
+
+    if (!LocalJob(sText, vMsisdns, oOpts, oJob))
+        return 0;
+
+    ClickTraceId oTrace = oJob.oOpts.oTrace;
+    uint64_t iRootSpan = oJob.iRootSpan;
+    ClickTimePoint tSubmitted = oJob.tSubmitted;
+
+    if (tWhen <= tNow || (oOptions.iGatewayScheduleS > 0 && tWhen - tNow >= std::chrono::seconds(oOptions.iGatewayScheduleS))) {
+        if (tWhen > tNow)
+            oJob.tScheduled = tWhen;
+
+        iId = LocalQueue(std::move(oJob), false);
+        LocalTraceSubmit(oTrace, iRootSpan, tSubmitted, iId);
+
+        return iId;
+    }
+
+    {
+        std::lock_guard<std::mutex> oLock(mtxState);
+
+        if (bStop) {
+            iRefused.fetch_add(1, std::memory_order_relaxed);
+        }
+        else {
+
+            iId = oJob.iId = iNextId++;
+
+            uint64_t iHandle = oWheel.Insert(LocalTick(tWhen, true), iId);
+            mDeferred.emplace(iId, ClickDeferredSend{iHandle, tWhen, std::move(oJob)});
+            bCheckpointDirty = true;
+        }
+    }
+
+    LocalTraceSubmit(oTrace, iRootSpan, tSubmitted, iId);
+
+    if (iId == 0)
+        return 0;
+
+    // the engine thread re-checks the wheel at least every CLICK_ENGINE_MAX_WAIT_MS
+    if (tWhen - tNow < std::chrono::milliseconds(CLICK_ENGINE_MAX_WAIT_MS))
+        oLoop.Wakeup();
+
+    return iId;
+}
+
+/*
+ * Function:  ClickSendEngine::CancelScheduled
+ * Info:      Cancels a scheduled message that is still waiting in the timer wheel. Its
+ *            completion function is not called. Messages already due (queued or being
+ *            sent) and messages handed to the gateway's scheduled delivery cannot be
+ *            cancelled here. The trace of a traced message ends here. Can be called from
+ *            any thread.
+ * Inputs:    iId - ID returned by SubmitAt()
+ * Return:    true if the message was cancelled
+ */
+bool ClickSendEngine::CancelScheduled(uint64_t iId)
+{
+    std::lock_guard<std::mutex> oLock(mtxState);
+    std::unordered_map<uint64_t, ClickDeferredSend>::iterator it = mDeferred.find(iId);
+
+    if (it == mDeferred.end())
+        return false;
+
+    oWheel.Cancel(it->second.iHandle);
+
+    if (LocalTraced(it->second.oJob))
+        LocalTraceEnd(it->second.oJob.oOpts.oTrace, it->second.oJob.iRootSpan, it->second.oJob.tSubmitted,
+                      std::chrono::steady_clock::now(), false, {{"click.message_id", (int64_t)iId}, {"click.status", "cancelled"}});
+
+    mDeferred.erase(it);
+    bCheckpointDirty = true;
+
+    return true;
+}
+
+/*
+ * Function:  ClickSendEngine::Cancel
+ * Info:      Cancels the queued and scheduled messages of a campaign. Their completion
+ *            functions are called with CLICK_SEND_CANCELLED on the engine thread. Sends in
+ *            progress are not aborted: the gateway may already hold the message, and only
+ *            its response tells the ID to stop it with. Can be called from any thread.
+ * Inputs:    iTag - campaign tag (ClickSendOptions::iTag; 0 matches nothing)
+ * Return:    number of messages cancelled
+ */
+size_t ClickSendEngine::Cancel(uint64_t iTag)
+{
+    if (iTag == 0)
+        return 0;
+
+    return LocalCancel([iTag](const ClickSendJob &oJob) { return oJob.oOpts.iTag == iTag; });
+}
+
+/*
+ * Function:  ClickSendEngine::Cancel
+ * Info:      Same as above, for the messages with the given IDs.
+ * Inputs:    vIds - IDs returned by Submit()/SubmitAt()
+ * Return:    number of messages cancelled
+ */
+size_t ClickSendEngine::Cancel(std::span<const uint64_t> vIds)
+{
+    std::unordered_set<uint64_t> sIds(vIds.begin(), vIds.end());
+
+    return LocalCancel([&sIds](const ClickSendJob &oJob) { return sIds.count(oJob.iId) > 0; });
+}
+
+/*
+ * Function:  ClickSendEngine::Stats
+ * Info:      Returns a snapshot of the engine counters. Queue lengths, the in-flight
+ *            count and the queue delay are as of the last dispatch round; the intake
+ *            length is current.
+ */
+ClickEngineStats ClickSendEngine::Stats()
+{
+    std::lock_guard<std::mutex> oLock(mtxState);
+
+    oStats.iIntake = oIntake.Size();
+    oStats.iRefused = iRefused.load(std::memory_order_relaxed);
+    oStats.iScheduled = mDeferred.size();
+    oStats.iLimit = (oOptions.bAdaptiveConcurrency ? oLimiter.Limit() : (unsigned int)vSlots.size());
+    oStats.tRtt = oLimiter.SmoothedRtt();
+    oStats.tMinRtt = oLimiter.MinRtt();
+    oStats.iLimitDecreases = oLimiter.Decreases();
+
+    return oStats;
+}
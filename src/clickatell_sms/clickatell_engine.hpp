@@ -0,0 +1,241 @@
+#ifndef CLICKATELL_ENGINE_H
+#define CLICKATELL_ENGINE_H
+
+/*
+ * clickatell_engine.hpp
+ *
+ *  Concurrent send engine for the Clickatell SMS library.
+ *
+ *  A ClickSendEngine owns a pool of ClickatellSms instances and a thread running a
+ *  ClickLoop. Messages submitted from any thread are queued in a ClickScheduler and sent
+ *  asynchronously, one per instance, as instances become free. Part of the pool can be
+ *  reserved for high-priority messages, so that a bulk campaign occupying the engine does
+ *  not delay time-critical messages.
+ *
+ *  Messages can also be scheduled for a later time (SubmitAt()). They wait in a timer wheel
+ *  until they are due and then join the queue like any other message. Messages due far
+ *  ahead can instead be handed to the gateway's own scheduled delivery at once, and pending
+ *  scheduled messages can be checkpointed to a file so that they survive a restart.
+ *
+ *  The number of concurrent sends can be tuned automatically (bAdaptiveConcurrency): a
+ *  ClickConcurrencyLimiter raises it while the gateway answers quickly and cuts it when
+ *  latency rises or the gateway throttles, within the configured bounds. Independently, the
+ *  rate at which sends start can be capped with a token bucket (dRatePerSec, iBurst), so
+ *  that the engine stays under the gateway's rate limit however many instances are free.
+ *
+ *  A campaign can be pulled at once with Cancel(), by tag (ClickSendOptions::iTag) or by
+ *  message ID; messages it has already sent are stopped at the gateway with ClickBulkStop
+ *  (clickatell_cancel.hpp).
+ *
+ *  With a ClickTracer (pTracer), a sampled fraction of the messages is traced through every
+ *  step from submission to the completion function (see clickatell_trace.hpp).
+ *
+ *  Submitting threads do not take the engine's lock: the message is built on the calling
+ *  thread and pushed onto a bounded lock-free intake (ClickMpscRing), which the engine
+ *  thread drains into the scheduler in batches. When the scheduler holds iMaxQueued
+ *  messages the engine leaves new ones in the intake, so a slow gateway fills the intake
+ *  and pushes back on the producers: Submit() then refuses, SubmitWait() waits for room.
+ *  With bDropLowest the engine instead drops queued messages of the lowest class to make
+ *  room (the one that class would send next, not necessarily the oldest arrival), and
+ *  the intake only fills if the engine thread itself falls behind.
+ */
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "clickatell_debug.hpp"
+#include "clickatell_sms.hpp"
+#include "clickatell_task.hpp"
+#include "clickatell_scheduler.hpp"
+#include "clickatell_timer.hpp"
+#include "clickatell_limiter.hpp"
+#include "clickatell_ring.hpp"
+
+// engine options
+struct ClickEngineOptions {
+    unsigned int iReservedHigh;  // instances only high-priority messages may use
+    unsigned int iAgingMs;       // queue wait that raises a message one class (0: no aging)
+    size_t iMaxQueued;           // queued messages beyond which new ones wait in the intake (0: unlimited)
+    size_t iIntakeCapacity;      // submitted messages not yet queued beyond which Submit() refuses (rounded up to a power of two)
+    bool bDropLowest;            // a full queue drops the next message of its lowest class instead (CLICK_SEND_DROPPED)
+
+    // scheduled messages (SubmitAt())
+    unsigned int iTimerTickMs;        // timer resolution; messages are never released early
+    unsigned int iGatewayScheduleS;   // messages due at least this far ahead use the gateway's scheduled delivery (0: never)
+    std::string sScheduleCheckpoint;  // file keeping pending scheduled messages across restarts (empty: none)
+    unsigned int iCheckpointMs;       // least interval between checkpoint writes
+    ClickSendDoneFn fnRestoredDone;   // completion function of messages restored from the checkpoint
+    void *pRestoredUserData;          // passed to fnRestoredDone
+
+    // adaptive concurrency
+    bool bAdaptiveConcurrency;        // tune the in-flight limit (otherwise every instance is used)
+    ClickLimiterOptions oLimiter;     // limiter bounds and tuning (iMaxLimit is capped at the pool size)
+
+    // rate limit
+    double dRatePerSec;               // sends started per second (0: unlimited)
+    unsigned int iBurst;              // token bucket depth (0: one second's worth of sends)
+
+    // lifecycle tracing
+    ClickTracer *pTracer;             // traces sampled messages (NULL: none); must outlive the engine
+
+    ClickEngineOptions()
+                       : iReservedHigh(1),
+                         iAgingMs(2000),
+                         iMaxQueued(100000),
+                         iIntakeCapacity(4096),
+                         bDropLowest(false),
+                         iTimerTickMs(10),
+                         iGatewayScheduleS(0),
+                         iCheckpointMs(1000),
+                         fnRestoredDone(NULL),
+                         pRestoredUserData(NULL),
+                         bAdaptiveConcurrency(false),
+                         dRatePerSec(0),
+                         iBurst(0),
+                         pTracer(NULL) {}
+};
+
+// engine counters
+struct ClickEngineStats {
+    size_t iQueued[CLICK_PRIORITY_COUNT];  // messages waiting, per class
+    size_t iIntake;                        // messages submitted and not yet queued
+    size_t iInFlight;                      // messages being sent
+    uint64_t iSent;                        // messages sent (CLICK_SEND_DONE)
+    uint64_t iExpired;                     // messages dropped at their deadline
+    uint64_t iCancelled;                   // messages cancelled
+    uint64_t iRefused;                     // Submit() calls refused (invalid, intake full or stopping)
+    uint64_t iDropped;                     // messages dropped to make room (bDropLowest)
+    size_t iScheduled;                     // scheduled messages not yet due
+    uint64_t iCheckpointFailed;            // checkpoint writes that failed
+    unsigned int iLimit;                   // current in-flight limit
+    std::chrono::microseconds tQueueDelay; // smoothed wait in the queue before dispatch
+    std::chrono::microseconds tRtt;        // smoothed request RTT (adaptive concurrency only)
+    std::chrono::microseconds tMinRtt;     // lowest recent request RTT (adaptive concurrency only)
+    uint64_t iLimitDecreases;              // times the limit was cut (adaptive concurrency only)
+};
+
+class ClickSendEngine
+{
+private:
+    // one pool instance and the message it is sending
+    struct ClickEngineSlot {
+        std::unique_ptr<ClickatellSms> pSms;
+        std::optional<ClickTask<void>> oTask;  // send in progress (engine thread only)
+        ClickSendJob oJob;                     // message being sent
+        ClickTimePoint tStarted;               // time the message left the queue
+        std::stop_source oStop;                // cancels the send
+    };
+
+    // a scheduled message waiting in the timer wheel
+    struct ClickDeferredSend {
+        uint64_t iHandle;                      // timer handle
+        ClickWallTime tWhen;                   // due time
+        ClickSendJob oJob;
+    };
+
+    ClickEngineOptions oOptions;
+    uint64_t iCorrelationPrefix;            // high half of the correlation IDs of untraced messages
+    ClickLoop oLoop;                        // driven by thrEngine
+    std::vector<ClickEngineSlot> vSlots;    // engine thread only
+    std::vector<uint64_t> vFired;           // engine thread only
+    ClickTimePoint tCheckpoint;             // engine thread only: last checkpoint write
+    bool bIntakeHeld;                       // engine thread only: the queue is full, the intake is not drained
+
+    // submission path (no lock)
+    ClickMpscRing<ClickSendJob> oIntake;    // submitted messages; consumed under mtxState
+    std::atomic<uint64_t> iNextId;
+    std::atomic<uint64_t> iRefused;
+    std::atomic<bool> bSleeping;            // the engine thread is waiting in RunOnce() with nothing to do
+    std::atomic<bool> bStop;
+    std::atomic<unsigned int> iIntakeWaiters; // threads in SubmitWait() waiting for room
+    std::mutex mtxIntake;                   // guards the wait for room only
+    std::condition_variable cvIntake;
+
+    std::mutex mtxState;                    // guards everything below
+    ClickScheduler oScheduler;
+    ClickTimerWheel oWheel;
+    ClickConcurrencyLimiter oLimiter;
+    std::unordered_map<uint64_t, ClickDeferredSend> mDeferred; // scheduled messages by ID
+    std::vector<ClickSendJob> vCancelled;   // removed by Cancel(), to be reported by the engine thread
+    std::vector<ClickSendJob> vEvicted;     // dropped to make room, to be reported by the engine thread
+    ClickEngineStats oStats;
+    size_t iGaugeQueued;                    // queue depth last added to ClickMetrics
+    std::chrono::nanoseconds tLimitWait;    // time dispatch was held back with free instances, up to tLimitSince
+    ClickTimePoint tLimitSince;             // last dispatch round
+    bool bLimitBlocked;                     // dispatch has been held back since tLimitSince
+    double dTokens;                         // rate limit token bucket level
+    ClickTimePoint tRefill;                 // last token bucket refill
+    bool bCheckpointDirty;
+
+    std::thread thrEngine;
+
+    ClickTask<void> LocalSend(ClickEngineSlot &oSlot);
+    void LocalReport(const ClickSendJob &oJob, eClickSendStatus eStatus, CURLcode curlCode, long iHttpStatus,
+                     std::string_view sResponse, ClickTimePoint tLeftQueue);
+    bool LocalTraced(const ClickSendJob &oJob) const { return oOptions.pTracer != NULL && oJob.oOpts.oTrace.bSampled; }
+    void LocalTraceSubmit(const ClickTraceId &oTrace, uint64_t iRootSpan, ClickTimePoint tSubmitted, uint64_t iId);
+    void LocalTraceEnd(const ClickTraceId &oTrace, uint64_t iSpan, ClickTimePoint tStart, ClickTimePoint tEnd, bool bError,
+                       std::initializer_list<ClickTraceAttr> vAttrs);
+    std::chrono::nanoseconds LocalLimitWait(ClickTimePoint tNow) const;
+    template <typename Pred>
+    size_t LocalCancel(Pred fnMatch);
+    bool LocalJob(std::string_view sText, std::span<const std::string_view> vMsisdns, const ClickSendOptions &oOpts,
+                  ClickSendJob &oJob);
+    uint64_t LocalQueue(ClickSendJob &&oJob, bool bWait);
+    size_t LocalDrain(bool bAll);
+    void LocalWake();
+    void LocalNotifyIntake();
+    uint64_t LocalTick(ClickWallTime tTime, bool bRoundUp) const;
+    void LocalFire(ClickTimePoint tNow);
+    void LocalCheckpointLoad();
+    void LocalCheckpointWrite(bool bForce);
+    bool LocalDispatch();
+    int LocalWaitMs();
+    void LocalThread();
+
+public:
+    ClickSendEngine(std::vector<std::unique_ptr<ClickatellSms>> vClients,
+                    const ClickEngineOptions &oOptions_ = ClickEngineOptions());
+    ~ClickSendEngine();
+
+    ClickSendEngine(const ClickSendEngine &) = delete;
+    ClickSendEngine &operator=(const ClickSendEngine &) = delete;
+
+    // queues a message; returns its ID, or 0 if it was refused (any thread; never blocks)
+    uint64_t Submit(std::string_view sText, std::span<const std::string_view> vMsisdns,
+                    const ClickSendOptions &oOpts = ClickSendOptions());
+    // same, but waits for room in a full intake until the message's deadline (any thread but the engine's)
+    uint64_t SubmitWait(std::string_view sText, std::span<const std::string_view> vMsisdns,
+                        const ClickSendOptions &oOpts = ClickSendOptions());
+
+    // schedules a message for tWhen; returns its ID, or 0 if it was refused (any thread)
+    uint64_t SubmitAt(ClickWallTime tWhen, std::string_view sText, std::span<const std::string_view> vMsisdns,
+                      const ClickSendOptions &oOpts = ClickSendOptions());
+    // cancels a scheduled message that is not yet due; false if unknown or already due (any thread)
+    bool CancelScheduled(uint64_t iId);
+
+    /* Removes the queued and scheduled messages of a campaign (tag 0 matches nothing), or
+     * those with the given IDs; their completion functions report CLICK_SEND_CANCELLED.
+     * Sends already in progress are left to finish, so that their gateway message IDs
+     * are reported and they can be stopped remotely. Returns the number removed (any
+     * thread).
+     */
+    size_t Cancel(uint64_t iTag);
+    size_t Cancel(std::span<const uint64_t> vIds);
+
+    // counters (any thread)
+    ClickEngineStats Stats();
+};
+
+#endif // CLICKATELL_ENGINE_H
@@ -0,0 +1,492 @@
+/*
+ * clickatell_index.cpp
+ *
+ *  Compact message ID index for the Clickatell SMS library.
+ *
+ *  The stripe is taken from the upper half of the key's hash and the slot from the lower
+ *  half. Removal shifts the rest of the probe run back instead of leaving tombstones, so a
+ *  lookup never scans further than the run its key belongs to, however many entries have
+ *  expired.
+ */
+
+#include <algorithm>
+#include <mutex>
+
+#include "clickatell_index.hpp"
+
+/* ----------------------------------------------------------------------------- *
+ * Types/Macros                                                                  *
+ * ----------------------------------------------------------------------------- */
+
+#define CLICK_INDEX_MIN_SLOTS    16          // initial capacity of a stripe
+#define CLICK_INDEX_MSISDN_MASK  0x00FFFFFFFFFFFFFFULL
+#define CLICK_INDEX_STATE_SHIFT  56
+
+static const char *sLocalStateNames[CLICK_MSG_STATE_COUNT] = {"submitted", "queued", "at_gateway", "delivered",
+                                                              "failed", "expired", "cancelled"};
+
+/* ----------------------------------------------------------------------------- *
+ * Free (non-class) functions                                                    *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  LocalHexDigit
+ * Info:      Returns the value of a hex digit, or -1.
+ */
+static int LocalHexDigit(char ch)
+{
+    if (ch >= '0' && ch <= '9')
+        return ch - '0';
+    if (ch >= 'a' && ch <= 'f')
+        return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F')
+        return ch - 'A' + 10;
+
+    return -1;
+}
+
+/*
+ * Function:  LocalSeconds
+ * Info:      Converts a wall-clock time to Unix seconds, as stored in a slot.
+ */
+static uint32_t LocalSeconds(ClickWallTime tTime)
+{
+    long long iSeconds = std::chrono::duration_cast<std::chrono::seconds>(tTime.time_since_epoch()).count();
+
+    return (uint32_t)std::clamp<long long>(iSeconds, 1, UINT32_MAX);
+}
+
+/*
+ * Function:  LocalMeta
+ * Info:      Unpacks the metadata of a slot.
+ */
+static void LocalMeta(uint64_t iClientId, uint64_t iMsisdnState, uint32_t iSubmitS, ClickMessageMeta &oMeta)
+{
+    oMeta.iMsisdn = iMsisdnState & CLICK_INDEX_MSISDN_MASK;
+    oMeta.iClientId = iClientId;
+    oMeta.tSubmitted = ClickWallTime(std::chrono::seconds(iSubmitS));
+    oMeta.eState = (eClickMessageState)(iMsisdnState >> CLICK_INDEX_STATE_SHIFT);
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Private function definitions                                                  *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickMessageIndex::LocalHash
+ * Info:      Mixes both halves of a key into a hash (gateway IDs need not be random).
+ */
+uint64_t ClickMessageIndex::LocalHash(const ClickMessageKey &oKey)
+{
+    uint64_t h = oKey.iHigh * 0x9E3779B97F4A7C15ULL ^ oKey.iLow;
+
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+
+    return h;
+}
+
+/*
+ * Function:  ClickMessageIndex::LocalFind
+ * Info:      Finds the slot of a key, or the free slot ending its probe run (stripe lock
+ *            held).
+ * Inputs:    oStripe - stripe
+ *            oKey    - key
+ *            iHash   - hash of the key
+ * Return:    slot position
+ */
+size_t ClickMessageIndex::LocalFind(const ClickIndexStripe &oStripe, const ClickMessageKey &oKey, uint64_t iHash)
+{
+    size_t iPos = iHash & oStripe.iMask;
+
+    for (;;) {
+        const ClickIndexSlot &oSlot = oStripe.pSlots[iPos];
+
+        if ((oSlot.iKeyHigh == oKey.iHigh && oSlot.iKeyLow == oKey.iLow) || (oSlot.iKeyHigh | oSlot.iKeyLow) == 0)
+            return iPos;
+
+        iPos = (iPos + 1) & oStripe.iMask;
+    }
+}
+
+/*
+ * Function:  ClickMessageIndex::LocalErase
+ * Info:      Frees a slot and shifts the rest of its probe run back to close the gap
+ *            (stripe lock held exclusively).
+ * Inputs:    oStripe - stripe
+ *            iPos    - slot to free
+ * Return:    void
+ */
+void ClickMessageIndex::LocalErase(ClickIndexStripe &oStripe, size_t iPos)
+{
+    size_t iNext = iPos;
+
+    for (;;) {
+        iNext = (iNext + 1) & oStripe.iMask;
+
+        ClickIndexSlot &oSlot = oStripe.pSlots[iNext];
+
+        if ((oSlot.iKeyHigh | oSlot.iKeyLow) == 0)
+            break;
+
+        // an entry may fill the gap unless its home slot lies cyclically in (iPos, iNext]
+        size_t iHome = LocalHash(ClickMessageKey{oSlot.iKeyHigh, oSlot.iKeyLow}) & oStripe.iMask;
+
+        if (((iNext - iHome) & oStripe.iMask) >= ((iNext - iPos) & oStripe.iMask)) {
+            oStripe.pSlots[iPos] = oSlot;
+            iPos = iNext;
+        }
+    }
+
+    oStripe.pSlots[iPos] = ClickIndexSlot{};
+    oStripe.iCount--;
+}
+
+/*
+ * Function:  ClickMessageIndex::LocalGrow
+ * Info:      Doubles the capacity of a stripe and re-inserts its entries (stripe lock held
+ *            exclusively).
+ * Return:    void
+ */
+void ClickMessageIndex::LocalGrow(ClickIndexStripe &oStripe)
+{
+    size_t iOldSize = oStripe.iMask + 1;
+    std::unique_ptr<ClickIndexSlot[]> pOld = std::move(oStripe.pSlots);
+
+    oStripe.pSlots = std::make_unique<ClickIndexSlot[]>(iOldSize * 2);
+    oStripe.iMask = iOldSize * 2 - 1;
+
+    for (size_t i = 0; i < iOldSize; i++) {
+        const ClickIndexSlot &oSlot = pOld[i];
+        ClickMessageKey oKey{oSlot.iKeyHigh, oSlot.iKeyLow};
+
+        if (oKey.Valid())
+            oStripe.pSlots[LocalFind(oStripe, oKey, LocalHash(oKey))] = oSlot;
+    }
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Public function definitions                                                   *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickMessageKey::Parse
+ * Info:      Packs a gateway message ID into a key.
+ * Inputs:    sMessageId - 32 hex digits
+ * Outputs:   oKey       - the key
+ * Return:    false if the ID is not 32 hex digits or is all zero
+ */
+bool ClickMessageKey::Parse(std::string_view sMessageId, ClickMessageKey &oKey)
+{
+    uint64_t iHalves[2] = {0, 0};
+
+    if (sMessageId.length() != 32)
+        return false;
+
+    for (size_t i = 0; i < 32; i++) {
+        int iDigit = LocalHexDigit(sMessageId[i]);
+
+        if (iDigit < 0)
+            return false;
+
+        iHalves[i / 16] = (iHalves[i / 16] << 4) | (uint64_t)iDigit;
+    }
+
+    oKey.iHigh = iHalves[0];
+    oKey.iLow = iHalves[1];
+
+    return oKey.Valid();
+}
+
+std::string ClickMessageKey::Hex() const
+{
+    static const char sDigits[] = "0123456789abcdef";
+    std::string sHex(32, '0');
+
+    for (size_t i = 0; i < 16; i++) {
+        sHex[15 - i] = sDigits[(iHigh >> (4 * i)) & 0xF];
+        sHex[31 - i] = sDigits[(iLow >> (4 * i)) & 0xF];
+    }
+
+    return sHex;
+}
+
+/*
+ * Function:  ClickMessageMeta::PackMsisdn
+ * Info:      Converts a destination to the number stored in the index.
+ * Inputs:    sMsisdn - E.164 digits, optionally with a leading '+'
+ * Return:    the number, or 0 if sMsisdn is not 1-15 digits
+ */
+uint64_t ClickMessageMeta::PackMsisdn(std::string_view sMsisdn)
+{
+    uint64_t iMsisdn = 0;
+
+    if (!sMsisdn.empty() && sMsisdn[0] == '+')
+        sMsisdn.remove_prefix(1);
+
+    if (sMsisdn.empty() || sMsisdn.length() > 15)
+        return 0;
+
+    for (char ch : sMsisdn) {
+        if (ch < '0' || ch > '9')
+            return 0;
+
+        iMsisdn = iMsisdn * 10 + (uint64_t)(ch - '0');
+    }
+
+    return iMsisdn;
+}
+
+std::string ClickMessageMeta::Msisdn() const
+{
+    return (iMsisdn == 0 ? std::string() : std::to_string(iMsisdn));
+}
+
+/*
+ * Function:  ClickMessageIndex
+ * Info:      Constructor. Sizes every stripe for its share of iExpected entries.
+ * Inputs:    iExpected - expected number of entries (0: start small)
+ */
+ClickMessageIndex::ClickMessageIndex(size_t iExpected)
+{
+    size_t iSlots = CLICK_INDEX_MIN_SLOTS;
+
+    // keep the load factor under 3/4 at the expected size
+    while (iSlots * 3 / 4 < iExpected / CLICK_INDEX_STRIPES + 1)
+        iSlots *= 2;
+
+    for (ClickIndexStripe &oStripe : vStripes) {
+        oStripe.pSlots = std::make_unique<ClickIndexSlot[]>(iSlots);
+        oStripe.iMask = iSlots - 1;
+        oStripe.iCount = 0;
+    }
+}
+
+bool ClickMessageIndex::Insert(std::string_view sMessageId, const ClickMessageMeta &oMeta)
+{
+    ClickMessageKey oKey;
+
+    return ClickMessageKey::Parse(sMessageId, oKey) && Insert(oKey, oMeta);
+}
+
+/*
+ * Function:  ClickMessageIndex::Insert
+ * Info:      Adds an entry, or replaces the entry of the same message.
+ * Inputs:    oKey  - message ID
+ *            oMeta - metadata (the MSISDN must fit in 56 bits, as every E.164 number does)
+ * Return:    false if the key is invalid
+ */
+bool ClickMessageIndex::Insert(const ClickMessageKey &oKey, const ClickMessageMeta &oMeta)
+{
+    if (!oKey.Valid())
+        return false;
+
+    uint64_t iHash = LocalHash(oKey);
+    ClickIndexStripe &oStripe = LocalStripe(iHash);
+    std::unique_lock<std::shared_mutex> oLock(oStripe.mtxStripe);
+
+    if ((oStripe.iCount + 1) * 4 > (oStripe.iMask + 1) * 3)
+        LocalGrow(oStripe);
+
+    ClickIndexSlot &oSlot = oStripe.pSlots[LocalFind(oStripe, oKey, iHash)];
+
+    if ((oSlot.iKeyHigh | oSlot.iKeyLow) == 0)
+        oStripe.iCount++;
+
+    oSlot.iKeyHigh = oKey.iHigh;
+    oSlot.iKeyLow = oKey.iLow;
+    oSlot.iClientId = oMeta.iClientId;
+    oSlot.iMsisdnState = (oMeta.iMsisdn & CLICK_INDEX_MSISDN_MASK) | ((uint64_t)oMeta.eState << CLICK_INDEX_STATE_SHIFT);
+    oSlot.iSubmitS = LocalSeconds(oMeta.tSubmitted);
+    oSlot.iFinalS = (IsFinal(oMeta.eState) ? LocalSeconds(std::chrono::system_clock::now()) : 0);
+
+    return true;
+}
+
+bool ClickMessageIndex::Find(std::string_view sMessageId, ClickMessageMeta &oMeta) const
+{
+    ClickMessageKey oKey;
+
+    return ClickMessageKey::Parse(sMessageId, oKey) && Find(oKey, oMeta);
+}
+
+bool ClickMessageIndex::Find(const ClickMessageKey &oKey, ClickMessageMeta &oMeta) const
+{
+    if (!oKey.Valid())
+        return false;
+
+    uint64_t iHash = LocalHash(oKey);
+    const ClickIndexStripe &oStripe = LocalStripe(iHash);
+    std::shared_lock<std::shared_mutex> oLock(oStripe.mtxStripe);
+    const ClickIndexSlot &oSlot = oStripe.pSlots[LocalFind(oStripe, oKey, iHash)];
+
+    if ((oSlot.iKeyHigh | oSlot.iKeyLow) == 0)
+        return false;
+
+    LocalMeta(oSlot.iClientId, oSlot.iMsisdnState, oSlot.iSubmitS, oMeta);
+
+    return true;
+}
+
+bool ClickMessageIndex::Update(std::string_view sMessageId, eClickMessageState eState, ClickWallTime tNow)
+{
+    ClickMessageKey oKey;
+
+    return ClickMessageKey::Parse(sMessageId, oKey) && Update(oKey, eState, tNow);
+}
+
+/*
+ * Function:  ClickMessageIndex::Update
+ * Info:      Moves an entry to a new state. A final state is not replaced by a non-final
+ *            one; the time the entry first became final is kept for Expire().
+ * Inputs:    oKey   - message ID
+ *            eState - new state
+ *            tNow   - current time
+ * Return:    false if there is no entry for the message
+ */
+bool ClickMessageIndex::Update(const ClickMessageKey &oKey, eClickMessageState eState, ClickWallTime tNow)
+{
+    if (!oKey.Valid())
+        return false;
+
+    uint64_t iHash = LocalHash(oKey);
+    ClickIndexStripe &oStripe = LocalStripe(iHash);
+    std::unique_lock<std::shared_mutex> oLock(oStripe.mtxStripe);
+    ClickIndexSlot &oSlot = oStripe.pSlots[LocalFind(oStripe, oKey, iHash)];
+
+    if ((oSlot.iKeyHigh | oSlot.iKeyLow) == 0)
+        return false;
+
+    if (oSlot.iFinalS != 0 && !IsFinal(eState))
+        return true;
+
+    oSlot.iMsisdnState = (oSlot.iMsisdnState & CLICK_INDEX_MSISDN_MASK) | ((uint64_t)eState << CLICK_INDEX_STATE_SHIFT);
+
+    if (oSlot.iFinalS == 0 && IsFinal(eState))
+        oSlot.iFinalS = LocalSeconds(tNow);
+
+    return true;
+}
+
+bool ClickMessageIndex::Erase(std::string_view sMessageId)
+{
+    ClickMessageKey oKey;
+
+    return ClickMessageKey::Parse(sMessageId, oKey) && Erase(oKey);
+}
+
+bool ClickMessageIndex::Erase(const ClickMessageKey &oKey)
+{
+    if (!oKey.Valid())
+        return false;
+
+    uint64_t iHash = LocalHash(oKey);
+    ClickIndexStripe &oStripe = LocalStripe(iHash);
+    std::unique_lock<std::shared_mutex> oLock(oStripe.mtxStripe);
+    size_t iPos = LocalFind(oStripe, oKey, iHash);
+
+    if ((oStripe.pSlots[iPos].iKeyHigh | oStripe.pSlots[iPos].iKeyLow) == 0)
+        return false;
+
+    LocalErase(oStripe, iPos);
+
+    return true;
+}
+
+/*
+ * Function:  ClickMessageIndex::Expire
+ * Info:      Removes the entries that became final at least tKeep ago. Each stripe is
+ *            locked for one pass over its slots; an entry shifted back into the slot just
+ *            freed is examined again, so none is skipped.
+ * Inputs:    tKeep - how long final entries are kept
+ *            tNow  - current time
+ * Return:    number of entries removed
+ */
+size_t ClickMessageIndex::Expire(std::chrono::seconds tKeep, ClickWallTime tNow)
+{
+    uint32_t iNowS = LocalSeconds(tNow);
+    uint32_t iCutoffS = (iNowS > tKeep.count() ? iNowS - (uint32_t)tKeep.count() : 0);
+    size_t iRemoved = 0;
+
+    for (ClickIndexStripe &oStripe : vStripes) {
+        std::unique_lock<std::shared_mutex> oLock(oStripe.mtxStripe);
+
+        for (size_t i = 0; i <= oStripe.iMask && oStripe.iCount > 0; ) {
+            const ClickIndexSlot &oSlot = oStripe.pSlots[i];
+
+            if (oSlot.iFinalS != 0 && oSlot.iFinalS <= iCutoffS) {
+                LocalErase(oStripe, i);
+                iRemoved++;
+            }
+            else
+                i++;
+        }
+    }
+
+    return iRemoved;
+}
+
+size_t ClickMessageIndex::Size() const
+{
+    size_t iSize = 0;
+
+    for (const ClickIndexStripe &oStripe : vStripes) {
+        std::shared_lock<std::shared_mutex> oLock(oStripe.mtxStripe);
+        iSize += oStripe.iCount;
+    }
+
+    return iSize;
+}
+
+size_t ClickMessageIndex::MemoryBytes() const
+{
+    size_t iBytes = sizeof(*this);
+
+    for (const ClickIndexStripe &oStripe : vStripes) {
+        std::shared_lock<std::shared_mutex> oLock(oStripe.mtxStripe);
+        iBytes += (oStripe.iMask + 1) * sizeof(ClickIndexSlot);
+    }
+
+    return iBytes;
+}
+
+/*
+ * Function:  ClickMessageIndex::StateFromStatus
+ * Info:      Maps a gateway message status code to an index state.
+ * Inputs:    iStatusCode - status code (1-14; "004" and 4 are the same code)
+ * Return:    state (CLICK_MSG_SUBMITTED for unknown codes)
+ */
+eClickMessageState ClickMessageIndex::StateFromStatus(int iStatusCode)
+{
+    switch (iStatusCode) {
+        case 2:    // queued
+        case 8:    // received by the gateway
+        case 11:   // queued for later delivery
+            return CLICK_MSG_QUEUED;
+        case 3:    // delivered to the upstream gateway or network
+            return CLICK_MSG_AT_GATEWAY;
+        case 4:    // received by recipient
+            return CLICK_MSG_DELIVERED;
+        case 5:    // error with message
+        case 7:    // error delivering message
+        case 9:    // routing error
+        case 12:   // out of credit
+        case 14:   // maximum MT limit exceeded
+            return CLICK_MSG_FAILED;
+        case 6:    // user cancelled message delivery
+        case 13:   // cancelled by the gateway
+            return CLICK_MSG_CANCELLED;
+        case 10:   // message expired
+            return CLICK_MSG_EXPIRED;
+        default:   // 1: message unknown
+            return CLICK_MSG_SUBMITTED;
+    }
+}
+
+const char *ClickMessageIndex::StateName(eClickMessageState eState)
+{
+    return (eState < CLICK_MSG_STATE_COUNT ? sLocalStateNames[eState] : "unknown");
+}
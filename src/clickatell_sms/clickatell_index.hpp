@@ -0,0 +1,150 @@
+#ifndef CLICKATELL_INDEX_H
+#define CLICKATELL_INDEX_H
+
+/*
+ * clickatell_index.hpp
+ *
+ *  Compact message ID index for the Clickatell SMS library.
+ *
+ *  Maps the gateway's message IDs (apiMessageId, 32 hex digits) to a small metadata record,
+ *  so that status callbacks and SmsStatusGet() results can be matched to the sends that
+ *  produced them. An ID is packed into a 16-byte binary key and each entry takes 40 bytes in
+ *  an open-addressing table (linear probing, no per-entry allocation), a fraction of a
+ *  std::unordered_map<std::string, ...>.
+ *
+ *  The table is split into CLICK_INDEX_STRIPES stripes, each with its own reader/writer
+ *  lock, so lookups run concurrently and updates only contend on the same stripe. Entries
+ *  that reached a final state are removed by Expire() once they are old enough.
+ *
+ *      ClickMessageIndex oIndex(1000000);
+ *      oIndex.Insert(sApiMessageId, ClickMessageMeta(sMsisdn, iClientId));
+ *      oIndex.Update(sApiMessageId, ClickMessageIndex::StateFromStatus(4));
+ *      oIndex.Expire(std::chrono::hours(24));
+ */
+#include <stdint.h>
+#include <chrono>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+
+#include "clickatell_api.hpp"
+
+#define CLICK_INDEX_STRIPES  64  // independently locked parts of the table (a power of two)
+
+// state of an indexed message
+enum eClickMessageState : uint8_t {
+    CLICK_MSG_SUBMITTED,      // accepted by the gateway, no status yet
+    CLICK_MSG_QUEUED,         // queued or delayed by the gateway
+    CLICK_MSG_AT_GATEWAY,     // handed to the upstream network
+    CLICK_MSG_DELIVERED,      // final: received by the handset
+    CLICK_MSG_FAILED,         // final: error, routing failure, out of credit or limit exceeded
+    CLICK_MSG_EXPIRED,        // final: validity period passed
+    CLICK_MSG_CANCELLED,      // final: cancelled by the user
+    CLICK_MSG_STATE_COUNT
+};
+
+// gateway message ID in binary form; zero is not a valid ID
+struct ClickMessageKey {
+    uint64_t iHigh = 0;
+    uint64_t iLow = 0;
+
+    bool Valid() const { return (iHigh | iLow) != 0; }
+    bool operator==(const ClickMessageKey &oOther) const { return iHigh == oOther.iHigh && iLow == oOther.iLow; }
+
+    // parses 32 hex digits (either case); false for anything else
+    static bool Parse(std::string_view sMessageId, ClickMessageKey &oKey);
+    std::string Hex() const;  // 32 lowercase hex digits
+};
+
+// metadata kept per message
+struct ClickMessageMeta {
+    uint64_t iMsisdn;          // destination E.164 digits as a number (0: unknown)
+    uint64_t iClientId;        // caller's own ID of the message
+    ClickWallTime tSubmitted;  // submission time (second resolution)
+    eClickMessageState eState;
+
+    ClickMessageMeta() : iMsisdn(0), iClientId(0), eState(CLICK_MSG_SUBMITTED) {}
+    ClickMessageMeta(std::string_view sMsisdn, uint64_t iClientId_,
+                     ClickWallTime tSubmitted_ = std::chrono::system_clock::now(),
+                     eClickMessageState eState_ = CLICK_MSG_SUBMITTED)
+                     : iMsisdn(PackMsisdn(sMsisdn)),
+                       iClientId(iClientId_),
+                       tSubmitted(tSubmitted_),
+                       eState(eState_) {}
+
+    std::string Msisdn() const;
+
+    // E.164 digits (an optional leading '+') as a number; 0 if not a valid number
+    static uint64_t PackMsisdn(std::string_view sMsisdn);
+};
+
+class ClickMessageIndex
+{
+private:
+    // one entry; an all-zero key marks a free slot
+    struct ClickIndexSlot {
+        uint64_t iKeyHigh;
+        uint64_t iKeyLow;
+        uint64_t iClientId;
+        uint64_t iMsisdnState;  // MSISDN in the low 56 bits, state in the top 8
+        uint32_t iSubmitS;      // Unix seconds
+        uint32_t iFinalS;       // Unix seconds the state became final (0: not final)
+    };
+
+    // part of the table with its own lock
+    struct alignas(64) ClickIndexStripe {
+        mutable std::shared_mutex mtxStripe;
+        std::unique_ptr<ClickIndexSlot[]> pSlots;
+        size_t iMask;           // capacity - 1 (capacity is a power of two)
+        size_t iCount;
+    };
+
+    ClickIndexStripe vStripes[CLICK_INDEX_STRIPES];
+
+    static uint64_t LocalHash(const ClickMessageKey &oKey);
+    static size_t LocalFind(const ClickIndexStripe &oStripe, const ClickMessageKey &oKey, uint64_t iHash);
+    static void LocalErase(ClickIndexStripe &oStripe, size_t iPos);
+    static void LocalGrow(ClickIndexStripe &oStripe);
+    ClickIndexStripe &LocalStripe(uint64_t iHash) { return vStripes[(iHash >> 32) & (CLICK_INDEX_STRIPES - 1)]; }
+    const ClickIndexStripe &LocalStripe(uint64_t iHash) const { return vStripes[(iHash >> 32) & (CLICK_INDEX_STRIPES - 1)]; }
+
+public:
+    // iExpected: number of entries to size the table for (it grows as needed)
+    ClickMessageIndex(size_t iExpected = 0);
+
+    ClickMessageIndex(const ClickMessageIndex &) = delete;
+    ClickMessageIndex &operator=(const ClickMessageIndex &) = delete;
+
+    // adds or replaces an entry; false if the message ID is invalid (any thread)
+    bool Insert(std::string_view sMessageId, const ClickMessageMeta &oMeta);
+    bool Insert(const ClickMessageKey &oKey, const ClickMessageMeta &oMeta);
+
+    // looks an entry up; false if there is none (any thread, concurrently with each other)
+    bool Find(std::string_view sMessageId, ClickMessageMeta &oMeta) const;
+    bool Find(const ClickMessageKey &oKey, ClickMessageMeta &oMeta) const;
+
+    // moves an entry to a new state; false if there is none (any thread). A final state is
+    // kept if a non-final one arrives later, as status reports may come out of order.
+    bool Update(std::string_view sMessageId, eClickMessageState eState,
+                ClickWallTime tNow = std::chrono::system_clock::now());
+    bool Update(const ClickMessageKey &oKey, eClickMessageState eState,
+                ClickWallTime tNow = std::chrono::system_clock::now());
+
+    bool Erase(std::string_view sMessageId);
+    bool Erase(const ClickMessageKey &oKey);
+
+    // removes the entries that have been in a final state for tKeep or longer (any thread;
+    // locks one stripe at a time); returns the number removed
+    size_t Expire(std::chrono::seconds tKeep, ClickWallTime tNow = std::chrono::system_clock::now());
+
+    size_t Size() const;
+    size_t MemoryBytes() const;  // table memory
+
+    static bool IsFinal(eClickMessageState eState) { return eState >= CLICK_MSG_DELIVERED; }
+    // state of a gateway message status code (e.g. 4, "Received by recipient")
+    static eClickMessageState StateFromStatus(int iStatusCode);
+    static const char *StateName(eClickMessageState eState);
+};
+
+#endif // CLICKATELL_INDEX_H
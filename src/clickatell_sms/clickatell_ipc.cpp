@@ -0,0 +1,568 @@
+/*
+ * clickatell_ipc.cpp
+ *
+ *  Local submission protocol of the Clickatell SMS daemon, and its thin client.
+ *
+ *  The client keeps its socket non-blocking and does all I/O in LocalIo(), which writes
+ *  pending requests and reads replies in the same poll() round, so a pipeline of requests
+ *  larger than the socket buffer cannot deadlock against a daemon that is writing replies.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "clickatell_ipc.hpp"
+
+/* ----------------------------------------------------------------------------- *
+ * Types/Macros                                                                  *
+ * ----------------------------------------------------------------------------- */
+
+#define CLICK_IPC_READ_CHUNK  65536  // bytes read per recv() call
+
+/* ----------------------------------------------------------------------------- *
+ * ClickIpc function definitions                                                 *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickIpc::Begin
+ * Info:      Starts a frame: appends a placeholder length, the type and the tag.
+ * Inputs:    sOut  - output buffer
+ *            eType - frame type
+ *            iTag  - request tag
+ * Return:    offset of the frame in sOut, for End()
+ */
+size_t ClickIpc::Begin(std::string &sOut, eClickIpcType eType, uint32_t iTag)
+{
+    size_t iStart = sOut.length();
+
+    Put32(sOut, 0);
+    Put8(sOut, (uint8_t)eType);
+    Put32(sOut, iTag);
+
+    return iStart;
+}
+
+/*
+ * Function:  ClickIpc::End
+ * Info:      Completes a frame by filling in its length.
+ * Inputs:    sOut   - output buffer
+ *            iStart - offset returned by Begin()
+ * Return:    void
+ */
+void ClickIpc::End(std::string &sOut, size_t iStart)
+{
+    uint32_t iLen = (uint32_t)(sOut.length() - iStart - 4);
+
+    for (int i = 0; i < 4; i++)
+        sOut[iStart + i] = (char)(iLen >> (8 * i));
+}
+
+void ClickIpc::Put16(std::string &sOut, uint16_t iValue)
+{
+    for (int i = 0; i < 2; i++)
+        sOut.push_back((char)(iValue >> (8 * i)));
+}
+
+void ClickIpc::Put32(std::string &sOut, uint32_t iValue)
+{
+    for (int i = 0; i < 4; i++)
+        sOut.push_back((char)(iValue >> (8 * i)));
+}
+
+void ClickIpc::Put64(std::string &sOut, uint64_t iValue)
+{
+    for (int i = 0; i < 8; i++)
+        sOut.push_back((char)(iValue >> (8 * i)));
+}
+
+void ClickIpc::PutString(std::string &sOut, std::string_view sValue)
+{
+    Put32(sOut, (uint32_t)sValue.length());
+    sOut.append(sValue);
+}
+
+/*
+ * Function:  ClickIpc::FrameLength
+ * Info:      Checks whether a buffer starts with a complete frame.
+ * Inputs:    sBuf - received bytes
+ * Return:    length of the frame including its length field, 0 if more bytes are needed,
+ *            -1 if the frame is shorter than its header or longer than CLICK_IPC_MAX_FRAME
+ */
+long ClickIpc::FrameLength(std::string_view sBuf)
+{
+    if (sBuf.length() < 4)
+        return 0;
+
+    uint32_t iLen = 0;
+
+    for (int i = 0; i < 4; i++)
+        iLen |= (uint32_t)(uint8_t)sBuf[i] << (8 * i);
+
+    if (iLen < CLICK_IPC_HEADER - 4 || iLen > CLICK_IPC_MAX_FRAME)
+        return -1;
+
+    return (sBuf.length() - 4 >= iLen ? (long)iLen + 4 : 0);
+}
+
+/* ----------------------------------------------------------------------------- *
+ * ClickIpcReader function definitions                                           *
+ * ----------------------------------------------------------------------------- */
+
+bool ClickIpcReader::LocalHave(size_t iLen)
+{
+    if (bOk && sBuf.length() - iPos >= iLen)
+        return true;
+
+    bOk = false;
+    return false;
+}
+
+uint8_t ClickIpcReader::Get8()
+{
+    return (LocalHave(1) ? (uint8_t)sBuf[iPos++] : 0);
+}
+
+uint16_t ClickIpcReader::Get16()
+{
+    uint16_t iValue = 0;
+
+    if (LocalHave(2)) {
+        for (int i = 0; i < 2; i++)
+            iValue |= (uint16_t)((uint8_t)sBuf[iPos++] << (8 * i));
+    }
+
+    return iValue;
+}
+
+uint32_t ClickIpcReader::Get32()
+{
+    uint32_t iValue = 0;
+
+    if (LocalHave(4)) {
+        for (int i = 0; i < 4; i++)
+            iValue |= (uint32_t)(uint8_t)sBuf[iPos++] << (8 * i);
+    }
+
+    return iValue;
+}
+
+uint64_t ClickIpcReader::Get64()
+{
+    uint64_t iValue = 0;
+
+    if (LocalHave(8)) {
+        for (int i = 0; i < 8; i++)
+            iValue |= (uint64_t)(uint8_t)sBuf[iPos++] << (8 * i);
+    }
+
+    return iValue;
+}
+
+std::string_view ClickIpcReader::GetBytes(size_t iLen)
+{
+    if (!LocalHave(iLen))
+        return std::string_view();
+
+    iPos += iLen;
+
+    return sBuf.substr(iPos - iLen, iLen);
+}
+
+std::string_view ClickIpcReader::GetString()
+{
+    return GetBytes(Get32());
+}
+
+/* ----------------------------------------------------------------------------- *
+ * ClickDaemonClient private function definitions                                *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickDaemonClient::LocalConnect
+ * Info:      Connects to the daemon socket, unless already connected.
+ * Return:    true if connected
+ */
+bool ClickDaemonClient::LocalConnect()
+{
+    if (iFd >= 0)
+        return true;
+
+    struct sockaddr_un oAddr;
+
+    if (sPath.length() >= sizeof(oAddr.sun_path))
+        return false;
+
+    memset(&oAddr, 0, sizeof(oAddr));
+    oAddr.sun_family = AF_UNIX;
+    memcpy(oAddr.sun_path, sPath.data(), sPath.length());
+
+    if ((iFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+        return false;
+
+    if (connect(iFd, (struct sockaddr *)&oAddr, sizeof(oAddr)) != 0 ||
+        fcntl(iFd, F_SETFL, fcntl(iFd, F_GETFL) | O_NONBLOCK) != 0) {
+        LocalClose();
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Function:  ClickDaemonClient::LocalClose
+ * Info:      Drops the connection. Requests not yet written are discarded; their replies
+ *            will never arrive.
+ * Return:    void
+ */
+void ClickDaemonClient::LocalClose()
+{
+    if (iFd >= 0)
+        close(iFd);
+
+    iFd = -1;
+    sOut.clear();
+    sIn.clear();
+}
+
+/*
+ * Function:  ClickDaemonClient::LocalDecode
+ * Info:      Decodes every complete frame received so far into dqReplies.
+ * Return:    false if a frame was malformed (the connection is closed)
+ */
+bool ClickDaemonClient::LocalDecode()
+{
+    size_t iPos = 0;
+    long iLen;
+
+    while ((iLen = ClickIpc::FrameLength(std::string_view(sIn).substr(iPos))) > 0) {
+        ClickIpcReader oReader(std::string_view(sIn).substr(iPos + 4, iLen - 4));
+        ClickDaemonReply oReply;
+
+        oReply.eType = (eClickIpcType)oReader.Get8();
+        oReply.iTag = oReader.Get32();
+        oReply.bQueued = false;
+        oReply.iId = 0;
+        oReply.eStatus = CLICK_SEND_DONE;
+        oReply.curlCode = CURLE_OK;
+        oReply.iHttpStatus = 0;
+
+        if (oReply.eType == CLICK_IPC_ACK) {
+            oReply.bQueued = (oReader.Get8() != 0);
+            oReply.iId = oReader.Get64();
+        }
+        else if (oReply.eType == CLICK_IPC_RESULT) {
+            oReply.eStatus = (eClickSendStatus)oReader.Get8();
+            oReply.curlCode = (CURLcode)(int32_t)oReader.Get32();
+            oReply.iHttpStatus = (int32_t)oReader.Get32();
+            oReply.sResponse = oReader.GetString();
+        }
+        else
+            iLen = -1;
+
+        if (iLen < 0 || !oReader.Ok() || !oReader.AtEnd())
+            break;
+
+        dqReplies.push_back(std::move(oReply));
+        iPos += iLen;
+    }
+
+    if (iLen < 0) {
+        LocalClose();
+        return false;
+    }
+
+    sIn.erase(0, iPos);
+
+    return true;
+}
+
+/*
+ * Function:  ClickDaemonClient::LocalIo
+ * Info:      Waits up to iTimeoutMs for the socket, then writes as much of sOut as it takes
+ *            and reads whatever has arrived.
+ * Inputs:    bWantRead  - wait for replies (otherwise only for sOut to drain)
+ *            iTimeoutMs - longest wait (-1: no limit)
+ * Return:    false if the connection failed (it is closed)
+ */
+bool ClickDaemonClient::LocalIo(bool bWantRead, int iTimeoutMs)
+{
+    struct pollfd oPoll;
+
+    oPoll.fd = iFd;
+    oPoll.events = (short)((bWantRead ? POLLIN : 0) | (sOut.empty() ? 0 : POLLOUT));
+    oPoll.revents = 0;
+
+    if (poll(&oPoll, 1, iTimeoutMs) < 0)
+        return (errno == EINTR);
+
+    if (oPoll.revents & (POLLERR | POLLNVAL)) {
+        LocalClose();
+        return false;
+    }
+
+    if (!sOut.empty()) {
+        ssize_t iSent = send(iFd, sOut.data(), sOut.length(), MSG_NOSIGNAL);
+
+        if (iSent > 0)
+            sOut.erase(0, iSent);
+        else if (iSent < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            LocalClose();
+            return false;
+        }
+    }
+
+    if (oPoll.revents & (POLLIN | POLLHUP)) {
+        char chBuf[CLICK_IPC_READ_CHUNK];
+        ssize_t iRead = recv(iFd, chBuf, sizeof(chBuf), 0);
+
+        if (iRead == 0 || (iRead < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            LocalClose();
+            return false;
+        }
+
+        if (iRead > 0) {
+            sIn.append(chBuf, iRead);
+            return LocalDecode();
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Function:  ClickDaemonClient::LocalWait
+ * Info:      Completes a blocking call: writes the request and waits for its result.
+ *            Replies to other (pipelined) requests stay queued for Next(). A send the
+ *            daemon refused (queue full) fails like an unreachable daemon.
+ * Inputs:    iTag - tag of the request (0: it could not be queued)
+ * Return:    gateway response
+ */
+const std::string &ClickDaemonClient::LocalWait(uint32_t iTag)
+{
+    sResponse.clear();
+    curlCode = CURLE_COULDNT_CONNECT;
+    iHttpStatus = 0;
+
+    while (iTag != 0 && iFd >= 0) {
+        for (std::deque<ClickDaemonReply>::iterator it = dqReplies.begin(); it != dqReplies.end(); ++it) {
+            if (it->iTag != iTag)
+                continue;
+
+            if (it->eType == CLICK_IPC_ACK && it->bQueued) {
+                dqReplies.erase(it);
+                break;
+            }
+
+            if (it->eType == CLICK_IPC_RESULT) {
+                sResponse.swap(it->sResponse);
+                curlCode = it->curlCode;
+                iHttpStatus = it->iHttpStatus;
+            }
+
+            dqReplies.erase(it);
+            return sResponse;
+        }
+
+        LocalIo(true, -1);
+    }
+
+    return sResponse;
+}
+
+/* ----------------------------------------------------------------------------- *
+ * ClickDaemonClient public function definitions                                 *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickDaemonClient
+ * Info:      Constructor. Connects to the daemon; if it is not running, every call tries
+ *            again, so a client outlives a daemon restart.
+ * Inputs:    sPath_ - daemon socket
+ */
+ClickDaemonClient::ClickDaemonClient(std::string_view sPath_)
+                                     : sPath(sPath_),
+                                       iFd(-1),
+                                       iNextTag(1),
+                                       curlCode(CURLE_OK),
+                                       iHttpStatus(0)
+{
+    LocalConnect();
+}
+
+/*
+ * Function:  ~ClickDaemonClient
+ * Info:      Destructor. Closes the connection; pipelined requests still queued by the
+ *            daemon are sent regardless.
+ */
+ClickDaemonClient::~ClickDaemonClient()
+{
+    LocalClose();
+}
+
+/*
+ * Function:  SmsMessageSend
+ * Info:      Sends SMSes through the daemon and waits for the gateway's answer.
+ * Inputs:    sText     - message text
+ *            vMsisdns  - destination mobile numbers
+ *            ePriority - priority class in the daemon's queue
+ *            tDeadline - the daemon drops the message if it cannot be sent by then
+ * Return:    gateway response (empty if the daemon could not be reached)
+ */
+const std::string &ClickDaemonClient::SmsMessageSend(const std::string &sText, const std::vector<std::string> &vMsisdns)
+{
+    std::vector<std::string_view> vViews(vMsisdns.begin(), vMsisdns.end());
+
+    return SmsMessageSend(sText, vViews);
+}
+
+const std::string &ClickDaemonClient::SmsMessageSend(std::string_view sText, std::span<const std::string_view> vMsisdns,
+                                                     eClickPriority ePriority, ClickTimePoint tDeadline)
+{
+    return LocalWait(Submit(sText, vMsisdns, ePriority, tDeadline));
+}
+
+/*
+ * Function:  SmsStatusGet
+ * Info:      Queries the status of a message through the daemon.
+ * Inputs:    sMsgId - API message ID
+ * Return:    gateway response (empty if the daemon could not be reached)
+ */
+const std::string &ClickDaemonClient::SmsStatusGet(std::string_view sMsgId)
+{
+    return LocalWait(StatusQuery(sMsgId));
+}
+
+/*
+ * Function:  ClickDaemonClient::Submit
+ * Info:      Queues a send request without waiting; Flush() or Next() writes it. The
+ *            daemon answers with an ACK and, if the message was queued, later a RESULT.
+ * Inputs:    see SmsMessageSend()
+ * Return:    request tag, or 0 if the daemon cannot be reached
+ */
+uint32_t ClickDaemonClient::Submit(std::string_view sText, std::span<const std::string_view> vMsisdns,
+                                   eClickPriority ePriority, ClickTimePoint tDeadline)
+{
+    if (!LocalConnect())
+        return 0;
+
+    uint32_t iTag = iNextTag++;
+    uint32_t iDeadlineMs = 0;
+
+    if (iNextTag == 0)
+        iNextTag = 1;
+
+    if (tDeadline != ClickTimePoint::max()) {
+        long long iMs = std::chrono::duration_cast<std::chrono::milliseconds>(tDeadline - std::chrono::steady_clock::now()).count();
+
+        iDeadlineMs = (uint32_t)std::clamp<long long>(iMs, 1, UINT32_MAX);
+    }
+
+    size_t iStart = ClickIpc::Begin(sOut, CLICK_IPC_SEND, iTag);
+
+    ClickIpc::Put8(sOut, (uint8_t)ePriority);
+    ClickIpc::Put32(sOut, iDeadlineMs);
+    ClickIpc::PutString(sOut, sText);
+    ClickIpc::Put32(sOut, (uint32_t)vMsisdns.size());
+
+    for (std::string_view sMsisdn : vMsisdns) {
+        sMsisdn = sMsisdn.substr(0, UINT16_MAX);
+        ClickIpc::Put16(sOut, (uint16_t)sMsisdn.length());
+        sOut.append(sMsisdn);
+    }
+
+    ClickIpc::End(sOut, iStart);
+
+    return iTag;
+}
+
+/*
+ * Function:  ClickDaemonClient::StatusQuery
+ * Info:      Queues a status query without waiting; the daemon answers with a RESULT.
+ * Inputs:    sMsgId - API message ID
+ * Return:    request tag, or 0 if the daemon cannot be reached
+ */
+uint32_t ClickDaemonClient::StatusQuery(std::string_view sMsgId)
+{
+    if (!LocalConnect())
+        return 0;
+
+    uint32_t iTag = iNextTag++;
+
+    if (iNextTag == 0)
+        iNextTag = 1;
+
+    size_t iStart = ClickIpc::Begin(sOut, CLICK_IPC_STATUS, iTag);
+
+    ClickIpc::PutString(sOut, sMsgId);
+    ClickIpc::End(sOut, iStart);
+
+    return iTag;
+}
+
+/*
+ * Function:  ClickDaemonClient::Flush
+ * Info:      Writes the queued requests. Replies arriving meanwhile are kept for Next().
+ * Inputs:    iTimeoutMs - longest wait (-1: no limit)
+ * Return:    true once everything is written; false on timeout or connection failure
+ */
+bool ClickDaemonClient::Flush(int iTimeoutMs)
+{
+    ClickTimePoint tEnd = std::chrono::steady_clock::now() + std::chrono::milliseconds(iTimeoutMs);
+
+    while (iFd >= 0 && !sOut.empty()) {
+        int iWaitMs = iTimeoutMs;
+
+        if (iTimeoutMs >= 0) {
+            iWaitMs = (int)std::chrono::duration_cast<std::chrono::milliseconds>(tEnd - std::chrono::steady_clock::now()).count();
+
+            if (iWaitMs < 0)
+                return false;
+        }
+
+        LocalIo(true, iWaitMs);
+    }
+
+    return (iFd >= 0);
+}
+
+/*
+ * Function:  ClickDaemonClient::Next
+ * Info:      Returns the next reply from the daemon, writing queued requests meanwhile.
+ * Inputs:    iTimeoutMs - longest wait (-1: no limit, 0: only what has arrived)
+ * Outputs:   oReply - the reply
+ * Return:    false on timeout or connection failure
+ */
+bool ClickDaemonClient::Next(ClickDaemonReply &oReply, int iTimeoutMs)
+{
+    ClickTimePoint tEnd = std::chrono::steady_clock::now() + std::chrono::milliseconds(iTimeoutMs);
+
+    for (;;) {
+        if (!dqReplies.empty()) {
+            oReply = std::move(dqReplies.front());
+            dqReplies.pop_front();
+            return true;
+        }
+
+        if (iFd < 0)
+            return false;
+
+        int iWaitMs = iTimeoutMs;
+
+        if (iTimeoutMs >= 0) {
+            iWaitMs = (int)std::chrono::duration_cast<std::chrono::milliseconds>(tEnd - std::chrono::steady_clock::now()).count();
+
+            if (iWaitMs < 0)
+                return false;
+        }
+
+        LocalIo(true, iWaitMs);
+    }
+}
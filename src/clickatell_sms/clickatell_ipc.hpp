@@ -0,0 +1,164 @@
+#ifndef CLICKATELL_IPC_H
+#define CLICKATELL_IPC_H
+
+/*
+ * clickatell_ipc.hpp
+ *
+ *  Local submission protocol of the Clickatell SMS daemon, and its thin client.
+ *
+ *  The daemon (clickatell_daemon) owns the gateway connections, the concurrency limit and
+ *  the retries; local processes hand it messages over a Unix domain socket instead of each
+ *  creating their own ClickatellSms. Every message on the socket is a frame:
+ *
+ *      u32 length        length of everything after this field
+ *      u8  type          eClickIpcType
+ *      u32 tag           chosen by the client, echoed in the replies to the request
+ *      ... payload
+ *
+ *  All integers are little-endian. Payloads:
+ *
+ *      CLICK_IPC_SEND    u8 priority, u32 deadline (ms from now, 0: none), u32 text length,
+ *                        text, u32 count, count x (u16 length, msisdn)
+ *      CLICK_IPC_STATUS  u32 length, message ID
+ *      CLICK_IPC_ACK     u8 queued (0: refused, no result follows), u64 daemon message ID
+ *      CLICK_IPC_RESULT  u8 eClickSendStatus, i32 cURL code, i32 HTTP status, u32 length,
+ *                        gateway response
+ *
+ *  A send is acknowledged as soon as the daemon has queued it and gets its result when the
+ *  gateway has answered; a status query gets only a result. Requests may be pipelined:
+ *  replies arrive as they become available, not in request order, and are matched to their
+ *  requests by tag. A malformed frame closes the connection.
+ */
+#include <stdint.h>
+#include <deque>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <curl/curl.h>
+
+#include "clickatell_api.hpp"
+#include "clickatell_scheduler.hpp"
+
+#define CLICK_IPC_DEFAULT_SOCKET  "/tmp/clickatell_sms.sock" // default daemon socket
+#define CLICK_IPC_MAX_FRAME       (16 * 1024 * 1024)         // longest frame accepted (after the length field)
+#define CLICK_IPC_HEADER          9                          // length, type and tag
+
+// frame types
+enum eClickIpcType {
+    CLICK_IPC_SEND = 1,       // client: send a message
+    CLICK_IPC_STATUS = 2,     // client: query the status of a message
+    CLICK_IPC_ACK = 0x81,     // daemon: a send was queued or refused
+    CLICK_IPC_RESULT = 0x82   // daemon: result of a send or status query
+};
+
+// frame encoding helpers
+struct ClickIpc {
+    // starts a frame at the end of sOut; returns its offset for End()
+    static size_t Begin(std::string &sOut, eClickIpcType eType, uint32_t iTag);
+    // fills in the length of the frame started at iStart
+    static void End(std::string &sOut, size_t iStart);
+
+    static void Put8(std::string &sOut, uint8_t iValue) { sOut.push_back((char)iValue); }
+    static void Put16(std::string &sOut, uint16_t iValue);
+    static void Put32(std::string &sOut, uint32_t iValue);
+    static void Put64(std::string &sOut, uint64_t iValue);
+    static void PutString(std::string &sOut, std::string_view sValue);  // u32 length, bytes
+
+    // length of the complete frame at the start of sBuf: 0 if incomplete, -1 if invalid
+    static long FrameLength(std::string_view sBuf);
+};
+
+// bounds-checked frame decoder; a read past the end returns zeros and clears Ok()
+class ClickIpcReader
+{
+private:
+    std::string_view sBuf;
+    size_t iPos;
+    bool bOk;
+
+    bool LocalHave(size_t iLen);
+
+public:
+    ClickIpcReader(std::string_view sBuf_) : sBuf(sBuf_), iPos(0), bOk(true) {}
+
+    uint8_t Get8();
+    uint16_t Get16();
+    uint32_t Get32();
+    uint64_t Get64();
+    std::string_view GetBytes(size_t iLen);
+    std::string_view GetString();  // u32 length, bytes
+
+    bool Ok() const { return bOk; }
+    bool AtEnd() const { return iPos == sBuf.length(); }
+};
+
+// reply received from the daemon
+struct ClickDaemonReply {
+    eClickIpcType eType;        // CLICK_IPC_ACK or CLICK_IPC_RESULT
+    uint32_t iTag;              // tag of the request
+    bool bQueued;               // ACK: the send was queued
+    uint64_t iId;               // ACK: daemon message ID
+    eClickSendStatus eStatus;   // RESULT: final state of the send (status query: CLICK_SEND_DONE, or
+                                //         CLICK_SEND_CANCELLED if the daemon stopped before sending it)
+    CURLcode curlCode;          // RESULT: cURL result of the last attempt
+    long iHttpStatus;           // RESULT: HTTP status of the last attempt
+    std::string sResponse;      // RESULT: gateway response
+};
+
+/* Thin client of the daemon.
+ * The blocking functions mirror ClickatellSms: they return the gateway response and set
+ * GetCurlCode()/GetHttpStatus(). If the daemon cannot be reached they fail like a refused
+ * connection (CURLE_COULDNT_CONNECT, empty response). Submit()/StatusQuery() pipeline
+ * requests instead; their replies are collected with Next(). One object must not be used
+ * by several threads at once.
+ */
+class ClickDaemonClient
+{
+private:
+    std::string sPath;                     // daemon socket
+    int iFd;                               // -1 while not connected
+    uint32_t iNextTag;
+    std::string sOut;                      // frames not yet written
+    std::string sIn;                       // bytes received, not yet decoded
+    std::deque<ClickDaemonReply> dqReplies; // decoded replies not yet collected
+    std::string sResponse;                 // response of the last blocking call
+    CURLcode curlCode;
+    long iHttpStatus;
+
+    bool LocalConnect();
+    void LocalClose();
+    bool LocalDecode();
+    bool LocalIo(bool bWantRead, int iTimeoutMs);
+    const std::string &LocalWait(uint32_t iTag);
+
+public:
+    ClickDaemonClient(std::string_view sPath_ = CLICK_IPC_DEFAULT_SOCKET);
+    ~ClickDaemonClient();
+
+    ClickDaemonClient(const ClickDaemonClient &) = delete;
+    ClickDaemonClient &operator=(const ClickDaemonClient &) = delete;
+
+    // blocking calls, as ClickatellSms
+    const std::string &SmsMessageSend(const std::string &sText, const std::vector<std::string> &vMsisdns);
+    const std::string &SmsMessageSend(std::string_view sText, std::span<const std::string_view> vMsisdns,
+                                      eClickPriority ePriority = CLICK_PRIORITY_NORMAL,
+                                      ClickTimePoint tDeadline = ClickTimePoint::max());
+    const std::string &SmsStatusGet(std::string_view sMsgId);
+    CURLcode GetCurlCode() const { return curlCode; }
+    long GetHttpStatus() const { return iHttpStatus; }
+
+    // pipelined calls; return the request tag (0 if the daemon cannot be reached)
+    uint32_t Submit(std::string_view sText, std::span<const std::string_view> vMsisdns,
+                    eClickPriority ePriority = CLICK_PRIORITY_NORMAL, ClickTimePoint tDeadline = ClickTimePoint::max());
+    uint32_t StatusQuery(std::string_view sMsgId);
+    // writes the queued requests; false if the connection failed
+    bool Flush(int iTimeoutMs = -1);
+    // next reply (requests are written first); false on timeout or connection failure
+    bool Next(ClickDaemonReply &oReply, int iTimeoutMs = -1);
+
+    bool Connected() const { return iFd >= 0; }
+};
+
+#endif // CLICKATELL_IPC_H
@@ -0,0 +1,140 @@
+/*
+ * clickatell_limiter.cpp
+ *
+ *  Adaptive concurrency limit for the Clickatell SMS library.
+ *
+ *  The limit is kept as a real number so that the additive increase of 1/limit per
+ *  sample adds up to about one per round trip (a full limit's worth of completions).
+ */
+
+#include <algorithm>
+
+#include "clickatell_limiter.hpp"
+
+/* ----------------------------------------------------------------------------- *
+ * Types/Macros                                                                  *
+ * ----------------------------------------------------------------------------- */
+
+#define CLICK_LIMITER_RTT_WEIGHT  0.2  // weight of a new sample in the smoothed RTT
+
+/* ----------------------------------------------------------------------------- *
+ * Private function definitions                                                  *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickConcurrencyLimiter::LocalDecrease
+ * Info:      Cuts the limit by the backoff factor, unless it was already cut within the
+ *            last round trip (the smoothed RTT, or the triggering request's RTT if longer).
+ * Inputs:    tNow - current time
+ *            tRtt - RTT of the triggering request
+ * Return:    void
+ */
+void ClickConcurrencyLimiter::LocalDecrease(ClickTimePoint tNow, std::chrono::microseconds tRtt)
+{
+    if (iDecreases > 0 && tNow - tLastDecrease < std::max(tSmoothedRtt, tRtt))
+        return;
+
+    dLimit = std::max<double>(oOptions.iMinLimit, dLimit * oOptions.dBackoff);
+    tLastDecrease = tNow;
+    iDecreases++;
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Public function definitions                                                   *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickConcurrencyLimiter
+ * Info:      Constructor. Inconsistent bounds are corrected (iMinLimit >= 1,
+ *            iMaxLimit >= iMinLimit).
+ * Inputs:    oOptions_ - limiter options
+ */
+ClickConcurrencyLimiter::ClickConcurrencyLimiter(const ClickLimiterOptions &oOptions_)
+                                                 : oOptions(oOptions_),
+                                                   tMinRtt(0),
+                                                   tWindowMinRtt(0),
+                                                   tSmoothedRtt(0),
+                                                   tMinRttStart(std::chrono::steady_clock::now()),
+                                                   iDecreases(0)
+{
+    oOptions.iMinLimit = std::max(1u, oOptions.iMinLimit);
+    oOptions.iMaxLimit = std::max(oOptions.iMinLimit, oOptions.iMaxLimit);
+
+    dLimit = std::clamp(oOptions.iInitialLimit, oOptions.iMinLimit, oOptions.iMaxLimit);
+}
+
+/*
+ * Function:  ClickConcurrencyLimiter::OnSample
+ * Info:      Records a completed request. Overload responses and RTTs above the tolerance
+ *            cut the limit; normal RTTs grow it while the limit is in use (growing an
+ *            unused limit would only let the next burst overshoot).
+ * Inputs:    eSample   - classification of the request (see Classify())
+ *            tRtt      - time from dispatch to completion
+ *            iInFlight - requests in flight when it completed, itself included
+ *            tNow      - current time
+ * Return:    void
+ */
+void ClickConcurrencyLimiter::OnSample(eClickLimiterSample eSample, std::chrono::microseconds tRtt, size_t iInFlight,
+                                       ClickTimePoint tNow)
+{
+    if (eSample == CLICK_LIMITER_IGNORED)
+        return;
+
+    if (eSample == CLICK_LIMITER_OVERLOAD) {
+        LocalDecrease(tNow, tRtt);
+        return;
+    }
+
+    // the floor is the lowest RTT of the previous window, or lower if seen since
+    tRtt = std::max(tRtt, std::chrono::microseconds(1));
+
+    if (tWindowMinRtt.count() == 0 || tRtt < tWindowMinRtt)
+        tWindowMinRtt = tRtt;
+
+    if (tMinRtt.count() == 0 || tRtt < tMinRtt)
+        tMinRtt = tRtt;
+
+    if (tNow - tMinRttStart >= std::chrono::milliseconds(oOptions.iMinRttWindowMs)) {
+        tMinRtt = tWindowMinRtt;
+        tWindowMinRtt = std::chrono::microseconds(0);
+        tMinRttStart = tNow;
+    }
+
+    if (tSmoothedRtt.count() == 0)
+        tSmoothedRtt = tRtt;
+    else
+        tSmoothedRtt += std::chrono::microseconds((long long)(CLICK_LIMITER_RTT_WEIGHT * (tRtt - tSmoothedRtt).count()));
+
+    if (tRtt.count() > oOptions.dRttTolerance * tMinRtt.count())
+        LocalDecrease(tNow, tRtt);
+    else if (iInFlight >= (size_t)dLimit)
+        dLimit = std::min<double>(oOptions.iMaxLimit, dLimit + 1.0 / dLimit);
+}
+
+/*
+ * Function:  ClickConcurrencyLimiter::Classify
+ * Info:      Classifies a completed request for OnSample(). Throttling (429), server
+ *            errors (5xx) and timeouts are overload; other transport errors (DNS, refused
+ *            connections, cancellations) and client errors say nothing about load. Callers
+ *            pass timeouts caused by their own deadline, and requests that were never sent,
+ *            as CLICK_LIMITER_IGNORED without classifying them.
+ * Inputs:    curlCode    - cURL result
+ *            iHttpStatus - HTTP status
+ * Return:    classification
+ */
+eClickLimiterSample ClickConcurrencyLimiter::Classify(CURLcode curlCode, long iHttpStatus)
+{
+    if (curlCode == CURLE_OPERATION_TIMEDOUT)
+        return CLICK_LIMITER_OVERLOAD;
+
+    if (curlCode != CURLE_OK || iHttpStatus <= 0)
+        return CLICK_LIMITER_IGNORED;
+
+    if (iHttpStatus == 429 || iHttpStatus >= 500)
+        return CLICK_LIMITER_OVERLOAD;
+
+    if (iHttpStatus >= 400)
+        return CLICK_LIMITER_IGNORED;
+
+    return CLICK_LIMITER_OK;
+}
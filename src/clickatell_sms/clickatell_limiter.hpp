@@ -0,0 +1,77 @@
+#ifndef CLICKATELL_LIMITER_H
+#define CLICKATELL_LIMITER_H
+
+/*
+ * clickatell_limiter.hpp
+ *
+ *  Adaptive concurrency limit for the Clickatell SMS library.
+ *
+ *  A ClickConcurrencyLimiter decides how many requests may be in flight at once, using
+ *  additive-increase/multiplicative-decrease driven by observed round-trip times and
+ *  overload responses. While requests return close to the lowest RTT seen recently and
+ *  the limit is actually in use, the limit grows by about one per round trip. When the RTT
+ *  rises well above that floor (requests are queueing at the gateway) or the gateway
+ *  throttles, errors or times out, the limit is cut by a constant factor, at most once per
+ *  round trip so that one burst of failures counts as one congestion signal.
+ *
+ *  The limiter is not thread-safe; ClickSendEngine guards it with its own lock.
+ */
+#include <stdint.h>
+#include <chrono>
+
+#include "clickatell_api.hpp"
+
+// classification of a completed request
+enum eClickLimiterSample {
+    CLICK_LIMITER_OK,        // the gateway answered normally; the RTT is a latency sample
+    CLICK_LIMITER_OVERLOAD,  // throttled (429), server error (5xx) or timed out
+    CLICK_LIMITER_IGNORED    // not load-related (cancelled, refused locally, DNS, client error)
+};
+
+// limiter options
+struct ClickLimiterOptions {
+    unsigned int iMinLimit;       // the limit never drops below this
+    unsigned int iMaxLimit;       // the limit never grows above this
+    unsigned int iInitialLimit;   // starting limit (0: iMinLimit)
+    double dBackoff;              // factor applied to the limit on congestion (0..1)
+    double dRttTolerance;         // an RTT above dRttTolerance * minimum RTT signals congestion
+    unsigned int iMinRttWindowMs; // the RTT floor is re-measured over windows this long
+
+    ClickLimiterOptions()
+                        : iMinLimit(1),
+                          iMaxLimit(64),
+                          iInitialLimit(0),
+                          dBackoff(0.9),
+                          dRttTolerance(1.5),
+                          iMinRttWindowMs(30000) {}
+};
+
+class ClickConcurrencyLimiter
+{
+private:
+    ClickLimiterOptions oOptions;
+    double dLimit;
+    std::chrono::microseconds tMinRtt;       // RTT floor: lowest RTT of the previous window or since (0: none yet)
+    std::chrono::microseconds tWindowMinRtt; // lowest RTT in the current window
+    std::chrono::microseconds tSmoothedRtt;  // EWMA of the RTT samples
+    ClickTimePoint tMinRttStart;             // start of the minimum-RTT window
+    ClickTimePoint tLastDecrease;
+    uint64_t iDecreases;
+
+    void LocalDecrease(ClickTimePoint tNow, std::chrono::microseconds tRtt);
+
+public:
+    ClickConcurrencyLimiter(const ClickLimiterOptions &oOptions_ = ClickLimiterOptions());
+
+    // records a completed request; iInFlight is the number in flight when it completed
+    void OnSample(eClickLimiterSample eSample, std::chrono::microseconds tRtt, size_t iInFlight, ClickTimePoint tNow);
+
+    static eClickLimiterSample Classify(CURLcode curlCode, long iHttpStatus);
+
+    unsigned int Limit() const { return (unsigned int)dLimit; }
+    std::chrono::microseconds MinRtt() const { return tMinRtt; }
+    std::chrono::microseconds SmoothedRtt() const { return tSmoothedRtt; }
+    uint64_t Decreases() const { return iDecreases; }
+};
+
+#endif // CLICKATELL_LIMITER_H
@@ -0,0 +1,347 @@
+/*
+ * clickatell_loop.cpp
+ *
+ *  Event loop driving asynchronous Clickatell transfers.
+ *
+ *  In poll mode the loop is built on curl_multi_poll(), so a thread running Run() sleeps
+ *  until one of its sockets is ready, a cURL timer expires or another thread calls
+ *  Wakeup()/Cancel().
+ *
+ *  In socket mode the loop is built on curl_multi_socket_action(): CURLMOPT_SOCKETFUNCTION
+ *  and CURLMOPT_TIMERFUNCTION are forwarded to the application's hooks, and the application
+ *  feeds socket readiness and timer expiry back in.
+ */
+
+#include <algorithm>
+#include <string>
+
+#include "clickatell_loop.hpp"
+
+/* ----------------------------------------------------------------------------- *
+ * Types/Macros                                                                  *
+ * ----------------------------------------------------------------------------- */
+
+// longest time Run() sleeps in one curl_multi_poll() call
+#define CLICK_LOOP_MAX_WAIT_MS  1000
+
+/* ----------------------------------------------------------------------------- *
+ * Private function definitions                                                  *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickLoop::LocalComplete
+ * Info:      Detaches a transfer from the loop and invokes its completion callback.
+ *            The transfer is marked inactive under the cancel mutex first, so a concurrent
+ *            Cancel() can no longer queue it once the callback (which may free it) runs.
+ * Inputs:    pTransfer  - finished transfer
+ *            curlResult - result of the transfer
+ * Return:    void
+ */
+void ClickLoop::LocalComplete(ClickTransfer *pTransfer, CURLcode curlResult)
+{
+    curl_multi_remove_handle(curlMulti, pTransfer->curlHandle);
+    iActive--;
+
+    {
+        std::lock_guard<std::mutex> oLock(mtxCancel);
+        pTransfer->bActive = false;
+        vCancel.erase(std::remove(vCancel.begin(), vCancel.end(), pTransfer), vCancel.end());
+    }
+
+    if (pTransfer->fnDone != NULL)
+        pTransfer->fnDone(pTransfer->pUserData, curlResult);
+}
+
+/*
+ * Function:  ClickLoop::LocalDrainMessages
+ * Info:      Reads finished transfers from the multi handle and completes them.
+ * Return:    void
+ */
+void ClickLoop::LocalDrainMessages()
+{
+    CURLMsg *curlMsg = NULL;
+    int iQueued = 0;
+
+    while ((curlMsg = curl_multi_info_read(curlMulti, &iQueued)) != NULL) {
+        if (curlMsg->msg != CURLMSG_DONE)
+            continue;
+
+        ClickTransfer *pTransfer = NULL;
+        curl_easy_getinfo(curlMsg->easy_handle, CURLINFO_PRIVATE, (char **)&pTransfer);
+
+        if (pTransfer != NULL)
+            LocalComplete(pTransfer, curlMsg->data.result);
+    }
+}
+
+/*
+ * Function:  ClickLoop::LocalDrainCancels
+ * Info:      Completes transfers cancelled from other threads with CURLE_ABORTED_BY_CALLBACK.
+ * Return:    void
+ */
+void ClickLoop::LocalDrainCancels()
+{
+    ClickTransfer *pTransfer = NULL;
+
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> oLock(mtxCancel);
+
+            if (vCancel.empty())
+                return;
+
+            pTransfer = vCancel.back();
+            vCancel.pop_back();
+        }
+
+        LocalComplete(pTransfer, CURLE_ABORTED_BY_CALLBACK);
+    }
+}
+
+/*
+ * Function:  ClickLoop::LocalSocketCallback
+ * Info:      CURLMOPT_SOCKETFUNCTION callback (socket mode). Translates libcurl's socket
+ *            interest into CLICK_POLL_* flags and forwards it to the application.
+ * Return:    0
+ */
+int ClickLoop::LocalSocketCallback(CURL *curlHandle, curl_socket_t iSocket, int iWhat, void *pLoop, void *pSocketData)
+{
+    ClickLoop *pThis = static_cast<ClickLoop *>(pLoop);
+    int iEvents = CLICK_POLL_NONE;
+
+    if (iWhat == CURL_POLL_REMOVE)
+        iEvents = CLICK_POLL_REMOVE;
+    else {
+        if (iWhat & CURL_POLL_IN)
+            iEvents |= CLICK_POLL_IN;
+        if (iWhat & CURL_POLL_OUT)
+            iEvents |= CLICK_POLL_OUT;
+    }
+
+    pThis->oHooks.fnSocket(pThis->oHooks.pUserData, iSocket, iEvents);
+
+    return 0;
+}
+
+/*
+ * Function:  ClickLoop::LocalTimerCallback
+ * Info:      CURLMOPT_TIMERFUNCTION callback (socket mode). Forwards the timer request to
+ *            the application.
+ * Return:    0
+ */
+int ClickLoop::LocalTimerCallback(CURLM *curlMultiHandle, long iTimeoutMs, void *pLoop)
+{
+    ClickLoop *pThis = static_cast<ClickLoop *>(pLoop);
+
+    pThis->oHooks.fnTimer(pThis->oHooks.pUserData, iTimeoutMs);
+
+    return 0;
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Public function definitions                                                   *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickLoop
+ * Info:      Constructor. Creates a poll mode loop.
+ */
+ClickLoop::ClickLoop()
+                     : iActive(0),
+                       bSocketMode(false),
+                       oHooks()
+{
+    if ((curlMulti = curl_multi_init()) == NULL)
+        throw (std::string("curl_multi_init failed!"));
+}
+
+/*
+ * Function:  ClickLoop
+ * Info:      Constructor. Creates a socket mode loop driven by the application's event loop.
+ * Inputs:    oHooks_ - application hooks; fnSocket and fnTimer are required
+ */
+ClickLoop::ClickLoop(const ClickLoopHooks &oHooks_)
+                     : iActive(0),
+                       bSocketMode(true),
+                       oHooks(oHooks_)
+{
+    if (oHooks.fnSocket == NULL || oHooks.fnTimer == NULL)
+        throw (std::string("ClickLoop socket mode requires socket and timer hooks!"));
+
+    if ((curlMulti = curl_multi_init()) == NULL)
+        throw (std::string("curl_multi_init failed!"));
+
+    curl_multi_setopt(curlMulti, CURLMOPT_SOCKETFUNCTION, ClickLoop::LocalSocketCallback);
+    curl_multi_setopt(curlMulti, CURLMOPT_SOCKETDATA, this);
+    curl_multi_setopt(curlMulti, CURLMOPT_TIMERFUNCTION, ClickLoop::LocalTimerCallback);
+    curl_multi_setopt(curlMulti, CURLMOPT_TIMERDATA, this);
+}
+
+/*
+ * Function:  ~ClickLoop
+ * Info:      Destructor. Any transfers still registered are detached without invoking
+ *            their callbacks.
+ */
+ClickLoop::~ClickLoop()
+{
+    if (curlMulti != NULL) {
+        curl_multi_cleanup(curlMulti);
+        curlMulti = NULL;
+    }
+}
+
+/*
+ * Function:  ClickLoop::Add
+ * Info:      Registers a configured transfer. Must be called on the loop thread.
+ * Inputs:    pTransfer - transfer to start; must stay alive until its callback has run
+ * Return:    false if libcurl refused the transfer (its callback will not be invoked)
+ */
+bool ClickLoop::Add(ClickTransfer *pTransfer)
+{
+    curl_easy_setopt(pTransfer->curlHandle, CURLOPT_PRIVATE, pTransfer);
+
+    {
+        std::lock_guard<std::mutex> oLock(mtxCancel);
+        pTransfer->bActive = true;
+    }
+
+    CURLMcode curlmCode = curl_multi_add_handle(curlMulti, pTransfer->curlHandle);
+
+    if (curlmCode != CURLM_OK) {
+        std::lock_guard<std::mutex> oLock(mtxCancel);
+        pTransfer->bActive = false;
+        return false;
+    }
+
+    iActive++;
+
+    return true;
+}
+
+/*
+ * Function:  ClickLoop::RunOnce
+ * Info:      Waits up to iTimeoutMs for activity, then advances all transfers and invokes
+ *            completion callbacks. Applications with their own loop can call this
+ *            periodically with a timeout of 0.
+ * Inputs:    iTimeoutMs - maximum time to wait
+ * Return:    number of transfers still active
+ */
+int ClickLoop::RunOnce(int iTimeoutMs)
+{
+    int iRunning = 0;
+
+    curl_multi_poll(curlMulti, NULL, 0, iTimeoutMs, NULL);
+    curl_multi_perform(curlMulti, &iRunning);
+
+    LocalDrainMessages();
+    LocalDrainCancels();
+
+    return (int)iActive;
+}
+
+/*
+ * Function:  ClickLoop::Run
+ * Info:      Drives the loop until no transfers remain. Completion callbacks may register
+ *            further transfers, which keeps the loop running.
+ * Return:    void
+ */
+void ClickLoop::Run()
+{
+    while (iActive > 0)
+        RunOnce(CLICK_LOOP_MAX_WAIT_MS);
+}
+
+/*
+ * Function:  ClickLoop::SocketAction
+ * Info:      Socket mode: reports readiness of a socket previously announced through
+ *            fnSocket, advances the transfers using it and invokes completion callbacks.
+ * Inputs:    iSocket - ready socket
+ *            iEvents - CLICK_POLL_IN / CLICK_POLL_OUT / CLICK_POLL_ERR
+ * Return:    number of transfers still active
+ */
+int ClickLoop::SocketAction(curl_socket_t iSocket, int iEvents)
+{
+    int iRunning = 0;
+    int iFlags = 0;
+
+    if (iEvents & CLICK_POLL_IN)
+        iFlags |= CURL_CSELECT_IN;
+    if (iEvents & CLICK_POLL_OUT)
+        iFlags |= CURL_CSELECT_OUT;
+    if (iEvents & CLICK_POLL_ERR)
+        iFlags |= CURL_CSELECT_ERR;
+
+    curl_multi_socket_action(curlMulti, iSocket, iFlags, &iRunning);
+
+    LocalDrainMessages();
+    LocalDrainCancels();
+
+    return (int)iActive;
+}
+
+/*
+ * Function:  ClickLoop::TimerExpired
+ * Info:      Socket mode: reports that the timer requested through fnTimer has fired.
+ * Return:    number of transfers still active
+ */
+int ClickLoop::TimerExpired()
+{
+    int iRunning = 0;
+
+    curl_multi_socket_action(curlMulti, CURL_SOCKET_TIMEOUT, 0, &iRunning);
+
+    LocalDrainMessages();
+    LocalDrainCancels();
+
+    return (int)iActive;
+}
+
+/*
+ * Function:  ClickLoop::ProcessCancels
+ * Info:      Socket mode: completes transfers cancelled from other threads. Call this on
+ *            the loop thread after fnWakeup was invoked.
+ * Return:    number of transfers still active
+ */
+int ClickLoop::ProcessCancels()
+{
+    LocalDrainCancels();
+
+    return (int)iActive;
+}
+
+/*
+ * Function:  ClickLoop::Cancel
+ * Info:      Aborts a transfer. Safe to call from any thread; the transfer is completed
+ *            with CURLE_ABORTED_BY_CALLBACK on the loop thread. Does nothing if the
+ *            transfer has already completed.
+ * Inputs:    pTransfer - transfer to abort
+ * Return:    void
+ */
+void ClickLoop::Cancel(ClickTransfer *pTransfer)
+{
+    {
+        std::lock_guard<std::mutex> oLock(mtxCancel);
+
+        if (!pTransfer->bActive)
+            return;
+
+        if (std::find(vCancel.begin(), vCancel.end(), pTransfer) == vCancel.end())
+            vCancel.push_back(pTransfer);
+    }
+
+    Wakeup();
+}
+
+/*
+ * Function:  ClickLoop::Wakeup
+ * Info:      Interrupts a RunOnce() call that is waiting for activity, or in socket mode
+ *            invokes the application's fnWakeup hook. Safe to call from any thread.
+ * Return:    void
+ */
+void ClickLoop::Wakeup()
+{
+    if (!bSocketMode)
+        curl_multi_wakeup(curlMulti);
+    else if (oHooks.fnWakeup != NULL)
+        oHooks.fnWakeup(oHooks.pUserData);
+}
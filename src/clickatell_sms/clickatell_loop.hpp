@@ -0,0 +1,112 @@
+#ifndef CLICKATELL_LOOP_H
+#define CLICKATELL_LOOP_H
+
+/*
+ * clickatell_loop.hpp
+ *
+ *  Event loop driving asynchronous Clickatell transfers.
+ *
+ *  A ClickLoop wraps a libcurl multi handle. Transfers are registered with Add() and their
+ *  completion callback is invoked from the thread that drives the loop, once the transfer
+ *  has finished, failed or been cancelled. The loop can be driven in two ways:
+ *
+ *  - poll mode (default constructor): the library waits for activity itself in Run() or
+ *    RunOnce().
+ *  - socket mode (ClickLoopHooks constructor): an application event loop (epoll, io_uring,
+ *    libuv, ...) owns the waiting. The library reports which sockets to watch through
+ *    fnSocket and when to fire a timer through fnTimer; the application reports readiness
+ *    back with SocketAction() and TimerExpired(). Only sockets with activity are touched,
+ *    so thousands of transfers can share the application's reactor thread.
+ */
+#include <mutex>
+#include <vector>
+
+#include <curl/curl.h>
+
+// transfer completion callback, invoked on the loop thread
+typedef void (*ClickTransferDoneFn)(void *pUserData, CURLcode curlCode);
+
+// socket event flags used by socket mode
+enum eClickPoll {
+    CLICK_POLL_NONE   = 0,  // no interest (socket idle, keep it registered)
+    CLICK_POLL_IN     = 1,  // wait for / socket is readable
+    CLICK_POLL_OUT    = 2,  // wait for / socket is writable
+    CLICK_POLL_INOUT  = 3,  // both of the above
+    CLICK_POLL_ERR    = 4,  // socket reported an error (SocketAction() only)
+    CLICK_POLL_REMOVE = 8   // stop watching the socket (fnSocket only)
+};
+
+// socket mode: watch iSocket for iEvents (CLICK_POLL_*), or stop watching it on CLICK_POLL_REMOVE
+typedef void (*ClickSocketFn)(void *pUserData, curl_socket_t iSocket, int iEvents);
+// socket mode: (re)arm the single loop timer to fire in iTimeoutMs, or disarm it if iTimeoutMs is -1
+typedef void (*ClickTimerFn)(void *pUserData, long iTimeoutMs);
+// socket mode: called from any thread when the loop thread must call ProcessCancels()
+typedef void (*ClickWakeupFn)(void *pUserData);
+
+// application hooks for socket mode
+struct ClickLoopHooks {
+    ClickSocketFn fnSocket; // required
+    ClickTimerFn fnTimer;   // required
+    ClickWakeupFn fnWakeup; // optional, needed only if transfers are cancelled from other threads
+    void *pUserData;        // passed back to the hooks
+};
+
+// one transfer registered with a ClickLoop - owned by the caller, must stay alive until completion
+struct ClickTransfer {
+    CURL *curlHandle;           // configured easy handle
+    ClickTransferDoneFn fnDone; // completion callback
+    void *pUserData;            // passed back to fnDone
+    bool bActive;               // true while registered with the loop (guarded by the loop mutex)
+
+    ClickTransfer()
+                  : curlHandle(NULL),
+                    fnDone(NULL),
+                    pUserData(NULL),
+                    bActive(false) {}
+};
+
+class ClickLoop
+{
+private:
+    CURLM *curlMulti;                       // libcurl multi handle
+    size_t iActive;                         // registered transfers (loop thread only)
+    bool bSocketMode;                       // driven by application hooks instead of curl_multi_poll()
+    ClickLoopHooks oHooks;                  // socket mode hooks
+
+    std::mutex mtxCancel;                   // guards vCancel and ClickTransfer::bActive
+    std::vector<ClickTransfer *> vCancel;   // transfers cancelled from other threads
+
+    void LocalComplete(ClickTransfer *pTransfer, CURLcode curlResult);
+    void LocalDrainMessages();
+    void LocalDrainCancels();
+
+    static int LocalSocketCallback(CURL *curlHandle, curl_socket_t iSocket, int iWhat, void *pLoop, void *pSocketData);
+    static int LocalTimerCallback(CURLM *curlMultiHandle, long iTimeoutMs, void *pLoop);
+
+public:
+    ClickLoop();
+    ClickLoop(const ClickLoopHooks &oHooks_);
+    ~ClickLoop();
+
+    ClickLoop(const ClickLoop &) = delete;
+    ClickLoop &operator=(const ClickLoop &) = delete;
+
+    // loop thread only
+    bool Add(ClickTransfer *pTransfer);
+    size_t Active() const { return iActive; }
+
+    // loop thread only - poll mode
+    int RunOnce(int iTimeoutMs);
+    void Run();
+
+    // loop thread only - socket mode
+    int SocketAction(curl_socket_t iSocket, int iEvents);
+    int TimerExpired();
+    int ProcessCancels();
+
+    // any thread
+    void Cancel(ClickTransfer *pTransfer);
+    void Wakeup();
+};
+
+#endif // CLICKATELL_LOOP_H
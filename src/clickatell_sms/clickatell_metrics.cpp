@@ -0,0 +1,368 @@
+/*
+ * clickatell_metrics.cpp
+ *
+ *  Process-wide metrics of the Clickatell SMS library.
+ *
+ *  A thread picks its shard on its first update, round-robin, and keeps it; with more
+ *  threads than shards some threads share a shard, which costs a contended cache line but
+ *  never a lost update, since every shard counter is atomic.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "clickatell_metrics.hpp"
+
+/* ----------------------------------------------------------------------------- *
+ * Types/Macros                                                                  *
+ * ----------------------------------------------------------------------------- */
+
+#define CLICK_METRICS_REQUEST_MAX   4096  // request bytes read by the HTTP endpoint
+#define CLICK_METRICS_IO_TIMEOUT_MS 1000  // time a scraper has to send its request
+
+// label values
+static const char *sLocalOpNames[CLICK_OP_COUNT] = {"send", "status", "balance", "charge", "coverage", "stop"};
+static const char *sLocalApiNames[CLICK_API_COUNT] = {"http", "rest"};
+static const char *sLocalOutcomeNames[CLICK_REQUEST_OUTCOME_COUNT] = {"ok", "http_error", "throttled", "transport", "short_circuit",
+                                                                        "not_sent"};
+
+// exposition of the eClickMetric values
+static const struct {
+    const char *sName;
+    const char *sType;
+    const char *sHelp;
+} oLocalMetricInfo[CLICK_METRIC_COUNT] = {
+    {"clickatell_messages_total", "counter", "Messages (one per recipient) of sends answered with a 2xx status."},
+    {"clickatell_segments_total", "counter", "SMS segments of those messages."},
+    {"clickatell_retries_total", "counter", "Requests sent again after a failed attempt."},
+    {"clickatell_throttles_total", "counter", "Responses that throttled the account."},
+    {"clickatell_sent_bytes_total", "counter", "Request body bytes sent."},
+    {"clickatell_received_bytes_total", "counter", "Response body bytes received."},
+    {"clickatell_in_flight_requests", "gauge", "Requests being transferred."},
+    {"clickatell_queued_messages", "gauge", "Messages queued in send engines."}
+};
+
+// GSM 03.38 characters in Latin-1: 1 for the basic set, 2 for the extension table, 0 for none
+static unsigned char iLocalGsmWidth[256];
+
+static bool LocalGsmInit()
+{
+    static const char sBasic[] = "@$\n\r _!\"#%&'()*+,-./0123456789:;<=>?"
+                                 "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    static const unsigned char iLatin1[] = {0xA3, 0xA5, 0xE8, 0xE9, 0xF9, 0xEC, 0xF2, 0xC7, 0xD8, 0xF8, 0xC5, 0xE5,
+                                            0xC6, 0xE6, 0xDF, 0xC9, 0xA4, 0xA1, 0xC4, 0xD6, 0xD1, 0xDC, 0xA7, 0xBF,
+                                            0xE4, 0xF6, 0xF1, 0xFC, 0xE0};
+
+    for (const char *p = sBasic; *p != '\0'; p++)
+        iLocalGsmWidth[(unsigned char)*p] = 1;
+    for (unsigned char ch : iLatin1)
+        iLocalGsmWidth[ch] = 1;
+    for (const char *p = "^{}\\[~]|\f"; *p != '\0'; p++)
+        iLocalGsmWidth[(unsigned char)*p] = 2;
+
+    return true;
+}
+
+static const bool bLocalGsmInit = LocalGsmInit();
+
+/* ----------------------------------------------------------------------------- *
+ * ClickMetrics function definitions                                             *
+ * ----------------------------------------------------------------------------- */
+
+ClickMetrics::ClickMetricsShard ClickMetrics::vShards[CLICK_METRICS_SHARDS];
+std::atomic<unsigned int> ClickMetrics::iNextShard(0);
+
+/*
+ * Function:  ClickMetrics::LocalShard
+ * Info:      Returns the calling thread's shard.
+ */
+ClickMetrics::ClickMetricsShard &ClickMetrics::LocalShard()
+{
+    thread_local ClickMetricsShard *pShard =
+        &vShards[iNextShard.fetch_add(1, std::memory_order_relaxed) & (CLICK_METRICS_SHARDS - 1)];
+
+    return *pShard;
+}
+
+/*
+ * Function:  ClickMetricsSnapshot::Requests
+ * Info:      Requests of an operation, over all APIs and outcomes.
+ */
+uint64_t ClickMetricsSnapshot::Requests(eClickOperation eOp) const
+{
+    uint64_t iTotal = 0;
+
+    for (int a = 0; a < CLICK_API_COUNT; a++)
+        for (int o = 0; o < CLICK_REQUEST_OUTCOME_COUNT; o++)
+            iTotal += iRequests[eOp][a][o];
+
+    return iTotal;
+}
+
+/*
+ * Function:  ClickMetrics::Snapshot
+ * Info:      Sums the shards (any thread).
+ * Return:    totals
+ */
+ClickMetricsSnapshot ClickMetrics::Snapshot()
+{
+    ClickMetricsSnapshot oSnap;
+
+    memset(&oSnap, 0, sizeof(oSnap));
+
+    for (ClickMetricsShard &oShard : vShards) {
+        for (int m = 0; m < CLICK_METRIC_COUNT; m++)
+            oSnap.iValues[m] += oShard.iValues[m].load(std::memory_order_relaxed);
+
+        for (int e = 0; e < CLICK_OP_COUNT; e++)
+            for (int a = 0; a < CLICK_API_COUNT; a++)
+                for (int o = 0; o < CLICK_REQUEST_OUTCOME_COUNT; o++)
+                    oSnap.iRequests[e][a][o] += oShard.iRequests[e][a][o].load(std::memory_order_relaxed);
+    }
+
+    return oSnap;
+}
+
+/*
+ * Function:  ClickMetrics::Prometheus
+ * Info:      Formats metrics in the Prometheus text exposition format. Every label
+ *            combination is written, also when zero, so that series do not appear late.
+ * Inputs:    oSnap - values to format
+ * Outputs:   sOut  - the text is appended here
+ * Return:    void
+ */
+void ClickMetrics::Prometheus(const ClickMetricsSnapshot &oSnap, std::string &sOut)
+{
+    char chLine[256];
+    int iLen;
+
+    sOut.append("# HELP clickatell_requests_total Gateway requests by operation, API and outcome.\n"
+                "# TYPE clickatell_requests_total counter\n");
+
+    for (int e = 0; e < CLICK_OP_COUNT; e++) {
+        for (int a = 0; a < CLICK_API_COUNT; a++) {
+            for (int o = 0; o < CLICK_REQUEST_OUTCOME_COUNT; o++) {
+                iLen = snprintf(chLine, sizeof(chLine), "clickatell_requests_total{operation=\"%s\",api=\"%s\",outcome=\"%s\"} %llu\n",
+                                sLocalOpNames[e], sLocalApiNames[a], sLocalOutcomeNames[o],
+                                (unsigned long long)oSnap.iRequests[e][a][o]);
+                sOut.append(chLine, iLen);
+            }
+        }
+    }
+
+    for (int m = 0; m < CLICK_METRIC_COUNT; m++) {
+        iLen = snprintf(chLine, sizeof(chLine), "# HELP %s %s\n# TYPE %s %s\n%s %lld\n",
+                        oLocalMetricInfo[m].sName, oLocalMetricInfo[m].sHelp, oLocalMetricInfo[m].sName,
+                        oLocalMetricInfo[m].sType, oLocalMetricInfo[m].sName, (long long)oSnap.iValues[m]);
+        sOut.append(chLine, iLen);
+    }
+}
+
+std::string ClickMetrics::Prometheus()
+{
+    std::string sOut;
+
+    Prometheus(Snapshot(), sOut);
+
+    return sOut;
+}
+
+/*
+ * Function:  ClickMetrics::Segments
+ * Info:      Counts the SMS segments a text needs: with GSM 7-bit coding 160 characters fit
+ *            one segment and 153 each segment of a longer message (extension characters
+ *            take two); a text with a character GSM cannot code is sent as UCS-2, 70 and 67.
+ * Inputs:    sText - Latin-1 text
+ * Return:    segments (1 for an empty text)
+ */
+unsigned int ClickMetrics::Segments(std::string_view sText)
+{
+    size_t iSeptets = 0;
+
+    for (char ch : sText) {
+        unsigned int iWidth = iLocalGsmWidth[(unsigned char)ch];
+
+        if (iWidth == 0) {
+            iSeptets = 0;
+            break;
+        }
+
+        iSeptets += iWidth;
+    }
+
+    if (iSeptets == 0 && !sText.empty())
+        return (sText.length() <= 70 ? 1 : (unsigned int)((sText.length() + 66) / 67));
+
+    return (iSeptets <= 160 ? 1 : (unsigned int)((iSeptets + 152) / 153));
+}
+
+/*
+ * Function:  ClickMetrics::OutcomeName
+ * Info:      Label value of a request outcome.
+ */
+const char *ClickMetrics::OutcomeName(eClickRequestOutcome eOutcome)
+{
+    return (eOutcome >= 0 && eOutcome < CLICK_REQUEST_OUTCOME_COUNT ? sLocalOutcomeNames[eOutcome] : "unknown");
+}
+
+/* ----------------------------------------------------------------------------- *
+ * ClickMetricsServer function definitions                                       *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickMetricsServer::LocalServe
+ * Info:      Reads one request from an accepted connection and answers it.
+ * Inputs:    iFd - connection (closed by the caller)
+ * Return:    void
+ */
+void ClickMetricsServer::LocalServe(int iFd)
+{
+    char chBuf[CLICK_METRICS_REQUEST_MAX + 1];
+    size_t iLen = 0;
+
+    // read up to the end of the request head
+    while (iLen < CLICK_METRICS_REQUEST_MAX) {
+        struct pollfd oPoll = {iFd, POLLIN, 0};
+
+        if (poll(&oPoll, 1, CLICK_METRICS_IO_TIMEOUT_MS) <= 0)
+            return;
+
+        ssize_t iRead = recv(iFd, chBuf + iLen, CLICK_METRICS_REQUEST_MAX - iLen, 0);
+
+        if (iRead <= 0)
+            return;
+
+        iLen += iRead;
+        chBuf[iLen] = '\0';
+
+        if (strstr(chBuf, "\r\n\r\n") != NULL || strstr(chBuf, "\n\n") != NULL)
+            break;
+    }
+
+    std::string_view sRequest(chBuf, iLen);
+    std::string sBody;
+    const char *sStatus = "200 OK";
+
+    if (sRequest.substr(0, 13) == "GET /metrics " || sRequest.substr(0, 14) == "GET /metrics?" ||
+        sRequest.substr(0, 14) == "HEAD /metrics ")
+        ClickMetrics::Prometheus(ClickMetrics::Snapshot(), sBody);
+    else {
+        sStatus = "404 Not Found";
+        sBody = "Not found\n";
+    }
+
+    char chHead[256];
+    int iHead = snprintf(chHead, sizeof(chHead),
+                         "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                         "Content-Length: %zu\r\nConnection: close\r\n\r\n", sStatus, sBody.length());
+
+    if (sRequest.substr(0, 5) != "HEAD ")
+        sBody.insert(0, chHead, iHead);
+    else
+        sBody.assign(chHead, iHead);
+
+    for (size_t iSent = 0; iSent < sBody.length(); ) {
+        struct pollfd oPoll = {iFd, POLLOUT, 0};
+
+        if (poll(&oPoll, 1, CLICK_METRICS_IO_TIMEOUT_MS) <= 0)
+            return;
+
+        ssize_t iWritten = send(iFd, sBody.data() + iSent, sBody.length() - iSent, MSG_NOSIGNAL);
+
+        if (iWritten <= 0)
+            return;
+
+        iSent += iWritten;
+    }
+}
+
+/*
+ * Function:  ClickMetricsServer::LocalThread
+ * Info:      Accepts and serves connections until the wake pipe is written.
+ * Return:    void
+ */
+void ClickMetricsServer::LocalThread()
+{
+    for (;;) {
+        struct pollfd oPoll[2] = {{iListenFd, POLLIN, 0}, {iWake[0], POLLIN, 0}};
+
+        if (poll(oPoll, 2, -1) < 0 && errno != EINTR)
+            return;
+
+        if (oPoll[1].revents != 0)
+            return;
+
+        if (oPoll[0].revents & POLLIN) {
+            int iFd = accept4(iListenFd, NULL, NULL, SOCK_CLOEXEC);
+
+            if (iFd >= 0) {
+                LocalServe(iFd);
+                close(iFd);
+            }
+        }
+    }
+}
+
+/*
+ * Function:  ClickMetricsServer
+ * Info:      Constructor. Starts listening and the serving thread.
+ * Inputs:    iPort_   - TCP port (0: any free port, see Port())
+ *            sAddress - IPv4 address to listen on
+ */
+ClickMetricsServer::ClickMetricsServer(uint16_t iPort_, std::string_view sAddress)
+                                       : iListenFd(-1),
+                                         iPort(iPort_)
+{
+    struct sockaddr_in oAddr;
+    socklen_t iAddrLen = sizeof(oAddr);
+    std::string sAddr(sAddress);
+    int iOne = 1;
+
+    memset(&oAddr, 0, sizeof(oAddr));
+    oAddr.sin_family = AF_INET;
+    oAddr.sin_port = htons(iPort);
+
+    if (inet_pton(AF_INET, sAddr.c_str(), &oAddr.sin_addr) != 1)
+        throw (std::string("ClickMetricsServer: invalid address ") + sAddr);
+
+    if ((iListenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)) < 0)
+        throw (std::string("ClickMetricsServer: socket() failed"));
+
+    setsockopt(iListenFd, SOL_SOCKET, SO_REUSEADDR, &iOne, sizeof(iOne));
+
+    if (bind(iListenFd, (struct sockaddr *)&oAddr, sizeof(oAddr)) != 0 || listen(iListenFd, 16) != 0 ||
+        getsockname(iListenFd, (struct sockaddr *)&oAddr, &iAddrLen) != 0 || pipe2(iWake, O_CLOEXEC) != 0) {
+        std::string sErr = std::string("ClickMetricsServer: cannot listen on ") + sAddr + ":" + std::to_string(iPort) +
+                           ": " + strerror(errno);
+
+        close(iListenFd);
+        throw (sErr);
+    }
+
+    iPort = ntohs(oAddr.sin_port);
+    thrServer = std::thread(&ClickMetricsServer::LocalThread, this);
+}
+
+/*
+ * Function:  ~ClickMetricsServer
+ * Info:      Destructor. Stops the thread (after the connection it is serving, if any)
+ *            and closes the socket.
+ */
+ClickMetricsServer::~ClickMetricsServer()
+{
+    if (write(iWake[1], "", 1) < 0)
+        perror("ClickMetricsServer");
+
+    thrServer.join();
+
+    close(iWake[0]);
+    close(iWake[1]);
+    close(iListenFd);
+}
@@ -0,0 +1,125 @@
+#ifndef CLICKATELL_METRICS_H
+#define CLICKATELL_METRICS_H
+
+/*
+ * clickatell_metrics.hpp
+ *
+ *  Process-wide metrics of the Clickatell SMS library.
+ *
+ *  Every ClickatellSms instance counts its requests by operation, API and outcome, the
+ *  messages and segments it sent, throttled responses and the bytes it transferred, and
+ *  tracks the requests in flight; the send engine tracks its queue depth, and the sharded
+ *  client and the daemon count their retries. Nothing has to be enabled.
+ *
+ *  Updates never contend: each thread adds to one of CLICK_METRICS_SHARDS cache-line-aligned
+ *  shards with a relaxed atomic add, and readers sum the shards. A snapshot is therefore
+ *  not taken at a single instant, but every update is in it or in the next one.
+ *
+ *      ClickMetricsSnapshot oSnap = ClickMetrics::Snapshot();
+ *      std::string sText = ClickMetrics::Prometheus();    // text exposition format
+ *      ClickMetricsServer oServer(9464);                  // serves it at /metrics
+ */
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "clickatell_api.hpp"
+
+#define CLICK_METRICS_SHARDS  64  // shards updated by different threads (a power of two)
+
+// counters and gauges that are not per request
+enum eClickMetric {
+    CLICK_METRIC_MESSAGES,        // messages (one per recipient) of sends answered with a 2xx status
+    CLICK_METRIC_SEGMENTS,        // SMS segments of those messages
+    CLICK_METRIC_RETRIES,         // requests sent again after a failed attempt
+    CLICK_METRIC_THROTTLES,       // responses that throttled the account (HTTP 429 or a throttling error code)
+    CLICK_METRIC_BYTES_SENT,      // request bodies, as sent
+    CLICK_METRIC_BYTES_RECEIVED,  // response bodies, as received
+    CLICK_METRIC_IN_FLIGHT,       // gauge: requests being transferred
+    CLICK_METRIC_QUEUE_DEPTH,     // gauge: messages queued in send engines
+    CLICK_METRIC_COUNT
+};
+
+// outcome of a request
+enum eClickRequestOutcome {
+    CLICK_REQUEST_OK,             // 1xx-3xx response
+    CLICK_REQUEST_HTTP_ERROR,     // 4xx/5xx response other than 429
+    CLICK_REQUEST_THROTTLED,      // HTTP 429
+    CLICK_REQUEST_TRANSPORT,      // cURL failure, including cancellation and timeouts
+    CLICK_REQUEST_SHORT_CIRCUIT,  // failed fast by the circuit breaker, never sent
+    CLICK_REQUEST_NOT_SENT,       // deadline passed or stop requested before the request was sent
+    CLICK_REQUEST_OUTCOME_COUNT
+};
+
+// totals of all shards
+struct ClickMetricsSnapshot {
+    int64_t iValues[CLICK_METRIC_COUNT];
+    uint64_t iRequests[CLICK_OP_COUNT][CLICK_API_COUNT][CLICK_REQUEST_OUTCOME_COUNT];
+
+    // requests of an operation, over all APIs and outcomes
+    uint64_t Requests(eClickOperation eOp) const;
+};
+
+class ClickMetrics
+{
+private:
+    // the counters of one shard, alone in their cache lines
+    struct alignas(64) ClickMetricsShard {
+        std::atomic<int64_t> iValues[CLICK_METRIC_COUNT];
+        std::atomic<uint64_t> iRequests[CLICK_OP_COUNT][CLICK_API_COUNT][CLICK_REQUEST_OUTCOME_COUNT];
+    };
+
+    static ClickMetricsShard vShards[CLICK_METRICS_SHARDS];
+    static std::atomic<unsigned int> iNextShard;
+
+    static ClickMetricsShard &LocalShard();
+
+public:
+    // adds to a counter, or moves a gauge (any thread)
+    static void Add(eClickMetric eMetric, int64_t iDelta = 1)
+        { LocalShard().iValues[eMetric].fetch_add(iDelta, std::memory_order_relaxed); }
+    // counts a request (any thread)
+    static void Request(eClickOperation eOp, eClickApi eApi, eClickRequestOutcome eOutcome)
+        { LocalShard().iRequests[eOp][eApi][eOutcome].fetch_add(1, std::memory_order_relaxed); }
+
+    static ClickMetricsSnapshot Snapshot();
+
+    // current values in Prometheus text exposition format (version 0.0.4)
+    static std::string Prometheus();
+    static void Prometheus(const ClickMetricsSnapshot &oSnap, std::string &sOut);
+
+    // SMS segments needed for a Latin-1 text (GSM 7-bit if possible, otherwise UCS-2)
+    static unsigned int Segments(std::string_view sText);
+
+    static const char *OutcomeName(eClickRequestOutcome eOutcome);
+};
+
+/* Minimal HTTP server for the Prometheus text format.
+ * A thread answers GET /metrics with ClickMetrics::Prometheus(), one connection at a time;
+ * it is meant for a local scraper, not for exposure to untrusted networks.
+ */
+class ClickMetricsServer
+{
+private:
+    int iListenFd;
+    int iWake[2];            // pipe that stops the thread
+    uint16_t iPort;
+    std::thread thrServer;
+
+    void LocalServe(int iFd);
+    void LocalThread();
+
+public:
+    // listens on sAddress:iPort (port 0: any free port); throws a std::string on failure
+    ClickMetricsServer(uint16_t iPort_, std::string_view sAddress = "127.0.0.1");
+    ~ClickMetricsServer();
+
+    ClickMetricsServer(const ClickMetricsServer &) = delete;
+    ClickMetricsServer &operator=(const ClickMetricsServer &) = delete;
+
+    uint16_t Port() const { return iPort; }
+};
+
+#endif // CLICKATELL_METRICS_H
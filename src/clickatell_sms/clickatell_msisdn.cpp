@@ -0,0 +1,454 @@
+/*
+ * clickatell_msisdn.cpp
+ *
+ *  Bulk MSISDN pre-processing for the Clickatell SMS library.
+ *
+ *  Each input number goes through three stages:
+ *   1. character-class check and separator stripping. Numbers that are already plain
+ *      digits (the common case) are detected 16 characters at a time with SSE2 and copied
+ *      as is; everything else takes the scalar path, which drops separators and a leading '+'.
+ *   2. prefix handling: '+' and '00' mark an international number, a leading trunk prefix
+ *      is replaced by the configured default country code. Without one a local number has
+ *      no country code and is rejected (CLICK_MSISDN_REJECT_COUNTRY_CODE).
+ *   3. length, country code and duplicate checks. Duplicates are found with an
+ *      open-addressing hash set of 64-bit packed numbers, sized for the whole list up front.
+ */
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "clickatell_msisdn.hpp"
+
+/* ----------------------------------------------------------------------------- *
+ * Types/Macros                                                                  *
+ * ----------------------------------------------------------------------------- */
+
+// scratch buffer size for one number (leaves room for a default country code and separators)
+#define CLICK_MSISDN_SCRATCH_LEN     32
+
+// separators that may appear in human-entered numbers and are dropped
+#define CLICK_MSISDN_SEPARATOR(c)    ((c) == ' ' || (c) == '-' || (c) == '.' || (c) == '(' || (c) == ')' || (c) == '\t')
+
+// minimum hash set capacity
+#define CLICK_MSISDN_SEEN_MIN        64
+
+/* ITU-T E.164 assigned country codes. A number's country code is valid if its first digit,
+ * first two digits or first three digits appear in the corresponding list.
+ */
+static const unsigned short aCountryCodes1[] = {1, 7};
+static const unsigned short aCountryCodes2[] = {20, 27, 30, 31, 32, 33, 34, 36, 39, 40, 41, 43, 44, 45, 46,
+                                                47, 48, 49, 51, 52, 53, 54, 55, 56, 57, 58, 60, 61, 62, 63,
+                                                64, 65, 66, 81, 82, 84, 86, 90, 91, 92, 93, 94, 95, 98};
+static const unsigned short aCountryCodes3[] = {211, 212, 213, 216, 218, 220, 221, 222, 223, 224, 225, 226, 227,
+                                                228, 229, 230, 231, 232, 233, 234, 235, 236, 237, 238, 239, 240,
+                                                241, 242, 243, 244, 245, 246, 247, 248, 249, 250, 251, 252, 253,
+                                                254, 255, 256, 257, 258, 260, 261, 262, 263, 264, 265, 266, 267,
+                                                268, 269, 290, 291, 297, 298, 299, 350, 351, 352, 353, 354, 355,
+                                                356, 357, 358, 359, 370, 371, 372, 373, 374, 375, 376, 377, 378,
+                                                379, 380, 381, 382, 383, 385, 386, 387, 389, 420, 421, 423, 500,
+                                                501, 502, 503, 504, 505, 506, 507, 508, 509, 590, 591, 592, 593,
+                                                594, 595, 596, 597, 598, 599, 670, 672, 673, 674, 675, 676, 677,
+                                                678, 679, 680, 681, 682, 683, 685, 686, 687, 688, 689, 690, 691,
+                                                692, 800, 808, 850, 852, 853, 855, 856, 870, 878, 880, 881, 882,
+                                                883, 886, 888, 960, 961, 962, 963, 964, 965, 966, 967, 968, 970,
+                                                971, 972, 973, 974, 975, 976, 977, 979, 992, 993, 994, 995, 996,
+                                                998};
+
+// lookup table built once from the lists above, indexed by the numeric prefix value
+struct ClickCountryCodeTable {
+    bool bCode1[10];
+    bool bCode2[100];
+    bool bCode3[1000];
+
+    ClickCountryCodeTable()
+    {
+        memset(this, 0, sizeof(*this));
+
+        for (unsigned short iCode : aCountryCodes1)
+            bCode1[iCode] = true;
+        for (unsigned short iCode : aCountryCodes2)
+            bCode2[iCode] = true;
+        for (unsigned short iCode : aCountryCodes3)
+            bCode3[iCode] = true;
+    }
+};
+
+static const ClickCountryCodeTable oCountryCodes;
+
+/* ----------------------------------------------------------------------------- *
+ * Local function definitions                                                    *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  click_msisdn_all_digits
+ * Info:      Checks whether every character of a string is an ASCII digit.
+ *            With SSE2, 16 characters are classified per step: subtracting '0' maps the
+ *            digits onto 0..9, and min(x, 9) == x holds exactly for those lanes. The tail
+ *            is classified from a copy padded with '0' so no bytes past the end are read.
+ * Inputs:    chData - characters to check
+ *            iLen   - number of characters
+ * Return:    true if all characters are digits
+ */
+static bool click_msisdn_all_digits(const char *chData, size_t iLen)
+{
+#if defined(__SSE2__)
+    const __m128i vZero = _mm_set1_epi8('0');
+    const __m128i vNine = _mm_set1_epi8(9);
+    size_t i = 0;
+
+    for (; i + 16 <= iLen; i += 16) {
+        __m128i vChars = _mm_sub_epi8(_mm_loadu_si128((const __m128i *)(chData + i)), vZero);
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(vChars, vNine), vChars)) != 0xffff)
+            return false;
+    }
+
+    if (i < iLen) {
+        char chTail[16];
+        int iMask = (1 << (iLen - i)) - 1;
+
+        memset(chTail, '0', sizeof(chTail));
+        memcpy(chTail, chData + i, iLen - i);
+
+        __m128i vChars = _mm_sub_epi8(_mm_loadu_si128((const __m128i *)chTail), vZero);
+
+        if ((_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(vChars, vNine), vChars)) & iMask) != iMask)
+            return false;
+    }
+
+    return true;
+#else
+    for (size_t i = 0; i < iLen; i++) {
+        if (chData[i] < '0' || chData[i] > '9')
+            return false;
+    }
+
+    return true;
+#endif
+}
+
+/*
+ * Function:  click_msisdn_pack
+ * Info:      Packs a digit string of up to 15 digits into a non-zero 64-bit key. The digit
+ *            count is kept in the low 4 bits, so numbers differing only by leading zeros
+ *            do not collide.
+ * Inputs:    chDigits - digits
+ *            iLen     - number of digits (1..15)
+ * Return:    packed key
+ */
+static uint64_t click_msisdn_pack(const char *chDigits, unsigned int iLen)
+{
+    uint64_t iValue = 0;
+
+    for (unsigned int i = 0; i < iLen; i++)
+        iValue = iValue * 10 + (chDigits[i] - '0');
+
+    return ((iValue << 4) | iLen);
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Private function definitions                                                  *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickMsisdnNormalizer::LocalNormalizeOne
+ * Info:      Normalizes one number to E.164 digits (without '+') and checks its length.
+ * Inputs:    sInput   - number as supplied by the caller
+ *            chDigits - output buffer of CLICK_MSISDN_SCRATCH_LEN characters
+ *            iLen     - output: number of digits written
+ * Return:    CLICK_MSISDN_REJECT_COUNT if the number is valid, otherwise the reject reason
+ */
+eClickMsisdnReject ClickMsisdnNormalizer::LocalNormalizeOne(std::string_view sInput, char *chDigits,
+                                                            unsigned int &iLen) const
+{
+    char chRaw[CLICK_MSISDN_SCRATCH_LEN];
+    unsigned int iRaw = 0;
+    bool bInternational = false;
+
+    iLen = 0;
+
+    // 1. character-class check: fast path for plain digits, scalar path strips separators
+    if (sInput.length() < CLICK_MSISDN_SCRATCH_LEN && click_msisdn_all_digits(sInput.data(), sInput.length())) {
+        memcpy(chRaw, sInput.data(), sInput.length());
+        iRaw = sInput.length();
+    }
+    else {
+        for (size_t i = 0; i < sInput.length(); i++) {
+            char ch = sInput[i];
+
+            if (ch >= '0' && ch <= '9') {
+                if (iRaw >= CLICK_MSISDN_SCRATCH_LEN)
+                    return CLICK_MSISDN_REJECT_TOO_LONG;
+                chRaw[iRaw++] = ch;
+            }
+            else if (ch == '+' && iRaw == 0 && !bInternational)
+                bInternational = true;
+            else if (!CLICK_MSISDN_SEPARATOR(ch))
+                return CLICK_MSISDN_REJECT_INVALID_CHAR;
+        }
+    }
+
+    if (iRaw == 0)
+        return CLICK_MSISDN_REJECT_EMPTY;
+
+    // 2. prefix handling
+    const char *chStart = chRaw;
+
+    if (!bInternational && iRaw >= 2 && chRaw[0] == '0' && chRaw[1] == '0') {
+        // international call prefix 00
+        chStart += 2;
+        iRaw -= 2;
+    }
+    else if (!bInternational && chRaw[0] == oOptions.chTrunkPrefix) {
+        // local number: replace the trunk prefix with the default country code
+        if (oOptions.sDefaultCountryCode.empty())
+            return CLICK_MSISDN_REJECT_COUNTRY_CODE;
+
+        size_t iCodeLen = oOptions.sDefaultCountryCode.length();
+
+        if (iCodeLen + iRaw - 1 > CLICK_MSISDN_SCRATCH_LEN)
+            return CLICK_MSISDN_REJECT_TOO_LONG;
+
+        memcpy(chDigits, oOptions.sDefaultCountryCode.data(), iCodeLen);
+        memcpy(chDigits + iCodeLen, chRaw + 1, iRaw - 1);
+        iLen = iCodeLen + iRaw - 1;
+    }
+
+    if (iLen == 0) {
+        memcpy(chDigits, chStart, iRaw);
+        iLen = iRaw;
+    }
+
+    // 3. length checks (E.164 never exceeds 15 digits, whatever the options say)
+    unsigned int iMax = (oOptions.iMaxDigits < CLICK_MSISDN_MAX_DIGITS ? oOptions.iMaxDigits : CLICK_MSISDN_MAX_DIGITS);
+
+    if (iLen > iMax)
+        return CLICK_MSISDN_REJECT_TOO_LONG;
+    if (iLen < oOptions.iMinDigits)
+        return CLICK_MSISDN_REJECT_TOO_SHORT;
+
+    return CLICK_MSISDN_REJECT_COUNT;
+}
+
+/*
+ * Function:  ClickMsisdnNormalizer::LocalCountryCodeValid
+ * Info:      Checks the country code of a normalized number, either against the configured
+ *            list of allowed codes or against the table of ITU-assigned codes.
+ * Inputs:    chDigits - normalized digits
+ *            iLen     - number of digits
+ * Return:    true if the country code is acceptable
+ */
+bool ClickMsisdnNormalizer::LocalCountryCodeValid(const char *chDigits, unsigned int iLen) const
+{
+    if (chDigits[0] == '0')
+        return false;
+
+    if (!oOptions.vCountryCodes.empty()) {
+        for (const std::string &sCode : oOptions.vCountryCodes) {
+            if (sCode.length() < iLen && memcmp(chDigits, sCode.data(), sCode.length()) == 0)
+                return true;
+        }
+
+        return false;
+    }
+
+    unsigned int iCode = chDigits[0] - '0';
+
+    if (oCountryCodes.bCode1[iCode])
+        return true;
+
+    if (iLen < 3)
+        return false;
+
+    iCode = iCode * 10 + (chDigits[1] - '0');
+
+    if (oCountryCodes.bCode2[iCode])
+        return true;
+
+    if (iLen < 4)
+        return false;
+
+    iCode = iCode * 10 + (chDigits[2] - '0');
+
+    return oCountryCodes.bCode3[iCode];
+}
+
+/*
+ * Function:  ClickMsisdnNormalizer::LocalSeenReset
+ * Info:      Clears the duplicate hash set and sizes it for iCount numbers at a load factor
+ *            of at most 0.5. Previously allocated capacity is reused.
+ * Inputs:    iCount - number of numbers about to be inserted
+ * Return:    void
+ */
+void ClickMsisdnNormalizer::LocalSeenReset(size_t iCount)
+{
+    size_t iCapacity = CLICK_MSISDN_SEEN_MIN;
+    unsigned int iBits = 6;
+
+    while (iCapacity < iCount * 2) {
+        iCapacity <<= 1;
+        iBits++;
+    }
+
+    vSeen.assign(iCapacity, 0);
+    iSeenShift = 64 - iBits;
+}
+
+/*
+ * Function:  ClickMsisdnNormalizer::LocalSeenInsert
+ * Info:      Inserts a normalized number into the duplicate hash set (linear probing,
+ *            Fibonacci hashing).
+ * Inputs:    chDigits - normalized digits
+ *            iLen     - number of digits
+ * Return:    true if the number was not yet in the set
+ */
+bool ClickMsisdnNormalizer::LocalSeenInsert(const char *chDigits, unsigned int iLen)
+{
+    uint64_t iKey = click_msisdn_pack(chDigits, iLen);
+    size_t iMask = vSeen.size() - 1;
+    size_t iSlot = (size_t)((iKey * 0x9e3779b97f4a7c15ULL) >> iSeenShift);
+
+    while (vSeen[iSlot] != 0) {
+        if (vSeen[iSlot] == iKey)
+            return false;
+
+        iSlot = (iSlot + 1) & iMask;
+    }
+
+    vSeen[iSlot] = iKey;
+
+    return true;
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Public function definitions                                                   *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickMsisdnList::Clear
+ * Info:      Empties the list, keeping allocated capacity.
+ * Return:    void
+ */
+void ClickMsisdnList::Clear()
+{
+    sPacked.clear();
+    vOffsets.clear();
+    vViews.clear();
+    vRejects.clear();
+}
+
+/*
+ * Function:  ClickMsisdnList::At
+ * Info:      Returns one accepted number.
+ * Inputs:    i - index (0..Size()-1)
+ * Return:    view of the number, valid until the list is modified
+ */
+std::string_view ClickMsisdnList::At(size_t i) const
+{
+    return std::string_view(sPacked.data() + vOffsets[i], vOffsets[i + 1] - vOffsets[i]);
+}
+
+/*
+ * Function:  ClickMsisdnList::Views
+ * Info:      Returns all accepted numbers as views, suitable for the
+ *            ClickatellSms::SmsMessageSend() span overload.
+ * Return:    span of views, valid until the list is modified
+ */
+std::span<const std::string_view> ClickMsisdnList::Views()
+{
+    if (vViews.size() != Size()) {
+        vViews.clear();
+        vViews.reserve(Size());
+
+        for (size_t i = 0; i < Size(); i++)
+            vViews.push_back(At(i));
+    }
+
+    return vViews;
+}
+
+/*
+ * Function:  ClickMsisdnNormalizer::Normalize
+ * Info:      Normalizes, validates and de-duplicates a list of numbers. Accepted numbers are
+ *            packed into oOutput in input order; every rejected number is recorded in
+ *            oOutput's rejection report with its input index.
+ * Inputs:    vInput  - numbers as supplied by the caller
+ *            oOutput - output list (cleared first)
+ * Return:    void
+ */
+void ClickMsisdnNormalizer::Normalize(std::span<const std::string_view> vInput, ClickMsisdnList &oOutput)
+{
+    char chDigits[CLICK_MSISDN_SCRATCH_LEN];
+    unsigned int iLen = 0;
+
+    oOutput.Clear();
+    oOutput.sPacked.reserve(vInput.size() * 12);
+    oOutput.vOffsets.reserve(vInput.size() + 1);
+    oOutput.vOffsets.push_back(0);
+
+    if (oOptions.bDeduplicate)
+        LocalSeenReset(vInput.size());
+
+    for (size_t i = 0; i < vInput.size(); i++) {
+        eClickMsisdnReject eReason = LocalNormalizeOne(vInput[i], chDigits, iLen);
+
+        if (eReason == CLICK_MSISDN_REJECT_COUNT && !LocalCountryCodeValid(chDigits, iLen))
+            eReason = CLICK_MSISDN_REJECT_COUNTRY_CODE;
+
+        if (eReason == CLICK_MSISDN_REJECT_COUNT && oOptions.bDeduplicate && !LocalSeenInsert(chDigits, iLen))
+            eReason = CLICK_MSISDN_REJECT_DUPLICATE;
+
+        if (eReason != CLICK_MSISDN_REJECT_COUNT) {
+            oOutput.vRejects.push_back(ClickMsisdnReject{i, eReason});
+            continue;
+        }
+
+        oOutput.sPacked.append(chDigits, iLen);
+        oOutput.vOffsets.push_back(oOutput.sPacked.length());
+    }
+}
+
+/*
+ * Function:  ClickMsisdnNormalizer::Normalize
+ * Info:      Same as above for a vector of std::string.
+ * Inputs:    vInput  - numbers as supplied by the caller
+ *            oOutput - output list (cleared first)
+ * Return:    void
+ */
+void ClickMsisdnNormalizer::Normalize(const std::vector<std::string> &vInput, ClickMsisdnList &oOutput)
+{
+    std::vector<std::string_view> vViews(vInput.begin(), vInput.end());
+
+    Normalize(std::span<const std::string_view>(vViews), oOutput);
+}
+
+/*
+ * Function:  ClickMsisdnNormalizer::RejectName
+ * Info:      Returns a printable name for a reject reason.
+ * Inputs:    eReason - reject reason
+ * Return:    constant string
+ */
+const char *ClickMsisdnNormalizer::RejectName(eClickMsisdnReject eReason)
+{
+    switch (eReason) {
+        case CLICK_MSISDN_REJECT_EMPTY:
+            return "empty";
+        case CLICK_MSISDN_REJECT_INVALID_CHAR:
+            return "invalid character";
+        case CLICK_MSISDN_REJECT_TOO_SHORT:
+            return "too short";
+        case CLICK_MSISDN_REJECT_TOO_LONG:
+            return "too long";
+        case CLICK_MSISDN_REJECT_COUNTRY_CODE:
+            return "invalid country code";
+        case CLICK_MSISDN_REJECT_DUPLICATE:
+            return "duplicate";
+        default:
+            return "unknown";
+    }
+}
@@ -0,0 +1,100 @@
+#ifndef CLICKATELL_MSISDN_H
+#define CLICKATELL_MSISDN_H
+
+/*
+ * clickatell_msisdn.hpp
+ *
+ *  Bulk MSISDN pre-processing for the Clickatell SMS library.
+ *
+ *  Destination lists are normalized to E.164 digits (no '+'), validated for length and
+ *  country code, and de-duplicated before any request is built, so malformed or repeated
+ *  numbers never reach the gateway. The clean list is packed into a single buffer and
+ *  can be passed straight to the ClickatellSms::SmsMessageSend() span overload.
+ */
+#include <stdint.h>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// E.164 limits
+#define CLICK_MSISDN_MAX_DIGITS      15 // maximum number of digits in an E.164 number
+#define CLICK_MSISDN_DEFAULT_MIN      8 // default minimum number of digits (country code included)
+
+// reasons a number is rejected
+enum eClickMsisdnReject {
+    CLICK_MSISDN_REJECT_EMPTY,        // no digits at all
+    CLICK_MSISDN_REJECT_INVALID_CHAR, // character other than digits and separators
+    CLICK_MSISDN_REJECT_TOO_SHORT,    // fewer digits than ClickMsisdnOptions::iMinDigits
+    CLICK_MSISDN_REJECT_TOO_LONG,     // more digits than ClickMsisdnOptions::iMaxDigits
+    CLICK_MSISDN_REJECT_COUNTRY_CODE, // unassigned or disallowed country code
+    CLICK_MSISDN_REJECT_DUPLICATE,    // same number appeared earlier in the list
+    CLICK_MSISDN_REJECT_COUNT
+};
+
+// normalization options
+struct ClickMsisdnOptions {
+    std::string sDefaultCountryCode;          // replaces the trunk prefix of local numbers (empty: local numbers are rejected)
+    char chTrunkPrefix;                       // national trunk prefix, usually '0'
+    unsigned int iMinDigits;                  // minimum digits after normalization
+    unsigned int iMaxDigits;                  // maximum digits after normalization
+    std::vector<std::string> vCountryCodes;   // allowed country codes (empty: any ITU-assigned code)
+    bool bDeduplicate;                        // drop repeated numbers
+
+    ClickMsisdnOptions()
+                       : chTrunkPrefix('0'),
+                         iMinDigits(CLICK_MSISDN_DEFAULT_MIN),
+                         iMaxDigits(CLICK_MSISDN_MAX_DIGITS),
+                         bDeduplicate(true) {}
+};
+
+// rejection report entry
+struct ClickMsisdnReject {
+    size_t iIndex;              // index of the number in the input list
+    eClickMsisdnReject eReason; // why it was rejected
+};
+
+// clean packed MSISDN list with rejection report
+class ClickMsisdnList
+{
+private:
+    friend class ClickMsisdnNormalizer;
+
+    std::string sPacked;                     // all accepted numbers back to back
+    std::vector<uint32_t> vOffsets;          // start offset of each number in sPacked, plus end offset
+    std::vector<std::string_view> vViews;    // views into sPacked, built by Views()
+    std::vector<ClickMsisdnReject> vRejects; // rejected input numbers
+
+public:
+    void Clear();
+    size_t Size() const { return (vOffsets.empty() ? 0 : vOffsets.size() - 1); }
+    std::string_view At(size_t i) const;
+    std::span<const std::string_view> Views();
+    const std::vector<ClickMsisdnReject> &Rejects() const { return vRejects; }
+};
+
+// bulk normalizer - reuse one instance so that its hash set and buffers are reused
+class ClickMsisdnNormalizer
+{
+private:
+    ClickMsisdnOptions oOptions;
+    std::vector<uint64_t> vSeen; // open-addressing hash set of packed numbers (0 = empty slot)
+    unsigned int iSeenShift;     // 64 - log2(vSeen.size())
+
+    eClickMsisdnReject LocalNormalizeOne(std::string_view sInput, char *chDigits, unsigned int &iLen) const;
+    bool LocalCountryCodeValid(const char *chDigits, unsigned int iLen) const;
+    bool LocalSeenInsert(const char *chDigits, unsigned int iLen);
+    void LocalSeenReset(size_t iCount);
+
+public:
+    ClickMsisdnNormalizer(const ClickMsisdnOptions &oOptions_ = ClickMsisdnOptions())
+                          : oOptions(oOptions_),
+                            iSeenShift(64) {}
+
+    void Normalize(std::span<const std::string_view> vInput, ClickMsisdnList &oOutput);
+    void Normalize(const std::vector<std::string> &vInput, ClickMsisdnList &oOutput);
+
+    static const char *RejectName(eClickMsisdnReject eReason);
+};
+
+#endif // CLICKATELL_MSISDN_H
@@ -0,0 +1,475 @@
+/*
+ * clickatell_parser.cpp
+ *
+ *  Incremental parser of send responses for the Clickatell SMS library.
+ *
+ *  The JSON scanner does not build a document. It tracks the nesting depth, whether each
+ *  open container is an array, and the most recent object key; that is enough to recognise
+ *  the entries of a "message" array (objects directly inside it) and the members of their
+ *  "error" objects. Everything else in the response is scanned and dropped.
+ */
+
+#include <algorithm>
+
+#include "clickatell_parser.hpp"
+
+/* ----------------------------------------------------------------------------- *
+ * Types/Macros                                                                  *
+ * ----------------------------------------------------------------------------- */
+
+// container at depth d (1-based) is an array
+#define CLICK_PARSER_IS_ARRAY(d)  ((d) > 0 && (d) <= CLICK_PARSER_MAX_DEPTH && ((iArrays >> ((d) - 1)) & 1))
+
+/* ----------------------------------------------------------------------------- *
+ * Private function definitions                                                  *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickResponseParser::LocalAppend
+ * Info:      Appends a character to a parser string, dropping it once the string holds
+ *            CLICK_PARSER_MAX_TOKEN characters (the strings never reallocate).
+ * Inputs:    sOut - string
+ *            ch   - character
+ * Return:    void
+ */
+void ClickResponseParser::LocalAppend(std::string &sOut, char ch)
+{
+    if (sOut.length() < CLICK_PARSER_MAX_TOKEN)
+        sOut.push_back(ch);
+}
+
+/*
+ * Function:  ClickResponseParser::LocalAppendCode
+ * Info:      Appends a Unicode code point to a parser string as UTF-8. Like LocalAppend(),
+ *            it drops the character if it does not fit in CLICK_PARSER_MAX_TOKEN bytes, so a
+ *            truncated string never ends in a partial sequence.
+ * Inputs:    sOut  - string
+ *            iCode - code point
+ * Return:    void
+ */
+void ClickResponseParser::LocalAppendCode(std::string &sOut, uint32_t iCode)
+{
+    char chUtf8[4];
+    size_t iLen;
+
+    if (iCode < 0x80) {
+        chUtf8[0] = (char)iCode;
+        iLen = 1;
+    }
+    else if (iCode < 0x800) {
+        chUtf8[0] = (char)(0xC0 | (iCode >> 6));
+        chUtf8[1] = (char)(0x80 | (iCode & 0x3F));
+        iLen = 2;
+    }
+    else if (iCode < 0x10000) {
+        chUtf8[0] = (char)(0xE0 | (iCode >> 12));
+        chUtf8[1] = (char)(0x80 | ((iCode >> 6) & 0x3F));
+        chUtf8[2] = (char)(0x80 | (iCode & 0x3F));
+        iLen = 3;
+    }
+    else {
+        chUtf8[0] = (char)(0xF0 | (iCode >> 18));
+        chUtf8[1] = (char)(0x80 | ((iCode >> 12) & 0x3F));
+        chUtf8[2] = (char)(0x80 | ((iCode >> 6) & 0x3F));
+        chUtf8[3] = (char)(0x80 | (iCode & 0x3F));
+        iLen = 4;
+    }
+
+    if (sOut.length() + iLen <= CLICK_PARSER_MAX_TOKEN)
+        sOut.append(chUtf8, iLen);
+}
+
+/*
+ * Function:  ClickResponseParser::LocalCodeUnit
+ * Info:      Handles the UTF-16 code unit of a \uXXXX escape: a high surrogate is held until
+ *            the low surrogate that follows it, and the pair is appended as one code point.
+ *            An unpaired surrogate is appended as U+FFFD.
+ * Inputs:    iUnit - code unit
+ * Return:    void
+ */
+void ClickResponseParser::LocalCodeUnit(uint32_t iUnit)
+{
+    if (iUnit >= 0xDC00 && iUnit <= 0xDFFF && iHighSurrogate != 0) {
+        LocalAppendCode(sToken, 0x10000 + ((iHighSurrogate - 0xD800) << 10) + (iUnit - 0xDC00));
+        iHighSurrogate = 0;
+        return;
+    }
+
+    LocalSurrogateFlush();
+
+    if (iUnit >= 0xD800 && iUnit <= 0xDBFF)
+        iHighSurrogate = iUnit;
+    else
+        LocalAppendCode(sToken, (iUnit >= 0xDC00 && iUnit <= 0xDFFF ? 0xFFFD : iUnit));
+}
+
+/*
+ * Function:  ClickResponseParser::LocalSurrogateFlush
+ * Info:      Appends a held high surrogate that no low surrogate followed, as U+FFFD.
+ * Return:    void
+ */
+void ClickResponseParser::LocalSurrogateFlush()
+{
+    if (iHighSurrogate != 0) {
+        LocalAppendCode(sToken, 0xFFFD);
+        iHighSurrogate = 0;
+    }
+}
+
+/*
+ * Function:  ClickResponseParser::LocalEntryBegin
+ * Info:      Starts a recipient entry.
+ * Return:    void
+ */
+void ClickResponseParser::LocalEntryBegin()
+{
+    sTo.clear();
+    sMessageId.clear();
+    sErrorCode.clear();
+    sError.clear();
+    bAccepted = false;
+    bAcceptedSeen = false;
+}
+
+/*
+ * Function:  ClickResponseParser::LocalEntryEnd
+ * Info:      Reports the entry just read. An entry without an "accepted" member counts as
+ *            accepted if it has a message ID and no error.
+ * Return:    void
+ */
+void ClickResponseParser::LocalEntryEnd()
+{
+    ClickRecipientResult oResult;
+
+    oResult.iIndex = iCount++;
+    oResult.bAccepted = (bAcceptedSeen ? bAccepted : (!sMessageId.empty() && sError.empty() && sErrorCode.empty()));
+    oResult.sTo = sTo;
+    oResult.sMessageId = sMessageId;
+    oResult.sErrorCode = sErrorCode;
+    oResult.sError = sError;
+    oResult.iHttpStatus = iHttpStatus;
+
+    if (fnResult != NULL)
+        fnResult(pUserData, oResult);
+}
+
+/*
+ * Function:  ClickResponseParser::LocalValue
+ * Info:      Handles a complete JSON string or literal in sToken, keyed by sKey: members of
+ *            a recipient entry and of its "error" object are kept, anything else dropped.
+ * Inputs:    bString - the value was a string (otherwise a number, true, false or null)
+ * Return:    void
+ */
+void ClickResponseParser::LocalValue(bool bString)
+{
+    if (iMessageDepth == 0 || CLICK_PARSER_IS_ARRAY(iDepth))
+        return;
+
+    if (iDepth == iMessageDepth + 1) {
+        if (sKey == "to")
+            sTo = sToken;
+        else if (sKey == "apiMessageId")
+            sMessageId = sToken;
+        else if (sKey == "accepted") {
+            bAccepted = (sToken == "true");
+            bAcceptedSeen = true;
+        }
+        else if (sKey == "error" && bString)
+            sError = sToken;
+    }
+    else if (iErrorDepth > 0 && iDepth == iErrorDepth) {
+        if (sKey == "code")
+            sErrorCode = sToken;
+        else if (sKey == "description")
+            sError = sToken;
+    }
+}
+
+/*
+ * Function:  ClickResponseParser::LocalJson
+ * Info:      Scans one character of a JSON response. String escapes are decoded; \uXXXX
+ *            escapes (including surrogate pairs) become UTF-8, and a malformed \u escape
+ *            becomes U+FFFD.
+ * Inputs:    ch - character
+ * Return:    void
+ */
+void ClickResponseParser::LocalJson(char ch)
+{
+    if (bInString) {
+        if (iHexLeft > 0) {
+            int iDigit = (ch >= '0' && ch <= '9' ? ch - '0' :
+                          (ch >= 'a' && ch <= 'f' ? ch - 'a' + 10 : (ch >= 'A' && ch <= 'F' ? ch - 'A' + 10 : -1)));
+
+            if (iDigit >= 0) {
+                iCodeUnit = (iCodeUnit << 4) | (uint32_t)iDigit;
+                if (--iHexLeft == 0)
+                    LocalCodeUnit(iCodeUnit);
+                return;
+            }
+
+            // malformed escape: replaced, and the character is scanned as usual
+            iHexLeft = 0;
+            LocalCodeUnit(0xFFFD);
+        }
+
+        if (bEscape) {
+            bEscape = false;
+
+            if (ch == 'u') {
+                iHexLeft = 4;
+                iCodeUnit = 0;
+                return;
+            }
+
+            LocalSurrogateFlush();
+            LocalAppend(sToken, (ch == 'n' ? '\n' : (ch == 't' ? '\t' : (ch == 'r' ? '\r' :
+                                 (ch == 'b' ? '\b' : (ch == 'f' ? '\f' : ch))))));
+        }
+        else if (ch == '\\')
+            bEscape = true;
+        else if (ch == '"') {
+            LocalSurrogateFlush();
+            bInString = false;
+
+            if (bExpectKey) {
+                sKey = sToken;
+                bExpectKey = false;
+            }
+            else
+                LocalValue(true);
+        }
+        else {
+            LocalSurrogateFlush();
+            LocalAppend(sToken, ch);
+        }
+
+        return;
+    }
+
+    if (bInLiteral) {
+        if ((ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ||
+            ch == '.' || ch == '-' || ch == '+') {
+            LocalAppend(sToken, ch);
+            return;
+        }
+
+        // the character ending the literal is handled below
+        bInLiteral = false;
+        LocalValue(false);
+    }
+
+    switch (ch) {
+        case '"':
+            bInString = true;
+            sToken.clear();
+            break;
+
+        case '{':
+        case '[': {
+            bool bInObject = (iDepth > 0 && !CLICK_PARSER_IS_ARRAY(iDepth));
+
+            if (ch == '[' && iMessageDepth == 0 && bInObject && sKey == "message")
+                iMessageDepth = iDepth + 1;
+            else if (ch == '{' && iMessageDepth > 0 && iDepth == iMessageDepth)
+                LocalEntryBegin();
+            else if (ch == '{' && iMessageDepth > 0 && iDepth == iMessageDepth + 1 && bInObject && sKey == "error")
+                iErrorDepth = iDepth + 1;
+
+            iDepth++;
+
+            if (iDepth <= CLICK_PARSER_MAX_DEPTH) {
+                if (ch == '[')
+                    iArrays |= (uint64_t)1 << (iDepth - 1);
+                else
+                    iArrays &= ~((uint64_t)1 << (iDepth - 1));
+            }
+
+            bExpectKey = (ch == '{');
+            break;
+        }
+
+        case '}':
+        case ']':
+            if (iDepth == 0)
+                break;
+
+            if (iDepth == iErrorDepth)
+                iErrorDepth = 0;
+
+            if (ch == '}' && iMessageDepth > 0 && iDepth == iMessageDepth + 1)
+                LocalEntryEnd();
+
+            if (iDepth == iMessageDepth)
+                iMessageDepth = 0;
+
+            iDepth--;
+            bExpectKey = false;
+            break;
+
+        case ':':
+            bExpectKey = false;
+            break;
+
+        case ',':
+            bExpectKey = (iDepth > 0 && !CLICK_PARSER_IS_ARRAY(iDepth));
+            break;
+
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+            break;
+
+        default:
+            bInLiteral = true;
+            sToken.clear();
+            LocalAppend(sToken, ch);
+            break;
+    }
+}
+
+/*
+ * Function:  ClickResponseParser::LocalLine
+ * Info:      Parses one line of an HTTP API response held in sToken:
+ *                ID: <message ID> [To: <msisdn>]
+ *                ERR: <code>, <description> [To: <msisdn>]
+ *            Other lines are ignored.
+ * Return:    void
+ */
+void ClickResponseParser::LocalLine()
+{
+    std::string_view sLine(sToken);
+    size_t iTo = sLine.find("To:");
+    std::string_view sHead = sLine.substr(0, iTo);
+
+    sHead.remove_prefix(std::min(sHead.find_first_not_of(' '), sHead.length()));
+
+    LocalEntryBegin();
+
+    if (iTo != std::string_view::npos) {
+        std::string_view sDest = sLine.substr(iTo + 3);
+
+        sDest.remove_prefix(std::min(sDest.find_first_not_of(' '), sDest.length()));
+        sTo.assign(sDest.substr(0, sDest.find(' ')));
+    }
+
+    if (sHead.substr(0, 3) == "ID:") {
+        sHead.remove_prefix(3);
+        sHead.remove_prefix(std::min(sHead.find_first_not_of(' '), sHead.length()));
+        sMessageId.assign(sHead.substr(0, sHead.find(' ')));
+        bAccepted = true;
+    }
+    else if (sHead.substr(0, 4) == "ERR:") {
+        size_t iComma;
+
+        sHead.remove_prefix(4);
+        sHead.remove_prefix(std::min(sHead.find_first_not_of(' '), sHead.length()));
+
+        if ((iComma = sHead.find(',')) != std::string_view::npos) {
+            sErrorCode.assign(sHead.substr(0, iComma));
+            sHead.remove_prefix(iComma + 1);
+            sHead.remove_prefix(std::min(sHead.find_first_not_of(' '), sHead.length()));
+        }
+
+        sHead = sHead.substr(0, sHead.find_last_not_of(' ') + 1);
+        sError.assign(sHead);
+    }
+    else
+        return;
+
+    bAcceptedSeen = true;
+    LocalEntryEnd();
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Public function definitions                                                   *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickResponseParser
+ * Info:      Constructor. All parser strings are sized for CLICK_PARSER_MAX_TOKEN here, so
+ *            parsing performs no heap allocations.
+ * Inputs:    fnResult_  - called once per recipient entry (may be NULL)
+ *            pUserData_ - passed to fnResult_
+ */
+ClickResponseParser::ClickResponseParser(ClickRecipientFn fnResult_, void *pUserData_)
+                                         : fnResult(fnResult_),
+                                           pUserData(pUserData_)
+{
+    for (std::string *pStr : {&sToken, &sKey, &sTo, &sMessageId, &sErrorCode, &sError})
+        pStr->reserve(CLICK_PARSER_MAX_TOKEN);
+
+    Reset();
+}
+
+/*
+ * Function:  ClickResponseParser::Reset
+ * Info:      Prepares the parser for a new response.
+ * Return:    void
+ */
+void ClickResponseParser::Reset()
+{
+    eMode = CLICK_PARSER_DETECT;
+    iHttpStatus = 0;
+    iCount = 0;
+    sToken.clear();
+    sKey.clear();
+    iArrays = 0;
+    iDepth = 0;
+    iMessageDepth = 0;
+    iErrorDepth = 0;
+    bInString = false;
+    bEscape = false;
+    iHexLeft = 0;
+    iCodeUnit = 0;
+    iHighSurrogate = 0;
+    bInLiteral = false;
+    bExpectKey = false;
+
+    LocalEntryBegin();
+}
+
+/*
+ * Function:  ClickResponseParser::Feed
+ * Info:      Parses the next bytes of the response, reporting every recipient entry they
+ *            complete. The bytes may split the response anywhere.
+ * Inputs:    chData - response bytes
+ *            iLen   - number of bytes
+ * Return:    void
+ */
+void ClickResponseParser::Feed(const char *chData, size_t iLen)
+{
+    for (size_t i = 0; i < iLen; i++) {
+        char ch = chData[i];
+
+        if (eMode == CLICK_PARSER_DETECT) {
+            if (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n')
+                continue;
+
+            eMode = ((ch == '{' || ch == '[') ? CLICK_PARSER_JSON : CLICK_PARSER_LINES);
+        }
+
+        if (eMode == CLICK_PARSER_JSON)
+            LocalJson(ch);
+        else if (ch == '\n') {
+            LocalLine();
+            sToken.clear();
+        }
+        else if (ch != '\r')
+            LocalAppend(sToken, ch);
+    }
+}
+
+/*
+ * Function:  ClickResponseParser::Finish
+ * Info:      Ends the response: an HTTP API response need not end with a line break, so
+ *            its last line is only complete now.
+ * Return:    void
+ */
+void ClickResponseParser::Finish()
+{
+    if (eMode == CLICK_PARSER_LINES && !sToken.empty()) {
+        LocalLine();
+        sToken.clear();
+    }
+}
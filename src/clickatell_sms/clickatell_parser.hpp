@@ -0,0 +1,109 @@
+#ifndef CLICKATELL_PARSER_H
+#define CLICKATELL_PARSER_H
+
+/*
+ * clickatell_parser.hpp
+ *
+ *  Incremental parser of send responses for the Clickatell SMS library.
+ *
+ *  A ClickResponseParser is fed a send response as cURL receives it and reports one result
+ *  per recipient as soon as that recipient's entry is complete, so a large bulk response
+ *  can be consumed while it is still arriving and never has to be held in memory as a
+ *  whole. Both response formats are recognised from their first byte: the REST API's JSON
+ *  ({"data":{"message":[{"accepted":true,"to":"..","apiMessageId":".."},..]}}) and the
+ *  HTTP API's lines ("ID: <id> To: <msisdn>" or "ERR: <code>, <description> To: <msisdn>").
+ *
+ *  Memory is bounded: the parser keeps only the entry being read, and strings longer than
+ *  CLICK_PARSER_MAX_TOKEN are truncated.
+ */
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#define CLICK_PARSER_MAX_TOKEN  256   // longest string, number or line kept by the parser
+#define CLICK_PARSER_MAX_DEPTH  64    // JSON nesting tracked (deeper values are skipped)
+#define CLICK_PARSER_KEEP_BYTES 4096  // default response bytes a client keeps while results are streamed
+
+// result of one recipient of a send
+struct ClickRecipientResult {
+    size_t iIndex;                 // position of the entry in the response
+    bool bAccepted;                // the gateway accepted the message for this recipient
+    std::string_view sTo;          // destination (empty if the response does not name it)
+    std::string_view sMessageId;   // gateway message ID (empty if not accepted)
+    std::string_view sErrorCode;   // error code (empty if accepted)
+    std::string_view sError;       // error description (empty if accepted)
+    long iHttpStatus;              // HTTP status of the response
+};
+
+// called once per recipient entry, as soon as it has been received; the views are valid during the call only
+typedef void (*ClickRecipientFn)(void *pUserData, const ClickRecipientResult &oResult);
+
+class ClickResponseParser
+{
+private:
+    // response format, detected from the first non-blank byte
+    enum eClickParserMode {
+        CLICK_PARSER_DETECT,
+        CLICK_PARSER_JSON,
+        CLICK_PARSER_LINES
+    };
+
+    ClickRecipientFn fnResult;
+    void *pUserData;
+    eClickParserMode eMode;
+    long iHttpStatus;
+    size_t iCount;               // results reported
+
+    // JSON scanner
+    std::string sToken;          // string or literal being read
+    std::string sKey;            // most recent object key
+    uint64_t iArrays;            // bit n set: container at depth n+1 is an array
+    int iDepth;                  // containers open
+    int iMessageDepth;           // depth of the "message" array (0: not inside one)
+    int iErrorDepth;             // depth of an entry's "error" object (0: not inside one)
+    bool bInString;
+    bool bEscape;
+    int iHexLeft;                // hex digits of a \u escape still to read
+    uint32_t iCodeUnit;          // UTF-16 code unit of that escape
+    uint32_t iHighSurrogate;     // high surrogate waiting for its low half (0: none)
+    bool bInLiteral;
+    bool bExpectKey;             // the next string is an object key
+
+    // entry being read
+    std::string sTo;
+    std::string sMessageId;
+    std::string sErrorCode;
+    std::string sError;
+    bool bAccepted;
+    bool bAcceptedSeen;          // "accepted" was present (otherwise an ID means accepted)
+
+    void LocalAppend(std::string &sOut, char ch);
+    void LocalAppendCode(std::string &sOut, uint32_t iCode);
+    void LocalCodeUnit(uint32_t iUnit);
+    void LocalSurrogateFlush();
+    void LocalEntryBegin();
+    void LocalEntryEnd();
+    void LocalValue(bool bString);
+    void LocalJson(char ch);
+    void LocalLine();
+
+public:
+    ClickResponseParser(ClickRecipientFn fnResult_, void *pUserData_);
+
+    // sets the function called per recipient entry (NULL: none)
+    void SetHandler(ClickRecipientFn fnResult_, void *pUserData_) { fnResult = fnResult_; pUserData = pUserData_; }
+    // starts a new response
+    void Reset();
+    // parses the next bytes of the response
+    void Feed(const char *chData, size_t iLen);
+    // ends the response (reports a last HTTP API line without a line break)
+    void Finish();
+
+    void SetHttpStatus(long iHttpStatus_) { iHttpStatus = iHttpStatus_; }
+    long HttpStatus() const { return iHttpStatus; }
+    bool HasHandler() const { return fnResult != NULL; }
+    size_t Count() const { return iCount; }
+};
+
+#endif // CLICKATELL_PARSER_H
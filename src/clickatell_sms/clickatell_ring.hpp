@@ -0,0 +1,217 @@
+#ifndef CLICKATELL_RING_H
+#define CLICKATELL_RING_H
+
+/*
+ * clickatell_ring.hpp
+ *
+ *  Bounded lock-free queues for the Clickatell SMS library.
+ *
+ *  ClickRing<T> is a fixed-size ring of cells, each with a sequence number that tells
+ *  producers and consumers whose turn the cell is (D. Vyukov's bounded MPMC queue). A push
+ *  or pop claims a position with one compare-and-swap on the shared index and then only
+ *  touches its own cell, so there is no lock and no allocation after construction. Any
+ *  number of threads may push and pop; a full ring refuses pushes instead of growing.
+ *
+ *  ClickMpscRing<T> is the same ring for many producers and a single consumer. A push
+ *  reserves room with one fetch-and-add on the count of used cells and claims its position
+ *  with another, so it finishes in a fixed number of steps whatever the other threads do
+ *  (wait-free); only a push that finds the ring full takes a third step to give its
+ *  reservation back. The consumer takes a run of published cells at once and releases
+ *  them with one atomic operation. A producer that has claimed a cell but not yet written
+ *  it holds back the cells after it until it has.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <utility>
+
+template <typename T>
+class ClickRing
+{
+private:
+    struct ClickRingCell {
+        std::atomic<size_t> iSeq;    // position this cell is ready for: pos (push) or pos + 1 (pop)
+        T oValue;
+    };
+
+    std::unique_ptr<ClickRingCell[]> pCells;
+    size_t iMask;                                 // capacity - 1 (capacity is a power of two)
+    alignas(64) std::atomic<size_t> iPushPos;     // producers' position
+    alignas(64) std::atomic<size_t> iPopPos;      // consumers' position (alignas also pads the class after it)
+
+public:
+    // iCapacity is rounded up to a power of two (at least 2)
+    explicit ClickRing(size_t iCapacity)
+    {
+        size_t iSize = 2;
+
+        while (iSize < iCapacity)
+            iSize *= 2;
+
+        pCells = std::make_unique<ClickRingCell[]>(iSize);
+        iMask = iSize - 1;
+
+        for (size_t i = 0; i < iSize; i++)
+            pCells[i].iSeq.store(i, std::memory_order_relaxed);
+
+        iPushPos.store(0, std::memory_order_relaxed);
+        iPopPos.store(0, std::memory_order_relaxed);
+    }
+
+    ClickRing(const ClickRing &) = delete;
+    ClickRing &operator=(const ClickRing &) = delete;
+
+    // appends oValue (moved from only on success); false if the ring is full (any thread)
+    bool TryPush(T &&oValue)
+    {
+        size_t iPos = iPushPos.load(std::memory_order_relaxed);
+
+        for (;;) {
+            ClickRingCell &oCell = pCells[iPos & iMask];
+            size_t iSeq = oCell.iSeq.load(std::memory_order_acquire);
+            intptr_t iDiff = (intptr_t)iSeq - (intptr_t)iPos;
+
+            if (iDiff == 0) {
+                if (iPushPos.compare_exchange_weak(iPos, iPos + 1, std::memory_order_relaxed)) {
+                    oCell.oValue = std::move(oValue);
+                    oCell.iSeq.store(iPos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (iDiff < 0)
+                return false;
+            else
+                iPos = iPushPos.load(std::memory_order_relaxed);
+        }
+    }
+
+    // removes the oldest value into oValue; false if the ring is empty (any thread)
+    bool TryPop(T &oValue)
+    {
+        size_t iPos = iPopPos.load(std::memory_order_relaxed);
+
+        for (;;) {
+            ClickRingCell &oCell = pCells[iPos & iMask];
+            size_t iSeq = oCell.iSeq.load(std::memory_order_acquire);
+            intptr_t iDiff = (intptr_t)iSeq - (intptr_t)(iPos + 1);
+
+            if (iDiff == 0) {
+                if (iPopPos.compare_exchange_weak(iPos, iPos + 1, std::memory_order_relaxed)) {
+                    oValue = std::move(oCell.oValue);
+                    oCell.iSeq.store(iPos + iMask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (iDiff < 0)
+                return false;
+            else
+                iPos = iPopPos.load(std::memory_order_relaxed);
+        }
+    }
+
+    // values queued (a snapshot; exact only while no other thread pushes or pops)
+    size_t Size() const
+    {
+        size_t iPush = iPushPos.load(std::memory_order_acquire);
+        size_t iPop = iPopPos.load(std::memory_order_acquire);
+
+        return (iPush > iPop ? iPush - iPop : 0);
+    }
+
+    bool Empty() const { return Size() == 0; }
+    size_t Capacity() const { return iMask + 1; }
+};
+
+template <typename T>
+class ClickMpscRing
+{
+private:
+    struct ClickMpscCell {
+        std::atomic<size_t> iSeq;    // pos + 1 once the value for position pos is written
+        T oValue;
+    };
+
+    std::unique_ptr<ClickMpscCell[]> pCells;
+    size_t iMask;                                 // capacity - 1 (capacity is a power of two)
+    alignas(64) std::atomic<size_t> iUsed;        // cells reserved by producers and not yet released by the consumer
+    std::atomic<size_t> iPushPos;                 // next position to claim (same line as iUsed: a push touches both)
+    alignas(64) size_t iPopPos;                   // consumer only (alignas also pads the class after it)
+
+public:
+    // iCapacity is rounded up to a power of two (at least 2)
+    explicit ClickMpscRing(size_t iCapacity)
+    {
+        size_t iSize = 2;
+
+        while (iSize < iCapacity)
+            iSize *= 2;
+
+        pCells = std::make_unique<ClickMpscCell[]>(iSize);
+        iMask = iSize - 1;
+
+        for (size_t i = 0; i < iSize; i++)
+            pCells[i].iSeq.store(0, std::memory_order_relaxed);
+
+        iUsed.store(0, std::memory_order_relaxed);
+        iPushPos.store(0, std::memory_order_relaxed);
+        iPopPos = 0;
+    }
+
+    ClickMpscRing(const ClickMpscRing &) = delete;
+    ClickMpscRing &operator=(const ClickMpscRing &) = delete;
+
+    // appends oValue (moved from only on success); false if the ring is full (any thread, wait-free)
+    bool TryPush(T &&oValue)
+    {
+        // at most Capacity() reservations are held, so the claimed position's cell has been released
+        if (iUsed.fetch_add(1, std::memory_order_acq_rel) > iMask) {
+            iUsed.fetch_sub(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        size_t iPos = iPushPos.fetch_add(1, std::memory_order_relaxed);
+        ClickMpscCell &oCell = pCells[iPos & iMask];
+
+        oCell.oValue = std::move(oValue);
+        oCell.iSeq.store(iPos + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    /* Passes up to iMax of the oldest values, in order, to fnTake(T &&) and releases their
+     * cells; stops early at a cell whose producer has not finished writing it. Returns the
+     * number taken (consumer thread only).
+     */
+    template <typename Fn>
+    size_t PopBatch(size_t iMax, Fn fnTake)
+    {
+        size_t iTaken = 0;
+
+        while (iTaken < iMax) {
+            ClickMpscCell &oCell = pCells[iPopPos & iMask];
+
+            if (oCell.iSeq.load(std::memory_order_acquire) != iPopPos + 1)
+                break;
+
+            fnTake(std::move(oCell.oValue));
+            iPopPos++;
+            iTaken++;
+        }
+
+        // seq_cst, so that a producer waiting for room either sees it or is seen (see ClickSendEngine)
+        if (iTaken > 0)
+            iUsed.fetch_sub(iTaken, std::memory_order_seq_cst);
+
+        return iTaken;
+    }
+
+    // values queued, counting pushes in progress (a snapshot; any thread)
+    size_t Size() const { return std::min(iUsed.load(std::memory_order_acquire), iMask + 1); }
+
+    bool Empty() const { return Size() == 0; }
+    size_t Capacity() const { return iMask + 1; }
+};
+
+#endif // CLICKATELL_RING_H
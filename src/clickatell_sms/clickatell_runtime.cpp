@@ -0,0 +1,457 @@
+/*
+ * clickatell_runtime.cpp
+ *
+ *  Thread-per-core sharded sender runtime for the Clickatell SMS library.
+ *
+ *  Each shard thread runs the same round as the send engine's thread, without a lock: it
+ *  frees the instances whose send finished, takes messages from its queue (or, once that
+ *  is empty, from the other shards' queues) for its free instances as its rate allows, and
+ *  waits in ClickLoop::RunOnce() until a transfer finishes or the next start is due.
+ *
+ *  A shard with free instances and nothing to send marks itself sleeping before it waits;
+ *  Submit() wakes the loop only in that case, so a busy shard costs its producers no system
+ *  call. A fence on each side orders the flag against the queue, so that either the shard
+ *  sees the new message or the producer sees the flag. Idle shards poll the other queues
+ *  for work to steal, backing off from 1 ms to CLICK_RUNTIME_IDLE_MAX_MS; a producer that
+ *  finds its shard's queue longer than the shard's pool also wakes the next shard.
+ */
+
+#include <algorithm>
+#include <functional>
+#include <string>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "clickatell_runtime.hpp"
+#include "clickatell_metrics.hpp"
+#include "clickatell_trace.hpp"
+
+/* ----------------------------------------------------------------------------- *
+ * Types/Macros                                                                  *
+ * ----------------------------------------------------------------------------- */
+
+#define CLICK_RUNTIME_MAX_WAIT_MS  1000  // longest a shard waits without re-checking
+#define CLICK_RUNTIME_IDLE_MAX_MS  50    // longest an idle shard waits before looking for work to steal
+
+/* ----------------------------------------------------------------------------- *
+ * Private function definitions                                                  *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickCoreRuntime::LocalReport
+ * Info:      Passes the final state of a message to its completion function, if any. A
+ *            message without a correlation ID of its own gets one made of the runtime's
+ *            prefix and its message ID.
+ * Inputs:    oJob        - the message
+ *            eStatus     - final state
+ *            curlCode    - cURL result
+ *            iHttpStatus - HTTP status
+ *            sResponse   - gateway response
+ *            tLeftQueue  - time the message left the queue
+ * Return:    void
+ */
+void ClickCoreRuntime::LocalReport(const ClickSendJob &oJob, eClickSendStatus eStatus, CURLcode curlCode, long iHttpStatus,
+                                   std::string_view sResponse, ClickTimePoint tLeftQueue)
+{
+    if (oJob.oOpts.fnDone == NULL)
+        return;
+
+    ClickSendResult oResult{oJob.iId, oJob.oOpts.ePriority, eStatus, curlCode, iHttpStatus, sResponse,
+                            std::chrono::duration_cast<std::chrono::microseconds>(tLeftQueue - oJob.tEnqueued),
+                            oJob.oOpts.oTrace};
+
+    if (!oResult.oTrace.Valid()) {
+        oResult.oTrace.iHigh = iCorrelationPrefix;
+        oResult.oTrace.iLow = oJob.iId;
+    }
+
+    oJob.oOpts.fnDone(oJob.oOpts.pUserData, oResult);
+}
+
+/*
+ * Function:  ClickCoreRuntime::LocalSend
+ * Info:      Coroutine sending the message held by a slot. The send is bounded by the
+ *            message deadline and cancelled through the slot's stop source.
+ * Inputs:    oShard - shard owning the slot
+ *            oSlot  - pool slot holding the message
+ * Return:    task (started by LocalThread())
+ */
+ClickTask<void> ClickCoreRuntime::LocalSend(ClickRuntimeShard &oShard, ClickRuntimeSlot &oSlot)
+{
+    std::vector<std::string_view> vViews(oSlot.oJob.vMsisdns.begin(), oSlot.oJob.vMsisdns.end());
+
+    oSlot.pSms->SetResultStream(oSlot.oJob.oOpts.fnRecipient, oSlot.oJob.oOpts.pUserData);
+
+    const std::string &sResponse = co_await oSlot.pSms->SmsMessageSendAsync(oShard.oLoop, oSlot.oJob.sText, vViews,
+                                       ClickCallOptions(oSlot.oStop.get_token(), oSlot.oJob.oOpts.tDeadline));
+    // a send that found its deadline passed before anything went out expired, it was not sent
+    eClickSendStatus eStatus = (oSlot.oStop.stop_requested() ? CLICK_SEND_CANCELLED :
+                                oSlot.pSms->GetNotSent() ? CLICK_SEND_EXPIRED : CLICK_SEND_DONE);
+
+    LocalReport(oSlot.oJob, eStatus, oSlot.pSms->GetCurlCode(), oSlot.pSms->GetHttpStatus(), sResponse, oSlot.tStarted);
+
+    if (eStatus == CLICK_SEND_DONE)
+        oShard.oCounters.iSent.fetch_add(1, std::memory_order_relaxed);
+    else if (eStatus == CLICK_SEND_EXPIRED)
+        oShard.oCounters.iExpired.fetch_add(1, std::memory_order_relaxed);
+    else
+        oShard.oCounters.iCancelled.fetch_add(1, std::memory_order_relaxed);
+}
+
+/*
+ * Function:  ClickCoreRuntime::LocalNext
+ * Info:      Takes the next message for a shard (shard thread): from its own queue, or
+ *            else, with work stealing, from the queues of the other shards in turn.
+ * Inputs:    oShard - the shard
+ * Outputs:   oJob - the message
+ * Return:    false if there is none
+ */
+bool ClickCoreRuntime::LocalNext(ClickRuntimeShard &oShard, ClickSendJob &oJob)
+{
+    if (oShard.oRing.TryPop(oJob)) {
+        ClickMetrics::Add(CLICK_METRIC_QUEUE_DEPTH, -1);
+        return true;
+    }
+
+    if (!oOptions.bWorkStealing)
+        return false;
+
+    for (size_t i = 1; i < vShards.size(); i++) {
+        ClickRuntimeShard &oVictim = *vShards[(oShard.iIndex + i) % vShards.size()];
+
+        if (oVictim.oRing.TryPop(oJob)) {
+            ClickMetrics::Add(CLICK_METRIC_QUEUE_DEPTH, -1);
+            oShard.oCounters.iStolen.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Function:  ClickCoreRuntime::LocalWake
+ * Info:      Wakes a shard after a message was queued on it (producer thread), if it is
+ *            sleeping. If it is busy and its queue has outgrown its pool, the next shard is
+ *            woken instead, to steal.
+ * Inputs:    oShard - shard the message was queued on
+ * Return:    void
+ */
+void ClickCoreRuntime::LocalWake(ClickRuntimeShard &oShard)
+{
+    // pairs with the fence in LocalThread(): the push is visible to the shard or the flag to us
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (oShard.bSleeping.load(std::memory_order_relaxed)) {
+        if (oShard.bSleeping.exchange(false, std::memory_order_relaxed))
+            oShard.oLoop.Wakeup();
+        return;
+    }
+
+    if (!oOptions.bWorkStealing || vShards.size() < 2 || oShard.oRing.Size() <= oShard.vSlots.size())
+        return;
+
+    ClickRuntimeShard &oNext = *vShards[(oShard.iIndex + 1) % vShards.size()];
+
+    if (oNext.bSleeping.load(std::memory_order_relaxed) && oNext.bSleeping.exchange(false, std::memory_order_relaxed))
+        oNext.oLoop.Wakeup();
+}
+
+/*
+ * Function:  ClickCoreRuntime::LocalPin
+ * Info:      Pins the calling shard thread to its core, if configured. Only supported on
+ *            Linux; a failure leaves the thread unpinned.
+ * Inputs:    oShard - the shard
+ * Return:    void
+ */
+void ClickCoreRuntime::LocalPin(ClickRuntimeShard &oShard)
+{
+    if (!oOptions.bPinThreads)
+        return;
+
+#ifdef __linux__
+    unsigned int iCores = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t oSet;
+
+    CPU_ZERO(&oSet);
+    CPU_SET((oOptions.iFirstCore + oShard.iIndex) % iCores, &oSet);
+    pthread_setaffinity_np(pthread_self(), sizeof(oSet), &oSet);
+#else
+    (void)oShard;
+#endif
+}
+
+/*
+ * Function:  ClickCoreRuntime::LocalThread
+ * Info:      Shard thread body. Once the runtime is stopping, the messages queued on the
+ *            shard are cancelled and its sends in progress are asked to stop; the thread
+ *            ends when none is left.
+ * Inputs:    oShard - the shard
+ * Return:    void
+ */
+void ClickCoreRuntime::LocalThread(ClickRuntimeShard &oShard)
+{
+    long long iIdleMs = 1;
+
+    LocalPin(oShard);
+
+    for (;;) {
+        ClickTimePoint tNow = std::chrono::steady_clock::now();
+        size_t iFree = 0;
+
+        for (ClickRuntimeSlot &oSlot : oShard.vSlots) {
+            if (oSlot.oTask && oSlot.oTask->Done())
+                oSlot.oTask.reset();
+
+            iFree += !oSlot.oTask;
+        }
+
+        if (bStop.load(std::memory_order_acquire)) {
+            ClickSendJob oJob;
+
+            while (oShard.oRing.TryPop(oJob)) {
+                ClickMetrics::Add(CLICK_METRIC_QUEUE_DEPTH, -1);
+                oShard.oCounters.iCancelled.fetch_add(1, std::memory_order_relaxed);
+                LocalReport(oJob, CLICK_SEND_CANCELLED, CURLE_OK, 0, std::string_view(), tNow);
+            }
+
+            for (ClickRuntimeSlot &oSlot : oShard.vSlots) {
+                if (oSlot.oTask)
+                    oSlot.oStop.request_stop();
+            }
+
+            oShard.oCounters.iInFlight.store(oShard.vSlots.size() - iFree, std::memory_order_relaxed);
+
+            if (iFree == oShard.vSlots.size())
+                break;
+
+            oShard.oLoop.RunOnce(CLICK_RUNTIME_MAX_WAIT_MS);
+            continue;
+        }
+
+        bool bLimited = false;
+        bool bIdle = false;
+
+        for (size_t i = 0; i < oShard.vSlots.size() && iFree > 0; i++) {
+            ClickRuntimeSlot &oSlot = oShard.vSlots[i];
+
+            if (oSlot.oTask)
+                continue;
+
+            if (tNow < oShard.tNextStart) {
+                bLimited = !oShard.oRing.Empty();
+                bIdle = !bLimited;
+                break;
+            }
+
+            // expired messages are dropped without taking the slot
+            do {
+                if (!LocalNext(oShard, oSlot.oJob)) {
+                    bIdle = true;
+                    break;
+                }
+
+                if (oSlot.oJob.oOpts.tDeadline > tNow)
+                    break;
+
+                oShard.oCounters.iExpired.fetch_add(1, std::memory_order_relaxed);
+                LocalReport(oSlot.oJob, CLICK_SEND_EXPIRED, CURLE_OK, 0, std::string_view(), tNow);
+            } while (true);
+
+            if (bIdle)
+                break;
+
+            oSlot.oStop = std::stop_source();
+            oSlot.tStarted = tNow;
+            oSlot.oTask.emplace(LocalSend(oShard, oSlot));
+            oSlot.oTask->Start();
+            iFree--;
+
+            // a late start does not earn a burst
+            if (tInterval.count() > 0)
+                oShard.tNextStart = std::max(oShard.tNextStart, tNow - tInterval) + tInterval;
+        }
+
+        oShard.oCounters.iInFlight.store(oShard.vSlots.size() - iFree, std::memory_order_relaxed);
+
+        long long iWaitMs = CLICK_RUNTIME_MAX_WAIT_MS;
+
+        if (bLimited) {
+            iWaitMs = std::chrono::duration_cast<std::chrono::milliseconds>(oShard.tNextStart - tNow).count() + 1;
+        }
+        else if (bIdle) {
+            if (oOptions.bWorkStealing && vShards.size() > 1) {
+                iWaitMs = iIdleMs;
+                iIdleMs = std::min<long long>(iIdleMs * 2, CLICK_RUNTIME_IDLE_MAX_MS);
+            }
+
+            oShard.bSleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            // a message queued before the flag was set was not announced
+            if (!oShard.oRing.Empty())
+                iWaitMs = 0;
+        }
+
+        if (!bIdle)
+            iIdleMs = 1;
+
+        oShard.oLoop.RunOnce((int)std::clamp<long long>(iWaitMs, 0, CLICK_RUNTIME_MAX_WAIT_MS));
+        oShard.bSleeping.store(false, std::memory_order_relaxed);
+    }
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Public function definitions                                                   *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickCoreRuntime
+ * Info:      Constructor. Takes ownership of the pool instances, deals them out to the
+ *            shards round-robin, attaches each to its shard's ClickShare (replacing any
+ *            share set before) and starts the shard threads. Throws a std::string if the
+ *            pool is empty.
+ * Inputs:    vClients  - pool; its size is the number of concurrent sends
+ *            oOptions_ - runtime options
+ */
+ClickCoreRuntime::ClickCoreRuntime(std::vector<std::unique_ptr<ClickatellSms>> vClients,
+                                   const ClickRuntimeOptions &oOptions_)
+                                   : oOptions(oOptions_),
+                                     iCorrelationPrefix(ClickTracer::NewSpanId()),
+                                     tInterval(0),
+                                     bStop(false)
+{
+    if (vClients.empty())
+        throw (std::string("ClickCoreRuntime needs at least one ClickatellSms instance!"));
+
+    size_t iShards = (oOptions.iShards > 0 ? oOptions.iShards : std::max(1u, std::thread::hardware_concurrency()));
+
+    iShards = std::min<size_t>({iShards, vClients.size(), CLICK_RUNTIME_MAX_SHARDS});
+
+    // every shard owns its connections, so none are shared between threads
+    oOptions.oShare.bShareConnections = true;
+
+    for (size_t i = 0; i < iShards; i++) {
+        vShards.push_back(std::make_unique<ClickRuntimeShard>((unsigned int)i, oOptions.iQueueCapacity, oOptions.oShare));
+        vShards[i]->tNextStart = std::chrono::steady_clock::now();
+    }
+
+    for (size_t i = 0; i < vClients.size(); i++) {
+        ClickRuntimeShard &oShard = *vShards[i % iShards];
+
+        vClients[i]->SetShare(&oShard.oShare);
+        oShard.vSlots.emplace_back();
+        oShard.vSlots.back().pSms = std::move(vClients[i]);
+    }
+
+    if (oOptions.dRatePerSec > 0)
+        tInterval = std::chrono::nanoseconds((long long)(1e9 * iShards / oOptions.dRatePerSec));
+
+    // all shards exist before any thread may steal from them
+    for (std::unique_ptr<ClickRuntimeShard> &pShard : vShards)
+        pShard->thrShard = std::thread(&ClickCoreRuntime::LocalThread, this, std::ref(*pShard));
+}
+
+/*
+ * Function:  ~ClickCoreRuntime
+ * Info:      Destructor. Cancels queued messages and sends in progress (their completion
+ *            functions are called with CLICK_SEND_CANCELLED) and stops the shard threads.
+ *            A message that a racing Submit() queued after its shard's last drain is
+ *            cancelled here, on the destroying thread.
+ */
+ClickCoreRuntime::~ClickCoreRuntime()
+{
+    bStop.store(true, std::memory_order_release);
+
+    for (std::unique_ptr<ClickRuntimeShard> &pShard : vShards)
+        pShard->oLoop.Wakeup();
+
+    for (std::unique_ptr<ClickRuntimeShard> &pShard : vShards)
+        pShard->thrShard.join();
+
+    // a Submit() that passed the stop check may have pushed after the shard stopped draining
+    ClickTimePoint tNow = std::chrono::steady_clock::now();
+
+    for (std::unique_ptr<ClickRuntimeShard> &pShard : vShards) {
+        ClickSendJob oJob;
+
+        while (pShard->oRing.TryPop(oJob)) {
+            ClickMetrics::Add(CLICK_METRIC_QUEUE_DEPTH, -1);
+            pShard->oCounters.iCancelled.fetch_add(1, std::memory_order_relaxed);
+            LocalReport(oJob, CLICK_SEND_CANCELLED, CURLE_OK, 0, std::string_view(), tNow);
+        }
+    }
+}
+
+/*
+ * Function:  ClickCoreRuntime::Submit
+ * Info:      Queues a message on a shard. Can be called from any thread, including from a
+ *            completion function; it takes no lock. The completion function is called
+ *            exactly once for an accepted message, on the thread of the shard sending it (or
+ *            of the destructor, if the message is cancelled after the shards stopped).
+ * Inputs:    sText     - message text
+ *            vMsisdns  - destinations
+ *            oOpts     - deadline and completion function (the priority is ignored)
+ *            iRouteKey - routing key, e.g. a customer ID (0: a hash of the first destination)
+ * Return:    message ID, or 0 if the message was refused (invalid, queue full or stopping)
+ */
+uint64_t ClickCoreRuntime::Submit(std::string_view sText, std::span<const std::string_view> vMsisdns,
+                                  const ClickSendOptions &oOpts, uint64_t iRouteKey)
+{
+    if (iRouteKey == 0 && !vMsisdns.empty())
+        iRouteKey = std::hash<std::string_view>()(vMsisdns[0]);
+
+    ClickRuntimeShard &oShard = *vShards[iRouteKey % vShards.size()];
+
+    if (sText.empty() || vMsisdns.empty() || bStop.load(std::memory_order_acquire)) {
+        oShard.iRefused.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+    }
+
+    ClickSendJob oJob;
+
+    oJob.iId = oShard.iNextSeq.fetch_add(1, std::memory_order_relaxed) * CLICK_RUNTIME_MAX_SHARDS + oShard.iIndex;
+    oJob.oOpts = oOpts;
+    oJob.tEnqueued = oJob.tSubmitted = std::chrono::steady_clock::now();
+    oJob.sText.assign(sText);
+    oJob.vMsisdns.assign(vMsisdns.begin(), vMsisdns.end());
+
+    uint64_t iId = oJob.iId;
+
+    if (!oShard.oRing.TryPush(std::move(oJob))) {
+        oShard.iRefused.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+    }
+
+    ClickMetrics::Add(CLICK_METRIC_QUEUE_DEPTH);
+    LocalWake(oShard);
+
+    return iId;
+}
+
+/*
+ * Function:  ClickCoreRuntime::Stats
+ * Info:      Returns a snapshot of the counters of each shard, in shard order. Queue
+ *            lengths are approximate while messages are being submitted.
+ */
+std::vector<ClickRuntimeStats> ClickCoreRuntime::Stats() const
+{
+    std::vector<ClickRuntimeStats> vStats;
+
+    for (const std::unique_ptr<ClickRuntimeShard> &pShard : vShards) {
+        const ClickRuntimeCounters &oCounters = pShard->oCounters;
+
+        vStats.push_back(ClickRuntimeStats{pShard->oRing.Size(),
+                                           oCounters.iInFlight.load(std::memory_order_relaxed),
+                                           oCounters.iSent.load(std::memory_order_relaxed),
+                                           oCounters.iStolen.load(std::memory_order_relaxed),
+                                           oCounters.iExpired.load(std::memory_order_relaxed),
+                                           oCounters.iCancelled.load(std::memory_order_relaxed),
+                                           pShard->iRefused.load(std::memory_order_relaxed)});
+    }
+
+    return vStats;
+}
@@ -0,0 +1,152 @@
+#ifndef CLICKATELL_RUNTIME_H
+#define CLICKATELL_RUNTIME_H
+
+/*
+ * clickatell_runtime.hpp
+ *
+ *  Thread-per-core sharded sender runtime for the Clickatell SMS library.
+ *
+ *  A ClickCoreRuntime splits its pool of ClickatellSms instances into shards, one thread
+ *  each, optionally pinned to consecutive cores. A shard owns everything its sends touch: a
+ *  ClickLoop (its own curl multi handle), a ClickShare (DNS cache, TLS sessions and
+ *  connection pool, used by the shard's thread only), its instances with their request
+ *  arenas, and an equal part of the total send rate. Nothing is locked on the send path.
+ *
+ *  Submit() routes a message by a hash of its routing key (the first destination by
+ *  default) and pushes it onto the shard's bounded lock-free queue (ClickRing); a full queue
+ *  refuses the message. A shard with free instances and an empty queue steals from the
+ *  queues of the other shards, so a hot routing key cannot leave the other cores idle.
+ *  Messages with the same key are sent in order unless one of them is stolen.
+ *
+ *  Compared with ClickSendEngine, there are no priority classes, scheduled messages or
+ *  cancellation by tag: the runtime is meant for high-volume traffic of one kind.
+ *
+ *      ClickCoreRuntime oRuntime(std::move(vClients), oRuntimeOpts);
+ *      uint64_t iId = oRuntime.Submit("Hello", vMsisdns, ClickSendOptions(...));
+ */
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "clickatell_sms.hpp"
+#include "clickatell_task.hpp"
+#include "clickatell_share.hpp"
+#include "clickatell_scheduler.hpp"
+#include "clickatell_ring.hpp"
+
+#define CLICK_RUNTIME_MAX_SHARDS  256  // shard index is the low byte of a message ID
+
+// runtime options
+struct ClickRuntimeOptions {
+    unsigned int iShards;          // shards (0: one per hardware thread; at most one per instance)
+    bool bPinThreads;              // pin shard i to core (iFirstCore + i) modulo the core count (Linux only)
+    unsigned int iFirstCore;       // core of shard 0
+    size_t iQueueCapacity;         // queued messages per shard beyond which Submit() refuses (rounded up to a power of two)
+    double dRatePerSec;            // sends started per second, all shards together (0: unlimited)
+    bool bWorkStealing;            // idle shards take messages queued on other shards
+    ClickShareOptions oShare;      // options of each shard's ClickShare
+
+    ClickRuntimeOptions()
+                        : iShards(0),
+                          bPinThreads(false),
+                          iFirstCore(0),
+                          iQueueCapacity(16384),
+                          dRatePerSec(0),
+                          bWorkStealing(true) {}
+};
+
+// counters of one shard
+struct ClickRuntimeStats {
+    size_t iQueued;                // messages waiting in the shard's queue
+    size_t iInFlight;              // messages being sent
+    uint64_t iSent;                // messages sent (CLICK_SEND_DONE)
+    uint64_t iStolen;              // messages this shard took from other shards' queues
+    uint64_t iExpired;             // messages dropped at their deadline
+    uint64_t iCancelled;           // messages cancelled by the destructor
+    uint64_t iRefused;             // Submit() calls refused (queue full or stopping)
+};
+
+class ClickCoreRuntime
+{
+private:
+    // one pool instance and the message it is sending
+    struct ClickRuntimeSlot {
+        std::unique_ptr<ClickatellSms> pSms;
+        std::optional<ClickTask<void>> oTask;  // send in progress
+        ClickSendJob oJob;                     // message being sent
+        ClickTimePoint tStarted;               // time the message left the queue
+        std::stop_source oStop;                // cancels the send
+    };
+
+    // counters written by one thread, read by Stats()
+    struct ClickRuntimeCounters {
+        std::atomic<size_t> iInFlight{0};
+        std::atomic<uint64_t> iSent{0};
+        std::atomic<uint64_t> iStolen{0};
+        std::atomic<uint64_t> iExpired{0};
+        std::atomic<uint64_t> iCancelled{0};
+    };
+
+    // a shard; aligned so that no two shards share a cache line
+    struct alignas(64) ClickRuntimeShard {
+        unsigned int iIndex;
+        ClickRing<ClickSendJob> oRing;         // submitted messages (any thread pushes; this and idle shards pop)
+        ClickLoop oLoop;                       // driven by thrShard
+        ClickShare oShare;                     // used by this shard's instances only
+        std::vector<ClickRuntimeSlot> vSlots;  // shard thread only
+        ClickTimePoint tNextStart;             // shard thread only: earliest start allowed by the rate
+        alignas(64) std::atomic<uint64_t> iNextSeq{1}; // producers: message sequence on this shard
+        std::atomic<uint64_t> iRefused{0};     // producers
+        std::atomic<bool> bSleeping{false};    // the shard thread is waiting with nothing to do
+        alignas(64) ClickRuntimeCounters oCounters;
+        std::thread thrShard;
+
+        ClickRuntimeShard(unsigned int iIndex_, size_t iCapacity, const ClickShareOptions &oShareOpts)
+                          : iIndex(iIndex_),
+                            oRing(iCapacity),
+                            oShare(oShareOpts) {}
+    };
+
+    ClickRuntimeOptions oOptions;
+    uint64_t iCorrelationPrefix;           // high half of the correlation IDs (see clickatell_trace.hpp)
+    std::vector<std::unique_ptr<ClickRuntimeShard>> vShards;
+    std::chrono::nanoseconds tInterval;    // least spacing of sends on one shard (0: unlimited)
+    std::atomic<bool> bStop;
+
+    ClickTask<void> LocalSend(ClickRuntimeShard &oShard, ClickRuntimeSlot &oSlot);
+    void LocalReport(const ClickSendJob &oJob, eClickSendStatus eStatus, CURLcode curlCode, long iHttpStatus,
+                     std::string_view sResponse, ClickTimePoint tLeftQueue);
+    bool LocalNext(ClickRuntimeShard &oShard, ClickSendJob &oJob);
+    void LocalWake(ClickRuntimeShard &oShard);
+    void LocalPin(ClickRuntimeShard &oShard);
+    void LocalThread(ClickRuntimeShard &oShard);
+
+public:
+    // takes ownership of the pool, shared out round-robin (throws a std::string if it is empty)
+    ClickCoreRuntime(std::vector<std::unique_ptr<ClickatellSms>> vClients,
+                     const ClickRuntimeOptions &oOptions_ = ClickRuntimeOptions());
+    ~ClickCoreRuntime();
+
+    ClickCoreRuntime(const ClickCoreRuntime &) = delete;
+    ClickCoreRuntime &operator=(const ClickCoreRuntime &) = delete;
+
+    /* Queues a message on the shard chosen by iRouteKey (0: a hash of the first destination);
+     * returns its ID, or 0 if it was refused (any thread). The priority of oOpts is ignored;
+     * its deadline, completion and per-recipient functions apply as with ClickSendEngine,
+     * and are called on the thread of the shard that sends the message.
+     */
+    uint64_t Submit(std::string_view sText, std::span<const std::string_view> vMsisdns,
+                    const ClickSendOptions &oOpts = ClickSendOptions(), uint64_t iRouteKey = 0);
+
+    size_t Shards() const { return vShards.size(); }
+    // counters of each shard (any thread)
+    std::vector<ClickRuntimeStats> Stats() const;
+};
+
+#endif // CLICKATELL_RUNTIME_H
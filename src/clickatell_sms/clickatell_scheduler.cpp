@@ -0,0 +1,208 @@
+/*
+ * clickatell_scheduler.cpp
+ *
+ *  Priority- and deadline-aware queue of outbound messages.
+ *
+ *  Each class is a binary heap ordered by (deadline, arrival). Expired messages are
+ *  therefore always at the top of their heap, so dropping them never scans the queue.
+ *  Aging looks at the message of each class that has waited longest, which need not be at
+ *  the top of the heap (a message with a late deadline can sit below newer ones), so each
+ *  class also keeps its messages' arrival times in order: the oldest one's wait decides
+ *  the class the top message competes in.
+ */
+
+#include <algorithm>
+
+#include "clickatell_scheduler.hpp"
+
+/* ----------------------------------------------------------------------------- *
+ * Private function definitions                                                  *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickScheduler::LocalLater
+ * Info:      Heap ordering: true if oLeft should leave after oRight.
+ */
+bool ClickScheduler::LocalLater(const ClickSendJob &oLeft, const ClickSendJob &oRight)
+{
+    if (oLeft.oOpts.tDeadline != oRight.oOpts.tDeadline)
+        return oLeft.oOpts.tDeadline > oRight.oOpts.tDeadline;
+
+    return oLeft.iSeq > oRight.iSeq;
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Public function definitions                                                   *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickScheduler
+ * Info:      Constructor.
+ * Inputs:    iAgingMs - wait after which a message competes one class higher (0: no aging)
+ */
+ClickScheduler::ClickScheduler(unsigned int iAgingMs)
+                               : tAging(iAgingMs),
+                                 iNextSeq(0)
+{
+}
+
+/*
+ * Function:  ClickScheduler::Push
+ * Info:      Queues a message in its priority class.
+ * Inputs:    oJob - message (its iSeq is assigned here)
+ * Return:    void
+ */
+void ClickScheduler::Push(ClickSendJob &&oJob)
+{
+    std::vector<ClickSendJob> &vQueue = vQueues[oJob.oOpts.ePriority];
+
+    oJob.iSeq = iNextSeq++;
+    sArrivals[oJob.oOpts.ePriority].emplace(oJob.tEnqueued, oJob.iSeq);
+    vQueue.push_back(std::move(oJob));
+    std::push_heap(vQueue.begin(), vQueue.end(), LocalLater);
+}
+
+/*
+ * Function:  ClickScheduler::Pop
+ * Info:      Takes the next message to send. Each class offers its earliest-deadline
+ *            message; the offer from the highest class wins, where a class whose oldest
+ *            message has waited n * iAgingMs competes n classes higher. Ties go to the
+ *            message of the higher own class. Expired messages should have been dropped
+ *            first (DropExpired()).
+ * Inputs:    tNow      - current time
+ *            bHighOnly - only CLICK_PRIORITY_HIGH messages may be taken (reserved capacity)
+ * Outputs:   oJob      - the message
+ * Return:    true if a message was taken
+ */
+bool ClickScheduler::Pop(ClickTimePoint tNow, bool bHighOnly, ClickSendJob &oJob)
+{
+    int iBest = -1;
+    long long iBestRank = 0;
+
+    for (int i = 0; i < (bHighOnly ? 1 : (int)CLICK_PRIORITY_COUNT); i++) {
+        if (vQueues[i].empty())
+            continue;
+
+        long long iRank = i;
+
+        if (tAging.count() > 0)
+            iRank -= std::chrono::duration_cast<std::chrono::milliseconds>(tNow - sArrivals[i].begin()->first) / tAging;
+
+        if (iBest < 0 || iRank < iBestRank) {
+            iBest = i;
+            iBestRank = iRank;
+        }
+    }
+
+    if (iBest < 0)
+        return false;
+
+    std::vector<ClickSendJob> &vQueue = vQueues[iBest];
+
+    std::pop_heap(vQueue.begin(), vQueue.end(), LocalLater);
+    oJob = std::move(vQueue.back());
+    vQueue.pop_back();
+    LocalForget(oJob);
+
+    return true;
+}
+
+/*
+ * Function:  ClickScheduler::DropExpired
+ * Info:      Removes every message whose deadline has passed.
+ * Inputs:    tNow     - current time
+ * Outputs:   vExpired - removed messages are appended here
+ * Return:    number of messages removed
+ */
+size_t ClickScheduler::DropExpired(ClickTimePoint tNow, std::vector<ClickSendJob> &vExpired)
+{
+    size_t iDropped = 0;
+
+    for (std::vector<ClickSendJob> &vQueue : vQueues) {
+        while (!vQueue.empty() && vQueue.front().oOpts.tDeadline <= tNow) {
+            std::pop_heap(vQueue.begin(), vQueue.end(), LocalLater);
+            LocalForget(vQueue.back());
+            vExpired.push_back(std::move(vQueue.back()));
+            vQueue.pop_back();
+            iDropped++;
+        }
+    }
+
+    return iDropped;
+}
+
+/*
+ * Function:  ClickScheduler::Evict
+ * Info:      Makes room for a message of class ePriority: removes the message that would
+ *            leave first from the lowest non-empty class, unless every queued message is
+ *            of a higher class than ePriority.
+ * Inputs:    ePriority - class of the message that needs the room
+ * Outputs:   oJob      - the removed message
+ * Return:    true if a message was removed
+ */
+bool ClickScheduler::Evict(eClickPriority ePriority, ClickSendJob &oJob)
+{
+    for (int i = CLICK_PRIORITY_COUNT - 1; i >= (int)ePriority; i--) {
+        std::vector<ClickSendJob> &vQueue = vQueues[i];
+
+        if (vQueue.empty())
+            continue;
+
+        std::pop_heap(vQueue.begin(), vQueue.end(), LocalLater);
+        oJob = std::move(vQueue.back());
+        vQueue.pop_back();
+        LocalForget(oJob);
+
+        return true;
+    }
+
+    return false;
+}
+
+/*
+ * Function:  ClickScheduler::Clear
+ * Info:      Removes every queued message.
+ * Outputs:   vRemoved - removed messages are appended here
+ * Return:    void
+ */
+void ClickScheduler::Clear(std::vector<ClickSendJob> &vRemoved)
+{
+    for (std::vector<ClickSendJob> &vQueue : vQueues) {
+        for (ClickSendJob &oJob : vQueue)
+            vRemoved.push_back(std::move(oJob));
+        vQueue.clear();
+    }
+
+    for (std::set<std::pair<ClickTimePoint, uint64_t>> &sArrival : sArrivals)
+        sArrival.clear();
+}
+
+/*
+ * Function:  ClickScheduler::NextDeadline
+ * Info:      Returns the earliest deadline of any queued message (max() if none).
+ */
+ClickTimePoint ClickScheduler::NextDeadline() const
+{
+    ClickTimePoint tNext = ClickTimePoint::max();
+
+    for (const std::vector<ClickSendJob> &vQueue : vQueues) {
+        if (!vQueue.empty())
+            tNext = std::min(tNext, vQueue.front().oOpts.tDeadline);
+    }
+
+    return tNext;
+}
+
+/*
+ * Function:  ClickScheduler::Size
+ * Info:      Returns the number of queued messages.
+ */
+size_t ClickScheduler::Size() const
+{
+    size_t iSize = 0;
+
+    for (const std::vector<ClickSendJob> &vQueue : vQueues)
+        iSize += vQueue.size();
+
+    return iSize;
+}
@@ -0,0 +1,145 @@
+#ifndef CLICKATELL_SCHEDULER_H
+#define CLICKATELL_SCHEDULER_H
+
+/*
+ * clickatell_scheduler.hpp
+ *
+ *  Priority- and deadline-aware queue of outbound messages.
+ *
+ *  Messages are queued per priority class. Within a class they leave earliest deadline
+ *  first (messages without a deadline leave in arrival order, after those with one). A
+ *  message that has waited iAgingMs is treated as one class higher, and so on, so a busy
+ *  high-priority class cannot starve the classes below it. Messages whose deadline has
+ *  passed are dropped before they are handed out.
+ *
+ *  The scheduler is not thread-safe; ClickSendEngine guards it with its own lock.
+ */
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <set>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "clickatell_api.hpp"
+#include "clickatell_parser.hpp"
+#include "clickatell_trace.hpp"
+
+// message priority classes (highest first)
+enum eClickPriority {
+    CLICK_PRIORITY_HIGH,    // time-critical traffic, e.g. OTP codes
+    CLICK_PRIORITY_NORMAL,  // transactional traffic
+    CLICK_PRIORITY_LOW,     // bulk/marketing traffic
+    CLICK_PRIORITY_COUNT
+};
+
+// final state of a submitted message
+enum eClickSendStatus {
+    CLICK_SEND_DONE,       // the request was sent (see the cURL/HTTP result for its outcome)
+    CLICK_SEND_EXPIRED,    // the deadline passed before the message could be sent
+    CLICK_SEND_CANCELLED,  // cancelled before completion (engine shut down or ClickSendEngine::Cancel())
+    CLICK_SEND_DROPPED,    // dropped from a full queue to make room (ClickEngineOptions::bDropLowest)
+    CLICK_SEND_COUNT
+};
+
+// result of a submitted message, passed to its completion function
+struct ClickSendResult {
+    uint64_t iId;                       // ID returned by Submit()
+    eClickPriority ePriority;           // priority class
+    eClickSendStatus eStatus;           // final state
+    CURLcode curlCode;                  // cURL result (CURLE_OK if never sent)
+    long iHttpStatus;                   // HTTP status (0 if never sent)
+    std::string_view sResponse;         // gateway response (valid during the callback only)
+    std::chrono::microseconds tQueued;  // time spent waiting in the queue
+    ClickTraceId oTrace;                // correlation ID (the trace ID if the message was traced)
+};
+
+// called once per submitted message, on the engine thread
+typedef void (*ClickSendDoneFn)(void *pUserData, const ClickSendResult &oResult);
+
+// per-message options
+struct ClickSendOptions {
+    eClickPriority ePriority;  // priority class
+    ClickTimePoint tDeadline;  // the message is dropped if it cannot be sent by then
+    ClickSendDoneFn fnDone;    // completion function (may be NULL)
+    void *pUserData;           // passed to fnDone and fnRecipient
+    ClickRecipientFn fnRecipient; // per-recipient results as the response arrives, before fnDone (may be NULL)
+    ClickTraceId oTrace;       // ClickSendResult::oTrace of an earlier attempt to join (zero: the engine's tracer samples)
+    uint64_t iTag;             // campaign tag, for ClickSendEngine::Cancel() (0: none)
+
+    ClickSendOptions(eClickPriority ePriority_ = CLICK_PRIORITY_NORMAL, ClickTimePoint tDeadline_ = ClickTimePoint::max(),
+                     ClickSendDoneFn fnDone_ = NULL, void *pUserData_ = NULL, ClickRecipientFn fnRecipient_ = NULL)
+                     : ePriority(ePriority_),
+                       tDeadline(tDeadline_),
+                       fnDone(fnDone_),
+                       pUserData(pUserData_),
+                       fnRecipient(fnRecipient_),
+                       iTag(0) {}
+};
+
+// a queued message
+struct ClickSendJob {
+    uint64_t iId;                       // message ID
+    uint64_t iSeq;                      // arrival order (tie-breaker)
+    ClickSendOptions oOpts;             // options given to Submit()
+    ClickTimePoint tEnqueued;           // arrival time
+    ClickTimePoint tSubmitted;          // time of Submit()/SubmitAt() (traced messages)
+    uint64_t iRootSpan;                 // span ID of this attempt's "message" or "retry" span (traced messages)
+    std::chrono::nanoseconds tLimitMark;// engine's limited-dispatch time at arrival (traced messages)
+    ClickWallTime tScheduled;           // gateway-side delivery time (epoch: at once)
+    std::string sText;                  // message text
+    std::vector<std::string> vMsisdns;  // destinations
+};
+
+class ClickScheduler
+{
+private:
+    std::vector<ClickSendJob> vQueues[CLICK_PRIORITY_COUNT]; // one deadline-ordered heap per class
+    std::set<std::pair<ClickTimePoint, uint64_t>> sArrivals[CLICK_PRIORITY_COUNT]; // (arrival, seq) per class, oldest first
+    std::chrono::milliseconds tAging;                        // wait that raises a message one class
+    uint64_t iNextSeq;
+
+    static bool LocalLater(const ClickSendJob &oLeft, const ClickSendJob &oRight);
+    void LocalForget(const ClickSendJob &oJob) { sArrivals[oJob.oOpts.ePriority].erase({oJob.tEnqueued, oJob.iSeq}); }
+
+public:
+    ClickScheduler(unsigned int iAgingMs = 2000);
+
+    void Push(ClickSendJob &&oJob);
+    bool Pop(ClickTimePoint tNow, bool bHighOnly, ClickSendJob &oJob);
+    size_t DropExpired(ClickTimePoint tNow, std::vector<ClickSendJob> &vExpired);
+    bool Evict(eClickPriority ePriority, ClickSendJob &oJob);
+    void Clear(std::vector<ClickSendJob> &vRemoved);
+
+    // removes the messages for which fnMatch(job) is true, appending them to vRemoved
+    template <typename Pred>
+    size_t RemoveIf(Pred fnMatch, std::vector<ClickSendJob> &vRemoved)
+    {
+        size_t iRemoved = 0;
+
+        for (std::vector<ClickSendJob> &vQueue : vQueues) {
+            std::vector<ClickSendJob>::iterator itKeep = std::partition(vQueue.begin(), vQueue.end(),
+                                                                        [&](const ClickSendJob &oJob) { return !fnMatch(oJob); });
+
+            if (itKeep == vQueue.end())
+                continue;
+
+            iRemoved += vQueue.end() - itKeep;
+            std::for_each(itKeep, vQueue.end(), [this](const ClickSendJob &oJob) { LocalForget(oJob); });
+            std::move(itKeep, vQueue.end(), std::back_inserter(vRemoved));
+            vQueue.erase(itKeep, vQueue.end());
+            std::make_heap(vQueue.begin(), vQueue.end(), LocalLater);
+        }
+
+        return iRemoved;
+    }
+
+    ClickTimePoint NextDeadline() const;
+    size_t Size() const;
+    size_t Size(eClickPriority ePriority) const { return vQueues[ePriority].size(); }
+};
+
+#endif // CLICKATELL_SCHEDULER_H
@@ -0,0 +1,517 @@
+/*
+ * clickatell_shard.cpp
+ *
+ *  Multi-account sharded client for the Clickatell SMS library.
+ *
+ *  Account selection, rate limiting and cool-down bookkeeping happen under one mutex; the
+ *  request itself runs outside it on a ClickatellSms instance borrowed from the chosen
+ *  account. Only account-level refusals (authentication/throttling) are retried on another
+ *  account: after a transport error the gateway may already have accepted the message, so
+ *  the error is returned to the caller rather than risking a duplicate send.
+ */
+
+#include <string>
+#include <vector>
+
+#include <ctype.h>
+
+#include "clickatell_shard.hpp"
+#include "clickatell_metrics.hpp"
+
+/* ----------------------------------------------------------------------------- *
+ * Types/Macros                                                                  *
+ * ----------------------------------------------------------------------------- */
+
+// gateway error codes that take an account out of rotation
+static const int iLocalAuthCodes[] = {1,    // authentication failed
+                                      2,    // unknown username or password
+                                      3,    // session ID expired
+                                      4,    // account frozen
+                                      5,    // missing session ID
+                                      7,    // IP lockdown violation
+                                      108,  // invalid or missing API ID
+                                      301,  // no credit left
+                                      302}; // max allowed credit
+static const int iLocalThrottleCodes[] = {130}; // maximum MT limit exceeded
+
+/* ----------------------------------------------------------------------------- *
+ * Private function definitions                                                  *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  LocalErrorCode
+ * Info:      Extracts the gateway error code from a response that reports a request-level
+ *            error: "ERR: 001, ..." for the HTTP API, {"error":{"code":"001",...}} for REST.
+ *            Per-recipient errors inside an otherwise accepted request are not reported.
+ * Inputs:    eApiType  - API type of the response
+ *            sResponse - Clickatell response
+ * Return:    error code, or -1 if the response does not start with an error
+ */
+static int LocalErrorCode(eClickApi eApiType, std::string_view sResponse)
+{
+    size_t i = 0;
+    int iCode = 0;
+
+    while (i < sResponse.size() && isspace((unsigned char)sResponse[i]))
+        i++;
+    sResponse.remove_prefix(i);
+
+    if (eApiType == CLICK_API_HTTP) {
+        if (sResponse.substr(0, 4) != "ERR:")
+            return -1;
+        i = 4;
+    }
+    else {
+        // top-level error object only
+        if (sResponse.empty() || sResponse[0] != '{')
+            return -1;
+        for (i = 1; i < sResponse.size() && isspace((unsigned char)sResponse[i]); i++);
+        if (sResponse.substr(i, 7) != "\"error\"")
+            return -1;
+        if ((i = sResponse.find("\"code\"", i)) == std::string_view::npos)
+            return -1;
+        i += 6;
+    }
+
+    while (i < sResponse.size() && (isspace((unsigned char)sResponse[i]) || sResponse[i] == ':' || sResponse[i] == '"'))
+        i++;
+
+    if (i >= sResponse.size() || !isdigit((unsigned char)sResponse[i]))
+        return -1;
+
+    for (; i < sResponse.size() && isdigit((unsigned char)sResponse[i]) && iCode < 100000; i++)
+        iCode = iCode * 10 + (sResponse[i] - '0');
+
+    return iCode;
+}
+
+/*
+ * Function:  LocalDispatch
+ * Info:      Runs one blocking API operation on a ClickatellSms instance.
+ * Return:    Clickatell response
+ */
+static const std::string &LocalDispatch(ClickatellSms &oSms, eClickOperation eOp, std::string_view sArg,
+                                        std::span<const std::string_view> vMsisdns)
+{
+    switch (eOp) {
+        case CLICK_OP_SEND:
+            return oSms.SmsMessageSend(sArg, vMsisdns);
+        case CLICK_OP_STATUS:
+            return oSms.SmsStatusGet(sArg);
+        case CLICK_OP_BALANCE:
+            return oSms.SmsBalanceGet();
+        case CLICK_OP_CHARGE:
+            return oSms.SmsChargeGet(sArg);
+        case CLICK_OP_COVERAGE:
+            return oSms.SmsCoverageGet(sArg);
+        case CLICK_OP_STOP:
+        default:
+            return oSms.SmsMessageStop(sArg);
+    }
+}
+
+/*
+ * Function:  ClickShardAccount
+ * Info:      Constructor. Normalizes the account's weight and token bucket settings.
+ */
+ClickShardedClient::ClickShardAccount::ClickShardAccount(const ClickAccountConfig &oConfig_)
+                                                         : oConfig(oConfig_),
+                                                           iCreated(0),
+                                                           iInFlight(0),
+                                                           iCurrentWeight(0),
+                                                           dTokens(0),
+                                                           tRefill(std::chrono::steady_clock::now()),
+                                                           tCooldown(),
+                                                           bAuthDown(false),
+                                                           oStats()
+{
+    if (oConfig.iWeight == 0)
+        oConfig.iWeight = 1;
+    if (oConfig.iMaxInFlight == 0)
+        oConfig.iMaxInFlight = 1;
+    if (oConfig.dRatePerSec > 0 && oConfig.iBurst == 0)
+        oConfig.iBurst = (oConfig.dRatePerSec < 1 ? 1 : (unsigned int)oConfig.dRatePerSec);
+
+    dTokens = oConfig.iBurst;
+    oStats.bAvailable = true;
+}
+
+/*
+ * Function:  ClickShardedClient::LocalCreate
+ * Info:      Creates a ClickatellSms instance for an account. Throws a std::string if the
+ *            account's credentials are invalid.
+ * Return:    new instance
+ */
+std::unique_ptr<ClickatellSms> ClickShardedClient::LocalCreate(const ClickAccountConfig &oConfig) const
+{
+    if (oConfig.eApiType == CLICK_API_HTTP)
+        return std::make_unique<ClickatellSms>(oOptions.eDebugOpt, oConfig.eApiType, oConfig.sUsername, oConfig.sPassword,
+                                               oConfig.sApiId, oOptions.iTimeout, oOptions.iConnectTimeout);
+
+    return std::make_unique<ClickatellSms>(oOptions.eDebugOpt, oConfig.eApiType, oConfig.sApiKey, oConfig.sApiId,
+                                           oOptions.iTimeout, oOptions.iConnectTimeout);
+}
+
+/*
+ * Function:  ClickShardedClient::LocalEligible
+ * Info:      Checks whether an account can take a request now (called with mtxState held).
+ *            Refills the account's token bucket as a side effect.
+ * Inputs:    oAccount - account to check
+ *            tNow     - current time
+ * Outputs:   tRetry   - lowered to the time the account may become eligible, if known
+ * Return:    0 if eligible, 1 if worth waiting for, 2 if out of rotation for authentication
+ */
+int ClickShardedClient::LocalEligible(ClickShardAccount &oAccount, ClickTimePoint tNow, ClickTimePoint &tRetry)
+{
+    if (tNow < oAccount.tCooldown) {
+        if (oAccount.bAuthDown)
+            return 2;
+        tRetry = std::min(tRetry, oAccount.tCooldown);
+        return 1;
+    }
+
+    oAccount.bAuthDown = false;
+    oAccount.oStats.bAvailable = true;
+
+    if (oAccount.iInFlight >= oAccount.oConfig.iMaxInFlight)
+        return 1; // woken by LocalRelease()
+
+    if (oAccount.oConfig.dRatePerSec > 0) {
+        double dElapsed = std::chrono::duration<double>(tNow - oAccount.tRefill).count();
+
+        oAccount.dTokens = std::min((double)oAccount.oConfig.iBurst, oAccount.dTokens + dElapsed * oAccount.oConfig.dRatePerSec);
+        oAccount.tRefill = tNow;
+
+        if (oAccount.dTokens < 1.0) {
+            std::chrono::duration<double> tWait((1.0 - oAccount.dTokens) / oAccount.oConfig.dRatePerSec);
+            tRetry = std::min(tRetry, tNow + std::chrono::duration_cast<std::chrono::steady_clock::duration>(tWait));
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Function:  ClickShardedClient::LocalAcquire
+ * Info:      Chooses an account by the configured balancing strategy and borrows one of its
+ *            instances, waiting (up to tDeadline) for rate limit tokens, throttling
+ *            cool-downs and busy instances.
+ * Inputs:    iFixed    - account to use, or iAnyAccount
+ *            tDeadline - latest time to wait until
+ *            vTried    - accounts already tried for this request (skipped)
+ * Outputs:   iAccount  - chosen account
+ * Return:    borrowed instance, or NULL if no account could take the request
+ */
+std::unique_ptr<ClickatellSms> ClickShardedClient::LocalAcquire(size_t iFixed, ClickTimePoint tDeadline,
+                                                                std::vector<bool> &vTried, size_t &iAccount)
+{
+    std::unique_lock<std::mutex> oLock(mtxState);
+
+    for (;;) {
+        ClickTimePoint tNow = std::chrono::steady_clock::now();
+        ClickTimePoint tRetry = ClickTimePoint::max();
+        long long iTotalWeight = 0;
+        bool bWaitable = false;
+        size_t iBest = iAnyAccount;
+
+        for (size_t i = 0; i < vAccounts.size(); i++) {
+            if ((iFixed != iAnyAccount && i != iFixed) || vTried[i])
+                continue;
+
+            ClickShardAccount &oAccount = vAccounts[i];
+            int iState = LocalEligible(oAccount, tNow, tRetry);
+
+            if (iState != 0) {
+                bWaitable |= (iState == 1);
+                continue;
+            }
+
+            if (oOptions.eBalance == CLICK_BALANCE_WEIGHTED_RR) {
+                // smooth weighted round-robin over the eligible accounts
+                oAccount.iCurrentWeight += oAccount.oConfig.iWeight;
+                iTotalWeight += oAccount.oConfig.iWeight;
+
+                if (iBest == iAnyAccount || oAccount.iCurrentWeight > vAccounts[iBest].iCurrentWeight)
+                    iBest = i;
+            }
+            else {
+                // lowest (in-flight + 1) / weight
+                if (iBest == iAnyAccount ||
+                    (unsigned long long)(oAccount.iInFlight + 1) * vAccounts[iBest].oConfig.iWeight <
+                    (unsigned long long)(vAccounts[iBest].iInFlight + 1) * oAccount.oConfig.iWeight)
+                    iBest = i;
+            }
+        }
+
+        if (iBest != iAnyAccount) {
+            ClickShardAccount &oAccount = vAccounts[iBest];
+            std::unique_ptr<ClickatellSms> pSms;
+
+            oAccount.iCurrentWeight -= iTotalWeight;
+            if (oAccount.oConfig.dRatePerSec > 0)
+                oAccount.dTokens -= 1.0;
+            oAccount.iInFlight++;
+            oAccount.oStats.iRequests++;
+            iAccount = iBest;
+
+            if (!oAccount.vIdle.empty()) {
+                pSms = std::move(oAccount.vIdle.back());
+                oAccount.vIdle.pop_back();
+                return pSms;
+            }
+
+            // grow the account's pool outside the lock
+            oAccount.iCreated++;
+            oLock.unlock();
+
+            try {
+                pSms = LocalCreate(oAccount.oConfig);
+            }
+            catch (...) {
+                oLock.lock();
+                oAccount.iCreated--;
+                oAccount.iInFlight--;
+                cvState.notify_all();
+                throw;
+            }
+
+            return pSms;
+        }
+
+        if (!bWaitable || tNow >= tDeadline)
+            return NULL;
+
+        cvState.wait_until(oLock, std::min(tRetry, tDeadline));
+    }
+}
+
+/*
+ * Function:  ClickShardedClient::LocalRelease
+ * Info:      Returns a borrowed instance and applies the outcome to the account: an
+ *            authentication or throttling result starts the account's cool-down.
+ * Inputs:    iAccount - account the instance belongs to
+ *            pSms     - borrowed instance
+ *            eResult  - outcome of the request
+ * Return:    void
+ */
+void ClickShardedClient::LocalRelease(size_t iAccount, std::unique_ptr<ClickatellSms> pSms, eClickResult eResult)
+{
+    std::lock_guard<std::mutex> oLock(mtxState);
+    ClickShardAccount &oAccount = vAccounts[iAccount];
+    ClickTimePoint tNow = std::chrono::steady_clock::now();
+
+    oAccount.vIdle.push_back(std::move(pSms));
+    oAccount.iInFlight--;
+
+    switch (eResult) {
+        case CLICK_RESULT_AUTH:
+            oAccount.tCooldown = tNow + std::chrono::milliseconds(oOptions.iAuthCooldownMs);
+            oAccount.bAuthDown = true;
+            oAccount.oStats.bAvailable = false;
+            oAccount.oStats.iAuthErrors++;
+            break;
+        case CLICK_RESULT_THROTTLED:
+            oAccount.tCooldown = std::max(oAccount.tCooldown, tNow + std::chrono::milliseconds(oOptions.iThrottleCooldownMs));
+            oAccount.oStats.bAvailable = false;
+            oAccount.oStats.iThrottled++;
+            break;
+        case CLICK_RESULT_TRANSPORT:
+            oAccount.oStats.iTransportErrors++;
+            break;
+        default:
+            break;
+    }
+
+    cvState.notify_all();
+}
+
+/*
+ * Function:  ClickShardedClient::LocalExecute
+ * Info:      Runs one API operation, failing over to another account on authentication or
+ *            throttling refusals until every eligible account has been tried.
+ * Inputs:    iFixed    - account to use, or iAnyAccount
+ *            eOp       - API operation
+ *            sArg      - operation argument (see ClickatellSms::LocalRequestBuild())
+ *            vMsisdns  - destinations (send only)
+ *            tDeadline - latest time to wait for an account
+ * Return:    result of the last attempt (CLICK_RESULT_UNAVAILABLE if none was made)
+ */
+ClickShardResult ClickShardedClient::LocalExecute(size_t iFixed, eClickOperation eOp, std::string_view sArg,
+                                                  std::span<const std::string_view> vMsisdns, ClickTimePoint tDeadline)
+{
+    ClickShardResult oResult;
+    std::vector<bool> vTried(vAccounts.size(), false);
+
+    if ((eOp != CLICK_OP_BALANCE && sArg.empty()) || (eOp == CLICK_OP_SEND && vMsisdns.empty()) ||
+        (iFixed != iAnyAccount && iFixed >= vAccounts.size())) {
+        oResult.eResult = CLICK_RESULT_REJECTED;
+        return oResult;
+    }
+
+    for (;;) {
+        size_t iAccount = 0;
+        std::unique_ptr<ClickatellSms> pSms = LocalAcquire(iFixed, tDeadline, vTried, iAccount);
+
+        if (!pSms)
+            return oResult;
+
+        oResult.sResponse.assign(LocalDispatch(*pSms, eOp, sArg, vMsisdns));
+        oResult.curlCode = pSms->GetCurlCode();
+        oResult.iHttpStatus = pSms->GetHttpStatus();
+        oResult.iAccount = iAccount;
+        oResult.iAttempts++;
+        oResult.eResult = Classify(vAccounts[iAccount].oConfig.eApiType, oResult.curlCode, oResult.iHttpStatus, oResult.sResponse);
+
+        if (oResult.iAttempts > 1)
+            ClickMetrics::Add(CLICK_METRIC_RETRIES);
+
+        // the client counted HTTP 429 itself; throttling error codes are only recognised here
+        if (oResult.eResult == CLICK_RESULT_THROTTLED && oResult.iHttpStatus != 429)
+            ClickMetrics::Add(CLICK_METRIC_THROTTLES);
+
+        LocalRelease(iAccount, std::move(pSms), oResult.eResult);
+
+        if (oResult.eResult != CLICK_RESULT_AUTH && oResult.eResult != CLICK_RESULT_THROTTLED)
+            return oResult;
+
+        vTried[iAccount] = true;
+    }
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Public function definitions                                                   *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickShardedClient
+ * Info:      Constructor. Creates the first instance of every account, so that invalid
+ *            credentials are reported here (as a thrown std::string) rather than on first use.
+ * Inputs:    vConfigs - accounts to shard across (at least one)
+ *            oOptions_ - balancing, timeout and cool-down options
+ */
+ClickShardedClient::ClickShardedClient(const std::vector<ClickAccountConfig> &vConfigs, const ClickShardOptions &oOptions_)
+                                       : oOptions(oOptions_)
+{
+    if (vConfigs.empty())
+        throw (std::string("ClickShardedClient requires at least one account!"));
+
+    vAccounts.reserve(vConfigs.size());
+
+    for (const ClickAccountConfig &oConfig : vConfigs) {
+        vAccounts.emplace_back(oConfig);
+        vAccounts.back().vIdle.push_back(LocalCreate(vAccounts.back().oConfig));
+        vAccounts.back().iCreated = 1;
+    }
+}
+
+/*
+ * Function:  ~ClickShardedClient
+ * Info:      Destructor. All requests must have returned.
+ */
+ClickShardedClient::~ClickShardedClient()
+{
+}
+
+/*
+ * Function:  SmsMessageSend
+ * Info:      Sends SMSes through the next account chosen by the balancing strategy.
+ * Inputs:    sText     - message text
+ *            vMsisdns  - destination numbers
+ *            tDeadline - latest time to wait for an account
+ * Return:    result, including the account that sent the message
+ */
+ClickShardResult ClickShardedClient::SmsMessageSend(std::string_view sText, std::span<const std::string_view> vMsisdns,
+                                                    ClickTimePoint tDeadline)
+{
+    return LocalExecute(iAnyAccount, CLICK_OP_SEND, sText, vMsisdns, tDeadline);
+}
+
+ClickShardResult ClickShardedClient::SmsCoverageGet(std::string_view sMsisdn, ClickTimePoint tDeadline)
+{
+    return LocalExecute(iAnyAccount, CLICK_OP_COVERAGE, sMsisdn, {}, tDeadline);
+}
+
+ClickShardResult ClickShardedClient::SmsStatusGet(size_t iAccount, std::string_view sMsgId, ClickTimePoint tDeadline)
+{
+    return LocalExecute(iAccount, CLICK_OP_STATUS, sMsgId, {}, tDeadline);
+}
+
+ClickShardResult ClickShardedClient::SmsChargeGet(size_t iAccount, std::string_view sMsgId, ClickTimePoint tDeadline)
+{
+    return LocalExecute(iAccount, CLICK_OP_CHARGE, sMsgId, {}, tDeadline);
+}
+
+ClickShardResult ClickShardedClient::SmsMessageStop(size_t iAccount, std::string_view sMsgId, ClickTimePoint tDeadline)
+{
+    return LocalExecute(iAccount, CLICK_OP_STOP, sMsgId, {}, tDeadline);
+}
+
+ClickShardResult ClickShardedClient::SmsBalanceGet(size_t iAccount, ClickTimePoint tDeadline)
+{
+    return LocalExecute(iAccount, CLICK_OP_BALANCE, std::string_view(), {}, tDeadline);
+}
+
+/*
+ * Function:  AccountStats
+ * Info:      Returns a snapshot of an account's counters.
+ * Inputs:    iAccount - account index (as in the constructor's vConfigs)
+ * Return:    counters
+ */
+ClickAccountStats ClickShardedClient::AccountStats(size_t iAccount)
+{
+    std::lock_guard<std::mutex> oLock(mtxState);
+    ClickAccountStats oStats = vAccounts.at(iAccount).oStats;
+
+    oStats.iInFlight = vAccounts[iAccount].iInFlight;
+
+    return oStats;
+}
+
+/*
+ * Function:  Classify
+ * Info:      Classifies the outcome of a request for failover purposes.
+ *            HTTP status 401/403 and gateway errors 001-007, 108, 301, 302 are account
+ *            refusals; HTTP status 429 and gateway error 130 are throttling.
+ * Inputs:    eApiType    - API type of the account
+ *            curlCode    - cURL result
+ *            iHttpStatus - HTTP status
+ *            sResponse   - Clickatell response
+ * Return:    classification
+ */
+eClickResult ClickShardedClient::Classify(eClickApi eApiType, CURLcode curlCode, long iHttpStatus, std::string_view sResponse)
+{
+    if (curlCode != CURLE_OK)
+        return CLICK_RESULT_TRANSPORT;
+
+    if (iHttpStatus == 401 || iHttpStatus == 403)
+        return CLICK_RESULT_AUTH;
+    if (iHttpStatus == 429)
+        return CLICK_RESULT_THROTTLED;
+
+    int iCode = LocalErrorCode(eApiType, sResponse);
+
+    for (int iAuth : iLocalAuthCodes)
+        if (iCode == iAuth)
+            return CLICK_RESULT_AUTH;
+    for (int iThrottle : iLocalThrottleCodes)
+        if (iCode == iThrottle)
+            return CLICK_RESULT_THROTTLED;
+
+    if (iCode >= 0 || iHttpStatus >= 400)
+        return CLICK_RESULT_REJECTED;
+
+    return CLICK_RESULT_OK;
+}
+
+/*
+ * Function:  ResultName
+ * Info:      Returns a printable name for a result classification.
+ */
+const char *ClickShardedClient::ResultName(eClickResult eResult)
+{
+    static const char *chNames[CLICK_RESULT_COUNT] = {"ok", "transport error", "account refused",
+                                                      "throttled", "rejected", "no account available"};
+
+    return (eResult >= CLICK_RESULT_OK && eResult < CLICK_RESULT_COUNT ? chNames[eResult] : "unknown");
+}
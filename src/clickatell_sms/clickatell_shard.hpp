@@ -0,0 +1,195 @@
+#ifndef CLICKATELL_SHARD_H
+#define CLICKATELL_SHARD_H
+
+/*
+ * clickatell_shard.hpp
+ *
+ *  Multi-account sharded client for the Clickatell SMS library.
+ *
+ *  A ClickShardedClient owns a set of Clickatell accounts (HTTP and/or REST API IDs) and
+ *  spreads requests across them by weighted round-robin or least-outstanding-requests.
+ *  Each account has its own rate limit (token bucket) and concurrency limit. When an account
+ *  answers with an authentication/account error or a throttling error it is taken out of
+ *  rotation for a cool-down period and the request is retried on another account.
+ *
+ *  The client is thread-safe: any number of threads may call it concurrently, each request
+ *  borrowing one of the account's ClickatellSms instances for its duration.
+ */
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <curl/curl.h>
+
+#include "clickatell_debug.hpp"
+#include "clickatell_sms.hpp"
+
+// how requests are spread across accounts
+enum eClickBalance {
+    CLICK_BALANCE_WEIGHTED_RR,        // smooth weighted round-robin
+    CLICK_BALANCE_LEAST_OUTSTANDING,  // fewest in-flight requests relative to weight
+    CLICK_BALANCE_COUNT
+};
+
+// classification of a request outcome
+enum eClickResult {
+    CLICK_RESULT_OK,          // request accepted by the gateway
+    CLICK_RESULT_TRANSPORT,   // cURL failure (outcome unknown, not retried on another account)
+    CLICK_RESULT_AUTH,        // account refused: authentication, frozen, out of credit, ...
+    CLICK_RESULT_THROTTLED,   // account is being rate-limited by the gateway
+    CLICK_RESULT_REJECTED,    // request refused for a reason unrelated to the account
+    CLICK_RESULT_UNAVAILABLE, // no account could take the request before the deadline
+    CLICK_RESULT_COUNT
+};
+
+// one account of a sharded client
+struct ClickAccountConfig {
+    eClickApi eApiType;         // API type of the account
+    std::string sApiId;         // API ID
+    std::string sUsername;      // HTTP API username
+    std::string sPassword;      // HTTP API password
+    std::string sApiKey;        // REST API key
+    unsigned int iWeight;       // relative share of the traffic (0 is treated as 1)
+    double dRatePerSec;         // request rate limit (0: unlimited)
+    unsigned int iBurst;        // token bucket depth (0: one second's worth of requests)
+    unsigned int iMaxInFlight;  // concurrent requests (ClickatellSms instances) for the account
+
+    // HTTP account
+    ClickAccountConfig(eClickApi eApiType_, std::string_view sUsername_, std::string_view sPassword_,
+                       std::string_view sApiId_, unsigned int iWeight_ = 1, double dRatePerSec_ = 0)
+                       : eApiType(eApiType_),
+                         sApiId(sApiId_),
+                         sUsername(sUsername_),
+                         sPassword(sPassword_),
+                         iWeight(iWeight_),
+                         dRatePerSec(dRatePerSec_),
+                         iBurst(0),
+                         iMaxInFlight(4) {}
+
+    // REST account
+    ClickAccountConfig(eClickApi eApiType_, std::string_view sApiKey_, std::string_view sApiId_,
+                       unsigned int iWeight_ = 1, double dRatePerSec_ = 0)
+                       : eApiType(eApiType_),
+                         sApiId(sApiId_),
+                         sApiKey(sApiKey_),
+                         iWeight(iWeight_),
+                         dRatePerSec(dRatePerSec_),
+                         iBurst(0),
+                         iMaxInFlight(4) {}
+};
+
+// sharded client options
+struct ClickShardOptions {
+    eClickDebugOption eDebugOpt;      // debug option passed to every ClickatellSms instance
+    eClickBalance eBalance;           // balancing strategy
+    long iTimeout;                    // per-request timeout in seconds
+    long iConnectTimeout;             // per-request connect timeout in seconds
+    unsigned int iAuthCooldownMs;     // time an account stays out of rotation after CLICK_RESULT_AUTH
+    unsigned int iThrottleCooldownMs; // time an account stays out of rotation after CLICK_RESULT_THROTTLED
+
+    ClickShardOptions()
+                      : eDebugOpt(CLICK_DEBUG_OFF),
+                        eBalance(CLICK_BALANCE_WEIGHTED_RR),
+                        iTimeout(5),
+                        iConnectTimeout(5),
+                        iAuthCooldownMs(60000),
+                        iThrottleCooldownMs(1000) {}
+};
+
+// result of a sharded request - the response is copied out, so it stays valid
+struct ClickShardResult {
+    eClickResult eResult;    // outcome classification
+    CURLcode curlCode;       // cURL result of the last attempt
+    long iHttpStatus;        // HTTP status of the last attempt
+    size_t iAccount;         // account that served the last attempt
+    unsigned int iAttempts;  // number of accounts tried
+    std::string sResponse;   // Clickatell response of the last attempt
+
+    ClickShardResult()
+                     : eResult(CLICK_RESULT_UNAVAILABLE),
+                       curlCode(CURLE_OK),
+                       iHttpStatus(0),
+                       iAccount(0),
+                       iAttempts(0) {}
+};
+
+// per-account counters
+struct ClickAccountStats {
+    unsigned int iInFlight;   // requests currently using the account
+    bool bAvailable;          // in rotation (not cooling down)
+    uint64_t iRequests;       // requests sent
+    uint64_t iAuthErrors;     // CLICK_RESULT_AUTH responses
+    uint64_t iThrottled;      // CLICK_RESULT_THROTTLED responses
+    uint64_t iTransportErrors;// CLICK_RESULT_TRANSPORT results
+};
+
+class ClickShardedClient
+{
+private:
+    // runtime state of one account (guarded by mtxState)
+    struct ClickShardAccount {
+        ClickAccountConfig oConfig;
+        std::vector<std::unique_ptr<ClickatellSms>> vIdle; // instances not in use
+        unsigned int iCreated;      // instances created so far (<= iMaxInFlight)
+        unsigned int iInFlight;     // instances in use
+        long long iCurrentWeight;   // smooth weighted round-robin state
+        double dTokens;             // token bucket level
+        ClickTimePoint tRefill;     // last token bucket refill
+        ClickTimePoint tCooldown;   // out of rotation until this time
+        bool bAuthDown;             // the cool-down is for an account refusal (not waited for)
+        ClickAccountStats oStats;
+
+        ClickShardAccount(const ClickAccountConfig &oConfig_);
+    };
+
+    ClickShardOptions oOptions;
+    std::vector<ClickShardAccount> vAccounts;
+
+    std::mutex mtxState;              // guards vAccounts
+    std::condition_variable cvState;  // signalled when an instance is returned
+
+    std::unique_ptr<ClickatellSms> LocalCreate(const ClickAccountConfig &oConfig) const;
+    int LocalEligible(ClickShardAccount &oAccount, ClickTimePoint tNow, ClickTimePoint &tRetry);
+    std::unique_ptr<ClickatellSms> LocalAcquire(size_t iFixed, ClickTimePoint tDeadline,
+                                                std::vector<bool> &vTried, size_t &iAccount);
+    void LocalRelease(size_t iAccount, std::unique_ptr<ClickatellSms> pSms, eClickResult eResult);
+    ClickShardResult LocalExecute(size_t iFixed, eClickOperation eOp, std::string_view sArg,
+                                  std::span<const std::string_view> vMsisdns, ClickTimePoint tDeadline);
+
+public:
+    // pass as iAccount to let the client choose
+    static const size_t iAnyAccount = (size_t)-1;
+
+    ClickShardedClient(const std::vector<ClickAccountConfig> &vConfigs, const ClickShardOptions &oOptions_ = ClickShardOptions());
+    ~ClickShardedClient();
+
+    ClickShardedClient(const ClickShardedClient &) = delete;
+    ClickShardedClient &operator=(const ClickShardedClient &) = delete;
+
+    /* Sharded API functions
+     * Sends and coverage queries go to any account. Message status/charge/stop must go to
+     * the account that sent the message (ClickShardResult::iAccount of the send), and
+     * balance is per account. tDeadline bounds the time spent waiting for an account.
+     */
+    ClickShardResult SmsMessageSend(std::string_view sText, std::span<const std::string_view> vMsisdns,
+                                    ClickTimePoint tDeadline = ClickTimePoint::max());
+    ClickShardResult SmsCoverageGet(std::string_view sMsisdn, ClickTimePoint tDeadline = ClickTimePoint::max());
+    ClickShardResult SmsStatusGet(size_t iAccount, std::string_view sMsgId, ClickTimePoint tDeadline = ClickTimePoint::max());
+    ClickShardResult SmsChargeGet(size_t iAccount, std::string_view sMsgId, ClickTimePoint tDeadline = ClickTimePoint::max());
+    ClickShardResult SmsMessageStop(size_t iAccount, std::string_view sMsgId, ClickTimePoint tDeadline = ClickTimePoint::max());
+    ClickShardResult SmsBalanceGet(size_t iAccount, ClickTimePoint tDeadline = ClickTimePoint::max());
+
+    size_t AccountCount() const { return vAccounts.size(); }
+    ClickAccountStats AccountStats(size_t iAccount);
+
+    static eClickResult Classify(eClickApi eApiType, CURLcode curlCode, long iHttpStatus, std::string_view sResponse);
+    static const char *ResultName(eClickResult eResult);
+};
+
+#endif // CLICKATELL_SHARD_H
@@ -0,0 +1,524 @@
+/*
+ * clickatell_share.cpp
+ *
+ *  Shared connection state for Clickatell SMS instances.
+ *
+ *  Warm-up opens real connections by sending HEAD requests to the gateway in parallel.
+ *  CURLOPT_CONNECT_ONLY is not used for this: libcurl never hands a connect-only connection
+ *  to a later transfer, so it would not pre-warm anything. A HEAD request leaves a resolved
+ *  host, a TLS session and an idle keep-alive connection behind, all of which later requests
+ *  pick up.
+ *
+ *  Host pinning publishes an immutable CURLOPT_RESOLVE list together with a generation
+ *  number. Attached instances compare the generation before each request and only then
+ *  pick up the new list, so the common case costs one atomic load.
+ *
+ *  TLS session files hold the sessions exported by curl_easy_ssls_export(): a magic line
+ *  followed by (length, salted peer hash, length, session data) records. The file is
+ *  written to a temporary file with mode 0600 and renamed into place, and is refused on
+ *  load unless it belongs to the current user and is not accessible to anyone else.
+ *  Session export needs libcurl 8.12 or later built with SSL session export support
+ *  (--enable-ssls-export); without it the functions fail and sessions are only shared
+ *  within the process.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "clickatell_debug.hpp"
+#include "clickatell_api.hpp"
+#include "clickatell_share.hpp"
+
+/* ----------------------------------------------------------------------------- *
+ * Types/Macros                                                                  *
+ * ----------------------------------------------------------------------------- */
+
+// TLS session file header
+#define CLICK_SESSION_MAGIC      "CLICKTLS1\n"
+#define CLICK_SESSION_MAGIC_LEN  10
+#define CLICK_SESSION_MAX_LEN    (64 * 1024) // upper bound for one hash or session record
+
+/* ----------------------------------------------------------------------------- *
+ * Private function definitions                                                  *
+ * ----------------------------------------------------------------------------- */
+
+#if LIBCURL_VERSION_NUM >= 0x080c00
+/*
+ * Function:  LocalAppendRecord
+ * Info:      Appends a length-prefixed record to a session file image.
+ * Return:    void
+ */
+static void LocalAppendRecord(std::string &sImage, const unsigned char *chData, size_t iLen)
+{
+    uint32_t iLen32 = (uint32_t)iLen;
+
+    sImage.append((const char *)&iLen32, sizeof(iLen32));
+    sImage.append((const char *)chData, iLen);
+}
+
+/*
+ * Function:  LocalReadRecord
+ * Info:      Reads a length-prefixed record from a session file image.
+ * Inputs:    sImage - file image
+ *            iPos   - read position, advanced past the record
+ * Outputs:   sRecord - record contents
+ * Return:    false at the end of the image or on a malformed record
+ */
+static bool LocalReadRecord(const std::string &sImage, size_t &iPos, std::string_view &sRecord)
+{
+    uint32_t iLen32 = 0;
+
+    if (sImage.size() - iPos < sizeof(iLen32))
+        return false;
+
+    memcpy(&iLen32, sImage.data() + iPos, sizeof(iLen32));
+    iPos += sizeof(iLen32);
+
+    if (iLen32 > CLICK_SESSION_MAX_LEN || sImage.size() - iPos < iLen32)
+        return false;
+
+    sRecord = std::string_view(sImage.data() + iPos, iLen32);
+    iPos += iLen32;
+
+    return true;
+}
+
+/*
+ * Function:  LocalExportSession
+ * Info:      curl_easy_ssls_export() callback - appends one session to the file image.
+ *            Expired sessions are skipped.
+ * Return:    CURLE_OK
+ */
+static CURLcode LocalExportSession(CURL *curlHandle, void *pImage, const char *chSessionKey,
+                                   const unsigned char *chShmac, size_t iShmacLen,
+                                   const unsigned char *chData, size_t iDataLen,
+                                   curl_off_t iValidUntil, int iTlsId, const char *chAlpn, size_t iEarlyDataMax)
+{
+    std::string &sImage = *static_cast<std::string *>(pImage);
+
+    if (iValidUntil > 0 && iValidUntil <= (curl_off_t)time(NULL))
+        return CURLE_OK;
+
+    LocalAppendRecord(sImage, chShmac, iShmacLen);
+    LocalAppendRecord(sImage, chData, iDataLen);
+
+    return CURLE_OK;
+}
+#endif
+
+/*
+ * Function:  ClickShare::LocalLock, LocalUnlock
+ * Info:      libcurl share lock callbacks - one mutex per shared data type.
+ */
+void ClickShare::LocalLock(CURL *curlHandle, curl_lock_data eData, curl_lock_access eAccess, void *pShare)
+{
+    static_cast<ClickShare *>(pShare)->mtxLock[eData].lock();
+}
+
+void ClickShare::LocalUnlock(CURL *curlHandle, curl_lock_data eData, void *pShare)
+{
+    static_cast<ClickShare *>(pShare)->mtxLock[eData].unlock();
+}
+
+/*
+ * Function:  ClickShare::LocalResolve
+ * Info:      Resolves the gateway host and builds its CURLOPT_RESOLVE entry. A failed
+ *            lookup keeps the previous entry.
+ * Return:    true if the entry changed
+ */
+bool ClickShare::LocalResolve()
+{
+    struct addrinfo oHints = {};
+    struct addrinfo *pResult = NULL;
+    std::vector<std::string> vAddrs;
+    char chAddr[INET6_ADDRSTRLEN];
+
+    oHints.ai_family = AF_UNSPEC;
+    oHints.ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo(sHost.c_str(), sPort.c_str(), &oHints, &pResult) != 0)
+        return false;
+
+    for (struct addrinfo *pAddr = pResult; pAddr != NULL; pAddr = pAddr->ai_next) {
+        std::string sAddr;
+
+        if (pAddr->ai_family == AF_INET &&
+            inet_ntop(AF_INET, &((struct sockaddr_in *)pAddr->ai_addr)->sin_addr, chAddr, sizeof(chAddr)) != NULL)
+            sAddr = chAddr;
+        else if (pAddr->ai_family == AF_INET6 &&
+                 inet_ntop(AF_INET6, &((struct sockaddr_in6 *)pAddr->ai_addr)->sin6_addr, chAddr, sizeof(chAddr)) != NULL)
+            sAddr = std::string("[") + chAddr + "]";
+
+        if (!sAddr.empty() && std::find(vAddrs.begin(), vAddrs.end(), sAddr) == vAddrs.end())
+            vAddrs.push_back(sAddr);
+    }
+
+    freeaddrinfo(pResult);
+
+    if (vAddrs.empty())
+        return false;
+
+    std::string sEntry(sHost + ":" + sPort + ":");
+    for (size_t i = 0; i < vAddrs.size(); i++) {
+        if (i > 0)
+            sEntry.push_back(',');
+        sEntry.append(vAddrs[i]);
+    }
+
+    if (sEntry == sResolved)
+        return false;
+
+    sResolved.swap(sEntry);
+
+    return true;
+}
+
+/*
+ * Function:  ClickShare::LocalPublish
+ * Info:      Builds a new CURLOPT_RESOLVE list from the resolved gateway entry and the
+ *            static entries (which come last, so they win), and publishes it.
+ * Return:    void
+ */
+void ClickShare::LocalPublish()
+{
+    curl_slist *curlList = NULL;
+
+    if (!sResolved.empty()) {
+        // drop the previous pin from the shared DNS cache before adding the new one
+        curlList = curl_slist_append(curlList, ("-" + sHost + ":" + sPort).c_str());
+        curlList = curl_slist_append(curlList, sResolved.c_str());
+    }
+
+    for (const std::string &sEntry : oOptions.vResolve)
+        curlList = curl_slist_append(curlList, sEntry.c_str());
+
+    std::shared_ptr<curl_slist> pList(curlList, curl_slist_free_all);
+
+    {
+        std::lock_guard<std::mutex> oLock(mtxResolve);
+        pResolve.swap(pList);
+    }
+
+    iResolveGen.fetch_add(1, std::memory_order_release);
+}
+
+/*
+ * Function:  ClickShare::LocalResolveThread
+ * Info:      Background thread re-resolving the gateway host every iReResolveSec seconds.
+ * Return:    void
+ */
+void ClickShare::LocalResolveThread()
+{
+    std::unique_lock<std::mutex> oLock(mtxStop);
+
+    while (!cvStop.wait_for(oLock, std::chrono::seconds(oOptions.iReResolveSec), [this] { return bStop; })) {
+        oLock.unlock();
+
+        if (LocalResolve())
+            LocalPublish();
+
+        oLock.lock();
+    }
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Public function definitions                                                   *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickShare
+ * Info:      Constructor. Creates the share handle, pins hosts and warms up connections as
+ *            configured. Throws a std::string if libcurl cannot create the share handle.
+ * Inputs:    oOptions_ - options
+ */
+ClickShare::ClickShare(const ClickShareOptions &oOptions_)
+                       : oOptions(oOptions_),
+                         sUrl(ClickApiBase::sBaseUrl),
+                         iResolveGen(0),
+                         bStop(false)
+{
+    if ((curlShare = curl_share_init()) == NULL)
+        throw (std::string("curl_share_init failed!"));
+
+    curl_share_setopt(curlShare, CURLSHOPT_LOCKFUNC, ClickShare::LocalLock);
+    curl_share_setopt(curlShare, CURLSHOPT_UNLOCKFUNC, ClickShare::LocalUnlock);
+    curl_share_setopt(curlShare, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(curlShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(curlShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    if (oOptions.bShareConnections)
+        curl_share_setopt(curlShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+
+    // gateway host and port, for pinning
+    CURLU *curlUrl = curl_url();
+    char *chHost = NULL;
+    char *chPort = NULL;
+
+    if (curlUrl != NULL && curl_url_set(curlUrl, CURLUPART_URL, sUrl.c_str(), 0) == CURLUE_OK &&
+        curl_url_get(curlUrl, CURLUPART_HOST, &chHost, 0) == CURLUE_OK &&
+        curl_url_get(curlUrl, CURLUPART_PORT, &chPort, CURLU_DEFAULT_PORT) == CURLUE_OK) {
+        sHost = chHost;
+        sPort = chPort;
+    }
+
+    curl_free(chHost);
+    curl_free(chPort);
+    curl_url_cleanup(curlUrl);
+
+    if (oOptions.iReResolveSec > 0 && !sHost.empty()) {
+        LocalResolve();
+        LocalPublish();
+        thrResolve = std::thread(&ClickShare::LocalResolveThread, this);
+    }
+    else if (!oOptions.vResolve.empty())
+        LocalPublish();
+
+    if (!oOptions.sSessionFile.empty())
+        LoadSessions(oOptions.sSessionFile);
+
+    if (oOptions.iWarmConnections > 0)
+        Warmup(oOptions.iWarmConnections);
+}
+
+/*
+ * Function:  ~ClickShare
+ * Info:      Destructor. Every attached ClickatellSms must have been destroyed or detached.
+ */
+ClickShare::~ClickShare()
+{
+    if (thrResolve.joinable()) {
+        {
+            std::lock_guard<std::mutex> oLock(mtxStop);
+            bStop = true;
+        }
+        cvStop.notify_all();
+        thrResolve.join();
+    }
+
+    if (!oOptions.sSessionFile.empty())
+        SaveSessions(oOptions.sSessionFile);
+
+    curl_share_cleanup(curlShare);
+}
+
+/*
+ * Function:  ClickShare::Warmup
+ * Info:      Opens connections to the gateway by sending HEAD requests in parallel. The
+ *            DNS entry and TLS sessions are kept in the share; the connections themselves
+ *            are kept only if bShareConnections is set.
+ * Inputs:    iConnections - connections to open
+ *            iTimeoutMs   - time allowed for each request (0: twice the connect timeout)
+ * Return:    number of connections established
+ */
+unsigned int ClickShare::Warmup(unsigned int iConnections, long iTimeoutMs)
+{
+    std::shared_ptr<curl_slist> pList = ResolveList();
+    std::vector<CURL *> vHandles;
+    unsigned int iEstablished = 0;
+    long iMaxConnects = (long)std::max(iConnections, oOptions.iMaxConnections);
+    CURLM *curlMulti = NULL;
+
+    if (iConnections == 0 || (curlMulti = curl_multi_init()) == NULL)
+        return 0;
+
+    if (iTimeoutMs <= 0)
+        iTimeoutMs = oOptions.iConnectTimeoutMs * 2;
+
+    curl_multi_setopt(curlMulti, CURLMOPT_MAXCONNECTS, iMaxConnects);
+
+    for (unsigned int i = 0; i < iConnections; i++) {
+        CURL *curlHandle = curl_easy_init();
+
+        if (curlHandle == NULL)
+            break;
+
+        curl_easy_setopt(curlHandle, CURLOPT_URL, sUrl.c_str());
+        curl_easy_setopt(curlHandle, CURLOPT_NOBODY, 1L);
+        curl_easy_setopt(curlHandle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+        curl_easy_setopt(curlHandle, CURLOPT_SHARE, curlShare);
+        curl_easy_setopt(curlHandle, CURLOPT_FRESH_CONNECT, 1L);
+        curl_easy_setopt(curlHandle, CURLOPT_MAXCONNECTS, iMaxConnects);
+        curl_easy_setopt(curlHandle, CURLOPT_CONNECTTIMEOUT_MS, oOptions.iConnectTimeoutMs);
+        curl_easy_setopt(curlHandle, CURLOPT_TIMEOUT_MS, iTimeoutMs);
+        if (pList)
+            curl_easy_setopt(curlHandle, CURLOPT_RESOLVE, pList.get());
+
+        vHandles.push_back(curlHandle);
+        curl_multi_add_handle(curlMulti, curlHandle);
+    }
+
+    int iRunning = 0;
+    do {
+        curl_multi_perform(curlMulti, &iRunning);
+        if (iRunning > 0)
+            curl_multi_poll(curlMulti, NULL, 0, 1000, NULL);
+    } while (iRunning > 0);
+
+    CURLMsg *curlMsg = NULL;
+    int iQueued = 0;
+    while ((curlMsg = curl_multi_info_read(curlMulti, &iQueued)) != NULL)
+        if (curlMsg->msg == CURLMSG_DONE && curlMsg->data.result == CURLE_OK)
+            iEstablished++;
+
+    for (CURL *curlHandle : vHandles) {
+        curl_multi_remove_handle(curlMulti, curlHandle);
+        curl_easy_cleanup(curlHandle);
+    }
+
+    curl_multi_cleanup(curlMulti);
+
+    return iEstablished;
+}
+
+/*
+ * Function:  ClickShare::SaveSessions
+ * Info:      Writes the TLS sessions held in the share to a file readable only by the
+ *            current user. The file is replaced atomically.
+ * Inputs:    sPath - session file
+ * Return:    number of sessions saved, or -1 on error (or if libcurl cannot export sessions)
+ */
+int ClickShare::SaveSessions(const std::string &sPath)
+{
+#if LIBCURL_VERSION_NUM >= 0x080c00
+    std::string sImage(CLICK_SESSION_MAGIC);
+    CURL *curlHandle = curl_easy_init();
+
+    if (curlHandle == NULL)
+        return -1;
+
+    curl_easy_setopt(curlHandle, CURLOPT_SHARE, curlShare);
+    CURLcode curlResult = curl_easy_ssls_export(curlHandle, LocalExportSession, &sImage);
+    curl_easy_cleanup(curlHandle);
+
+    // CURLE_NOT_BUILT_IN: libcurl was built without session export
+    if (curlResult != CURLE_OK)
+        return -1;
+
+    std::string sTemp(sPath + ".tmp");
+    int iFd = open(sTemp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+    if (iFd < 0)
+        return -1;
+
+    // a pre-existing temporary file keeps its mode, so enforce it
+    bool bOk = (fchmod(iFd, 0600) == 0);
+
+    for (size_t iDone = 0; bOk && iDone < sImage.size(); ) {
+        ssize_t iWritten = write(iFd, sImage.data() + iDone, sImage.size() - iDone);
+
+        if (iWritten <= 0)
+            bOk = false;
+        else
+            iDone += (size_t)iWritten;
+    }
+
+    bOk = (fsync(iFd) == 0) && bOk;
+    bOk = (close(iFd) == 0) && bOk;
+
+    if (!bOk || rename(sTemp.c_str(), sPath.c_str()) != 0) {
+        unlink(sTemp.c_str());
+        return -1;
+    }
+
+    // two records per session
+    size_t iPos = CLICK_SESSION_MAGIC_LEN;
+    std::string_view sRecord;
+    int iCount = 0;
+
+    while (LocalReadRecord(sImage, iPos, sRecord))
+        iCount++;
+
+    return iCount / 2;
+#else
+    return -1;
+#endif
+}
+
+/*
+ * Function:  ClickShare::LoadSessions
+ * Info:      Imports TLS sessions saved by SaveSessions() into the share. The file is
+ *            refused if it is not owned by the current user or is accessible to others.
+ * Inputs:    sPath - session file
+ * Return:    number of sessions loaded, or -1 on error (or if libcurl cannot import sessions)
+ */
+int ClickShare::LoadSessions(const std::string &sPath)
+{
+#if LIBCURL_VERSION_NUM >= 0x080c00
+    struct stat oStat;
+    int iFd = open(sPath.c_str(), O_RDONLY);
+
+    if (iFd < 0)
+        return -1;
+
+    if (fstat(iFd, &oStat) != 0 || !S_ISREG(oStat.st_mode) ||
+        oStat.st_uid != geteuid() || (oStat.st_mode & (S_IRWXG | S_IRWXO)) != 0) {
+        close(iFd);
+        return -1;
+    }
+
+    std::string sImage((size_t)oStat.st_size, '\0');
+    size_t iDone = 0;
+
+    while (iDone < sImage.size()) {
+        ssize_t iRead = read(iFd, &sImage[iDone], sImage.size() - iDone);
+
+        if (iRead <= 0)
+            break;
+        iDone += (size_t)iRead;
+    }
+
+    close(iFd);
+    sImage.resize(iDone);
+
+    if (sImage.compare(0, CLICK_SESSION_MAGIC_LEN, CLICK_SESSION_MAGIC) != 0)
+        return -1;
+
+    CURL *curlHandle = curl_easy_init();
+
+    if (curlHandle == NULL)
+        return -1;
+
+    curl_easy_setopt(curlHandle, CURLOPT_SHARE, curlShare);
+
+    size_t iPos = CLICK_SESSION_MAGIC_LEN;
+    std::string_view sShmac;
+    std::string_view sData;
+    int iCount = 0;
+
+    while (LocalReadRecord(sImage, iPos, sShmac) && LocalReadRecord(sImage, iPos, sData)) {
+        if (curl_easy_ssls_import(curlHandle, NULL, (const unsigned char *)sShmac.data(), sShmac.size(),
+                                  (const unsigned char *)sData.data(), sData.size()) == CURLE_OK)
+            iCount++;
+    }
+
+    curl_easy_cleanup(curlHandle);
+
+    return iCount;
+#else
+    return -1;
+#endif
+}
+
+/*
+ * Function:  ClickShare::ResolveList
+ * Info:      Returns the current CURLOPT_RESOLVE list. The caller keeps the list alive for
+ *            as long as its cURL handle refers to it.
+ * Return:    list (empty pointer if nothing is pinned)
+ */
+std::shared_ptr<curl_slist> ClickShare::ResolveList()
+{
+    std::lock_guard<std::mutex> oLock(mtxResolve);
+
+    return pResolve;
+}
@@ -0,0 +1,104 @@
+#ifndef CLICKATELL_SHARE_H
+#define CLICKATELL_SHARE_H
+
+/*
+ * clickatell_share.hpp
+ *
+ *  Shared connection state for Clickatell SMS instances.
+ *
+ *  A ClickShare wraps a libcurl share handle holding the DNS cache, TLS sessions and
+ *  (optionally) the connection pool, so that ClickatellSms instances attached to it with
+ *  ClickatellSms::SetShare() reuse each other's work. It can pre-open connections to the
+ *  gateway (Warmup()), pin host names to addresses (CURLOPT_RESOLVE) and keep the pinned
+ *  addresses fresh from a background thread, so that requests never block on DNS.
+ *
+ *  TLS sessions can be saved to and loaded from a file readable only by the owner, so that a
+ *  restarted process resumes its sessions with abbreviated handshakes. This needs libcurl
+ *  8.12 or later built with SSL session export support.
+ */
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <curl/curl.h>
+
+// shared state options
+struct ClickShareOptions {
+    bool bShareConnections;           // share the connection pool (see note below)
+    unsigned int iMaxConnections;     // connections kept open in the pool
+    unsigned int iWarmConnections;    // connections opened by the constructor (0: none)
+    long iConnectTimeoutMs;           // connect timeout used for warm-up
+    std::vector<std::string> vResolve;// static CURLOPT_RESOLVE entries ("host:port:address[,address]")
+    unsigned int iReResolveSec;       // pin the gateway host and re-resolve it this often (0: off)
+    std::string sSessionFile;         // TLS sessions loaded by the constructor, saved by the destructor (empty: off)
+
+    /* libcurl does not support a shared connection pool used by several threads at once.
+     * If the attached instances run on more than one thread, set bShareConnections to false:
+     * DNS and TLS sessions are still shared, and each instance can warm its own connection
+     * with ClickatellSms::Warmup().
+     */
+    ClickShareOptions()
+                      : bShareConnections(true),
+                        iMaxConnections(16),
+                        iWarmConnections(0),
+                        iConnectTimeoutMs(5000),
+                        iReResolveSec(0) {}
+};
+
+class ClickShare
+{
+private:
+    ClickShareOptions oOptions;
+    CURLSH *curlShare;                          // libcurl share handle
+    std::mutex mtxLock[CURL_LOCK_DATA_LAST];    // one lock per shared data type
+
+    std::string sUrl;                           // gateway base URL
+    std::string sHost;                          // gateway host name
+    std::string sPort;                          // gateway port
+
+    // host pinning - a new list is published (with a new generation) whenever it changes
+    std::mutex mtxResolve;                      // guards pResolve
+    std::shared_ptr<curl_slist> pResolve;       // current CURLOPT_RESOLVE list (NULL if none)
+    std::atomic<uint64_t> iResolveGen;          // bumped on every change of pResolve
+    std::string sResolved;                      // last resolved "host:port:addresses" entry
+
+    // background re-resolution
+    std::thread thrResolve;
+    std::mutex mtxStop;
+    std::condition_variable cvStop;
+    bool bStop;
+
+    static void LocalLock(CURL *curlHandle, curl_lock_data eData, curl_lock_access eAccess, void *pShare);
+    static void LocalUnlock(CURL *curlHandle, curl_lock_data eData, void *pShare);
+
+    bool LocalResolve();
+    void LocalPublish();
+    void LocalResolveThread();
+
+public:
+    ClickShare(const ClickShareOptions &oOptions_ = ClickShareOptions());
+    ~ClickShare();
+
+    ClickShare(const ClickShare &) = delete;
+    ClickShare &operator=(const ClickShare &) = delete;
+
+    // opens iConnections connections to the gateway in parallel; returns the number established
+    unsigned int Warmup(unsigned int iConnections, long iTimeoutMs = 0);
+
+    // TLS session persistence; return the number of sessions saved/loaded, or -1 on error
+    int SaveSessions(const std::string &sPath);
+    int LoadSessions(const std::string &sPath);
+
+    // used by ClickatellSms
+    CURLSH *Handle() const { return curlShare; }
+    unsigned int MaxConnections() const { return oOptions.iMaxConnections; }
+    uint64_t ResolveGeneration() const { return iResolveGen.load(std::memory_order_acquire); }
+    std::shared_ptr<curl_slist> ResolveList();
+};
+
+#endif // CLICKATELL_SHARE_H
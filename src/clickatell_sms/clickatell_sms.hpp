@@ -18,88 +18,31 @@
  *
  *  Martin Beyers <martin.beyers@clickatell.com>
  */
-#include <curl/curl.h>
-
-// enumeration designating Clickatell APIs supported in this class library
-enum eClickApi {
-    CLICK_API_HTTP,   // HTTP API using username+password to authenticate
-    CLICK_API_REST,   // REST API using api_key (an auth token) to authenticate
-    CLICK_API_COUNT
-}; // count of supported APIs
-
-// enum designating cURL request types
-enum eClickCurlRequestType{CLICK_CURL_GET,     // REST or HTTP
-                           CLICK_CURL_POST,    // REST or HTTP
-                           CLICK_CURL_DELETE}; // REST API only
-
-// enumeration designating possible login credentials
-enum eClickLoginCred {
-    CLICK_CRED_USER,   // API using username for Clickatell APIs such as HTTP
-    CLICK_CRED_PASS,   // API using password for Clickatell APIs such as HTTP
-    CLICK_CRED_APIKEY, // API token for the Clickatell REST API
-    CLICK_CRED_APIID   // API ID for a Clickatell API
-}; // count of supported APIs
-
-// key/value pair container
-struct ClickKeyVal {
-    std::string sKey; // parameter key string
-    std::string sVal; // parameter value string
-};
+#include <span>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
 
-// username/password container
-struct ClickUserPass {
-    std::string sUsername; // user's Clickatell API username
-    std::string sPassword; // user's Clickatell API password
+#include <curl/curl.h>
 
-    ClickUserPass(){ }
-    ClickUserPass(std::string sUsername_, std::string sPassword_)
-                  : sUsername(sUsername_),
-                    sPassword(sPassword_) { }
-};
+#include "clickatell_client.hpp"
 
-// Clickatell SMS class
+/* Clickatell SMS class
+ * Thin wrapper that picks ClickatellClient<HttpApi> or ClickatellClient<RestApi> at run time,
+ * for callers that only know the API type when the object is created. Code that knows its
+ * API at compile time can use ClickatellClient directly.
+ */
 class ClickatellSms
 {
 private:
-    // ---------------------------------------------------------------------------------------------
-    // private class functions
-
-    void Initialize(long iTimeout, long iConnectTimeout);
-    void LocalCurlConfig(long iTimeout, long iConnectTimeout);
-    void LocalCurlExecute(std::string &sPostData);
-    void LocalApiCommandExecute(const std::string &sPath,
-                                const std::vector<ClickKeyVal> &vKeyVals,
-                                const std::vector<std::string> &vMsisdns);
-
-    // ---------------------------------------------------------------------------------------------
-    // private class members
-
-    // static initialization list parameter validation functions
-    static eClickApi ValidateParamAPI(eClickApi eApiType);
-    static std::string ValidateApiString(eClickLoginCred eCred, std::string &sParam);
-
-    // static URL
-    static std::string sLocalBaseUrl; // shared base URL
-
-    // input configuration
-    eClickApi eUserApiType;  // API type
-    std::string sUserApiId;  // user's Clickatell API ID when user creates a new API in Clickatell central.
-    ClickUserPass oUserCred; // username+password login credentials
-    std::string sUserApiKey; // REST API Key login credential
-    std::string sFullUrl;    // URL request to Clickatell
-
-    ClickDebug oLocalDebug;  // local debug instance
+    typedef std::variant<ClickatellClient<HttpApi>, ClickatellClient<RestApi>> ClickClientVariant;
 
-    eClickCurlRequestType eRequest; // Type of request (i.e. POST, GET, DELETE)
+    // static initialization list parameter validation function
+    static eClickApi ValidateParamAPI(eClickApi eApiType, eClickApi eExpected);
 
-    // output data
-    std::string sClickatellResponse; // Clickatell API response string
-
-    // cURL-request class members
-    struct curl_slist *curlHeaders; // cURL header data
-    long     curlHttpStatus;        // HTTP status code
-    CURL    *curlHandle;            // libcurl handle
-    CURLcode curlCode;              // return code from recent curl request
+    eClickApi eUserApiType;     // API type
+    ClickClientVariant oClient; // client for eUserApiType
 
 public:
     // ---------------------------------------------------------------------------------------------
@@ -109,38 +52,85 @@ public:
      * This constructor creates an HTTP Clickatell SMS object which requires an HTTP username and
      * HTTP password to be set as arguments to the constructor.
      */
-    ClickatellSms(eClickDebugOption eDebugOpt, eClickApi eApiType, std::string sUsername, std::string sPassword, std::string &sApiId,
-                  long iTimeout, long iConnectTimeout)
-                  : eUserApiType((ValidateParamAPI(eApiType))),
-                    sUserApiId((ValidateApiString(CLICK_CRED_APIID, sApiId))),
-                    oUserCred(((ValidateApiString(CLICK_CRED_USER, sUsername))),
-                              ((ValidateApiString(CLICK_CRED_PASS, sPassword)))),
-                    oLocalDebug(eDebugOpt)
-                  {Initialize(iTimeout, iConnectTimeout);}
+    ClickatellSms(eClickDebugOption eDebugOpt, eClickApi eApiType, std::string_view sUsername, std::string_view sPassword,
+                  std::string_view sApiId, long iTimeout, long iConnectTimeout)
+                  : eUserApiType((ValidateParamAPI(eApiType, CLICK_API_HTTP))),
+                    oClient(std::in_place_type<ClickatellClient<HttpApi>>, eDebugOpt,
+                            HttpApi::Credentials(sUsername, sPassword, sApiId), iTimeout, iConnectTimeout) {}
 
     /* ClickatellSms constructor declaration with initialization list
      * This constructor creates a REST Clickatell SMS object which requires a REST API Key (token)
      * to be set as an argument to the constructor.
      */
-    ClickatellSms(eClickDebugOption eDebugOpt, eClickApi eApiType, std::string &sApiKey, std::string &sApiId,
+    ClickatellSms(eClickDebugOption eDebugOpt, eClickApi eApiType, std::string_view sApiKey, std::string_view sApiId,
                   long iTimeout, long iConnectTimeout)
-                  : eUserApiType((ValidateParamAPI(eApiType))),
-                    sUserApiId((ValidateApiString(CLICK_CRED_APIID, sApiId))),
-                    sUserApiKey((ValidateApiString(CLICK_CRED_APIKEY, sApiKey))),
-                    oLocalDebug(eDebugOpt)
-                  {Initialize(iTimeout, iConnectTimeout);}
-
-    ~ClickatellSms();
-
-    // Clickatell API functions
-    std::string SmsMessageSend(const std::string &sText, const std::vector<std::string> &vMsisdns);
-    std::string SmsStatusGet(const std::string &sMsgId);
-    std::string SmsBalanceGet();
-    std::string SmsChargeGet(const std::string &sMsgId);
-    std::string SmsCoverageGet(const std::string &sMsisdn);
-    std::string SmsMessageStop(const std::string &sMsgId);
-
-    void SetResponse(char *chStr); // setter function (can be called from a callback, so it needs to be public)
+                  : eUserApiType((ValidateParamAPI(eApiType, CLICK_API_REST))),
+                    oClient(std::in_place_type<ClickatellClient<RestApi>>, eDebugOpt,
+                            RestApi::Credentials(sApiKey, sApiId), iTimeout, iConnectTimeout) {}
+
+    ClickatellSms(const ClickatellSms &) = delete;
+    ClickatellSms &operator=(const ClickatellSms &) = delete;
+
+    /* Clickatell API functions
+     * The returned response reference stays valid until the next API call on this object.
+     * The string_view/span overload of SmsMessageSend() performs no heap allocations once
+     * the request arena and response buffer have grown to their steady-state size.
+     * oOpts.tDeadline bounds the call (see ClickDeadlineIn()); oOpts.tScheduled is not used.
+     */
+    const std::string &SmsMessageSend(const std::string &sText, const std::vector<std::string> &vMsisdns,
+                                      const ClickCallOptions &oOpts = ClickCallOptions());
+    const std::string &SmsMessageSend(std::string_view sText, std::span<const std::string_view> vMsisdns,
+                                      const ClickCallOptions &oOpts = ClickCallOptions());
+    const std::string &SmsStatusGet(std::string_view sMsgId, const ClickCallOptions &oOpts = ClickCallOptions());
+    const std::string &SmsBalanceGet(const ClickCallOptions &oOpts = ClickCallOptions());
+    const std::string &SmsChargeGet(std::string_view sMsgId, const ClickCallOptions &oOpts = ClickCallOptions());
+    const std::string &SmsCoverageGet(std::string_view sMsisdn, const ClickCallOptions &oOpts = ClickCallOptions());
+    const std::string &SmsMessageStop(std::string_view sMsgId, const ClickCallOptions &oOpts = ClickCallOptions());
+
+    /* Awaitable Clickatell API functions (C++20 coroutines)
+     * The request is built immediately; co_await suspends until the transfer driven by oLoop
+     * completes. One request may be in flight per object at a time.
+     */
+    ClickSmsAwaiter SmsMessageSendAsync(ClickLoop &oLoop, std::string_view sText, std::span<const std::string_view> vMsisdns,
+                                        const ClickCallOptions &oOpts = ClickCallOptions());
+    ClickSmsAwaiter SmsStatusGetAsync(ClickLoop &oLoop, std::string_view sMsgId, const ClickCallOptions &oOpts = ClickCallOptions());
+    ClickSmsAwaiter SmsBalanceGetAsync(ClickLoop &oLoop, const ClickCallOptions &oOpts = ClickCallOptions());
+    ClickSmsAwaiter SmsChargeGetAsync(ClickLoop &oLoop, std::string_view sMsgId, const ClickCallOptions &oOpts = ClickCallOptions());
+    ClickSmsAwaiter SmsCoverageGetAsync(ClickLoop &oLoop, std::string_view sMsisdn, const ClickCallOptions &oOpts = ClickCallOptions());
+    ClickSmsAwaiter SmsMessageStopAsync(ClickLoop &oLoop, std::string_view sMsgId, const ClickCallOptions &oOpts = ClickCallOptions());
+
+    // API type and the API-independent part of the client (results, breaker, share, warm-up)
+    eClickApi GetApiType() const { return eUserApiType; }
+    ClickClientBase &Base();
+    const ClickClientBase &Base() const;
+
+    // result of the most recent request
+    CURLcode GetCurlCode() const { return Base().GetCurlCode(); }
+    long GetHttpStatus() const { return Base().GetHttpStatus(); }
+    bool GetShortCircuited() const { return Base().GetShortCircuited(); }
+    bool GetNotSent() const { return Base().GetNotSent(); }
+    bool GetDeadlineCut() const { return Base().GetDeadlineCut(); }
+
+    // see ClickClientBase
+    void SetTimeouts(long iTimeoutMs_, long iConnectTimeoutMs_) { Base().SetTimeouts(iTimeoutMs_, iConnectTimeoutMs_); }
+    void SetCircuitBreaker(ClickCircuitBreaker *pBreaker_) { Base().SetCircuitBreaker(pBreaker_); }
+    void SetShare(ClickShare *pShare_) { Base().SetShare(pShare_); }
+    void SetCoalescer(ClickCoalescer *pCoalescer_) { Base().SetCoalescer(pCoalescer_); }
+    bool Warmup() { return Base().Warmup(); }
+    void SetCompression(const ClickCompressOptions &oOptions) { Base().SetCompression(oOptions); }
+    void SetBodyStreaming(size_t iMinBytes) { Base().SetBodyStreaming(iMinBytes); }
+    void SetResultStream(ClickRecipientFn fnResult, void *pUserData, size_t iKeepBytes = CLICK_PARSER_KEEP_BYTES)
+    {
+        Base().SetResultStream(fnResult, pUserData, iKeepBytes);
+    }
+    const ClickRequestMetrics &GetMetrics() const { return Base().GetMetrics(); }
+
+    // gateway base URL
+    static std::string_view BaseUrl() { return ClickClientBase::BaseUrl(); }
+
+    // setter functions (can be called from a callback, so they need to be public)
+    void SetResponse(char *chStr) { Base().SetResponse(chStr); }
+    void AppendResponse(const char *chData, size_t iLen) { Base().AppendResponse(chData, iLen); }
 
     friend std::ostream& operator<<(std::ostream& os, const ClickatellSms &oClickSms);
 };
@@ -92,40 +92,49 @@ void clickstr::click_string_url_encode(std::string &sData)
     }
 
     std::string sEncData;                           // url-encoded output string
-    std::string::iterator iterData = sData.begin(); // pointer to original string
-    unsigned int iDecimalVal = 0;
     char chBuf[3];
 
+    sEncData.reserve(sData.length());
+
     // traverse string searching for characters to URL encode
-    while(*iterData != '\0') {
-        if (URL_ENCODE_SAFE_CHAR(*iterData)) {
-            sEncData.push_back(*iterData); // safe characters remain as is
-        }
-        else {
-            /* http://www.w3.org/Addressing/URL/uri-spec.html#z5 states:
-             * "Within the query string, the plus sign is reserved as shorthand notation for a space."
-             * note this also saves space in the SMS message instead of using 3 characters "%20" per space
-             * we instead utilize just one "+"
-             */
-            if (*iterData == ' ') {
-                sEncData.push_back('+'); // use + instead of %20
-            }
-            else {
-                // add URL-encoded 3-character replacement, i.e.  +  becomes  %2B
-                sEncData.push_back('%');
-
-                iDecimalVal = ((*iterData >> 4) & 0xf);
-                sprintf(chBuf, "%x", iDecimalVal); // convert upper nibble to lowercase hex char
-                sEncData.push_back(chBuf[0]);
-
-                iDecimalVal = ((*iterData) & 0xf);
-                sprintf(chBuf, "%x", iDecimalVal); // convert lower nibble to lowercase hex char
-                sEncData.push_back(chBuf[0]);
-            }
-        }
-
-        iterData++;
-    }
+    for (std::string::iterator iterData = sData.begin(); iterData != sData.end() && *iterData != '\0'; iterData++)
+        sEncData.append(chBuf, click_string_url_encode_char(*iterData, chBuf));
 
     sData.swap(sEncData); // clear original string and replace with URL-encoded string
 }
+
+/*
+ * Function:  click_string_url_encode_char
+ * Info:      URL-encodes a single character into a caller-supplied buffer.
+ *            Safe characters are copied as is, a space becomes '+' and all other characters
+ *            become a 3-character lowercase hex escape, i.e.  +  becomes  %2b
+ * Inputs:    ch    - character to URL-encode
+ *            chOut - output buffer with room for at least 3 characters (not NUL-terminated)
+ * Return:    Number of characters written to chOut (1 or 3)
+ */
+unsigned int clickstr::click_string_url_encode_char(char ch, char *chOut)
+{
+    static const char chHex[] = "0123456789abcdef";
+
+    if (URL_ENCODE_SAFE_CHAR(ch)) {
+        chOut[0] = ch; // safe characters remain as is
+        return 1;
+    }
+
+    /* http://www.w3.org/Addressing/URL/uri-spec.html#z5 states:
+     * "Within the query string, the plus sign is reserved as shorthand notation for a space."
+     * note this also saves space in the SMS message instead of using 3 characters "%20" per space
+     * we instead utilize just one "+"
+     */
+    if (ch == ' ') {
+        chOut[0] = '+'; // use + instead of %20
+        return 1;
+    }
+
+    // add URL-encoded 3-character replacement using lowercase hex nibbles
+    chOut[0] = '%';
+    chOut[1] = chHex[(ch >> 4) & 0xf];
+    chOut[2] = chHex[ch & 0xf];
+
+    return 3;
+}
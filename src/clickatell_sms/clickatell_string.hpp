@@ -18,6 +18,7 @@ namespace clickstr
     void click_string_append_formatted_cstr(std::string &sDest, const char *cstrFormat, ...);
     void click_string_trim_prefix(std::string &sData, unsigned int iLen);
     void click_string_url_encode(std::string &sData);
+    unsigned int click_string_url_encode_char(char ch, char *chOut);
 }
 
 #endif // CLICKATELL_STRING_H
@@ -0,0 +1,144 @@
+#ifndef CLICKATELL_TASK_H
+#define CLICKATELL_TASK_H
+
+/*
+ * clickatell_task.hpp
+ *
+ *  Minimal C++20 coroutine task type for the asynchronous Clickatell SMS API.
+ *
+ *  ClickTask<T> is lazy: the coroutine body starts when the task is awaited (or started
+ *  with ClickTaskRun()), and the awaiting coroutine is resumed by symmetric transfer when
+ *  the body finishes. Applications that already have their own coroutine types can
+ *  co_await the ClickatellSms *Async() operations directly and ignore this header.
+ */
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+#include "clickatell_loop.hpp"
+
+template <typename T> class ClickTask;
+
+// promise state shared by ClickTask<T> and ClickTask<void>
+struct ClickTaskPromiseBase {
+    std::coroutine_handle<> hContinuation; // coroutine awaiting this task (may be empty)
+    std::exception_ptr pException;         // exception escaping the coroutine body
+    bool bDone = false;                    // set when the coroutine body has finished
+
+    // resume whoever awaits us when the body finishes
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> hSelf) noexcept
+        {
+            hSelf.promise().bDone = true;
+
+            if (hSelf.promise().hContinuation)
+                return hSelf.promise().hContinuation;
+
+            return std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { pException = std::current_exception(); }
+};
+
+template <typename T>
+struct ClickTaskPromise : ClickTaskPromiseBase {
+    std::optional<T> oValue;
+
+    ClickTask<T> get_return_object();
+    void return_value(T oResult) { oValue.emplace(std::move(oResult)); }
+
+    T Result()
+    {
+        if (pException)
+            std::rethrow_exception(pException);
+        return std::move(*oValue);
+    }
+};
+
+template <>
+struct ClickTaskPromise<void> : ClickTaskPromiseBase {
+    ClickTask<void> get_return_object();
+    void return_void() {}
+
+    void Result()
+    {
+        if (pException)
+            std::rethrow_exception(pException);
+    }
+};
+
+template <typename T = void>
+class ClickTask
+{
+public:
+    typedef ClickTaskPromise<T> promise_type;
+
+private:
+    std::coroutine_handle<promise_type> hCoro;
+
+public:
+    explicit ClickTask(std::coroutine_handle<promise_type> hCoro_) : hCoro(hCoro_) {}
+    ClickTask(ClickTask &&oOther) noexcept : hCoro(std::exchange(oOther.hCoro, {})) {}
+    ClickTask(const ClickTask &) = delete;
+    ClickTask &operator=(const ClickTask &) = delete;
+    ~ClickTask() { if (hCoro) hCoro.destroy(); }
+
+    // start the body without awaiting it (used by ClickTaskRun)
+    void Start() { hCoro.resume(); }
+    bool Done() const { return hCoro.promise().bDone; }
+    T Result() { return hCoro.promise().Result(); }
+
+    // co_await support
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> hAwaiter) noexcept
+    {
+        hCoro.promise().hContinuation = hAwaiter;
+        return hCoro;
+    }
+
+    T await_resume() { return hCoro.promise().Result(); }
+};
+
+template <typename T>
+inline ClickTask<T> ClickTaskPromise<T>::get_return_object()
+{
+    return ClickTask<T>(std::coroutine_handle<ClickTaskPromise<T>>::from_promise(*this));
+}
+
+inline ClickTask<void> ClickTaskPromise<void>::get_return_object()
+{
+    return ClickTask<void>(std::coroutine_handle<ClickTaskPromise<void>>::from_promise(*this));
+}
+
+/*
+ * Function:  ClickTaskRun
+ * Info:      Starts a task and drives the loop on the calling thread until the task has
+ *            finished. This is the library-provided event loop; applications with their own
+ *            loop start the task themselves and drive the ClickLoop from it (RunOnce(), or
+ *            SocketAction()/TimerExpired() in socket mode).
+ * Inputs:    oLoop - loop that the task's transfers are registered with
+ *            oTask - task to run
+ * Return:    the task's result (rethrows an exception escaping the task)
+ */
+template <typename T>
+T ClickTaskRun(ClickLoop &oLoop, ClickTask<T> &oTask)
+{
+    oTask.Start();
+
+    while (!oTask.Done())
+        oLoop.RunOnce(1000);
+
+    return oTask.Result();
+}
+
+#endif // CLICKATELL_TASK_H
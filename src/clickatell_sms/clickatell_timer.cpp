@@ -0,0 +1,285 @@
+/*
+ * clickatell_timer.cpp
+ *
+ *  Hierarchical timer wheel for the Clickatell SMS library.
+ *
+ *  A timer due d ticks ahead sits on the lowest level n with d < CLICK_TIMER_SLOTS^(n+1),
+ *  in the slot selected by bits [n*CLICK_TIMER_BITS, (n+1)*CLICK_TIMER_BITS) of its tick.
+ *  When the current tick reaches the start of a level-n slot, that slot is cascaded: its
+ *  timers are placed again relative to the new current tick, which moves them at least
+ *  one level down. Level-0 slots therefore only hold timers due at exactly one tick.
+ */
+
+#include <algorithm>
+#include <bit>
+
+#include "clickatell_timer.hpp"
+
+/* ----------------------------------------------------------------------------- *
+ * Types/Macros                                                                  *
+ * ----------------------------------------------------------------------------- */
+
+#define CLICK_TIMER_MASK       ((uint64_t)CLICK_TIMER_SLOTS - 1)
+#define CLICK_TIMER_RANGE      (((uint64_t)1 << (CLICK_TIMER_BITS * CLICK_TIMER_LEVELS)) - 1) // farthest tick the wheel can place
+
+/* ----------------------------------------------------------------------------- *
+ * Private function definitions                                                  *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickTimerWheel::LocalLink
+ * Info:      Places a node in its slot, relative to the current tick. Ticks already
+ *            processed go to the current level-0 slot; ticks beyond the wheel's range are
+ *            placed at the far end and placed again when their slot is cascaded.
+ * Inputs:    iNode - node index
+ * Return:    void
+ */
+void ClickTimerWheel::LocalLink(uint32_t iNode)
+{
+    ClickTimerNode &oNode = vNodes[iNode];
+    uint64_t iDelta = (oNode.iTick > iNow ? oNode.iTick - iNow : 0);
+    int iLevel = 0;
+
+    if (iDelta > CLICK_TIMER_RANGE)
+        iDelta = CLICK_TIMER_RANGE;
+
+    while (iLevel < CLICK_TIMER_LEVELS - 1 && iDelta >= ((uint64_t)1 << (CLICK_TIMER_BITS * (iLevel + 1))))
+        iLevel++;
+
+    unsigned int iSlot = (unsigned int)(((iNow + iDelta) >> (CLICK_TIMER_BITS * iLevel)) & CLICK_TIMER_MASK);
+    uint32_t &iHead = iHeads[iLevel][iSlot];
+
+    oNode.iSlot = (uint16_t)(iLevel * CLICK_TIMER_SLOTS + iSlot);
+    oNode.iPrev = iNone;
+    oNode.iNext = iHead;
+
+    if (iHead != iNone)
+        vNodes[iHead].iPrev = iNode;
+
+    iHead = iNode;
+    iOccupied[iLevel] |= (uint64_t)1 << iSlot;
+}
+
+/*
+ * Function:  ClickTimerWheel::LocalUnlink
+ * Info:      Removes a node from its slot list.
+ * Inputs:    iNode - node index
+ * Return:    void
+ */
+void ClickTimerWheel::LocalUnlink(uint32_t iNode)
+{
+    ClickTimerNode &oNode = vNodes[iNode];
+    int iLevel = oNode.iSlot / CLICK_TIMER_SLOTS;
+    int iSlot = oNode.iSlot % CLICK_TIMER_SLOTS;
+
+    if (oNode.iPrev != iNone)
+        vNodes[oNode.iPrev].iNext = oNode.iNext;
+    else
+        iHeads[iLevel][iSlot] = oNode.iNext;
+
+    if (oNode.iNext != iNone)
+        vNodes[oNode.iNext].iPrev = oNode.iPrev;
+
+    if (iHeads[iLevel][iSlot] == iNone)
+        iOccupied[iLevel] &= ~((uint64_t)1 << iSlot);
+}
+
+/*
+ * Function:  ClickTimerWheel::LocalCascade
+ * Info:      Places the timers of the current slot of a level again, relative to the
+ *            current tick (the current tick is the start of that slot).
+ * Inputs:    iLevel - level (1..CLICK_TIMER_LEVELS-1)
+ * Return:    void
+ */
+void ClickTimerWheel::LocalCascade(int iLevel)
+{
+    unsigned int iSlot = (unsigned int)((iNow >> (CLICK_TIMER_BITS * iLevel)) & CLICK_TIMER_MASK);
+    uint32_t iNode = iHeads[iLevel][iSlot];
+
+    iHeads[iLevel][iSlot] = iNone;
+    iOccupied[iLevel] &= ~((uint64_t)1 << iSlot);
+
+    while (iNode != iNone) {
+        uint32_t iNext = vNodes[iNode].iNext;
+
+        LocalLink(iNode);
+        iNode = iNext;
+    }
+}
+
+/*
+ * Function:  ClickTimerWheel::LocalNextWork
+ * Info:      Returns the first tick at or after iFrom at which a slot is visited that holds
+ *            timers: a level-0 slot fires, a level-n slot is cascaded at the start of its
+ *            range. Every tick before iFrom must have been processed.
+ * Inputs:    iFrom - first tick to consider
+ * Return:    tick, or UINT64_MAX if the wheel is empty
+ */
+uint64_t ClickTimerWheel::LocalNextWork(uint64_t iFrom) const
+{
+    uint64_t iNext = UINT64_MAX;
+
+    for (int i = 0; i < CLICK_TIMER_LEVELS; i++) {
+        if (iOccupied[i] == 0)
+            continue;
+
+        // level-i slots are visited every 2^(i*CLICK_TIMER_BITS) ticks; find the first visit of an occupied slot
+        int iShift = CLICK_TIMER_BITS * i;
+        uint64_t iUnit = (iFrom + ((uint64_t)1 << iShift) - 1) >> iShift;
+        uint64_t iAhead = iOccupied[i] & (~(uint64_t)0 << (iUnit & CLICK_TIMER_MASK));
+
+        if (iAhead != 0)
+            iUnit = (iUnit & ~CLICK_TIMER_MASK) + std::countr_zero(iAhead);
+        else
+            iUnit = (iUnit & ~CLICK_TIMER_MASK) + CLICK_TIMER_SLOTS + std::countr_zero(iOccupied[i]);
+
+        iNext = std::min(iNext, iUnit << iShift);
+    }
+
+    return iNext;
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Public function definitions                                                   *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickTimerWheel
+ * Info:      Constructor.
+ * Inputs:    iStartTick - current tick
+ */
+ClickTimerWheel::ClickTimerWheel(uint64_t iStartTick)
+                                 : iFree(iNone),
+                                   iNow(iStartTick),
+                                   iCount(0)
+{
+    for (int i = 0; i < CLICK_TIMER_LEVELS; i++) {
+        iOccupied[i] = 0;
+
+        for (int j = 0; j < CLICK_TIMER_SLOTS; j++)
+            iHeads[i][j] = iNone;
+    }
+}
+
+/*
+ * Function:  ClickTimerWheel::Insert
+ * Info:      Adds a timer.
+ * Inputs:    iTick  - due tick (a tick already processed counts as the next tick)
+ *            iValue - caller's value, returned by Advance()
+ * Return:    handle for Cancel() (never 0)
+ */
+uint64_t ClickTimerWheel::Insert(uint64_t iTick, uint64_t iValue)
+{
+    uint32_t iNode = iFree;
+
+    if (iNode != iNone)
+        iFree = vNodes[iNode].iNext;
+    else {
+        iNode = (uint32_t)vNodes.size();
+        vNodes.push_back(ClickTimerNode{0, 0, iNone, iNone, 0, 0, false});
+    }
+
+    ClickTimerNode &oNode = vNodes[iNode];
+
+    if (++oNode.iGeneration == 0)
+        oNode.iGeneration = 1;
+
+    oNode.iTick = iTick;
+    oNode.iValue = iValue;
+    oNode.bUsed = true;
+
+    LocalLink(iNode);
+    iCount++;
+
+    return ((uint64_t)oNode.iGeneration << 32) | iNode;
+}
+
+/*
+ * Function:  ClickTimerWheel::Cancel
+ * Info:      Removes a pending timer.
+ * Inputs:    iHandle - handle returned by Insert()
+ * Return:    true if the timer was pending, false if it already fired or was cancelled
+ */
+bool ClickTimerWheel::Cancel(uint64_t iHandle)
+{
+    uint32_t iNode = (uint32_t)iHandle;
+
+    if (iNode >= vNodes.size() || !vNodes[iNode].bUsed || vNodes[iNode].iGeneration != (uint32_t)(iHandle >> 32))
+        return false;
+
+    LocalUnlink(iNode);
+
+    vNodes[iNode].bUsed = false;
+    vNodes[iNode].iNext = iFree;
+    iFree = iNode;
+    iCount--;
+
+    return true;
+}
+
+/*
+ * Function:  ClickTimerWheel::Advance
+ * Info:      Fires every timer due at or before iTick. Only ticks at which an occupied slot
+ *            fires or cascades are visited, so long idle spans cost nothing.
+ * Inputs:    iTick  - current tick
+ * Outputs:   vFired - values of the fired timers are appended here (earlier ticks first)
+ * Return:    void
+ */
+void ClickTimerWheel::Advance(uint64_t iTick, std::vector<uint64_t> &vFired)
+{
+    while (iNow <= iTick) {
+        if (iCount == 0) {
+            iNow = iTick + 1;
+            break;
+        }
+
+        // at a level-1 boundary: cascade every level whose boundary this is, highest first
+        if ((iNow & CLICK_TIMER_MASK) == 0) {
+            int iTop = 1;
+
+            while (iTop < CLICK_TIMER_LEVELS - 1 && ((iNow >> (CLICK_TIMER_BITS * iTop)) & CLICK_TIMER_MASK) == 0)
+                iTop++;
+
+            for (int i = iTop; i >= 1; i--)
+                LocalCascade(i);
+        }
+
+        // fire the current level-0 slot
+        unsigned int iSlot = (unsigned int)(iNow & CLICK_TIMER_MASK);
+        uint32_t iNode = iHeads[0][iSlot];
+
+        iHeads[0][iSlot] = iNone;
+        iOccupied[0] &= ~((uint64_t)1 << iSlot);
+
+        while (iNode != iNone) {
+            ClickTimerNode &oNode = vNodes[iNode];
+            uint32_t iNext = oNode.iNext;
+
+            vFired.push_back(oNode.iValue);
+            oNode.bUsed = false;
+            oNode.iNext = iFree;
+            iFree = iNode;
+            iCount--;
+            iNode = iNext;
+        }
+
+        // skip to the next tick with work
+        uint64_t iNext = LocalNextWork(iNow + 1);
+
+        iNow = (iNext <= iTick ? iNext : iTick + 1);
+    }
+}
+
+/*
+ * Function:  ClickTimerWheel::NextTick
+ * Info:      Returns the next tick at which Advance() has work: an occupied slot fires or
+ *            cascades. Never later than the earliest due timer.
+ * Return:    tick, or UINT64_MAX if the wheel is empty
+ */
+uint64_t ClickTimerWheel::NextTick() const
+{
+    if (iCount == 0)
+        return UINT64_MAX;
+
+    return LocalNextWork(iNow);
+}
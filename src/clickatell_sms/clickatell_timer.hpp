@@ -0,0 +1,70 @@
+#ifndef CLICKATELL_TIMER_H
+#define CLICKATELL_TIMER_H
+
+/*
+ * clickatell_timer.hpp
+ *
+ *  Hierarchical timer wheel for the Clickatell SMS library.
+ *
+ *  Holds a large number of timers, each a 64-bit value due at an absolute tick. The wheel
+ *  has CLICK_TIMER_LEVELS levels of CLICK_TIMER_SLOTS slots; level n covers
+ *  CLICK_TIMER_SLOTS^(n+1) ticks ahead, so six levels of 64 slots reach 2^36 ticks (over
+ *  20 years at 10 ms per tick). Timers live in intrusive lists inside one node array, so
+ *  insertion and cancellation are O(1) and allocation-free once the array has grown.
+ *  Advancing only visits the ticks at which an occupied slot fires or is cascaded down.
+ *
+ *  The wheel is not thread-safe; ClickSendEngine guards it with its own lock.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#define CLICK_TIMER_BITS       6                       // log2 of the slots per level
+#define CLICK_TIMER_SLOTS      (1 << CLICK_TIMER_BITS) // slots per level (one bit each in a uint64_t)
+#define CLICK_TIMER_LEVELS     6                       // levels
+
+class ClickTimerWheel
+{
+private:
+    static constexpr uint32_t iNone = UINT32_MAX;
+
+    // one timer (or a free node)
+    struct ClickTimerNode {
+        uint64_t iTick;        // due tick
+        uint64_t iValue;       // caller's value
+        uint32_t iPrev;        // slot list links (iNone at the ends)
+        uint32_t iNext;        // slot list link, or the next free node
+        uint32_t iGeneration;  // bumped on every reuse, so stale handles are rejected
+        uint16_t iSlot;        // level * CLICK_TIMER_SLOTS + slot, while in use
+        bool bUsed;
+    };
+
+    std::vector<ClickTimerNode> vNodes;
+    uint32_t iFree;                                            // head of the free list
+    uint32_t iHeads[CLICK_TIMER_LEVELS][CLICK_TIMER_SLOTS];    // slot list heads
+    uint64_t iOccupied[CLICK_TIMER_LEVELS];                    // non-empty slots, one bit per slot
+    uint64_t iNow;                                             // next tick to process
+    size_t iCount;
+
+    void LocalLink(uint32_t iNode);
+    void LocalUnlink(uint32_t iNode);
+    void LocalCascade(int iLevel);
+    uint64_t LocalNextWork(uint64_t iFrom) const;
+
+public:
+    ClickTimerWheel(uint64_t iStartTick = 0);
+
+    // adds a timer (a tick already processed counts as the next tick); returns its handle (never 0)
+    uint64_t Insert(uint64_t iTick, uint64_t iValue);
+    // removes a pending timer; false if it already fired or was cancelled
+    bool Cancel(uint64_t iHandle);
+    // fires every timer due at or before iTick, appending their values (earlier ticks first)
+    void Advance(uint64_t iTick, std::vector<uint64_t> &vFired);
+
+    // a tick at or before the next due timer, at which Advance() has work (UINT64_MAX if empty)
+    uint64_t NextTick() const;
+    uint64_t Now() const { return iNow; }
+    size_t Size() const { return iCount; }
+};
+
+#endif // CLICKATELL_TIMER_H
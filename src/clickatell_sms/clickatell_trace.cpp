@@ -0,0 +1,326 @@
+/*
+ * clickatell_trace.cpp
+ *
+ *  Sampled message lifecycle tracing for the Clickatell SMS library.
+ *
+ *  Span() formats the attributes at once, so the caller's strings need not outlive the
+ *  call, and appends the span to a buffer; the exporter thread swaps the buffer out and
+ *  writes it as a single OTLP/JSON line, so recording a span never waits for the file.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+#include "clickatell_trace.hpp"
+
+/* ----------------------------------------------------------------------------- *
+ * Types/Macros                                                                  *
+ * ----------------------------------------------------------------------------- */
+
+#define CLICK_TRACE_SCOPE  "clickatell_sms"  // instrumentation scope name
+
+/* ----------------------------------------------------------------------------- *
+ * Free (non-class) functions                                                    *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  LocalRandom
+ * Info:      Per-thread splitmix64 generator, seeded once per thread.
+ * Return:    64 random bits
+ */
+static uint64_t LocalRandom()
+{
+    thread_local uint64_t iState = ((uint64_t)std::random_device()() << 32) ^ std::random_device()() ^
+                                   (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+    uint64_t z = (iState += 0x9E3779B97F4A7C15ULL);
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+
+    return z ^ (z >> 31);
+}
+
+/*
+ * Function:  LocalJsonString
+ * Info:      Appends a JSON string literal.
+ * Inputs:    sValue - string (control characters are escaped)
+ * Outputs:   sOut   - output
+ * Return:    void
+ */
+static void LocalJsonString(std::string &sOut, std::string_view sValue)
+{
+    char chEsc[8];
+
+    sOut.push_back('"');
+
+    for (char ch : sValue) {
+        if (ch == '"' || ch == '\\') {
+            sOut.push_back('\\');
+            sOut.push_back(ch);
+        }
+        else if ((unsigned char)ch < 0x20) {
+            snprintf(chEsc, sizeof(chEsc), "\\u%04x", (unsigned char)ch);
+            sOut.append(chEsc);
+        }
+        else
+            sOut.push_back(ch);
+    }
+
+    sOut.push_back('"');
+}
+
+/*
+ * Function:  LocalHex64
+ * Info:      Appends 16 lowercase hex digits.
+ */
+static void LocalHex64(std::string &sOut, uint64_t iValue)
+{
+    char chHex[17];
+
+    snprintf(chHex, sizeof(chHex), "%016llx", (unsigned long long)iValue);
+    sOut.append(chHex, 16);
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Private function definitions                                                  *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickTracer::LocalWrite
+ * Info:      Writes spans as one ExportTraceServiceRequest line.
+ * Inputs:    vSpans - spans to write (cleared)
+ *            sOut   - scratch buffer
+ * Return:    void
+ */
+void ClickTracer::LocalWrite(std::vector<ClickSpanRecord> &vSpans, std::string &sOut)
+{
+    if (vSpans.empty())
+        return;
+
+    char chTimes[96];
+
+    sOut.assign("{\"resourceSpans\":[{\"resource\":{\"attributes\":[{\"key\":\"service.name\",\"value\":{\"stringValue\":");
+    LocalJsonString(sOut, oOptions.sServiceName);
+    sOut.append("}}]},\"scopeSpans\":[{\"scope\":{\"name\":\"" CLICK_TRACE_SCOPE "\"},\"spans\":[");
+
+    for (size_t i = 0; i < vSpans.size(); i++) {
+        const ClickSpanRecord &oSpan = vSpans[i];
+
+        sOut.append(i == 0 ? "{\"traceId\":\"" : ",{\"traceId\":\"");
+        LocalHex64(sOut, oSpan.oTrace.iHigh);
+        LocalHex64(sOut, oSpan.oTrace.iLow);
+        sOut.append("\",\"spanId\":\"");
+        LocalHex64(sOut, oSpan.iSpanId);
+
+        if (oSpan.iParentId != 0) {
+            sOut.append("\",\"parentSpanId\":\"");
+            LocalHex64(sOut, oSpan.iParentId);
+        }
+
+        sOut.append("\",\"name\":\"");
+        sOut.append(oSpan.sName);
+        snprintf(chTimes, sizeof(chTimes), "\",\"kind\":1,\"startTimeUnixNano\":\"%lld\",\"endTimeUnixNano\":\"%lld\"",
+                 (long long)oSpan.iStartNs, (long long)oSpan.iEndNs);
+        sOut.append(chTimes);
+        sOut.append(",\"attributes\":[");
+        sOut.append(oSpan.sAttrs);
+        sOut.append(oSpan.bError ? "],\"status\":{\"code\":2}}" : "],\"status\":{\"code\":1}}");
+    }
+
+    sOut.append("]}]}]}\n");
+    vSpans.clear();
+
+    if (fwrite(sOut.data(), 1, sOut.length(), pFile) != sOut.length() || fflush(pFile) != 0) {
+        std::lock_guard<std::mutex> oLock(mtxBuffer);
+        iWriteErrors++;
+    }
+}
+
+/*
+ * Function:  ClickTracer::LocalThread
+ * Info:      Exporter thread: writes the buffer every iFlushMs, or sooner once it is half
+ *            full, until the tracer is destroyed.
+ * Return:    void
+ */
+void ClickTracer::LocalThread()
+{
+    std::vector<ClickSpanRecord> vSpans;
+    std::string sOut;
+    bool bLast = false;
+
+    while (!bLast) {
+        {
+            std::unique_lock<std::mutex> oLock(mtxBuffer);
+
+            cvBuffer.wait_for(oLock, std::chrono::milliseconds(oOptions.iFlushMs),
+                              [&]() { return bStop || vBuffer.size() >= oOptions.iMaxBuffered / 2; });
+
+            bLast = bStop;
+            vSpans.swap(vBuffer);
+        }
+
+        LocalWrite(vSpans, sOut);
+    }
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Public function definitions                                                   *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  ClickTraceId::Hex
+ * Info:      Formats the ID as in OTLP and W3C traceparent: 32 lowercase hex digits.
+ */
+std::string ClickTraceId::Hex() const
+{
+    std::string sHex;
+
+    LocalHex64(sHex, iHigh);
+    LocalHex64(sHex, iLow);
+
+    return sHex;
+}
+
+/*
+ * Function:  ClickTracer
+ * Info:      Constructor. Opens the output file and starts the exporter thread.
+ * Inputs:    oOptions_ - tracer options
+ */
+ClickTracer::ClickTracer(const ClickTraceOptions &oOptions_)
+                         : oOptions(oOptions_),
+                           pFile(NULL),
+                           iDropped(0),
+                           iWriteErrors(0),
+                           bStop(false)
+{
+    iClockOffsetNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count() -
+                     std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    if ((pFile = fopen(oOptions.sFile.c_str(), "a")) == NULL)
+        throw (std::string("ClickTracer: cannot open ") + oOptions.sFile);
+
+    oOptions.iMaxBuffered = std::max<size_t>(oOptions.iMaxBuffered, 2);
+    vBuffer.reserve(oOptions.iMaxBuffered);
+    thrExport = std::thread(&ClickTracer::LocalThread, this);
+}
+
+/*
+ * Function:  ~ClickTracer
+ * Info:      Destructor. Writes the spans still buffered and closes the file. Objects
+ *            recording spans (send engines) must be destroyed first.
+ */
+ClickTracer::~ClickTracer()
+{
+    {
+        std::lock_guard<std::mutex> oLock(mtxBuffer);
+        bStop = true;
+    }
+
+    cvBuffer.notify_one();
+    thrExport.join();
+
+    fclose(pFile);
+}
+
+/*
+ * Function:  ClickTracer::Sample
+ * Info:      Decides whether a new message is traced.
+ * Return:    a new trace ID, or zero if the message is not sampled
+ */
+ClickTraceId ClickTracer::Sample()
+{
+    ClickTraceId oTrace;
+
+    if (oOptions.dSampleRate <= 0 || (double)(LocalRandom() >> 11) * 0x1.0p-53 >= oOptions.dSampleRate)
+        return oTrace;
+
+    oTrace.iHigh = LocalRandom();
+    oTrace.iLow = LocalRandom() | 1;
+    oTrace.bSampled = true;
+
+    return oTrace;
+}
+
+/*
+ * Function:  ClickTracer::NewSpanId
+ * Info:      Returns a random, non-zero span ID.
+ */
+uint64_t ClickTracer::NewSpanId()
+{
+    return LocalRandom() | 1;
+}
+
+/*
+ * Function:  ClickTracer::Span
+ * Info:      Records a finished span. If the buffer is full the span is dropped and
+ *            counted (Dropped()).
+ * Inputs:    oTrace    - trace ID
+ *            iSpanId   - span ID (NewSpanId())
+ *            iParentId - parent span ID (0: root span)
+ *            sName     - span name (a string literal: it is not copied)
+ *            tStart    - start time
+ *            tEnd      - end time
+ *            bError    - the step failed
+ *            vAttrs    - attributes (copied)
+ * Return:    void
+ */
+void ClickTracer::Span(const ClickTraceId &oTrace, uint64_t iSpanId, uint64_t iParentId, const char *sName,
+                       ClickTimePoint tStart, ClickTimePoint tEnd, bool bError,
+                       std::initializer_list<ClickTraceAttr> vAttrs)
+{
+    ClickSpanRecord oSpan;
+    char chValue[32];
+
+    oSpan.oTrace = oTrace;
+    oSpan.iSpanId = iSpanId;
+    oSpan.iParentId = iParentId;
+    oSpan.sName = sName;
+    oSpan.iStartNs = iClockOffsetNs + std::chrono::duration_cast<std::chrono::nanoseconds>(tStart.time_since_epoch()).count();
+    oSpan.iEndNs = iClockOffsetNs + std::chrono::duration_cast<std::chrono::nanoseconds>(tEnd.time_since_epoch()).count();
+    oSpan.bError = bError;
+
+    for (const ClickTraceAttr &oAttr : vAttrs) {
+        oSpan.sAttrs.append(oSpan.sAttrs.empty() ? "{\"key\":" : ",{\"key\":");
+        LocalJsonString(oSpan.sAttrs, oAttr.sKey);
+
+        if (oAttr.bString) {
+            oSpan.sAttrs.append(",\"value\":{\"stringValue\":");
+            LocalJsonString(oSpan.sAttrs, oAttr.sValue);
+            oSpan.sAttrs.append("}}");
+        }
+        else {
+            snprintf(chValue, sizeof(chValue), "%lld", (long long)oAttr.iValue);
+            oSpan.sAttrs.append(",\"value\":{\"intValue\":\"");
+            oSpan.sAttrs.append(chValue);
+            oSpan.sAttrs.append("\"}}");
+        }
+    }
+
+    std::lock_guard<std::mutex> oLock(mtxBuffer);
+
+    if (vBuffer.size() >= oOptions.iMaxBuffered) {
+        iDropped++;
+        return;
+    }
+
+    vBuffer.push_back(std::move(oSpan));
+
+    if (vBuffer.size() == oOptions.iMaxBuffered / 2)
+        cvBuffer.notify_one();
+}
+
+uint64_t ClickTracer::Dropped()
+{
+    std::lock_guard<std::mutex> oLock(mtxBuffer);
+    return iDropped;
+}
+
+uint64_t ClickTracer::WriteErrors()
+{
+    std::lock_guard<std::mutex> oLock(mtxBuffer);
+    return iWriteErrors;
+}
@@ -0,0 +1,129 @@
+#ifndef CLICKATELL_TRACE_H
+#define CLICKATELL_TRACE_H
+
+/*
+ * clickatell_trace.hpp
+ *
+ *  Sampled message lifecycle tracing for the Clickatell SMS library.
+ *
+ *  A send engine with a ClickTracer (ClickEngineOptions::pTracer) gives a sampled fraction
+ *  of its messages a trace ID and records one span per lifecycle step under a "message"
+ *  root span: submit, queue, rate_limit_wait, build, attempt (with the cURL timings) and
+ *  callback. A message submitted again with the ClickSendResult::oTrace of an earlier
+ *  attempt (as ClickSendOptions::oTrace), e.g. a retry, joins that trace: its steps go
+ *  under a "retry" span that is a child of the first attempt's "message" span, so the
+ *  trace keeps a single root.
+ *
+ *  Every message gets a correlation ID in ClickSendResult::oTrace, sampled or not: the trace
+ *  ID if it is traced, otherwise an ID made of a random per-engine prefix and the message
+ *  ID. Resubmitting with it keeps the ID across retries.
+ *
+ *  Spans are buffered and written by a background thread as OpenTelemetry OTLP/JSON, one
+ *  ExportTraceServiceRequest per line (the format of the OpenTelemetry Collector's file
+ *  exporter and receiver). A message that is not sampled costs one random number; an engine
+ *  without a tracer costs a pointer check.
+ */
+#include <stdint.h>
+#include <condition_variable>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "clickatell_api.hpp"
+
+// trace (correlation) ID of a message; zero before the engine has assigned one
+struct ClickTraceId {
+    uint64_t iHigh = 0;
+    uint64_t iLow = 0;
+    uint64_t iRootSpan = 0;  // "message" span of the trace's first attempt (0: none yet)
+    bool bSampled = false;   // spans are recorded (otherwise the ID only correlates)
+
+    bool Valid() const { return (iHigh | iLow) != 0; }
+    std::string Hex() const;  // 32 lowercase hex digits
+};
+
+// span attribute: an integer or a string
+struct ClickTraceAttr {
+    const char *sKey;
+    int64_t iValue;
+    std::string_view sValue;
+    bool bString;
+
+    ClickTraceAttr(const char *sKey_, int64_t iValue_) : sKey(sKey_), iValue(iValue_), bString(false) {}
+    ClickTraceAttr(const char *sKey_, std::string_view sValue_) : sKey(sKey_), iValue(0), sValue(sValue_), bString(true) {}
+};
+
+// tracer options
+struct ClickTraceOptions {
+    double dSampleRate;         // fraction of messages traced (0..1)
+    std::string sFile;          // OTLP/JSON lines output, appended to
+    std::string sServiceName;   // service.name resource attribute
+    size_t iMaxBuffered;        // spans buffered for the exporter; further spans are dropped
+    unsigned int iFlushMs;      // longest time a span waits in the buffer
+
+    ClickTraceOptions()
+                      : dSampleRate(0.01),
+                        sServiceName("clickatell_sms"),
+                        iMaxBuffered(65536),
+                        iFlushMs(1000) {}
+};
+
+class ClickTracer
+{
+private:
+    // a finished span, as buffered for the exporter
+    struct ClickSpanRecord {
+        ClickTraceId oTrace;
+        uint64_t iSpanId;
+        uint64_t iParentId;        // 0: root span
+        const char *sName;
+        int64_t iStartNs;          // Unix time
+        int64_t iEndNs;
+        bool bError;
+        std::string sAttrs;        // attributes, already formatted as OTLP/JSON
+    };
+
+    ClickTraceOptions oOptions;
+    int64_t iClockOffsetNs;        // Unix time minus steady clock
+    FILE *pFile;
+
+    std::mutex mtxBuffer;          // guards everything below
+    std::condition_variable cvBuffer;
+    std::vector<ClickSpanRecord> vBuffer;
+    uint64_t iDropped;
+    uint64_t iWriteErrors;
+    bool bStop;
+
+    std::thread thrExport;
+
+    void LocalWrite(std::vector<ClickSpanRecord> &vSpans, std::string &sOut);
+    void LocalThread();
+
+public:
+    // opens the output file; throws a std::string if it cannot be opened
+    ClickTracer(const ClickTraceOptions &oOptions_);
+    // writes the buffered spans and stops the exporter
+    ~ClickTracer();
+
+    ClickTracer(const ClickTracer &) = delete;
+    ClickTracer &operator=(const ClickTracer &) = delete;
+
+    // sampling decision for a new message: a new sampled trace ID, or zero (any thread)
+    ClickTraceId Sample();
+    // new span ID (any thread)
+    static uint64_t NewSpanId();
+
+    // records a finished span (any thread)
+    void Span(const ClickTraceId &oTrace, uint64_t iSpanId, uint64_t iParentId, const char *sName,
+              ClickTimePoint tStart, ClickTimePoint tEnd, bool bError,
+              std::initializer_list<ClickTraceAttr> vAttrs = {});
+
+    // spans dropped because the buffer was full, and failed writes
+    uint64_t Dropped();
+    uint64_t WriteErrors();
+};
+
+#endif // CLICKATELL_TRACE_H
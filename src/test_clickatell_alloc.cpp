@@ -0,0 +1,174 @@
+/*
+ * test_clickatell_alloc.cpp
+ *
+ * Checks that a steady-state send makes no heap allocations on the library's side.
+ * This program replaces the global operator new/delete with counting versions, warms up
+ * a ClickatellSms instance of each API type with a few sends (the request arena and the
+ * response buffer grow to their working size), then asserts that every further
+ * SmsMessageSend(std::string_view, std::span) call allocates nothing. libcurl allocates
+ * with malloc() and is not counted.
+ *
+ * By default the gateway host is pinned to the loopback address, so the sends fail at
+ * connect and the check runs without network access or credentials. Run it with the
+ * argument "live" to send to the real gateway instead (the gateway's responses, success
+ * or error, are then parsed as well):
+ *
+ *      ./test_clickatell_alloc
+ *      ./test_clickatell_alloc live
+ *
+ * Exits with status 0 if no steady-state send allocated, 1 otherwise.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <memory>
+#include <new>
+#include <string_view>
+
+#include "clickatell_sms/clickatell_debug.hpp"
+#include "clickatell_sms/clickatell_sms.hpp"
+#include "clickatell_sms/clickatell_share.hpp"
+
+/* ----------------------------------------------------------------------------- *
+ * Input configuration values                                                    *
+ * ----------------------------------------------------------------------------- */
+
+// credentials used by the "live" run (the default run never reaches the gateway)
+#define CFG_HTTP_USERNAME           "myusernamehere"
+#define CFG_HTTP_PASSWORD           "mypasswordhere"
+#define CFG_HTTP_APIID              "3518209"
+#define CFG_REST_APIKEY             "myrestapikeyhere"
+#define CFG_REST_APIID              "2517153"
+
+#define CFG_SAMPLE_MSISDN1          "2991000000"
+#define CFG_SAMPLE_MSISDN2          "2991000001"
+#define CFG_SAMPLE_MSG_TEXT         "Allocation check message"
+
+#define CFG_ALLOC_WARMUP_CALLS      3    // sends before counting starts
+#define CFG_ALLOC_CHECKED_CALLS     50   // sends that must not allocate
+#define CFG_ALLOC_PINNED_ADDRESS    "api.clickatell.com:443:127.0.0.1" // default run: connection refused at once
+
+#define CFG_APICALL_TIMEOUT         5
+#define CFG_APICALL_CONNECT_TIMEOUT 2
+
+/* ----------------------------------------------------------------------------- *
+ * Counting allocator                                                            *
+ * ----------------------------------------------------------------------------- */
+
+static std::atomic<unsigned long> iAllocCount(0);
+
+void *operator new(size_t iSize)
+{
+    iAllocCount.fetch_add(1, std::memory_order_relaxed);
+
+    if (void *p = malloc(iSize == 0 ? 1 : iSize))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t iSize)
+{
+    return operator new(iSize);
+}
+
+void *operator new(size_t iSize, std::align_val_t iAlign)
+{
+    iAllocCount.fetch_add(1, std::memory_order_relaxed);
+
+    size_t iAlignment = std::max(sizeof(void *), (size_t)iAlign);
+
+    if (void *p = aligned_alloc(iAlignment, (iSize + iAlignment - 1) / iAlignment * iAlignment))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t iSize, std::align_val_t iAlign)
+{
+    return operator new(iSize, iAlign);
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { free(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete[](void *p, size_t, std::align_val_t) noexcept { free(p); }
+
+/* ----------------------------------------------------------------------------- *
+ * Local function definitions                                                    *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  check_sends
+ * Info:      Warms up an instance, then counts the allocations of each further send.
+ * Inputs:    sName     - label for the output
+ *            oClickSms - instance under test
+ * Return:    number of sends that allocated
+ */
+static int check_sends(const char *sName, ClickatellSms &oClickSms)
+{
+    static const std::string_view vMsisdns[] = {CFG_SAMPLE_MSISDN1, CFG_SAMPLE_MSISDN2};
+    unsigned long iTotal = 0;
+    int iFailed = 0;
+
+    for (int i = 0; i < CFG_ALLOC_WARMUP_CALLS; i++)
+        oClickSms.SmsMessageSend(std::string_view(CFG_SAMPLE_MSG_TEXT), vMsisdns);
+
+    for (int i = 0; i < CFG_ALLOC_CHECKED_CALLS; i++) {
+        unsigned long iBefore = iAllocCount.load(std::memory_order_relaxed);
+
+        oClickSms.SmsMessageSend(std::string_view(CFG_SAMPLE_MSG_TEXT), vMsisdns);
+
+        unsigned long iAllocs = iAllocCount.load(std::memory_order_relaxed) - iBefore;
+
+        iTotal += iAllocs;
+        iFailed += (iAllocs > 0 ? 1 : 0);
+    }
+
+    printf("%-5s: %d sends, %lu allocations (curl code %d, HTTP status %ld) -> %s\n", sName, CFG_ALLOC_CHECKED_CALLS, iTotal,
+           (int)oClickSms.GetCurlCode(), oClickSms.GetHttpStatus(), (iFailed == 0 ? "OK" : "FAILED"));
+
+    return iFailed;
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Main                                                                          *
+ * ----------------------------------------------------------------------------- */
+
+int main(int argc, char *argv[])
+{
+    bool bLive = (argc > 1 && strcmp(argv[1], "live") == 0);
+    int iFailed = 0;
+
+    try {
+        ClickShareOptions oShareOpts;
+
+        if (!bLive)
+            oShareOpts.vResolve.push_back(CFG_ALLOC_PINNED_ADDRESS);
+
+        ClickShare oShare(oShareOpts);
+        ClickatellSms oHttpSms(CLICK_DEBUG_OFF, CLICK_API_HTTP, CFG_HTTP_USERNAME, CFG_HTTP_PASSWORD, CFG_HTTP_APIID,
+                               CFG_APICALL_TIMEOUT, CFG_APICALL_CONNECT_TIMEOUT);
+        ClickatellSms oRestSms(CLICK_DEBUG_OFF, CLICK_API_REST, CFG_REST_APIKEY, CFG_REST_APIID,
+                               CFG_APICALL_TIMEOUT, CFG_APICALL_CONNECT_TIMEOUT);
+
+        oHttpSms.SetShare(&oShare);
+        oRestSms.SetShare(&oShare);
+
+        iFailed += check_sends("HTTP", oHttpSms);
+        iFailed += check_sends("REST", oRestSms);
+    }
+    catch (const std::string &sError) {
+        printf("Error: %s\n", sError.c_str());
+        return 1;
+    }
+
+    return (iFailed == 0 ? 0 : 1);
+}
@@ -0,0 +1,197 @@
+/*
+ * test_clickatell_index.cpp
+ *
+ * Checks the message ID index (ClickMessageIndex) against a std::unordered_map.
+ * The first check starts from the smallest table and runs a fixed pseudo-random mix of
+ * inserts and erases, so the stripes grow and fill up to their 3/4 load factor; long probe
+ * runs that wrap around the end of a stripe are then common, and every erase has to shift
+ * the rest of its run back correctly. After each round every live key must be found with
+ * its metadata and every erased key must be gone. The second check covers Expire(): only
+ * entries that became final at least the keep time ago are removed, a late non-final
+ * status does not revive a final entry, and the survivors stay reachable.
+ *
+ *      ./test_clickatell_index
+ *
+ * Exits with status 0 if the index matched the reference, 1 otherwise.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+
+#include "clickatell_sms/clickatell_index.hpp"
+
+/* ----------------------------------------------------------------------------- *
+ * Input configuration values                                                    *
+ * ----------------------------------------------------------------------------- */
+
+#define CFG_INDEX_SEED              0x9e3779b97f4a7c15ULL  // pseudo-random sequence seed
+#define CFG_INDEX_ROUNDS            20                     // verification rounds of the erase check
+#define CFG_INDEX_OPS_PER_ROUND     10000                  // inserts and erases per round
+#define CFG_INDEX_EXPIRE_COUNT      20000                  // entries of the expire check
+#define CFG_INDEX_EPOCH_S           1700000000             // wall time of the expire check (Unix seconds)
+
+/* ----------------------------------------------------------------------------- *
+ * Local function definitions                                                    *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  check_random
+ * Info:      Returns the next value of a xorshift64 sequence.
+ * Inputs:    iState - sequence state
+ * Return:    next value
+ */
+static uint64_t check_random(uint64_t &iState)
+{
+    iState ^= iState << 13;
+    iState ^= iState >> 7;
+    iState ^= iState << 17;
+
+    return iState;
+}
+
+/*
+ * Function:  check_key
+ * Info:      Returns the key of a test message (never zero).
+ * Inputs:    iNumber - message number
+ * Return:    key
+ */
+static ClickMessageKey check_key(uint64_t iNumber)
+{
+    return ClickMessageKey{iNumber * 0x100000001b3ULL + 1, ~iNumber};
+}
+
+/*
+ * Function:  check_erase
+ * Info:      Runs inserts and erases against the reference and compares the whole index
+ *            after every round.
+ * Return:    number of mismatches
+ */
+static int check_erase()
+{
+    ClickMessageIndex oIndex;
+    std::unordered_map<uint64_t, uint64_t> mRef;  // message number -> client ID
+    std::vector<uint64_t> vLive, vErased;
+    uint64_t iState = CFG_INDEX_SEED, iNext = 1;
+    ClickMessageMeta oMeta;
+    int iFailed = 0;
+
+    for (int r = 0; r < CFG_INDEX_ROUNDS; r++) {
+        // grow during the first half, then keep the size steady so erases dominate the churn
+        int iInsertPct = (r < CFG_INDEX_ROUNDS / 2 ? 75 : 50);
+
+        for (int i = 0; i < CFG_INDEX_OPS_PER_ROUND; i++) {
+            if (vLive.empty() || (int)(check_random(iState) % 100) < iInsertPct) {
+                uint64_t iNumber = iNext++;
+                uint64_t iClientId = check_random(iState);
+
+                iFailed += (oIndex.Insert(check_key(iNumber), ClickMessageMeta("27820000000", iClientId)) ? 0 : 1);
+                mRef[iNumber] = iClientId;
+                vLive.push_back(iNumber);
+                continue;
+            }
+
+            size_t iPick = check_random(iState) % vLive.size();
+            uint64_t iNumber = vLive[iPick];
+
+            vLive[iPick] = vLive.back();
+            vLive.pop_back();
+            mRef.erase(iNumber);
+            vErased.push_back(iNumber);
+
+            iFailed += (oIndex.Erase(check_key(iNumber)) ? 0 : 1);
+        }
+
+        iFailed += (oIndex.Size() == mRef.size() ? 0 : 1);
+
+        for (const auto &oRef : mRef)
+            iFailed += (oIndex.Find(check_key(oRef.first), oMeta) && oMeta.iClientId == oRef.second ? 0 : 1);
+
+        for (uint64_t iNumber : vErased)
+            iFailed += (oIndex.Find(check_key(iNumber), oMeta) || oIndex.Erase(check_key(iNumber)) ? 1 : 0);
+
+        vErased.clear();
+    }
+
+    printf("erase  : %zu entries left, %d mismatches -> %s\n", mRef.size(), iFailed, (iFailed == 0 ? "OK" : "FAILED"));
+
+    return iFailed;
+}
+
+/*
+ * Function:  check_expire
+ * Info:      Moves entries to final and non-final states at different times and checks
+ *            which ones two Expire() calls remove.
+ * Return:    number of mismatches
+ */
+static int check_expire()
+{
+    ClickMessageIndex oIndex;
+    ClickWallTime tEpoch{std::chrono::seconds(CFG_INDEX_EPOCH_S)};
+    ClickMessageMeta oMeta;
+    int iFailed = 0;
+
+    // n % 4: 0 delivered at +100 s, 1 failed at +500 s, 2 queued, 3 delivered at +100 s and queued at +200 s
+    for (uint64_t n = 0; n < CFG_INDEX_EXPIRE_COUNT; n++) {
+        ClickMessageKey oKey = check_key(n);
+
+        oIndex.Insert(oKey, ClickMessageMeta("27820000000", n, tEpoch));
+
+        switch (n % 4) {
+        case 0:
+            oIndex.Update(oKey, CLICK_MSG_DELIVERED, tEpoch + std::chrono::seconds(100));
+            break;
+        case 1:
+            oIndex.Update(oKey, CLICK_MSG_FAILED, tEpoch + std::chrono::seconds(500));
+            break;
+        case 2:
+            oIndex.Update(oKey, CLICK_MSG_QUEUED, tEpoch + std::chrono::seconds(100));
+            break;
+        default:
+            oIndex.Update(oKey, CLICK_MSG_DELIVERED, tEpoch + std::chrono::seconds(100));
+            oIndex.Update(oKey, CLICK_MSG_QUEUED, tEpoch + std::chrono::seconds(200));
+            break;
+        }
+    }
+
+    // keep 300 s: at +450 s only the entries final since +100 s are old enough
+    size_t iRemoved = oIndex.Expire(std::chrono::seconds(300), tEpoch + std::chrono::seconds(450));
+    iFailed += (iRemoved == CFG_INDEX_EXPIRE_COUNT / 2 ? 0 : 1);
+
+    for (uint64_t n = 0; n < CFG_INDEX_EXPIRE_COUNT; n++) {
+        bool bFound = oIndex.Find(check_key(n), oMeta);
+
+        if (n % 4 == 0 || n % 4 == 3)
+            iFailed += (bFound ? 1 : 0);
+        else
+            iFailed += (bFound && oMeta.iClientId == n && oMeta.eState == (n % 4 == 1 ? CLICK_MSG_FAILED : CLICK_MSG_QUEUED) ? 0 : 1);
+    }
+
+    // at +800 s the failed entries are old enough as well; queued ones never expire
+    iRemoved = oIndex.Expire(std::chrono::seconds(300), tEpoch + std::chrono::seconds(800));
+    iFailed += (iRemoved == CFG_INDEX_EXPIRE_COUNT / 4 && oIndex.Size() == CFG_INDEX_EXPIRE_COUNT / 4 ? 0 : 1);
+
+    for (uint64_t n = 2; n < CFG_INDEX_EXPIRE_COUNT; n += 4)
+        iFailed += (oIndex.Find(check_key(n), oMeta) && oMeta.iClientId == n ? 0 : 1);
+
+    printf("expire : %d entries, %d mismatches -> %s\n", CFG_INDEX_EXPIRE_COUNT, iFailed, (iFailed == 0 ? "OK" : "FAILED"));
+
+    return iFailed;
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Main                                                                          *
+ * ----------------------------------------------------------------------------- */
+
+int main()
+{
+    int iFailed = 0;
+
+    iFailed += check_erase();
+    iFailed += check_expire();
+
+    return (iFailed == 0 ? 0 : 1);
+}
@@ -0,0 +1,150 @@
+/*
+ * test_clickatell_parser.cpp
+ *
+ * Checks the incremental send response parser (ClickResponseParser) on fixed REST (JSON)
+ * and HTTP API (line) responses. Each response is fed whole, one byte at a time, and split
+ * in two at every offset; every way of feeding it must report the same recipient results,
+ * and those must match the expected ones. The responses cover accepted and rejected
+ * entries, an "error" object, members outside the entries that must be ignored, string
+ * escapes including \uXXXX and surrogate pairs, a last HTTP API line without a line break,
+ * and a string longer than CLICK_PARSER_MAX_TOKEN.
+ *
+ *      ./test_clickatell_parser
+ *
+ * Exits with status 0 if every response was parsed as expected, 1 otherwise.
+ */
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "clickatell_sms/clickatell_parser.hpp"
+
+/* ----------------------------------------------------------------------------- *
+ * Types                                                                         *
+ * ----------------------------------------------------------------------------- */
+
+// a response and the results it must produce, one "index|accepted|to|id|code|error" each
+struct check_case {
+    const char *chName;
+    std::string sResponse;
+    std::vector<std::string> vExpected;
+};
+
+/* ----------------------------------------------------------------------------- *
+ * Local function definitions                                                    *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  check_result
+ * Info:      Parser handler: records a recipient result as one line.
+ * Inputs:    pUserData - vector of recorded lines
+ *            oResult   - recipient result
+ * Return:    void
+ */
+static void check_result(void *pUserData, const ClickRecipientResult &oResult)
+{
+    std::vector<std::string> &vResults = *(std::vector<std::string> *)pUserData;
+    std::string sLine = std::to_string(oResult.iIndex) + (oResult.bAccepted ? "|1|" : "|0|");
+
+    sLine.append(oResult.sTo).append("|").append(oResult.sMessageId).append("|");
+    sLine.append(oResult.sErrorCode).append("|").append(oResult.sError);
+
+    vResults.push_back(sLine);
+}
+
+/*
+ * Function:  check_parse
+ * Info:      Feeds a response in pieces of the given sizes and returns the results.
+ * Inputs:    oParser   - parser (reset first)
+ *            sResponse - response
+ *            iSplit    - length of the first piece (the rest follows at once)
+ *            iStep     - piece length after the first (0: the rest in one piece)
+ * Return:    recorded results
+ */
+static std::vector<std::string> check_parse(ClickResponseParser &oParser, std::string_view sResponse, size_t iSplit,
+                                            size_t iStep)
+{
+    std::vector<std::string> vResults;
+
+    oParser.Reset();
+    oParser.SetHandler(check_result, &vResults);
+    oParser.SetHttpStatus(202);
+
+    oParser.Feed(sResponse.data(), iSplit);
+    for (size_t i = iSplit; i < sResponse.length(); i += (iStep == 0 ? sResponse.length() : iStep))
+        oParser.Feed(sResponse.data() + i, std::min(sResponse.length() - i, (iStep == 0 ? sResponse.length() : iStep)));
+    oParser.Finish();
+
+    return vResults;
+}
+
+/*
+ * Function:  check_response
+ * Info:      Parses one response in every way and compares the results with the expected.
+ * Inputs:    oCase - response and expected results
+ * Return:    number of ways of feeding it that gave a wrong result
+ */
+static int check_response(const check_case &oCase)
+{
+    ClickResponseParser oParser(NULL, NULL);
+    int iFailed = 0;
+
+    std::vector<std::string> vWhole = check_parse(oParser, oCase.sResponse, oCase.sResponse.length(), 0);
+
+    if (vWhole != oCase.vExpected) {
+        for (const std::string &sLine : vWhole)
+            printf("  got: %s\n", sLine.c_str());
+        iFailed++;
+    }
+
+    if (check_parse(oParser, oCase.sResponse, 0, 1) != oCase.vExpected)
+        iFailed++;
+
+    for (size_t i = 1; i < oCase.sResponse.length(); i++) {
+        if (check_parse(oParser, oCase.sResponse, i, 0) != oCase.vExpected)
+            iFailed++;
+    }
+
+    printf("%-7s: %zu results, %d mismatches -> %s\n", oCase.chName, oCase.vExpected.size(), iFailed,
+           (iFailed == 0 ? "OK" : "FAILED"));
+
+    return iFailed;
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Main                                                                          *
+ * ----------------------------------------------------------------------------- */
+
+int main()
+{
+    std::string sLong(CLICK_PARSER_MAX_TOKEN + 40, 'x');
+    std::vector<check_case> vCases = {
+        {"REST",
+         "{\"data\":{\"message\":["
+         "{\"accepted\":true,\"to\":\"27820000001\",\"apiMessageId\":\"a1\"},"
+         "{\"accepted\":false,\"to\":\"27820000002\",\"apiMessageId\":\"\",\"error\":{\"code\":\"105\",\"description\":\"Invalid destination\"}},"
+         "{\"to\":\"27820000003\",\"apiMessageId\":\"a3\",\"extra\":{\"to\":\"ignored\"},\"list\":[\"ignored\"]}"
+         "]},\"error\":null}",
+         {"0|1|27820000001|a1||", "1|0|27820000002||105|Invalid destination", "2|1|27820000003|a3||"}},
+        {"escapes",
+         " {\"data\":{\"message\":[{\"accepted\":false,\"to\":\"27820000004\","
+         "\"error\":{\"code\":\"1\",\"description\":\"Caf\\u00e9 \\ud83d\\ude00 \\\"q\\\"\\/\\ud800x\"}}]}}",
+         {"0|0|27820000004||1|Caf\xc3\xa9 \xf0\x9f\x98\x80 \"q\"/\xef\xbf\xbdx"}},
+        {"HTTP",
+         "ID: h1 To: 27820000005\r\nERR: 114, Cannot route message To: 27820000006\nOK\nID: h3 To: 27820000007",
+         {"0|1|27820000005|h1||", "1|0|27820000006||114|Cannot route message", "2|1|27820000007|h3||"}},
+        {"long",
+         "{\"data\":{\"message\":[{\"accepted\":false,\"to\":\"27820000008\",\"error\":\"" + sLong + "\"}]}}",
+         {"0|0|27820000008|||" + sLong.substr(0, CLICK_PARSER_MAX_TOKEN)}},
+    };
+    int iFailed = 0;
+
+    for (const check_case &oCase : vCases)
+        iFailed += check_response(oCase);
+
+    return (iFailed == 0 ? 0 : 1);
+}
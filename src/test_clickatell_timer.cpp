@@ -0,0 +1,197 @@
+/*
+ * test_clickatell_timer.cpp
+ *
+ * Checks the hierarchical timer wheel (ClickTimerWheel) against a plain ordered map.
+ * Timers are inserted at pseudo-random ticks spread over every level of the wheel, some
+ * are cancelled, and the wheel is advanced in steps of random size; after each step the
+ * fired values must be exactly the reference timers due by then, earlier ticks first, so
+ * every cascade from a higher level down to level 0 is exercised. A second check covers
+ * the handles: a handle stops working once its timer fires or is cancelled, also after
+ * its node has been reused by a new timer.
+ *
+ * The sequence is seeded with a fixed value, so every run checks the same timers:
+ *
+ *      ./test_clickatell_timer
+ *
+ * Exits with status 0 if the wheel matched the reference, 1 otherwise.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "clickatell_sms/clickatell_timer.hpp"
+
+/* ----------------------------------------------------------------------------- *
+ * Input configuration values                                                    *
+ * ----------------------------------------------------------------------------- */
+
+#define CFG_TIMER_SEED              0x2545f4914f6cdd1dULL  // pseudo-random sequence seed
+#define CFG_TIMER_COUNT             20000                  // timers inserted by the cascade check
+#define CFG_TIMER_CANCEL_EVERY      7                      // every n-th timer is cancelled
+#define CFG_TIMER_STEPS             4000                   // Advance() calls of the cascade check
+
+/* ----------------------------------------------------------------------------- *
+ * Local function definitions                                                    *
+ * ----------------------------------------------------------------------------- */
+
+/*
+ * Function:  check_random
+ * Info:      Returns the next value of a xorshift64 sequence.
+ * Inputs:    iState - sequence state
+ * Return:    next value
+ */
+static uint64_t check_random(uint64_t &iState)
+{
+    iState ^= iState << 13;
+    iState ^= iState >> 7;
+    iState ^= iState << 17;
+
+    return iState;
+}
+
+/*
+ * Function:  check_cascade
+ * Info:      Inserts timers across all levels, cancels some, and advances the wheel in
+ *            random steps, comparing every batch of fired values with the reference.
+ * Return:    number of mismatches
+ */
+static int check_cascade()
+{
+    ClickTimerWheel oWheel(1000);
+    std::multimap<uint64_t, uint64_t> mRef;            // tick -> value
+    std::vector<std::pair<uint64_t, uint64_t>> vHandles; // (handle, tick) of each value
+    std::vector<uint64_t> vFired;
+    uint64_t iState = CFG_TIMER_SEED;
+    int iFailed = 0;
+
+    for (uint64_t v = 0; v < CFG_TIMER_COUNT; v++) {
+        // spread the delays over every level: up to 2^(CLICK_TIMER_BITS * CLICK_TIMER_LEVELS - 1) ticks
+        int iBits = (int)(check_random(iState) % (CLICK_TIMER_BITS * CLICK_TIMER_LEVELS - 1)) + 1;
+        uint64_t iTick = oWheel.Now() + check_random(iState) % (1ULL << iBits);
+
+        vHandles.emplace_back(oWheel.Insert(iTick, v), iTick);
+        mRef.emplace(iTick, v);
+    }
+
+    for (uint64_t v = 0; v < CFG_TIMER_COUNT; v += CFG_TIMER_CANCEL_EVERY) {
+        if (!oWheel.Cancel(vHandles[v].first))
+            iFailed++;
+
+        auto pRange = mRef.equal_range(vHandles[v].second);
+        for (auto it = pRange.first; it != pRange.second; ++it) {
+            if (it->second == v) {
+                mRef.erase(it);
+                break;
+            }
+        }
+    }
+
+    if (oWheel.Size() != mRef.size())
+        iFailed++;
+
+    // step sizes grow so that the far levels are reached within CFG_TIMER_STEPS calls
+    for (int i = 0; i < CFG_TIMER_STEPS && !mRef.empty(); i++) {
+        uint64_t iStep = 1 + check_random(iState) % (1ULL << (i * CLICK_TIMER_BITS * CLICK_TIMER_LEVELS / CFG_TIMER_STEPS));
+        uint64_t iTo = oWheel.Now() + iStep;
+
+        if (oWheel.NextTick() > mRef.begin()->first)
+            iFailed++;
+
+        vFired.clear();
+        oWheel.Advance(iTo, vFired);
+
+        // the reference timers due by iTo, in tick order (values of one tick in any order)
+        auto itEnd = mRef.upper_bound(iTo);
+        std::multimap<uint64_t, uint64_t> mDue(mRef.begin(), itEnd);
+        mRef.erase(mRef.begin(), itEnd);
+
+        if (vFired.size() != mDue.size()) {
+            iFailed++;
+            continue;
+        }
+
+        uint64_t iLastTick = 0;
+        for (uint64_t v : vFired) {
+            uint64_t iTick = vHandles[v].second;
+            auto pRange = mDue.equal_range(iTick);
+            auto it = pRange.first;
+
+            while (it != pRange.second && it->second != v)
+                ++it;
+
+            if (iTick < iLastTick || it == pRange.second)
+                iFailed++;
+            else
+                mDue.erase(it);
+
+            iLastTick = iTick;
+        }
+    }
+
+    // drain whatever the steps did not reach
+    vFired.clear();
+    oWheel.Advance(UINT64_MAX / 2, vFired);
+    if (vFired.size() != mRef.size() || oWheel.Size() != 0)
+        iFailed++;
+
+    printf("cascade: %d timers, %d mismatches -> %s\n", CFG_TIMER_COUNT, iFailed, (iFailed == 0 ? "OK" : "FAILED"));
+
+    return iFailed;
+}
+
+/*
+ * Function:  check_handles
+ * Info:      Checks that handles of fired and cancelled timers are rejected, also once
+ *            their node carries a new timer.
+ * Return:    number of mismatches
+ */
+static int check_handles()
+{
+    ClickTimerWheel oWheel;
+    std::vector<uint64_t> vFired;
+    int iFailed = 0;
+
+    uint64_t iFiredHandle = oWheel.Insert(5, 1);
+    oWheel.Advance(5, vFired);
+    iFailed += (vFired.size() == 1 && vFired[0] == 1 ? 0 : 1);
+    iFailed += (oWheel.Cancel(iFiredHandle) ? 1 : 0);
+
+    // the fired timer's node is reused; the old handle must not cancel the new timer
+    uint64_t iReused = oWheel.Insert(10, 2);
+    iFailed += (iReused != 0 && iReused != iFiredHandle ? 0 : 1);
+    iFailed += (oWheel.Cancel(iFiredHandle) ? 1 : 0);
+    iFailed += (oWheel.Size() == 1 ? 0 : 1);
+
+    // a cancelled handle is rejected the second time
+    iFailed += (oWheel.Cancel(iReused) ? 0 : 1);
+    iFailed += (oWheel.Cancel(iReused) ? 1 : 0);
+
+    // a tick already processed counts as the next tick
+    uint64_t iLate = oWheel.Insert(1, 3);
+    vFired.clear();
+    oWheel.Advance(oWheel.Now(), vFired);
+    iFailed += (iLate != 0 && vFired.size() == 1 && vFired[0] == 3 ? 0 : 1);
+    iFailed += (oWheel.Size() == 0 && oWheel.NextTick() == UINT64_MAX ? 0 : 1);
+
+    printf("handles: %d mismatches -> %s\n", iFailed, (iFailed == 0 ? "OK" : "FAILED"));
+
+    return iFailed;
+}
+
+/* ----------------------------------------------------------------------------- *
+ * Main                                                                          *
+ * ----------------------------------------------------------------------------- */
+
+int main()
+{
+    int iFailed = 0;
+
+    iFailed += check_cascade();
+    iFailed += check_handles();
+
+    return (iFailed == 0 ? 0 : 1);
+}